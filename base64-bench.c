@@ -0,0 +1,125 @@
+/*
+ * base64-bench.c -- base64 throughput benchmark
+ *
+ * Copyright (c) 2013-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "base64.h"
+#include "util.h"
+
+/* Run each function for at least this number of seconds. */
+#define DURATION 1.0
+
+static const char * const kernels[] = {
+	"scalar",
+	"ssse3",
+	"avx2"
+};
+
+static unsigned char *data, *dec;
+static char *enc;
+static size_t datasz, encsz;
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+encode(void)
+{
+	if (b64_encode(data, datasz, enc, B64_ENCODE_LENGTH(datasz) + 1) == (size_t)-1)
+		die("abort: b64_encode failed\n");
+}
+
+static void
+decode(void)
+{
+	if (b64_decode(enc, encsz, dec, datasz + 1) != datasz)
+		die("abort: b64_decode failed\n");
+}
+
+/*
+ * Return the throughput in MB/s of the original data.
+ */
+static double
+run(void (*fn)(void))
+{
+	double start, elapsed;
+	size_t count = 0;
+
+	start = now();
+
+	do {
+		fn();
+		++count;
+	} while ((elapsed = now() - start) < DURATION);
+
+	return (double)datasz * count / elapsed / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *errstr;
+
+	/* Size in MB, default to a large image. */
+	datasz = 16;
+
+	if (argc > 1) {
+		datasz = bstrtonum(argv[1], 1, 1024, &errstr);
+
+		if (errstr)
+			die("abort: size is %s\n", errstr);
+	}
+
+	datasz *= 1000000;
+	data = emalloc(datasz, 1);
+	dec = emalloc(datasz + 1, 1);
+	enc = emalloc(B64_ENCODE_LENGTH(datasz) + 1, 1);
+
+	for (size_t i = 0; i < datasz; ++i)
+		data[i] = random();
+
+	encode();
+	encsz = strlen(enc);
+
+	printf("%-8s %12s %12s\n", "kernel", "encode MB/s", "decode MB/s");
+
+	for (size_t i = 0; i < LEN(kernels); ++i) {
+		if (b64_set_kernel(kernels[i]) < 0)
+			continue;
+
+		printf("%-8s %12.1f", kernels[i], run(encode));
+		printf(" %12.1f\n", run(decode));
+
+		if (memcmp(data, dec, datasz) != 0)
+			die("abort: %s: data mismatch\n", kernels[i]);
+	}
+
+	free(data);
+	free(dec);
+	free(enc);
+}
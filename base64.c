@@ -17,16 +17,379 @@
  */
 
 #include <assert.h>
-#include <ctype.h>
 #include <errno.h>
 #include <string.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#       define B64_X86
+#       include <immintrin.h>
+#endif
+
 #include "base64.h"
 
+/* Value returned by rtable for characters outside of the alphabet. */
+#define INVALID 0xff
+
+/* Decoded bytes per sink call in b64_decoder_update, multiple of 3. */
+#define CHUNK 12288
+
+/*
+ * Process as many whole blocks as possible, return the number of source
+ * bytes consumed which is always a multiple of 3 (encode) or 4 (decode).
+ */
+typedef size_t (*encode_fn)(const unsigned char *, size_t, char *, size_t);
+typedef size_t (*decode_fn)(const char *, size_t, unsigned char *, size_t);
+
+static const char table[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Reverse of table, '-' and '_' are base64url support. */
+static const unsigned char rtable[256] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0x3e, 0xff, 0x3e, 0xff, 0x3f,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b,
+	0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+	0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+	0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0x3f,
+	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20,
+	0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+	0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static const char *kernel = "scalar";
+static encode_fn encode_blocks;
+static decode_fn decode_blocks;
+
+#if defined(B64_X86)
+
+/*
+ * The vector kernels are based on the algorithms described by Wojciech Muła
+ * and Daniel Lemire: input bytes are spread into 6-bit indices using
+ * shuffles and multiplications, then translated to ASCII by adding an offset
+ * chosen with a small lookup table.
+ *
+ * Decoding uses range comparisons instead so that both the standard and the
+ * URL alphabets are accepted, any other character (including padding) stops
+ * the kernel and the scalar code takes over.
+ */
+
+__attribute__((target("ssse3")))
+static inline __m128i
+encode_ssse3_block(__m128i in)
+{
+	__m128i t0, t1, t2, t3, idx, res, less;
+
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(
+		10, 11,  9, 10,  7,  8,  6,  7,
+		 4,  5,  3,  4,  1,  2,  0,  1
+	));
+
+	t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	idx = _mm_or_si128(t1, t3);
+
+	/* 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12. */
+	res = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+	res = _mm_or_si128(res, _mm_and_si128(less, _mm_set1_epi8(13)));
+	res = _mm_shuffle_epi8(_mm_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		'/' - 63, 'A',      0,        0
+	), res);
+
+	return _mm_add_epi8(res, idx);
+}
+
+__attribute__((target("ssse3")))
+static size_t
+encode_ssse3(const unsigned char *src, size_t srcsz, char *dst, size_t dstsz)
+{
+	size_t n = 0;
+
+	/* 16 bytes are loaded to encode 12 of them. */
+	for (; srcsz - n >= 16 && dstsz >= 16; n += 12, dst += 16, dstsz -= 16)
+		_mm_storeu_si128((__m128i *)dst, encode_ssse3_block(
+		    _mm_loadu_si128((const __m128i *)(src + n))));
+
+	return n;
+}
+
+__attribute__((target("avx2")))
+static size_t
+encode_avx2(const unsigned char *src, size_t srcsz, char *dst, size_t dstsz)
+{
+	__m256i in, t0, t1, t2, t3, idx, res, less;
+	size_t n = 0;
+
+	/* Two lanes of 12 bytes, the second one being loaded at offset 12. */
+	for (; srcsz - n >= 28 && dstsz >= 32; n += 24, dst += 32, dstsz -= 32) {
+		in = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + n)));
+		in = _mm256_inserti128_si256(in,
+		    _mm_loadu_si128((const __m128i *)(src + n + 12)), 1);
+		in = _mm256_shuffle_epi8(in, _mm256_set_epi8(
+			10, 11,  9, 10,  7,  8,  6,  7,
+			 4,  5,  3,  4,  1,  2,  0,  1,
+			10, 11,  9, 10,  7,  8,  6,  7,
+			 4,  5,  3,  4,  1,  2,  0,  1
+		));
+
+		t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+		t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+		t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		idx = _mm256_or_si256(t1, t3);
+
+		res = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+		less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+		less = _mm256_and_si256(less, _mm256_set1_epi8(13));
+		res = _mm256_or_si256(res, less);
+		res = _mm256_shuffle_epi8(_mm256_setr_epi8(
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '+' - 62,
+			'/' - 63, 'A',      0,        0,
+			'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '+' - 62,
+			'/' - 63, 'A',      0,        0
+		), res);
+
+		_mm256_storeu_si256((__m256i *)dst, _mm256_add_epi8(res, idx));
+	}
+
+	/* Finish with the 128-bit kernel. */
+	return n + encode_ssse3(src + n, srcsz - n, dst, dstsz);
+}
+
+/*
+ * Translate 16 characters into their 6-bit values, return 0 if one of them
+ * is not in the alphabet.
+ */
+__attribute__((target("ssse3")))
+static inline int
+decode_ssse3_values(__m128i in, __m128i *out)
+{
+	__m128i upper, lower, digit, plus, slash, valid, shift, sym;
+
+#define EQ(c)           _mm_cmpeq_epi8(in, _mm_set1_epi8(c))
+#define GT(c)           _mm_cmpgt_epi8(in, _mm_set1_epi8(c))
+#define LT(c)           _mm_cmpgt_epi8(_mm_set1_epi8(c), in)
+#define RANGE(lo, hi)   _mm_and_si128(GT(lo - 1), LT(hi + 1))
+
+	upper = RANGE('A', 'Z');
+	lower = RANGE('a', 'z');
+	digit = RANGE('0', '9');
+	plus = _mm_or_si128(EQ('+'), EQ('-'));
+	slash = _mm_or_si128(EQ('/'), EQ('_'));
+	sym = _mm_or_si128(plus, slash);
+	valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, sym));
+
+#undef EQ
+#undef GT
+#undef LT
+#undef RANGE
+
+	if (_mm_movemask_epi8(valid) != 0xffff)
+		return 0;
+
+	shift = _mm_or_si128(
+		_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+		_mm_or_si128(
+			_mm_and_si128(lower, _mm_set1_epi8(26 - 'a')),
+			_mm_and_si128(digit, _mm_set1_epi8(52 - '0'))
+		)
+	);
+
+	/* Symbols have no shift, replace them entirely. */
+	*out = _mm_or_si128(
+		_mm_andnot_si128(sym, _mm_add_epi8(in, shift)),
+		_mm_or_si128(
+			_mm_and_si128(plus, _mm_set1_epi8(62)),
+			_mm_and_si128(slash, _mm_set1_epi8(63))
+		)
+	);
+
+	return 1;
+}
+
+/*
+ * Same as above with 32 characters.
+ */
+__attribute__((target("avx2")))
+static inline int
+decode_avx2_values(__m256i in, __m256i *out)
+{
+	__m256i upper, lower, digit, plus, slash, valid, shift, sym;
+
+#define EQ(c)           _mm256_cmpeq_epi8(in, _mm256_set1_epi8(c))
+#define GT(c)           _mm256_cmpgt_epi8(in, _mm256_set1_epi8(c))
+#define LT(c)           _mm256_cmpgt_epi8(_mm256_set1_epi8(c), in)
+#define RANGE(lo, hi)   _mm256_and_si256(GT(lo - 1), LT(hi + 1))
+
+	upper = RANGE('A', 'Z');
+	lower = RANGE('a', 'z');
+	digit = RANGE('0', '9');
+	plus = _mm256_or_si256(EQ('+'), EQ('-'));
+	slash = _mm256_or_si256(EQ('/'), EQ('_'));
+	sym = _mm256_or_si256(plus, slash);
+	valid = _mm256_or_si256(_mm256_or_si256(upper, lower),
+	    _mm256_or_si256(digit, sym));
+
+#undef EQ
+#undef GT
+#undef LT
+#undef RANGE
+
+	if ((unsigned int)_mm256_movemask_epi8(valid) != 0xffffffffU)
+		return 0;
+
+	shift = _mm256_or_si256(
+		_mm256_and_si256(upper, _mm256_set1_epi8(-'A')),
+		_mm256_or_si256(
+			_mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a')),
+			_mm256_and_si256(digit, _mm256_set1_epi8(52 - '0'))
+		)
+	);
+
+	*out = _mm256_or_si256(
+		_mm256_andnot_si256(sym, _mm256_add_epi8(in, shift)),
+		_mm256_or_si256(
+			_mm256_and_si256(plus, _mm256_set1_epi8(62)),
+			_mm256_and_si256(slash, _mm256_set1_epi8(63))
+		)
+	);
+
+	return 1;
+}
+
+__attribute__((target("ssse3")))
+static size_t
+decode_ssse3(const char *src, size_t srcsz, unsigned char *dst, size_t dstsz)
+{
+	__m128i values, out;
+	size_t n = 0;
+
+	/* 16 bytes are stored for 12 useful ones. */
+	for (; srcsz - n >= 16 && dstsz > 16; n += 16, dst += 12, dstsz -= 12) {
+		if (!decode_ssse3_values(_mm_loadu_si128((const __m128i *)(src + n)), &values))
+			break;
+
+		/* Merge 4 values into 3 bytes in each 32-bit word. */
+		out = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		out = _mm_madd_epi16(out, _mm_set1_epi32(0x00011000));
+		out = _mm_shuffle_epi8(out, _mm_setr_epi8(
+			 2,  1,  0,  6,  5,  4, 10,  9,
+			 8, 14, 13, 12, -1, -1, -1, -1
+		));
+
+		_mm_storeu_si128((__m128i *)dst, out);
+	}
+
+	return n;
+}
+
+__attribute__((target("avx2")))
+static size_t
+decode_avx2(const char *src, size_t srcsz, unsigned char *dst, size_t dstsz)
+{
+	__m256i values, out;
+	size_t n = 0;
+
+	/* Each lane produces 12 bytes, stored separately. */
+	for (; srcsz - n >= 32 && dstsz > 32; n += 32, dst += 24, dstsz -= 24) {
+		if (!decode_avx2_values(_mm256_loadu_si256((const __m256i *)(src + n)), &values))
+			break;
+
+		out = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+		out = _mm256_madd_epi16(out, _mm256_set1_epi32(0x00011000));
+		out = _mm256_shuffle_epi8(out, _mm256_setr_epi8(
+			 2,  1,  0,  6,  5,  4, 10,  9,
+			 8, 14, 13, 12, -1, -1, -1, -1,
+			 2,  1,  0,  6,  5,  4, 10,  9,
+			 8, 14, 13, 12, -1, -1, -1, -1
+		));
+
+		_mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(out));
+		_mm_storeu_si128((__m128i *)(dst + 12), _mm256_extracti128_si256(out, 1));
+	}
+
+	/* Finish with the 128-bit kernel. */
+	return n + decode_ssse3(src + n, srcsz - n, dst, dstsz);
+}
+
+static int
+setup(const char *name)
+{
+	__builtin_cpu_init();
+
+	if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+		encode_blocks = encode_avx2;
+		decode_blocks = decode_avx2;
+		kernel = "avx2";
+	} else if (strcmp(name, "ssse3") == 0 && __builtin_cpu_supports("ssse3")) {
+		encode_blocks = encode_ssse3;
+		decode_blocks = decode_ssse3;
+		kernel = "ssse3";
+	} else
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Select the best kernel at startup, before any thread is created.
+ */
+__attribute__((constructor))
+static void
+init(void)
+{
+	if (setup("avx2") < 0)
+		setup("ssse3");
+}
+
+#else
+
+static int
+setup(const char *name)
+{
+	(void)name;
+
+	return -1;
+}
+
+#endif
+
 int
 b64_isbase64(unsigned char ch)
 {
-	return isalnum(ch) || ch == '+' || ch == '-' || ch == '_' || ch == '/';
+	return rtable[ch] != INVALID;
 }
 
 int
@@ -40,8 +403,6 @@ b64_lookup(unsigned char value)
 {
 	assert(value < 64);
 
-	static const char *table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
 	return table[value];
 }
 
@@ -50,15 +411,28 @@ b64_rlookup(unsigned char ch)
 {
 	assert(b64_isbase64(ch));
 
-	if (ch >= '0' && ch <= '9')
-		return ch + 4;
-	if (ch >= 'A' && ch <= 'Z')
-		return ch - 65;
-	if (ch >= 'a' && ch <= 'z')
-		return ch - 71;
+	return rtable[ch];
+}
+
+const char *
+b64_kernel(void)
+{
+	return kernel;
+}
+
+int
+b64_set_kernel(const char *name)
+{
+	assert(name);
+
+	if (strcmp(name, "scalar") == 0) {
+		encode_blocks = NULL;
+		decode_blocks = NULL;
+		kernel = "scalar";
+		return 0;
+	}
 
-	/* '-' is base64url support. */
-	return ch == '+' || ch == '-' ? 62U : 63U;
+	return setup(name);
 }
 
 size_t
@@ -67,51 +441,47 @@ b64_encode(const unsigned char *src, size_t srcsz, char *dst, size_t dstsz)
 	assert(src);
 	assert(dst);
 
-	size_t nwritten = 0;
+	size_t n = 0, rest;
+	char *start = dst;
 
 	if (srcsz == (size_t)-1)
 		srcsz = strlen((const char *)src);
 
-	while (srcsz && dstsz) {
-		unsigned char inputbuf[3] = {0};
-		int count = 0;
-
-		while (srcsz && count < 3) {
-			inputbuf[count++] = *src++;
-			--srcsz;
-		}
+	/* Every started group of 3 bytes gives 4 characters, plus '\0'. */
+	if (dstsz <= (srcsz + 2) / 3 * 4) {
+		errno = ERANGE;
+		return -1;
+	}
 
-		if (dstsz < 4) {
-			errno = ERANGE;
-			return -1;
-		}
+	if (encode_blocks) {
+		n = encode_blocks(src, srcsz, dst, dstsz);
+		dst += n / 3 * 4;
+	}
 
-		*dst++ = b64_lookup(inputbuf[0] >> 2 & 0x3f);
-		*dst++ = b64_lookup((inputbuf[0] << 4 & 0x3f) | (inputbuf[1] >> 4 & 0x0f));
+	for (; srcsz - n >= 3; n += 3) {
+		*dst++ = table[src[n] >> 2];
+		*dst++ = table[(src[n] << 4 & 0x30) | src[n + 1] >> 4];
+		*dst++ = table[(src[n + 1] << 2 & 0x3c) | src[n + 2] >> 6];
+		*dst++ = table[src[n + 2] & 0x3f];
+	}
 
-		if (count < 2)
-			*dst++ = '=';
-		else
-			*dst++ = b64_lookup((inputbuf[1] << 2 & 0x3c) | (inputbuf[2] >> 6 & 0x03));
+	if ((rest = srcsz - n)) {
+		*dst++ = table[src[n] >> 2];
 
-		if (count < 3)
+		if (rest == 1) {
+			*dst++ = table[src[n] << 4 & 0x30];
 			*dst++ = '=';
-		else
-			*dst++ = b64_lookup(inputbuf[2] & 0x3f);
-
-		nwritten += 4;
-		dstsz -= 4;
-	}
+		} else {
+			*dst++ = table[(src[n] << 4 & 0x30) | src[n + 1] >> 4];
+			*dst++ = table[src[n + 1] << 2 & 0x3c];
+		}
 
-	/* Not enough room to store '\0'. */
-	if (dstsz == 0) {
-		errno = ERANGE;
-		return -1;
+		*dst++ = '=';
 	}
 
 	*dst = '\0';
 
-	return nwritten;
+	return dst - start;
 }
 
 size_t
@@ -120,17 +490,27 @@ b64_decode(const char *src, size_t srcsz, unsigned char *dst, size_t dstsz)
 	assert(src);
 	assert(dst);
 
-	size_t nwritten = 0;
+	size_t n, nwritten = 0;
+	const unsigned char *s;
 
 	if (srcsz == (size_t)-1)
 		srcsz = strlen(src);
 
+	if (decode_blocks) {
+		n = decode_blocks(src, srcsz, dst, dstsz);
+		nwritten = n / 4 * 3;
+		src += n;
+		srcsz -= n;
+		dst += nwritten;
+		dstsz -= nwritten;
+	}
+
 	while (srcsz && dstsz) {
 		int i = 0, r = 3;
 		unsigned int inputbuf[4] = {0};
 
-		for (; srcsz && i < 4; i++) {
-			if (*src == '=') {
+		for (s = (const unsigned char *)src; srcsz && i < 4; i++) {
+			if (*s == '=') {
 				/*
 				 * '=' is only allowed in last 2 characters,
 				 * otherwise it means we need less data.
@@ -140,16 +520,15 @@ b64_decode(const char *src, size_t srcsz, unsigned char *dst, size_t dstsz)
 
 				/* Less data required. */
 				--r;
-			} else if (!b64_isvalid(*src))
+			} else if ((inputbuf[i] = rtable[*s]) == INVALID)
 				goto eilseq;
 
-			if (b64_isbase64(*src))
-				inputbuf[i] = b64_rlookup(*src);
-
-			++src;
+			++s;
 			--srcsz;
 		}
 
+		src = (const char *)s;
+
 		/* Make sure we haven't seen AB=Z as well. */
 		if (i != 4 || (src[-2] == '=' && src[-1] != '='))
 			goto eilseq;
@@ -181,3 +560,91 @@ erange:
 	errno = ERANGE;
 	return -1;
 }
+
+void
+b64_decoder_init(struct b64_decoder *dec, b64_sink sink, void *data)
+{
+	assert(dec);
+	assert(sink);
+
+	memset(dec, 0, sizeof (*dec));
+	dec->sink = sink;
+	dec->data = data;
+}
+
+/*
+ * Decode whole groups of 4 characters by chunks, one more byte is needed
+ * because b64_decode is strict on the destination length.
+ */
+static int
+decode_groups(struct b64_decoder *dec, const char *src, size_t srcsz)
+{
+	unsigned char buf[CHUNK + 1];
+	size_t len, nw;
+
+	while (srcsz) {
+		len = srcsz < CHUNK / 3 * 4 ? srcsz : CHUNK / 3 * 4;
+
+		if ((nw = b64_decode(src, len, buf, sizeof (buf))) == (size_t)-1)
+			return -1;
+		if (dec->sink(dec->data, buf, nw) < 0)
+			return -1;
+
+		src += len;
+		srcsz -= len;
+	}
+
+	return 0;
+}
+
+int
+b64_decoder_update(struct b64_decoder *dec, const char *src, size_t srcsz)
+{
+	assert(dec);
+	assert(src);
+
+	size_t len;
+
+	/* Complete the group started in a previous call. */
+	if (dec->pendingsz) {
+		len = 4 - dec->pendingsz;
+
+		if (len > srcsz)
+			len = srcsz;
+
+		memcpy(dec->pending + dec->pendingsz, src, len);
+		dec->pendingsz += len;
+		src += len;
+		srcsz -= len;
+
+		if (dec->pendingsz < 4)
+			return 0;
+		if (decode_groups(dec, dec->pending, 4) < 0)
+			return -1;
+
+		dec->pendingsz = 0;
+	}
+
+	len = srcsz / 4 * 4;
+
+	if (decode_groups(dec, src, len) < 0)
+		return -1;
+
+	memcpy(dec->pending, src + len, srcsz - len);
+	dec->pendingsz = srcsz - len;
+
+	return 0;
+}
+
+int
+b64_decoder_final(struct b64_decoder *dec)
+{
+	assert(dec);
+
+	if (dec->pendingsz) {
+		errno = EILSEQ;
+		return -1;
+	}
+
+	return 0;
+}
@@ -28,6 +28,22 @@ extern "C" {
 #define B64_ENCODE_LENGTH(x) (4 * ((x) / 3 + 1))
 #define B64_DECODE_LENGTH(x) (3 * ((x) / 4))
 
+/*
+ * Function receiving decoded data, returns -1 to stop decoding.
+ */
+typedef int (*b64_sink)(void *, const unsigned char *, size_t);
+
+/*
+ * Incremental decoder, the input can be split anywhere and is decoded into
+ * the sink by chunks as soon as possible.
+ */
+struct b64_decoder {
+	b64_sink sink;
+	void *data;
+	char pending[4];
+	size_t pendingsz;
+};
+
 int
 b64_isbase64(unsigned char);
 
@@ -40,12 +56,42 @@ b64_lookup(unsigned char);
 unsigned char
 b64_rlookup(unsigned char);
 
+/*
+ * Name of the kernel in use: scalar, ssse3 or avx2. The best one supported
+ * by the CPU is selected at startup.
+ */
+const char *
+b64_kernel(void);
+
+/*
+ * Force a kernel by name, returns -1 if not supported by the CPU.
+ */
+int
+b64_set_kernel(const char *);
+
 size_t
 b64_encode(const unsigned char *, size_t, char *, size_t);
 
 size_t
 b64_decode(const char *, size_t, unsigned char *, size_t);
 
+void
+b64_decoder_init(struct b64_decoder *, b64_sink, void *);
+
+/*
+ * Returns 0 on success or -1 on error with errno set to EILSEQ on invalid
+ * input or left as is by the sink.
+ */
+int
+b64_decoder_update(struct b64_decoder *, const char *, size_t);
+
+/*
+ * Returns 0 on success or -1 with errno set to EILSEQ if the input was
+ * truncated.
+ */
+int
+b64_decoder_final(struct b64_decoder *);
+
 #if defined(__cplusplus)
 }
 #endif
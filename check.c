@@ -17,18 +17,247 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(WITH_MAGIC)
+#include <pthread.h>
+
 #include <magic.h>
+#endif
 
 #include "check.h"
+#include "log.h"
 #include "paste.h"
 #include "tmp.h"
 #include "util.h"
 
+#define TAG "check: "
+
 #if defined(WITH_MAGIC)
-static magic_t cookie;
+/* Cookies can't be shared between threads, each one opens its own. */
+static pthread_key_t cookie_key;
+static int cookie_ready;
+#endif
+
+static inline uint32_t
+be32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline unsigned int
+be16(const unsigned char *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static inline unsigned int
+le16(const unsigned char *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+/*
+ * The sniffers below only reject what contradicts the format, a header cut
+ * by the end of the buffer is accepted as long as the present part is valid
+ * because the first bytes of a stream may be all that is available.
+ */
+
+static int
+png(const unsigned char *p, size_t len)
+{
+	static const unsigned char sig[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	unsigned int depth, color;
+
+	if (len < sizeof (sig) || memcmp(p, sig, sizeof (sig)) != 0)
+		return 0;
+
+	/* IHDR must be the first chunk, 13 bytes long. */
+	if (len >= 16 && (be32(p + 8) != 13 || memcmp(p + 12, "IHDR", 4) != 0))
+		return -1;
+	if (len < 29)
+		return 1;
+
+	if (be32(p + 16) == 0 || be32(p + 16) > INT32_MAX ||
+	    be32(p + 20) == 0 || be32(p + 20) > INT32_MAX)
+		return -1;
+
+	depth = p[24];
+	color = p[25];
+
+	switch (color) {
+	case 0:
+		if (depth != 1 && depth != 2 && depth != 4 && depth != 8 && depth != 16)
+			return -1;
+		break;
+	case 3:
+		if (depth != 1 && depth != 2 && depth != 4 && depth != 8)
+			return -1;
+		break;
+	case 2:
+	case 4:
+	case 6:
+		if (depth != 8 && depth != 16)
+			return -1;
+		break;
+	default:
+		return -1;
+	}
+
+	/* Compression, filter and interlace methods. */
+	if (p[26] != 0 || p[27] != 0 || p[28] > 1)
+		return -1;
+
+	return 1;
+}
+
+static int
+jpeg(const unsigned char *p, size_t len)
+{
+	size_t i = 2, seglen;
+	unsigned int marker, ncomp;
+
+	if (len < 3 || p[0] != 0xff || p[1] != 0xd8 || p[2] != 0xff)
+		return 0;
+
+	/* Walk the segments up to the frame header. */
+	for (;;) {
+		if (i >= len)
+			return 1;
+		if (p[i] != 0xff)
+			return -1;
+
+		/* Any number of fill bytes may precede a marker. */
+		while (i < len && p[i] == 0xff)
+			++i;
+		if (i >= len)
+			return 1;
+
+		marker = p[i++];
+
+		/* Standalone markers have no length. */
+		if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7))
+			continue;
+		if (marker == 0x00 || marker == 0xd8 || marker == 0xd9 || marker == 0xda)
+			return -1;
+		if (i + 2 > len)
+			return 1;
+		if ((seglen = be16(p + i)) < 2)
+			return -1;
+
+		/* SOF0 to SOF15 except DHT, JPG and DAC. */
+		if (marker >= 0xc0 && marker <= 0xcf &&
+		    marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+			break;
+
+		i += seglen;
+	}
+
+	if (seglen < 8)
+		return -1;
+	if (i + 8 > len)
+		return 1;
+	if ((p[i + 2] != 8 && p[i + 2] != 12 && p[i + 2] != 16) || be16(p + i + 5) == 0)
+		return -1;
+
+	ncomp = p[i + 7];
+
+	if (ncomp == 0 || ncomp > 4 || seglen != 8 + 3 * ncomp)
+		return -1;
+
+	return 1;
+}
+
+static int
+gif(const unsigned char *p, size_t len)
+{
+	if (len < 6 || (memcmp(p, "GIF87a", 6) != 0 && memcmp(p, "GIF89a", 6) != 0))
+		return 0;
+	if (len >= 10 && (le16(p + 6) == 0 || le16(p + 8) == 0))
+		return -1;
+
+	return 1;
+}
+
+static int
+webp(const unsigned char *p, size_t len)
+{
+	if (len < 12 || memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WEBP", 4) != 0)
+		return 0;
+	if (len >= 16 && memcmp(p + 12, "VP8 ", 4) != 0 &&
+	    memcmp(p + 12, "VP8L", 4) != 0 && memcmp(p + 12, "VP8X", 4) != 0)
+		return -1;
+
+	return 1;
+}
+
+#if defined(WITH_MAGIC)
+
+static void
+cookie_close(void *cookie)
+{
+	magic_close(cookie);
+}
+
+static magic_t
+cookie_get(void)
+{
+	magic_t cookie;
+
+	if (!cookie_ready)
+		return NULL;
+	if ((cookie = pthread_getspecific(cookie_key)))
+		return cookie;
+
+	if (!(cookie = magic_open(MAGIC_SYMLINK | MAGIC_MIME_TYPE)))
+		return NULL;
+	if (magic_load(cookie, NULL) < 0) {
+		log_warn(TAG "magic_load: %s", magic_error(cookie));
+		magic_close(cookie);
+		return NULL;
+	}
+
+	pthread_setspecific(cookie_key, cookie);
+
+	return cookie;
+}
+
+/*
+ * Last resort for headers the sniffers do not know, the mime type must still
+ * be one of the supported formats.
+ */
+static enum check_image_format
+fallback(const void *data, size_t datasz)
+{
+	static const struct {
+		const char *mime;
+		enum check_image_format format;
+	} mimes[] = {
+		{ "image/gif",  CHECK_IMAGE_GIF  },
+		{ "image/jpeg", CHECK_IMAGE_JPEG },
+		{ "image/png",  CHECK_IMAGE_PNG  },
+		{ "image/webp", CHECK_IMAGE_WEBP }
+	};
+	magic_t cookie;
+	const char *rv;
+
+	if (!(cookie = cookie_get()))
+		return CHECK_IMAGE_NONE;
+	if (!(rv = magic_buffer(cookie, data, datasz))) {
+		log_warn(TAG "magic_buffer: %s", magic_error(cookie));
+		return CHECK_IMAGE_NONE;
+	}
+
+	for (size_t i = 0; i < LEN(mimes); ++i)
+		if (strcmp(rv, mimes[i].mime) == 0)
+			return mimes[i].format;
+
+	return CHECK_IMAGE_NONE;
+}
+
 #endif
 
 static int
@@ -40,16 +269,18 @@ cmp_str(const void *key, const void *val)
 int
 check_init(void)
 {
-	int rv = 0;
-
 #if defined(WITH_MAGIC)
-	if (!(cookie = magic_open(MAGIC_SYMLINK | MAGIC_MIME_TYPE)))
-		return -1;
-	if (magic_load(cookie, NULL) < 0)
+	int rv;
+
+	if ((rv = pthread_key_create(&cookie_key, cookie_close)) != 0) {
+		errno = rv;
 		return -1;
+	}
+
+	cookie_ready = 1;
 #endif
 
-	return rv;
+	return 0;
 }
 
 int
@@ -90,46 +321,58 @@ check_duration(time_t start, time_t end, char *error, size_t errorsz)
 	return 0;
 }
 
-int
-check_image(const void *data, size_t datasz)
+enum check_image_format
+check_image_format(const void *data, size_t datasz)
 {
-#if defined(WITH_MAGIC)
-	assert(data);
+	assert(data || datasz == 0);
 
-	static const char * const mimes[] = {
-		"image/png",
-		"image/jpeg"
+	static int (* const sniffers[])(const unsigned char *, size_t) = {
+		[CHECK_IMAGE_PNG]       = png,
+		[CHECK_IMAGE_JPEG]      = jpeg,
+		[CHECK_IMAGE_GIF]       = gif,
+		[CHECK_IMAGE_WEBP]      = webp
 	};
-	const char *rv;
+	int rv;
 
-	/* No cookie? assume yes as last resort. */
-	if (!cookie)
-		return 0;
-
-	if (!(rv = magic_buffer(cookie, data, datasz))) {
-		log_warn(TAG "magic_buffer: %s", magic_error(cookie));
-		return 0;
+	for (size_t i = CHECK_IMAGE_PNG; i < LEN(sniffers); ++i) {
+		/* A known signature with a broken header is not an image. */
+		if ((rv = sniffers[i](data, datasz)) > 0)
+			return i;
+		if (rv < 0)
+			return CHECK_IMAGE_NONE;
 	}
 
-	for (size_t i = 0; i < LEN(mimes); ++i)
-		if (strcmp(rv, mimes[i]) == 0)
-			return 0;
-
-	return -1;
+#if defined(WITH_MAGIC)
+	return fallback(data, datasz);
 #else
-	/* No libmagic, accept everything. */
-	(void)data;
-	(void)datasz;
-
-	return 1;
+	return CHECK_IMAGE_NONE;
 #endif
 }
 
+int
+check_image(const void *data, size_t datasz)
+{
+	assert(data || datasz == 0);
+
+	return check_image_format(data, datasz) == CHECK_IMAGE_NONE ? -1 : 0;
+}
+
 void
 check_finish(void)
 {
 #if defined(WITH_MAGIC)
-	if (cookie)
+	magic_t cookie;
+
+	if (!cookie_ready)
+		return;
+
+	/* The destructor only runs for threads that exit. */
+	if ((cookie = pthread_getspecific(cookie_key))) {
 		magic_close(cookie);
+		pthread_setspecific(cookie_key, NULL);
+	}
+
+	pthread_key_delete(cookie_key);
+	cookie_ready = 0;
 #endif
 }
@@ -27,6 +27,25 @@
 #include <stddef.h>
 #include <time.h>
 
+/**
+ * \def CHECK_IMAGE_HEAD
+ * Bytes to gather from the beginning of a stream before detecting its image
+ * format, less is only given when the whole image is smaller.
+ */
+#define CHECK_IMAGE_HEAD 4096
+
+/**
+ * \enum check_image_format
+ * \brief Image formats recognized.
+ */
+enum check_image_format {
+	CHECK_IMAGE_NONE,       /*!< Not a supported image. */
+	CHECK_IMAGE_PNG,        /*!< PNG. */
+	CHECK_IMAGE_JPEG,       /*!< JPEG. */
+	CHECK_IMAGE_GIF,        /*!< GIF. */
+	CHECK_IMAGE_WEBP        /*!< WebP. */
+};
+
 /**
  * Initialize check system.
  *
@@ -62,12 +81,26 @@ int
 check_duration(time_t start, time_t end, char *error, size_t errorsz);
 
 /**
- * Check if image is valid.
+ * Detect the image format from its first bytes.
  *
- * This function will accept images if the libmagic isn't enabled/available to
- * avoid blocking users from sending images.
+ * The signature and the header structure are checked by built-in sniffers
+ * for PNG, JPEG, GIF and WebP so that the beginning of a stream is enough,
+ * a header cut by the end of the data is accepted if the present part is
+ * valid. When built with libmagic, unknown signatures are given to it as a
+ * last resort.
+ *
+ * \pre data != NULL || datasz == 0
+ * \param data the image data content
+ * \param datasz the image data length
+ * \return the format or CHECK_IMAGE_NONE
+ */
+enum check_image_format
+check_image_format(const void *data, size_t datasz);
+
+/**
+ * Check if image is valid, same as ::check_image_format.
  *
- * \pre data != NULL
+ * \pre data != NULL || datasz == 0
  * \param data the image data content
  * \param datasz the image data length
  * \return 0 on success or -1 if invalid
@@ -0,0 +1,197 @@
+/*
+ * codec.c -- paste compression
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "codec.h"
+#include "util.h"
+
+/* Adding 16 to the window bits selects the gzip wrapper. */
+#define GZIP_BITS (MAX_WBITS + 16)
+
+/* Negative window bits select raw deflate, blocks have no header. */
+#define RAW_BITS (-MAX_WBITS)
+
+unsigned char *
+codec_compress(const void *data,
+               size_t datasz,
+               size_t *outsz,
+               unsigned char **blocks,
+               size_t *blockssz)
+{
+	assert(data);
+	assert(outsz);
+
+	z_stream z = {0};
+	unsigned char *out;
+	char *index;
+	size_t indexsz, n;
+	FILE *fp;
+	int rv;
+
+	if (datasz < CODEC_MIN || datasz > UINT_MAX)
+		return NULL;
+	if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, GZIP_BITS, 8,
+	    Z_DEFAULT_STRATEGY) != Z_OK)
+		return NULL;
+
+	/*
+	 * The output has room for one byte less than the input so that
+	 * deflate stops by itself when there is no gain.
+	 */
+	out = emalloc(datasz - 1, 1);
+	z.next_out = out;
+	z.avail_out = datasz - 1;
+
+	/* An empty flush first so that the first block starts after it. */
+	rv = deflate(&z, Z_FULL_FLUSH);
+	fp = eopen_memstream(&index, &indexsz);
+
+	for (size_t off = 0; rv == Z_OK && off < datasz; off += n) {
+		n = datasz - off < CODEC_BLOCK ? datasz - off : CODEC_BLOCK;
+
+		for (int i = 0; i < 8; ++i)
+			putc(((uint64_t)z.total_out >> (i * 8)) & 0xff, fp);
+
+		z.next_in = (Bytef *)data + off;
+		z.avail_in = n;
+
+		if (off + n == datasz)
+			rv = deflate(&z, Z_FINISH);
+		else if ((rv = deflate(&z, Z_FULL_FLUSH)) == Z_OK && z.avail_out == 0)
+			rv = Z_BUF_ERROR;
+	}
+
+	deflateEnd(&z);
+	fclose(fp);
+
+	if (rv != Z_STREAM_END) {
+		free(index);
+		free(out);
+		return NULL;
+	}
+
+	*outsz = z.total_out;
+
+	if (blocks) {
+		*blocks = (unsigned char *)index;
+		*blockssz = indexsz;
+	} else
+		free(index);
+
+	return out;
+}
+
+char *
+codec_decompress(const char *codec, const void *data, size_t datasz, size_t length)
+{
+	assert(codec);
+	assert(data);
+
+	z_stream z = {0};
+	char *out;
+	int rv;
+
+	if (strcmp(codec, CODEC_GZIP) != 0 || datasz > UINT_MAX || length > UINT_MAX)
+		return NULL;
+	if (inflateInit2(&z, GZIP_BITS) != Z_OK)
+		return NULL;
+
+	out = emalloc(length + 1, 1);
+	z.next_in = (Bytef *)data;
+	z.avail_in = datasz;
+	z.next_out = (Bytef *)out;
+	z.avail_out = length;
+
+	rv = inflate(&z, Z_FINISH);
+	inflateEnd(&z);
+
+	if (rv != Z_STREAM_END || z.total_out != length) {
+		free(out);
+		return NULL;
+	}
+
+	out[length] = '\0';
+
+	return out;
+}
+
+size_t
+codec_block(const void *blocks, size_t blockssz, size_t block, size_t datasz)
+{
+	assert(blocks);
+
+	const unsigned char *p = (const unsigned char *)blocks + block * 8;
+	uint64_t off = 0;
+
+	if (block >= blockssz / 8)
+		return datasz;
+
+	for (int i = 0; i < 8; ++i)
+		off |= (uint64_t)p[i] << (i * 8);
+
+	return off;
+}
+
+char *
+codec_decompress_part(const char *codec,
+                      const void *data,
+                      size_t datasz,
+                      size_t length)
+{
+	assert(codec);
+	assert(data);
+
+	z_stream z = {0};
+	char *out;
+	int rv;
+
+	if (strcmp(codec, CODEC_GZIP) != 0 || datasz > UINT_MAX || length > UINT_MAX)
+		return NULL;
+	if (length == 0)
+		return estrdup("");
+	if (inflateInit2(&z, RAW_BITS) != Z_OK)
+		return NULL;
+
+	out = emalloc(length + 1, 1);
+	z.next_in = (Bytef *)data;
+	z.avail_in = datasz;
+	z.next_out = (Bytef *)out;
+	z.avail_out = length;
+
+	/* The stream goes on after the part wanted. */
+	rv = inflate(&z, Z_SYNC_FLUSH);
+	inflateEnd(&z);
+
+	if ((rv != Z_OK && rv != Z_STREAM_END) || z.total_out != length) {
+		free(out);
+		return NULL;
+	}
+
+	out[length] = '\0';
+
+	return out;
+}
@@ -0,0 +1,130 @@
+/*
+ * codec.h -- paste compression
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef TMPUPD_CODEC_H
+#define TMPUPD_CODEC_H
+
+/**
+ * \file codec.h
+ * \brief Paste compression.
+ *
+ * Pastes are stored as gzip streams so that they can be sent as is to
+ * clients accepting that content encoding.
+ *
+ * The stream is flushed every ::CODEC_BLOCK bytes of input so that a part of
+ * the code is decompressed from the closest block without reading the
+ * compressed data before it.
+ */
+
+#include <stddef.h>
+
+/**
+ * \def CODEC_GZIP
+ * Codec name, also the HTTP content encoding of the compressed data.
+ */
+#define CODEC_GZIP "gzip"
+
+/**
+ * \def CODEC_MIN
+ * Minimum length in bytes worth compressing.
+ */
+#define CODEC_MIN 256
+
+/**
+ * \def CODEC_BLOCK
+ * Length in bytes of the code between two flush points.
+ */
+#define CODEC_BLOCK (64 * 1024)
+
+/**
+ * Compress data.
+ *
+ * The blocks are the offsets in the compressed data where every block of
+ * ::CODEC_BLOCK bytes of the original data starts, as 64 bits little endian
+ * integers.
+ *
+ * \pre data != NULL
+ * \pre outsz != NULL
+ * \param data the data to compress
+ * \param datasz the data length
+ * \param outsz the compressed length to set
+ * \param blocks the dynamically allocated blocks to set (may be NULL)
+ * \param blockssz the blocks length to set (may be NULL)
+ * \return the dynamically allocated compressed data or NULL if it would not
+ * be smaller
+ */
+unsigned char *
+codec_compress(const void *data,
+               size_t datasz,
+               size_t *outsz,
+               unsigned char **blocks,
+               size_t *blockssz);
+
+/**
+ * Decompress data previously compressed with the given codec.
+ *
+ * The returned text is NUL terminated.
+ *
+ * \pre codec != NULL
+ * \pre data != NULL
+ * \param codec the codec name
+ * \param data the compressed data
+ * \param datasz the compressed length
+ * \param length the original length
+ * \return the dynamically allocated original data or NULL if the codec is
+ * unknown or the data is corrupted
+ */
+char *
+codec_decompress(const char *codec, const void *data, size_t datasz, size_t length);
+
+/**
+ * Get the compressed offset of a block.
+ *
+ * \pre blocks != NULL
+ * \param blocks the blocks returned by ::codec_compress
+ * \param blockssz the blocks length
+ * \param block the block number
+ * \param datasz the compressed length
+ * \return the block offset or datasz if there is no such block
+ */
+size_t
+codec_block(const void *blocks, size_t blockssz, size_t block, size_t datasz);
+
+/**
+ * Decompress a part of data previously compressed with the given codec.
+ *
+ * The data must start at the offset of a block as returned by
+ * ::codec_compress and the returned text is NUL terminated.
+ *
+ * \pre codec != NULL
+ * \pre data != NULL
+ * \param codec the codec name
+ * \param data the compressed data from the block start
+ * \param datasz the compressed length available
+ * \param length the original length wanted
+ * \return the dynamically allocated original data or NULL if the codec is
+ * unknown or the data is corrupted
+ */
+char *
+codec_decompress_part(const char *codec,
+                      const void *data,
+                      size_t datasz,
+                      size_t length);
+
+#endif /* !TMPUPD_CODEC_H */
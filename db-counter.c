@@ -0,0 +1,128 @@
+/*
+ * db-counter.c -- storage counters
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "db-counter.h"
+#include "db.h"
+
+#include "sql/counter-get.h"
+#include "sql/counter-hours.h"
+#include "sql/counter-languages.h"
+#include "sql/counter-prune.h"
+
+static void
+get(sqlite3_stmt *stmt, void *data)
+{
+	struct db_counter *counter = data;
+
+	counter->pastes = sqlite3_column_int64(stmt, 0);
+	counter->pastes_bytes = sqlite3_column_int64(stmt, 1);
+	counter->images = sqlite3_column_int64(stmt, 2);
+	counter->images_bytes = sqlite3_column_int64(stmt, 3);
+}
+
+struct language {
+	db_counter_language_fn fn;
+	void *data;
+};
+
+static int
+language_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct language *language = data;
+
+	(void)row;
+
+	return language->fn((const char *)sqlite3_column_text(stmt, 0),
+	    sqlite3_column_int64(stmt, 1), language->data);
+}
+
+struct hour {
+	db_counter_hour_fn fn;
+	void *data;
+};
+
+static int
+hour_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct hour *hour = data;
+
+	(void)row;
+
+	return hour->fn(sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1),
+	    sqlite3_column_int64(stmt, 2), hour->data);
+}
+
+int
+db_counter_get(struct db_counter *counter, struct db *db)
+{
+	assert(counter);
+	assert(db);
+
+	struct db_select select = {
+		.data = counter,
+		.datasz = 1,
+		.elemsz = sizeof (*counter),
+		.get = get
+	};
+
+	memset(counter, 0, sizeof (*counter));
+
+	return db_select(db, &select, (const char *)sql_counter_get, "") < 0 ? -1 : 0;
+}
+
+int
+db_counter_languages(db_counter_language_fn fn, void *data, struct db *db)
+{
+	assert(fn);
+	assert(db);
+
+	struct language language = {
+		.fn = fn,
+		.data = data
+	};
+
+	return db_iterate(db, language_row, &language,
+	    (const char *)sql_counter_languages, "");
+}
+
+int
+db_counter_hours(db_counter_hour_fn fn, void *data, struct db *db)
+{
+	assert(fn);
+	assert(db);
+
+	struct hour hour = {
+		.fn = fn,
+		.data = data
+	};
+
+	return db_iterate(db, hour_row, &hour,
+	    (const char *)sql_counter_hours, "");
+}
+
+int
+db_counter_prune(struct db *db)
+{
+	assert(db);
+
+	return db_execf(db, (const char *)sql_counter_prune, "t",
+	    time(NULL) - DB_COUNTER_HOURS * 3600);
+}
@@ -0,0 +1,122 @@
+/*
+ * db-counter.h -- storage counters
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_DB_COUNTER_H
+#define TMPUPD_DB_COUNTER_H
+
+/**
+ * \file db-counter.h
+ * \brief Storage counters.
+ *
+ * Counters are kept by the database itself in the statements adding and
+ * removing items, reading them never scans the items.
+ */
+
+#include <stddef.h>
+#include <time.h>
+
+#include "db.h"
+
+/**
+ * \def DB_COUNTER_HOURS
+ * Number of hours of creations kept.
+ */
+#define DB_COUNTER_HOURS 48
+
+/**
+ * \struct db_counter
+ * \brief Totals of the items stored.
+ */
+struct db_counter {
+	size_t pastes;          /*!< Number of pastes. */
+	size_t pastes_bytes;    /*!< Bytes stored for their code. */
+	size_t images;          /*!< Number of images. */
+	size_t images_bytes;    /*!< Bytes stored for their data. */
+};
+
+/**
+ * Function called for each language.
+ *
+ * \param language the language name
+ * \param count the number of pastes
+ * \param data the user data
+ * \return 0 to continue or -1 to stop with an error
+ */
+typedef int (*db_counter_language_fn)(const char *language, size_t count, void *data);
+
+/**
+ * Function called for each hour.
+ *
+ * \param hour the UTC timestamp of the beginning of the hour
+ * \param pastes the number of pastes created
+ * \param images the number of images created
+ * \param data the user data
+ * \return 0 to continue or -1 to stop with an error
+ */
+typedef int (*db_counter_hour_fn)(time_t hour, size_t pastes, size_t images, void *data);
+
+/**
+ * Get the totals of the items stored.
+ *
+ * \pre counter != NULL
+ * \pre db != NULL
+ * \param counter the totals to fill
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_counter_get(struct db_counter *counter, struct db *db);
+
+/**
+ * Iterate over the languages of the pastes stored, the most used first.
+ *
+ * \pre fn != NULL
+ * \pre db != NULL
+ * \param fn the function to call for each language
+ * \param data the function user data
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_counter_languages(db_counter_language_fn fn, void *data, struct db *db);
+
+/**
+ * Iterate over the last hours in which items were created, the most recent
+ * first.
+ *
+ * \pre fn != NULL
+ * \pre db != NULL
+ * \param fn the function to call for each hour
+ * \param data the function user data
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_counter_hours(db_counter_hour_fn fn, void *data, struct db *db);
+
+/**
+ * Forget the hours older than ::DB_COUNTER_HOURS.
+ *
+ * \pre db != NULL
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_counter_prune(struct db *db);
+
+#endif /* !TMPUPD_DB_COUNTER_H */
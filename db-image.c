@@ -17,15 +17,21 @@
  */
 
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "db-image.h"
 #include "db.h"
 #include "image.h"
+#include "util.h"
 
 #include "sql/image-delete.h"
 #include "sql/image-get.h"
+#include "sql/image-list.h"
 #include "sql/image-recents.h"
+#include "sql/image-save-stream.h"
 #include "sql/image-save.h"
+#include "sql/image-stat.h"
 #include "sql/image-prune.h"
 
 static void
@@ -46,6 +52,32 @@ get(sqlite3_stmt *stmt, void *data)
 	);
 }
 
+struct list {
+	db_image_fn fn;
+	void *data;
+};
+
+static int
+list_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct list *list = data;
+	struct image image = {
+		.datasz         = (size_t)sqlite3_column_int64(stmt, 0),
+		.id             = (char *)sqlite3_column_text(stmt, 1),
+		.title          = (char *)sqlite3_column_text(stmt, 2),
+		.author         = (char *)sqlite3_column_text(stmt, 3),
+		.filename       = (char *)sqlite3_column_text(stmt, 4),
+		.data           = (unsigned char *)sqlite3_column_blob(stmt, 5),
+		.start          = (time_t)sqlite3_column_int64(stmt, 6),
+		.end            = (time_t)sqlite3_column_int64(stmt, 7),
+		.visible        = sqlite3_column_int(stmt, 8)
+	};
+
+	(void)row;
+
+	return list->fn(&image, list->data);
+}
+
 int
 db_image_save(struct image *image, struct db *db)
 {
@@ -64,6 +96,116 @@ db_image_save(struct image *image, struct db *db)
 	);
 }
 
+int
+db_image_save_stream(struct image *image, db_read_fn read, void *data, struct db *db)
+{
+	assert(image);
+	assert(read);
+	assert(db);
+
+	intmax_t row;
+
+	if (db_exec(db, "begin") < 0)
+		return -1;
+
+	row = db_insert(db, (const char *)sql_image_save_stream, "sssszttd",
+		image->id,
+		image->title,
+		image->author,
+		image->filename,
+		image->datasz,
+		image->start,
+		image->end,
+		image->visible
+	);
+
+	if (row < 0 || db_blob_write(db, "image", "data", row, read, data) < 0 ||
+	    db_exec(db, "commit") < 0) {
+		/* Keep the original error. */
+		sqlite3_exec(db->handle, "rollback", NULL, NULL, NULL);
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+db_image_list(const char *ids, int content, db_image_fn fn, void *data, struct db *db)
+{
+	assert(ids);
+	assert(fn);
+	assert(db);
+
+	struct list list = {
+		.fn = fn,
+		.data = data
+	};
+
+	return db_iterate(db, list_row, &list, (const char *)sql_image_list, "ds",
+	    content, ids);
+}
+
+struct info {
+	struct image *image;
+	intmax_t *row;
+};
+
+static int
+stat_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct info *st = data;
+
+	(void)row;
+
+	*st->row = sqlite3_column_int64(stmt, 0);
+	st->image->id = estrdup((const char *)sqlite3_column_text(stmt, 1));
+	st->image->title = estrdup((const char *)sqlite3_column_text(stmt, 2));
+	st->image->author = estrdup((const char *)sqlite3_column_text(stmt, 3));
+	st->image->filename = estrdup((const char *)sqlite3_column_text(stmt, 4));
+	st->image->data = NULL;
+	st->image->datasz = (size_t)sqlite3_column_int64(stmt, 5);
+	st->image->start = (time_t)sqlite3_column_int64(stmt, 6);
+	st->image->end = (time_t)sqlite3_column_int64(stmt, 7);
+	st->image->visible = sqlite3_column_int(stmt, 8);
+
+	return 0;
+}
+
+int
+db_image_stat(struct image *image, intmax_t *row, const char *id, struct db *db)
+{
+	assert(image);
+	assert(row);
+	assert(id);
+	assert(db);
+
+	struct info st = {
+		.image = image,
+		.row = row
+	};
+
+	memset(image, 0, sizeof (*image));
+
+	if (db_iterate(db, stat_row, &st, (const char *)sql_image_stat, "s", id) < 0)
+		return -1;
+
+	return image->id != NULL;
+}
+
+int
+db_image_read(intmax_t row,
+              size_t offset,
+              size_t length,
+              db_write_fn write,
+              void *data,
+              struct db *db)
+{
+	assert(write);
+	assert(db);
+
+	return db_blob_read(db, "image", "data", row, offset, length, write, data);
+}
+
 int
 db_image_get(struct image *image, const char *id, struct db *db)
 {
@@ -81,20 +223,29 @@ db_image_get(struct image *image, const char *id, struct db *db)
 	return db_select(db, &select, (const char *)sql_image_get, "s", id);
 }
 
-ssize_t
-db_image_recents(struct image *images, size_t imagesz, struct db *db)
+int
+db_image_recents(time_t start,
+                 const char *id,
+                 size_t limit,
+                 db_image_fn fn,
+                 void *data,
+                 struct db *db)
 {
-	assert(images);
+	assert(fn);
 	assert(db);
 
-	struct db_select select = {
-		.data = images,
-		.datasz = imagesz,
-		.elemsz = sizeof (*images),
-		.get = get
+	struct list list = {
+		.fn = fn,
+		.data = data
 	};
 
-	return db_select(db, &select, (const char *)sql_image_recents, "z", imagesz);
+	/* The first page starts before any possible item. */
+	if (!id || !*id)
+		return db_iterate(db, list_row, &list, (const char *)sql_image_recents,
+		    "jsz", INTMAX_MAX, "", limit);
+
+	return db_iterate(db, list_row, &list, (const char *)sql_image_recents,
+	    "tsz", start, id, limit);
 }
 
 int
@@ -26,9 +26,22 @@
 
 #include <sys/types.h>
 
-struct db;
+#include "db.h"
+
 struct image;
 
+/**
+ * Callback function for ::db_image_list.
+ *
+ * The image fields are borrowed from the database and only valid during the
+ * call, the data is NULL if it was not requested but its size is always set.
+ *
+ * \param image the image
+ * \param data optional user data
+ * \return 0 on success or -1 to stop
+ */
+typedef int (*db_image_fn)(const struct image *image, void *data);
+
 /**
  * Save an image into the database.
  *
@@ -43,6 +56,65 @@ struct image;
 int
 db_image_save(struct image *img, struct db *db);
 
+/**
+ * Save an image into the database reading its content by chunks.
+ *
+ * The image data field is ignored, the datasz field must be set to the
+ * content length.
+ *
+ * \pre img != NULL
+ * \pre read != NULL
+ * \pre db != NULL
+ * \param img the image
+ * \param read the function providing the content
+ * \param data optional user data passed to read
+ * \param db the database
+ * \return 0 on success or -1 on error
+ * \see ::db_blob_write
+ */
+int
+db_image_save_stream(struct image *img, db_read_fn read, void *data, struct db *db);
+
+/**
+ * Get a unique image from database without loading its data.
+ *
+ * The image datasz field is set while data is left NULL, the row is set to
+ * the value needed by ::db_image_read.
+ *
+ * \pre img != NULL
+ * \pre row != NULL
+ * \pre id != NULL
+ * \pre db != NULL
+ * \param img the image
+ * \param row the image row to set
+ * \param id the image identifier
+ * \param db the database
+ * \return 1 if found, 0 if not found or -1 on error
+ */
+int
+db_image_stat(struct image *img, intmax_t *row, const char *id, struct db *db);
+
+/**
+ * Read a portion of the image data in chunks.
+ *
+ * \pre write != NULL
+ * \pre db != NULL
+ * \param row the row obtained from ::db_image_stat
+ * \param offset the first byte to read
+ * \param length the number of bytes to read
+ * \param write the function receiving the data
+ * \param data the function user data
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_image_read(intmax_t row,
+              size_t offset,
+              size_t length,
+              db_write_fn write,
+              void *data,
+              struct db *db);
+
 /**
  * Get a unique image from database.
  *
@@ -58,17 +130,47 @@ int
 db_image_get(struct image *img, const char *id, struct db *db);
 
 /**
- * Get a list of most recent images.
+ * Iterate over the images matching a list of identifiers with one query,
+ * in the order of the list. Unknown identifiers are ignored.
+ *
+ * \pre ids != NULL
+ * \pre fn != NULL
+ * \pre db != NULL
+ * \param ids the identifiers as a JSON array of strings
+ * \param content non-zero to fetch the image data too
+ * \param fn the function to call for each image
+ * \param data the function user data
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_image_list(const char *ids, int content, db_image_fn fn, void *data, struct db *db);
+
+/**
+ * Iterate over the most recent visible images without their data, from the
+ * newest or from the one created right before the given image.
  *
- * \pre imgs != NULL
+ * The order is the creation date then the identifier, both descending, so
+ * that any page costs the same whatever the number of images before it.
+ *
+ * \pre fn != NULL
  * \pre db != NULL
- * \param imgs array of images to fill
- * \param imgsz number of images to load at most
+ * \param start the creation date of the image to start after
+ * \param id the identifier of the image to start after, NULL or empty to
+ * start from the newest
+ * \param limit the number of images to load at most
+ * \param fn the function to call for each image
+ * \param data the function user data
  * \param db the database
- * \return the number of images loaded or -1 on error
+ * \return 0 on success or -1 on error
  */
-ssize_t
-db_image_recents(struct image *imgs, size_t imgsz, struct db *db);
+int
+db_image_recents(time_t start,
+                 const char *id,
+                 size_t limit,
+                 db_image_fn fn,
+                 void *data,
+                 struct db *db);
 
 /**
  * Delete the specified image from database.
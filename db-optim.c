@@ -0,0 +1,76 @@
+/*
+ * db-optim.c -- storage helpers for image recompression
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+
+#include "db-optim.h"
+#include "db.h"
+#include "util.h"
+
+#include "sql/optim-pending.h"
+#include "sql/optim-replace.h"
+#include "sql/optim-save.h"
+
+static void
+pending(sqlite3_stmt *stmt, void *data)
+{
+	char **id = data;
+
+	*id = estrdup((const char *)sqlite3_column_text(stmt, 0));
+}
+
+ssize_t
+db_optim_pending(char **ids, size_t idsz, struct db *db)
+{
+	assert(ids);
+	assert(db);
+
+	struct db_select select = {
+		.data = ids,
+		.datasz = idsz,
+		.elemsz = sizeof (*ids),
+		.get = pending
+	};
+
+	return db_select(db, &select, (const char *)sql_optim_pending, "z", idsz);
+}
+
+int
+db_optim_save(const char *id,
+              size_t original,
+              const void *data,
+              size_t datasz,
+              struct db *db)
+{
+	assert(id);
+	assert(db);
+
+	if (db_exec(db, "begin") < 0)
+		return -1;
+
+	if ((data && db_execf(db, (const char *)sql_optim_replace, "bs",
+	    data, datasz, id) < 0) ||
+	    db_execf(db, (const char *)sql_optim_save, "szzs", id, original,
+	    data ? datasz : original, id) < 0 ||
+	    db_exec(db, "commit") < 0) {
+		sqlite3_exec(db->handle, "rollback", NULL, NULL, NULL);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * db-optim.h -- storage helpers for image recompression
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_DB_OPTIM_H
+#define TMPUPD_DB_OPTIM_H
+
+/**
+ * \file db-optim.h
+ * \brief Storage helpers for image recompression.
+ *
+ * Every image processed is recorded with its size before and after, even
+ * when it could not be made smaller, so that it is processed only once.
+ */
+
+#include <sys/types.h>
+
+#include "db.h"
+
+/**
+ * Collect identifiers of images that have not been processed yet.
+ *
+ * Each identifier is dynamically allocated and must be freed.
+ *
+ * \pre ids != NULL
+ * \pre db != NULL
+ * \param ids the array of identifiers to fill
+ * \param idsz the maximum number of identifiers
+ * \param db the database
+ * \return the number of identifiers or -1 on error
+ */
+ssize_t
+db_optim_pending(char **ids, size_t idsz, struct db *db);
+
+/**
+ * Record an image as processed and replace its data if a smaller one is
+ * given, nothing is saved if the image has been removed meanwhile.
+ *
+ * \pre id != NULL
+ * \pre db != NULL
+ * \param id the image identifier
+ * \param original the image length before
+ * \param data the smaller image (may be NULL to keep the original)
+ * \param datasz the smaller image length
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_optim_save(const char *id,
+              size_t original,
+              const void *data,
+              size_t datasz,
+              struct db *db);
+
+#endif /* !TMPUPD_DB_OPTIM_H */
@@ -0,0 +1,213 @@
+/*
+ * db-paste-test.c -- paste database tests
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "db-paste.h"
+#include "db.h"
+#include "paste.h"
+#include "util.h"
+
+#include "sql/init.h"
+
+#define CHECK(cond)                                                             \
+do {                                                                            \
+        if (!(cond))                                                            \
+                die("abort: %s:%d: %s\n", __FILE__, __LINE__, #cond);           \
+} while (0)
+
+static char path[64];
+
+/*
+ * Open the database like tmpupd does at startup, the schema is created or
+ * upgraded.
+ */
+static void
+open_db(struct db *db)
+{
+	if (db_open(db, path, DB_RDWR) < 0 ||
+	    db_paste_register(db) < 0 ||
+	    db_exec(db, (const char *)sql_init) < 0)
+		die("abort: %s: %s\n", path, db->error);
+}
+
+static void
+save(struct db *db, const char *id, const char *code, time_t end)
+{
+	struct paste paste;
+
+	paste_init(&paste, id, "test", NULL, NULL, "cpp", code, 1, end, 1);
+	CHECK(db_paste_save(&paste, db) == 0);
+	paste_finish(&paste);
+}
+
+static int
+found(const struct paste *paste, const char *snippet, void *data)
+{
+	(void)snippet;
+
+	bstrlcpy(data, paste->id, 32);
+
+	return 0;
+}
+
+static int
+count_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	(void)row;
+
+	*(int *)data = sqlite3_column_int(stmt, 0);
+
+	return 0;
+}
+
+static int
+count(struct db *db, const char *sql)
+{
+	int n = -1;
+
+	CHECK(db_iterate(db, count_row, &n, sql, "") == 0);
+
+	return n;
+}
+
+/*
+ * Pastes saved before the search index existed must be indexed so that
+ * pruning them does not break it.
+ */
+static void
+test_prune_unindexed(void)
+{
+	struct db db;
+	char id[32] = {0};
+
+	open_db(&db);
+
+	/* Make it look like a database from before the index. */
+	CHECK(db_exec(&db,
+	    "drop trigger `paste_fts_insert`;"
+	    "drop trigger `paste_fts_delete`;"
+	    "drop table `paste_fts`;"
+	    "delete from `setting` where `key` = 'paste_fts';") == 0);
+
+	save(&db, "expired", "int expired_function(void);", 2);
+	save(&db, "alive", "int alive_function(void);", time(NULL) + 3600);
+	db_finish(&db);
+
+	open_db(&db);
+
+	CHECK(db_paste_search("alive_function", 10, found, id, &db) == 0);
+	CHECK(strcmp(id, "alive") == 0);
+	CHECK(db_paste_prune(&db) == 0);
+	CHECK(count(&db, "select count(*) from `paste`") == 1);
+	CHECK(db_exec(&db,
+	    "insert into `paste_fts`(`paste_fts`, `rank`) values ('integrity-check', 1)") == 0);
+
+	/* Only once, the index is not rebuilt on every start. */
+	db_finish(&db);
+	open_db(&db);
+
+	CHECK(count(&db, "select count(*) from `setting` where `key` = 'paste_fts'") == 1);
+
+	db_finish(&db);
+}
+
+/*
+ * Code which does not compress well so that forks are stored as deltas.
+ */
+static char *
+code(unsigned int seed, size_t lines)
+{
+	char *text = ecalloc(lines, 32), *p = text;
+
+	srandom(seed);
+
+	for (size_t i = 0; i < lines; ++i)
+		p += sprintf(p, "int v%zu = %ld;\n", i, random());
+
+	return text;
+}
+
+static void
+fork_code(struct db *db, const char *id, const char *parent, const char *code)
+{
+	struct paste paste;
+
+	paste_init(&paste, id, "test", NULL, NULL, "cpp", code, 1, time(NULL) + 3600, 1);
+	CHECK(db_paste_fork(&paste, parent, db) == 0);
+	paste_finish(&paste);
+}
+
+/*
+ * A paste deleted and created again with the same identifier must not be
+ * rebuilt from the code cached for the previous one.
+ */
+static void
+test_delta_evict(void)
+{
+	struct db db;
+	struct paste paste = {0};
+	char *first, *second, *child;
+
+	first = code(1, 400);
+	second = code(2, 200);
+	child = ememdup(second, strlen(second) + 16);
+	strcat(child, "int last;\n");
+
+	open_db(&db);
+
+	save(&db, "base", first, time(NULL) + 3600);
+	fork_code(&db, "fork1", "base", first);
+
+	paste.id = "base";
+	CHECK(db_paste_delete(&paste, &db) == 0);
+	paste.id = "fork1";
+	CHECK(db_paste_delete(&paste, &db) == 0);
+
+	save(&db, "base", second, time(NULL) + 3600);
+	fork_code(&db, "fork2", "base", child);
+	CHECK(count(&db, "select count(*) from `paste_content` where `codec` = 'delta'") == 1);
+
+	paste = (struct paste) {0};
+	CHECK(db_paste_get(&paste, "fork2", &db) == 1);
+	CHECK(strcmp(paste.code, child) == 0);
+	paste_finish(&paste);
+
+	db_finish(&db);
+	free(first);
+	free(second);
+	free(child);
+}
+
+int
+main(void)
+{
+	snprintf(path, sizeof (path), "/tmp/db-paste-test-%ld.db", (long)getpid());
+
+	test_prune_unindexed();
+	test_delta_evict();
+
+	unlink(path);
+	puts("db-paste-test: ok");
+
+	return 0;
+}
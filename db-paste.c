@@ -17,23 +17,294 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "codec.h"
 #include "db-paste.h"
 #include "db.h"
+#include "delta.h"
+#include "lines.h"
+#include "log.h"
 #include "paste.h"
+#include "tmp.h"
+#include "util.h"
 
+#include "sql/paste-append.h"
+#include "sql/paste-chunks.h"
+#include "sql/paste-code.h"
+#include "sql/paste-content-delete.h"
+#include "sql/paste-content.h"
 #include "sql/paste-delete.h"
+#include "sql/paste-dependents.h"
+#include "sql/paste-depth.h"
+#include "sql/paste-expired.h"
+#include "sql/paste-fork.h"
 #include "sql/paste-get.h"
-#include "sql/paste-prune.h"
+#include "sql/paste-index.h"
+#include "sql/paste-list.h"
+#include "sql/paste-raw.h"
 #include "sql/paste-recents.h"
 #include "sql/paste-save.h"
+#include "sql/paste-search.h"
+#include "sql/paste-set-code.h"
+#include "sql/paste-span.h"
+#include "sql/paste-stat.h"
+#include "sql/paste-summary-get.h"
+#include "sql/paste-summary.h"
+#include "sql/paste-token.h"
+
+#define TAG "db-paste: "
+
+/* Codec of forks stored as a delta of their parent code. */
+#define DELTA "delta"
+
+/* Longest chain of deltas, deeper forks are stored whole. */
+#define DELTA_DEPTH 8
+
+/* Lines and bytes kept in the preview of a paste. */
+#define PREVIEW_LINES 3
+#define PREVIEW_MAX 240
+
+/* Number of rebuilt codes kept and the longest one. */
+#define CACHE_SIZE 16
+#define CACHE_TEXT_MAX (1024 * 1024)
+
+/*
+ * Codes rebuilt from deltas and their bases. A paste is only appended to
+ * so an entry serves any prefix of the code it holds, it is evicted when
+ * the paste is deleted or rebased in this process.
+ */
+static struct {
+	char id[TMP_ID_LEN];
+	char *text;
+	size_t textsz;
+	unsigned long long used;
+} cache[CACHE_SIZE];
+
+static unsigned long long cache_clock;
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static char *
+cache_get(const char *id, size_t length)
+{
+	char *text = NULL;
+
+	pthread_mutex_lock(&cache_mutex);
+
+	for (size_t i = 0; i < CACHE_SIZE; ++i) {
+		if (!cache[i].text || strcmp(cache[i].id, id) != 0)
+			continue;
+
+		if (cache[i].textsz >= length) {
+			cache[i].used = ++cache_clock;
+			text = emalloc(length + 1, 1);
+			memcpy(text, cache[i].text, length);
+			text[length] = '\0';
+		}
+
+		break;
+	}
+
+	pthread_mutex_unlock(&cache_mutex);
+
+	return text;
+}
 
 static void
-get(sqlite3_stmt *stmt, void *data)
+cache_put(const char *id, const char *text, size_t textsz)
 {
-	struct paste *paste = data;
+	size_t slot = 0;
+
+	if (textsz > CACHE_TEXT_MAX || strlen(id) >= sizeof (cache[0].id))
+		return;
+
+	pthread_mutex_lock(&cache_mutex);
+
+	/* Replace the same paste or the least recently used one. */
+	for (size_t i = 0; i < CACHE_SIZE; ++i) {
+		if (cache[i].text && strcmp(cache[i].id, id) == 0) {
+			slot = i;
+			break;
+		}
+		if (cache[i].used < cache[slot].used)
+			slot = i;
+	}
+
+	if (!cache[slot].text || strcmp(cache[slot].id, id) != 0 ||
+	    cache[slot].textsz < textsz) {
+		free(cache[slot].text);
+		bstrlcpy(cache[slot].id, id, sizeof (cache[slot].id));
+		cache[slot].text = ememdup(text, textsz);
+		cache[slot].textsz = textsz;
+	}
+
+	cache[slot].used = ++cache_clock;
+
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+static void
+cache_evict(const char *id)
+{
+	pthread_mutex_lock(&cache_mutex);
+
+	for (size_t i = 0; i < CACHE_SIZE; ++i) {
+		if (!cache[i].text || strcmp(cache[i].id, id) != 0)
+			continue;
+
+		free(cache[i].text);
+		cache[i].text = NULL;
+		cache[i].textsz = 0;
+		cache[i].used = 0;
+		break;
+	}
+
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+static char *
+resolve(const char *id, size_t length, struct db *db, unsigned int depth);
+
+/*
+ * Rebuild the code of a paste stored compressed or as a delta, the code
+ * column then only holds the chunks appended since and the codec, length,
+ * content, parent and base follow at the given column. The identifier must
+ * be the first column. The code is set to NULL if stored as is, -1 is
+ * returned if it can't be rebuilt.
+ */
+static int
+inflated(sqlite3_stmt *stmt, int code, int codec, struct db *db, unsigned int depth, char **out)
+{
+	const char *id, *name, *parent, *chunks;
+	const void *content;
+	char *text = NULL, *base, *full;
+	size_t length, contentsz, basesz, chunksz;
+
+	*out = NULL;
+
+	if (!(name = (const char *)sqlite3_column_text(stmt, codec)))
+		return 0;
+
+	id = (const char *)sqlite3_column_text(stmt, 0);
+	length = sqlite3_column_int64(stmt, codec + 1);
+	parent = (const char *)sqlite3_column_text(stmt, codec + 3);
+	basesz = sqlite3_column_int64(stmt, codec + 4);
+
+	if (strcmp(name, DELTA) != 0) {
+		content = sqlite3_column_blob(stmt, codec + 2);
+		contentsz = sqlite3_column_bytes(stmt, codec + 2);
+		text = codec_decompress(name, content ? content : "", contentsz, length);
+	} else if (!(text = cache_get(id, length)) && db && parent &&
+	    depth < DELTA_DEPTH && (base = resolve(parent, basesz, db, depth + 1))) {
+		content = sqlite3_column_blob(stmt, codec + 2);
+		contentsz = sqlite3_column_bytes(stmt, codec + 2);
+		text = delta_apply(content ? content : "", contentsz, base, basesz, length);
+		free(base);
+
+		if (text)
+			cache_put(id, text, length);
+	}
+
+	if (!text) {
+		log_warn(TAG "unable to rebuild paste '%s'", id);
+		return -1;
+	}
+
+	chunks = (const char *)sqlite3_column_text(stmt, code);
+	chunksz = sqlite3_column_bytes(stmt, code);
+
+	if (chunksz == 0) {
+		*out = text;
+		return 0;
+	}
+
+	full = emalloc(length + chunksz + 1, 1);
+	memcpy(full, text, length);
+	memcpy(full + length, chunks, chunksz + 1);
+	free(text);
+	*out = full;
+
+	return 0;
+}
+
+struct whole {
+	struct db *db;
+	unsigned int depth;
+	char *text;
+};
+
+static int
+whole_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct whole *wh = data;
+
+	(void)row;
+
+	if (inflated(stmt, 1, 2, wh->db, wh->depth, &wh->text) < 0)
+		return -1;
+	if (!wh->text)
+		wh->text = estrdup((const char *)sqlite3_column_text(stmt, 1));
+
+	return 0;
+}
+
+/*
+ * Get the current code of a paste from the database and keep it in the
+ * cache.
+ */
+static char *
+whole(const char *id, size_t *length, struct db *db, unsigned int depth)
+{
+	struct whole wh = {
+		.db = db,
+		.depth = depth
+	};
+
+	if (db_iterate(db, whole_row, &wh, (const char *)sql_paste_raw, "s", id) < 0 || !wh.text)
+		return NULL;
+
+	*length = strlen(wh.text);
+	cache_put(id, wh.text, *length);
+
+	return wh.text;
+}
+
+/*
+ * Get the first bytes of the code of a paste, the base of a delta.
+ */
+static char *
+resolve(const char *id, size_t length, struct db *db, unsigned int depth)
+{
+	char *text;
+	size_t textsz;
+
+	if ((text = cache_get(id, length)))
+		return text;
+	if (!(text = whole(id, &textsz, db, depth)))
+		return NULL;
+	if (textsz < length) {
+		free(text);
+		return NULL;
+	}
+
+	text[length] = '\0';
+
+	return text;
+}
+
+static int
+fill(struct paste *paste, sqlite3_stmt *stmt, struct db *db)
+{
+	const char *preview;
+	char *code;
+
+	if (inflated(stmt, 5, 9, db, 0, &code) < 0)
+		return -1;
 
 	paste_init(paste,
 		(const char *)sqlite3_column_text(stmt, 0),
@@ -41,30 +312,915 @@ get(sqlite3_stmt *stmt, void *data)
 		(const char *)sqlite3_column_text(stmt, 2),
 		(const char *)sqlite3_column_text(stmt, 3),
 		(const char *)sqlite3_column_text(stmt, 4),
-		(const char *)sqlite3_column_text(stmt, 5),
+		code ? code : (const char *)sqlite3_column_text(stmt, 5),
 		(time_t)sqlite3_column_int64(stmt, 6),
 		(time_t)sqlite3_column_int64(stmt, 7),
 		(int)sqlite3_column_int(stmt, 8)
 	);
+
+	paste->size = sqlite3_column_int64(stmt, 14);
+	paste->lines = sqlite3_column_int64(stmt, 15);
+
+	if ((preview = (const char *)sqlite3_column_text(stmt, 16)))
+		paste->preview = estrdup(preview);
+
+	free(code);
+
+	return 0;
 }
 
-int
-db_paste_save(struct paste *paste, struct db *db)
+/*
+ * Used for the pastes which come without their code, nothing to rebuild.
+ */
+static void
+get(sqlite3_stmt *stmt, void *data)
 {
-	assert(paste);
-	assert(db);
+	(void)fill(data, stmt, NULL);
+}
 
+struct one {
+	struct paste *paste;
+	struct db *db;
+	int found;
+};
+
+static int
+one_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct one *one = data;
+
+	(void)row;
+
+	if (fill(one->paste, stmt, one->db) < 0)
+		return -1;
+
+	one->found = 1;
+
+	return 0;
+}
+
+struct list {
+	db_paste_fn fn;
+	void *data;
+	struct db *db;
+};
+
+static int
+list_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct list *list = data;
+	char *code;
+	struct paste paste;
+	int rv;
+
+	(void)row;
+
+	if (inflated(stmt, 5, 9, list->db, 0, &code) < 0)
+		return -1;
+
+	paste = (struct paste) {
+		.id             = (char *)sqlite3_column_text(stmt, 0),
+		.title          = (char *)sqlite3_column_text(stmt, 1),
+		.author         = (char *)sqlite3_column_text(stmt, 2),
+		.filename       = (char *)sqlite3_column_text(stmt, 3),
+		.language       = (char *)sqlite3_column_text(stmt, 4),
+		.code           = code ? code : (char *)sqlite3_column_text(stmt, 5),
+		.start          = (time_t)sqlite3_column_int64(stmt, 6),
+		.end            = (time_t)sqlite3_column_int64(stmt, 7),
+		.visible        = sqlite3_column_int(stmt, 8),
+		.size           = sqlite3_column_int64(stmt, 14),
+		.lines          = sqlite3_column_int64(stmt, 15),
+		.preview        = (char *)sqlite3_column_text(stmt, 16)
+	};
+
+	rv = list->fn(&paste, list->data);
+	free(code);
+
+	return rv;
+}
+
+struct search {
+	db_paste_search_fn fn;
+	void *data;
+};
+
+static int
+search_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct search *search = data;
+	const struct paste paste = {
+		.id             = (char *)sqlite3_column_text(stmt, 0),
+		.title          = (char *)sqlite3_column_text(stmt, 1),
+		.author         = (char *)sqlite3_column_text(stmt, 2),
+		.filename       = (char *)sqlite3_column_text(stmt, 3),
+		.language       = (char *)sqlite3_column_text(stmt, 4),
+		.start          = (time_t)sqlite3_column_int64(stmt, 6),
+		.end            = (time_t)sqlite3_column_int64(stmt, 7),
+		.visible        = sqlite3_column_int(stmt, 8),
+		.size           = sqlite3_column_int64(stmt, 14),
+		.lines          = sqlite3_column_int64(stmt, 15),
+		.preview        = (char *)sqlite3_column_text(stmt, 16)
+	};
+	const char *snippet;
+
+	(void)row;
+
+	snippet = (const char *)sqlite3_column_text(stmt, 17);
+
+	return search->fn(&paste, snippet ? snippet : "", search->data);
+}
+
+/*
+ * Turn words into a query matching all of them, each word is quoted so that
+ * no operator applies and a trailing star keeps a prefix search.
+ */
+static char *
+match(const char *terms)
+{
+	const char *p = terms;
+	char *query;
+	size_t querysz, len;
+	int prefix;
+	FILE *fp;
+
+	fp = eopen_memstream(&query, &querysz);
+
+	for (; *(p += strspn(p, " \t\r\n")); p += len) {
+		len = strcspn(p, " \t\r\n");
+		prefix = len > 1 && p[len - 1] == '*';
+
+		putc('"', fp);
+
+		for (size_t i = 0; i < len - prefix; ++i) {
+			if (p[i] == '"')
+				putc('"', fp);
+
+			putc(p[i], fp);
+		}
+
+		fputs(prefix ? "\"* " : "\" ", fp);
+	}
+
+	fclose(fp);
+
+	return query;
+}
+
+struct raw {
+	const char *codec;
+	db_paste_raw_fn fn;
+	void *data;
+	struct db *db;
+	int found;
+};
+
+static int
+raw_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct raw *raw = data;
+	const char *codec, *code;
+	char *text;
+	size_t length;
+
+	(void)row;
+
+	codec = (const char *)sqlite3_column_text(stmt, 2);
+
+	/* Nothing appended since, the compressed code is the whole paste. */
+	if (codec && raw->codec && strcmp(codec, raw->codec) == 0 &&
+	    sqlite3_column_bytes(stmt, 1) == 0) {
+		code = sqlite3_column_blob(stmt, 4);
+		raw->fn(codec, code, sqlite3_column_bytes(stmt, 4),
+		    sqlite3_column_int64(stmt, 3), raw->data);
+	} else if (inflated(stmt, 1, 2, raw->db, 0, &text) < 0)
+		return -1;
+	else if (text) {
+		length = strlen(text);
+		raw->fn(NULL, text, length, length, raw->data);
+		free(text);
+	} else {
+		/* Text must be fetched before its length. */
+		code = (const char *)sqlite3_column_text(stmt, 1);
+		raw->fn(NULL, code ? code : "", sqlite3_column_bytes(stmt, 1),
+		    sqlite3_column_bytes(stmt, 1), raw->data);
+	}
+
+	raw->found = 1;
+
+	return 0;
+}
+
+struct span {
+	struct db_paste_lines *lines;
+	struct db *db;
+	FILE *fp;
+	size_t line;
+	int done;
+	int found;
+};
+
+/*
+ * Keep the lines wanted from the next text of the code, the line is the one
+ * the text starts at.
+ */
+static void
+slice(struct span *sp, const char *text, size_t textsz)
+{
+	struct db_paste_lines *ln = sp->lines;
+	size_t n, off;
+
+	if (sp->done) {
+		ln->more = ln->more || textsz;
+		return;
+	}
+
+	if (sp->line < ln->first) {
+		n = ln->first - sp->line;
+		off = lines_skip(text, textsz, &n);
+		sp->line = ln->first - n;
+
+		if (n)
+			return;
+
+		text += off;
+		textsz -= off;
+	}
+
+	n = ln->first + ln->count - sp->line;
+	off = lines_skip(text, textsz, &n);
+	fwrite(text, 1, off, sp->fp);
+	sp->line = ln->first + ln->count - n;
+
+	if (n == 0) {
+		sp->done = 1;
+		ln->more = off < textsz;
+	}
+}
+
+static int
+chunk_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct span *sp = data;
+	const char *text;
+
+	(void)row;
+
+	text = (const char *)sqlite3_column_text(stmt, 0);
+	slice(sp, text ? text : "", sqlite3_column_bytes(stmt, 0));
+
+	/* One chunk after the last line is enough to know there is more. */
+	return sp->done && sp->lines->more ? -1 : 0;
+}
+
+static int
+append(void *data, const void *buf, size_t bufsz)
+{
+	return fwrite(buf, 1, bufsz, data) == bufsz ? 0 : -1;
+}
+
+/*
+ * Decompress the code from the block holding the offset lo up to the offset
+ * hi, only the compressed data of these blocks is read.
+ */
+static char *
+part(sqlite3_stmt *stmt, size_t lo, size_t hi, struct db *db)
+{
+	const void *blocks;
+	char *buf, *text = NULL;
+	size_t blockssz, datasz, from, to, bufsz;
+	FILE *fp;
+	int rv;
+
+	blocks = sqlite3_column_blob(stmt, 8);
+	blockssz = sqlite3_column_bytes(stmt, 8);
+	datasz = sqlite3_column_int64(stmt, 9);
+	from = codec_block(blocks, blockssz, lo / CODEC_BLOCK, datasz);
+	to = codec_block(blocks, blockssz, (hi + CODEC_BLOCK - 1) / CODEC_BLOCK, datasz);
+
+	if (from > to)
+		return NULL;
+
+	fp = eopen_memstream(&buf, &bufsz);
+	rv = db_blob_read(db, "paste_content", "data", sqlite3_column_int64(stmt, 4),
+	    from, to - from, append, fp);
+	fclose(fp);
+
+	if (rv == 0)
+		text = codec_decompress_part(CODEC_GZIP, buf, bufsz,
+		    hi - lo / CODEC_BLOCK * CODEC_BLOCK);
+
+	free(buf);
+
+	return text;
+}
+
+static int
+span_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct span *sp = data;
+	struct db_paste_lines *ln = sp->lines;
+	const char *id, *code, *codec;
+	const void *offsets;
+	char *text = NULL;
+	size_t codesz, length, offsetssz, lo = 0, hi, last;
+	int rv;
+
+	(void)row;
+
+	id = (const char *)sqlite3_column_text(stmt, 0);
+	code = (const char *)sqlite3_column_text(stmt, 1);
+	codesz = sqlite3_column_bytes(stmt, 1);
+	codec = (const char *)sqlite3_column_text(stmt, 2);
+	length = codec ? (size_t)sqlite3_column_int64(stmt, 3) : codesz;
+	hi = length;
+	sp->found = 1;
+
+	/* Start at the closest line indexed and stop at the next one after. */
+	if ((offsets = sqlite3_column_blob(stmt, 7))) {
+		offsetssz = sqlite3_column_bytes(stmt, 7);
+		lo = lines_offset(offsets, offsetssz, ln->first, &sp->line);
+		hi = lines_offset(offsets, offsetssz, ln->first + ln->count + LINES_STEP - 1, &last);
+
+		if (last < ln->first + ln->count)
+			hi = length;
+	}
+
+	if (!codec)
+		slice(sp, code ? code + lo : "", hi - lo);
+	else if (strcmp(codec, CODEC_GZIP) == 0 && offsets && sqlite3_column_blob(stmt, 8)) {
+		if (!(text = part(stmt, lo, hi, sp->db)))
+			return -1;
+
+		slice(sp, text + lo % CODEC_BLOCK, hi - lo);
+	} else {
+		/* Pastes rebuilt from a delta go through the cache. */
+		if (!(text = resolve(id, length, sp->db, 0)))
+			return -1;
+
+		slice(sp, text + lo, hi - lo);
+	}
+
+	free(text);
+
+	if (sp->done && hi < length)
+		ln->more = 1;
+	if (ln->more)
+		return 0;
+
+	rv = db_iterate(sp->db, chunk_row, sp, (const char *)sql_paste_chunks, "s", id);
+
+	return rv < 0 && !ln->more ? -1 : 0;
+}
+
+static int
+insert(const struct paste *paste, const char *code, struct db *db)
+{
 	return db_insert(db, (const char *)sql_paste_save, "ssssssttd",
 		paste->id,
 		paste->title,
 		paste->author,
 		paste->filename,
 		paste->language,
-		paste->code,
+		code,
 		paste->start,
 		paste->end,
 		paste->visible
-	);
+	) < 0 ? -1 : 0;
+}
+
+static int
+content(const char *id,
+        const char *codec,
+        const void *data,
+        size_t datasz,
+        size_t length,
+        struct db *db)
+{
+	return db_execf(db, (const char *)sql_paste_content, "sszb",
+	    id, codec, length, data, datasz);
+}
+
+/*
+ * Index the lines of a code and the blocks of its compressed content if any.
+ */
+static int
+lines(const char *id,
+      const char *text,
+      size_t length,
+      const void *blocks,
+      size_t blockssz,
+      struct db *db)
+{
+	unsigned char *offsets;
+	size_t offsetssz;
+	int rv;
+
+	offsets = lines_index(text, length, &offsetssz);
+	rv = db_execf(db, (const char *)sql_paste_index, "sbb", id,
+	    offsets, offsetssz, blocks, blockssz);
+	free(offsets);
+
+	return rv;
+}
+
+static int
+summary(const char *id,
+        size_t size,
+        size_t lines,
+        int tail,
+        const char *preview,
+        struct db *db)
+{
+	return db_execf(db, (const char *)sql_paste_summary, "szzds",
+	    id, size, lines, tail, preview);
+}
+
+/*
+ * Compute the figures shown in listings once and for all.
+ */
+static int
+summarize(const char *id, const char *text, size_t length, struct db *db)
+{
+	char *preview;
+	int rv;
+
+	preview = lines_preview(text, length, PREVIEW_LINES, PREVIEW_MAX);
+	rv = summary(id, length, lines_count(text, length),
+	    length && text[length - 1] != '\n', preview, db);
+	free(preview);
+
+	return rv;
+}
+
+struct grow {
+	const char *id;
+	const char *data;
+	size_t datasz;
+	struct db *db;
+};
+
+/*
+ * Update the figures of a paste with the chunk appended.
+ */
+static int
+grow_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct grow *gr = data;
+	const char *preview;
+	char *text = NULL, *next = NULL;
+	size_t size, count, textsz;
+	int tail, rv;
+	FILE *fp;
+
+	(void)row;
+
+	size = sqlite3_column_int64(stmt, 0);
+	count = sqlite3_column_int64(stmt, 1);
+	tail = sqlite3_column_int(stmt, 2);
+	preview = (const char *)sqlite3_column_text(stmt, 3);
+
+	/* The preview is the whole code as long as it is that short. */
+	if (count <= PREVIEW_LINES && size <= PREVIEW_MAX) {
+		fp = eopen_memstream(&text, &textsz);
+		fprintf(fp, "%s%s%s", preview, !tail && size ? "\n" : "", gr->data);
+		fclose(fp);
+		preview = next = lines_preview(text, textsz, PREVIEW_LINES, PREVIEW_MAX);
+	}
+
+	/* Lines complete so far plus the newlines and the last line added. */
+	count -= tail;
+	tail = gr->data[gr->datasz - 1] != '\n';
+	count += lines_count(gr->data, gr->datasz);
+
+	rv = summary(gr->id, size + gr->datasz, count, tail, preview, gr->db);
+	free(next);
+	free(text);
+
+	return rv;
+}
+
+/*
+ * Insert a paste with its code stored as is if codec is NULL or in the
+ * content table otherwise, the blocks are those of a gzip content.
+ */
+static int
+save(const struct paste *paste,
+     const char *codec,
+     const void *data,
+     size_t datasz,
+     const void *blocks,
+     size_t blockssz,
+     struct db *db)
+{
+	size_t length = strlen(paste->code);
+
+	if (!codec)
+		return insert(paste, paste->code, db) < 0 ||
+		    lines(paste->id, paste->code, length, NULL, 0, db) < 0 ||
+		    summarize(paste->id, paste->code, length, db) < 0 ? -1 : 0;
+
+	/* The search index reads the content when the paste is inserted. */
+	return content(paste->id, codec, data, datasz, length, db) < 0 ||
+	    insert(paste, "", db) < 0 ||
+	    lines(paste->id, paste->code, length, blocks, blockssz, db) < 0 ||
+	    summarize(paste->id, paste->code, length, db) < 0 ? -1 : 0;
+}
+
+/*
+ * A savepoint rather than a transaction as pastes may be saved within a
+ * batch transaction.
+ */
+static int
+end(struct db *db, int rv)
+{
+	if (rv < 0 || db_exec(db, "release paste") < 0) {
+		/* Keep the original error. */
+		sqlite3_exec(db->handle, "rollback to paste", NULL, NULL, NULL);
+		sqlite3_exec(db->handle, "release paste", NULL, NULL, NULL);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+depth(sqlite3_stmt *stmt, void *data)
+{
+	*(int *)data = sqlite3_column_int(stmt, 0);
+}
+
+struct dependents {
+	char **ids;
+	size_t *lengths;
+	size_t n;
+};
+
+static int
+dependents_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct dependents *deps = data;
+
+	(void)row;
+
+	deps->ids = ereallocarray(deps->ids, deps->n + 1, sizeof (*deps->ids));
+	deps->lengths = ereallocarray(deps->lengths, deps->n + 1, sizeof (*deps->lengths));
+	deps->ids[deps->n] = estrdup((const char *)sqlite3_column_text(stmt, 0));
+	deps->lengths[deps->n++] = sqlite3_column_int64(stmt, 1);
+
+	return 0;
+}
+
+/*
+ * Store a paste kept as a delta whole again, its parent is about to be
+ * removed.
+ */
+static int
+rebase(const char *id, size_t length, struct db *db)
+{
+	unsigned char *data, *blocks = NULL;
+	char *text;
+	size_t datasz, blockssz = 0;
+	int rv;
+
+	if (!(text = resolve(id, length, db, 0))) {
+		snprintf(db->error, sizeof (db->error), "unable to rebuild paste '%s'", id);
+		return -1;
+	}
+
+	if ((data = codec_compress(text, length, &datasz, &blocks, &blockssz)))
+		rv = content(id, CODEC_GZIP, data, datasz, length, db);
+	else if ((rv = db_execf(db, (const char *)sql_paste_set_code, "ss", id, text)) == 0)
+		rv = db_execf(db, (const char *)sql_paste_content_delete, "s", id);
+
+	if (rv == 0)
+		rv = lines(id, text, length, blocks, blockssz, db);
+
+	cache_evict(id);
+	free(blocks);
+	free(data);
+	free(text);
+
+	return rv;
+}
+
+/*
+ * Rebase the pastes depending on the given one or on the ones expired.
+ */
+static int
+rebase_all(const char *parent, time_t now, struct db *db)
+{
+	struct dependents deps = {0};
+	int rv;
+
+	rv = db_iterate(db, dependents_row, &deps,
+	    (const char *)sql_paste_dependents, "st", parent, now);
+
+	for (size_t i = 0; rv == 0 && i < deps.n; ++i) {
+		log_debug(TAG "rebasing paste '%s'", deps.ids[i]);
+		rv = rebase(deps.ids[i], deps.lengths[i], db);
+	}
+
+	for (size_t i = 0; i < deps.n; ++i)
+		free(deps.ids[i]);
+
+	free(deps.ids);
+	free(deps.lengths);
+
+	return rv;
+}
+
+struct expired {
+	char **ids;
+	size_t n;
+};
+
+static int
+expired_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct expired *ex = data;
+
+	(void)row;
+
+	ex->ids = ereallocarray(ex->ids, ex->n + 1, sizeof (*ex->ids));
+	ex->ids[ex->n++] = estrdup((const char *)sqlite3_column_text(stmt, 0));
+
+	return 0;
+}
+
+/*
+ * Expired pastes are deleted one by one, the most recent first, so that a
+ * fork still finds its parent code when it leaves the search index.
+ */
+static int
+expire(time_t now, struct db *db)
+{
+	struct expired ex = {0};
+	int rv;
+
+	rv = db_iterate(db, expired_row, &ex, (const char *)sql_paste_expired, "t", now);
+
+	for (size_t i = 0; rv == 0 && i < ex.n; ++i) {
+		cache_evict(ex.ids[i]);
+		rv = db_execf(db, (const char *)sql_paste_delete, "s", ex.ids[i]);
+	}
+
+	for (size_t i = 0; i < ex.n; ++i)
+		free(ex.ids[i]);
+
+	free(ex.ids);
+
+	return rv;
+}
+
+struct saved {
+	struct db *db;
+	char *text;
+	size_t textsz;
+	int found;
+};
+
+static int
+saved_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct saved *sv = data;
+	const char *code;
+
+	(void)row;
+
+	sv->found = 1;
+
+	if (!sqlite3_column_text(stmt, 2)) {
+		/* Text must be fetched before its length. */
+		code = (const char *)sqlite3_column_text(stmt, 1);
+		sv->textsz = sqlite3_column_bytes(stmt, 1);
+		sv->text = ememdup(code ? code : "", sv->textsz + 1);
+	} else {
+		sv->textsz = sqlite3_column_int64(stmt, 3);
+		sv->text = resolve((const char *)sqlite3_column_text(stmt, 0),
+		    sv->textsz, sv->db, 0);
+	}
+
+	return 0;
+}
+
+/*
+ * SQL function paste_code(id) returning the code of a paste as saved,
+ * without the chunks appended since.
+ */
+static void
+code_fn(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+	struct saved sv = {
+		.db = sqlite3_user_data(ctx)
+	};
+	const char *id;
+
+	(void)argc;
+
+	if (!(id = (const char *)sqlite3_value_text(argv[0])))
+		return;
+
+	if (db_iterate(sv.db, saved_row, &sv, (const char *)sql_paste_span, "s", id) < 0)
+		sqlite3_result_error(ctx, sv.db->error, -1);
+	else if (sv.found && !sv.text)
+		sqlite3_result_error(ctx, "unable to rebuild paste", -1);
+	else if (sv.found)
+		sqlite3_result_text(ctx, sv.text, sv.textsz, free);
+}
+
+int
+db_paste_save(struct paste *paste, struct db *db)
+{
+	assert(paste);
+	assert(db);
+
+	unsigned char *data, *blocks = NULL;
+	size_t datasz, blockssz = 0;
+	int rv;
+
+	data = codec_compress(paste->code, strlen(paste->code), &datasz,
+	    &blocks, &blockssz);
+
+	if (db_exec(db, "savepoint paste") < 0)
+		rv = -1;
+	else
+		rv = end(db, save(paste, data ? CODEC_GZIP : NULL, data, datasz,
+		    blocks, blockssz, db));
+
+	free(blocks);
+	free(data);
+
+	return rv;
+}
+
+int
+db_paste_fork(struct paste *paste, const char *parent, struct db *db)
+{
+	assert(paste);
+	assert(parent);
+	assert(db);
+
+	struct db_select select = {
+		.datasz = 1,
+		.elemsz = sizeof (int),
+		.get = depth
+	};
+	unsigned char *delta = NULL, *data, *blocks = NULL;
+	const unsigned char *stored;
+	const char *codec = NULL;
+	char *base;
+	size_t basesz, deltasz, datasz, storedsz = 0, length, blockssz = 0;
+	int chain = DELTA_DEPTH, rv;
+
+	/* The parent may have expired in the meantime. */
+	if (!(base = whole(parent, &basesz, db, 0)))
+		return db_paste_save(paste, db);
+
+	select.data = &chain;
+
+	if (db_select(db, &select, (const char *)sql_paste_depth, "s", parent) < 0) {
+		free(base);
+		return -1;
+	}
+
+	length = strlen(paste->code);
+
+	if (length >= CODEC_MIN && chain < DELTA_DEPTH)
+		delta = delta_encode(base, basesz, paste->code, length, &deltasz);
+	if ((stored = data = codec_compress(paste->code, length, &datasz,
+	    &blocks, &blockssz))) {
+		codec = CODEC_GZIP;
+		storedsz = datasz;
+	}
+
+	/* Only worth it when it takes at most half of the whole code. */
+	if (delta && deltasz * 2 <= (data ? datasz : length)) {
+		codec = DELTA;
+		stored = delta;
+		storedsz = deltasz;
+		free(blocks);
+		blocks = NULL;
+		blockssz = 0;
+	}
+
+	free(base);
+
+	if (db_exec(db, "savepoint paste") < 0)
+		rv = -1;
+	else
+		rv = end(db, db_execf(db, (const char *)sql_paste_fork, "ssz",
+		    paste->id, parent, basesz) < 0 ||
+		    save(paste, codec, stored, storedsz, blocks, blockssz, db) < 0 ? -1 : 0);
+
+	free(blocks);
+	free(delta);
+	free(data);
+
+	return rv;
+}
+
+struct compress {
+	const char *id;
+	struct db *db;
+};
+
+static int
+compress_row(sqlite3_stmt *stmt, size_t row, void *data)
+{
+	struct compress *cp = data;
+	const char *code;
+	unsigned char *out, *blocks = NULL;
+	size_t length, outsz, blockssz = 0;
+	int rv;
+
+	(void)row;
+
+	/* Text must be fetched before its length. */
+	if (!(code = (const char *)sqlite3_column_text(stmt, 0)))
+		return 0;
+
+	length = sqlite3_column_bytes(stmt, 0);
+	out = codec_compress(code, length, &outsz, &blocks, &blockssz);
+	rv = lines(cp->id, code, length, blocks, blockssz, cp->db) < 0 ||
+	    summarize(cp->id, code, length, cp->db) < 0 ? -1 : 0;
+
+	if (rv == 0 && out)
+		rv = content(cp->id, CODEC_GZIP, out, outsz, length, cp->db) < 0 ||
+		    db_execf(cp->db, (const char *)sql_paste_set_code, "ss", cp->id, "") < 0 ? -1 : 0;
+
+	free(blocks);
+	free(out);
+
+	return rv;
+}
+
+int
+db_paste_compress(const char *id, struct db *db)
+{
+	assert(id);
+	assert(db);
+
+	struct compress cp = {
+		.id = id,
+		.db = db
+	};
+
+	if (db_exec(db, "savepoint paste") < 0)
+		return -1;
+
+	return end(db, db_iterate(db, compress_row, &cp,
+	    (const char *)sql_paste_code, "s", id));
+}
+
+int
+db_paste_register(struct db *db)
+{
+	assert(db);
+
+	if (sqlite3_create_function(db->handle, "paste_code", 1, SQLITE_UTF8, db,
+	    code_fn, NULL, NULL) != SQLITE_OK)
+		return db_set_error(db);
+
+	return 0;
+}
+
+int
+db_paste_set_token(const char *id, const char *token, struct db *db)
+{
+	assert(id);
+	assert(token);
+	assert(db);
+
+	return db_execf(db, (const char *)sql_paste_token, "ss", id, token);
+}
+
+int
+db_paste_append(const char *id, const char *token, const char *data, struct db *db)
+{
+	assert(id);
+	assert(token);
+	assert(data);
+	assert(db);
+
+	struct grow gr = {
+		.id = id,
+		.data = data,
+		.datasz = strlen(data),
+		.db = db
+	};
+	int rv;
+
+	if (db_exec(db, "savepoint paste") < 0)
+		return -1;
+	if (db_execf(db, (const char *)sql_paste_append, "sss", id, data, token) < 0)
+		return end(db, -1);
+
+	/* Nothing inserted if the token does not match. */
+	if ((rv = sqlite3_changes(db->handle) == 1) && gr.datasz)
+		rv = db_iterate(db, grow_row, &gr,
+		    (const char *)sql_paste_summary_get, "s", id) < 0 ? -1 : 1;
+
+	return end(db, rv) < 0 ? -1 : rv;
 }
 
 int
@@ -74,6 +1230,77 @@ db_paste_get(struct paste *paste, const char *id, struct db *db)
 	assert(id);
 	assert(db);
 
+	struct one one = {
+		.paste = paste,
+		.db = db
+	};
+
+	if (db_iterate(db, one_row, &one, (const char *)sql_paste_get, "s", id) < 0)
+		return -1;
+
+	return one.found;
+}
+
+int
+db_paste_raw(const char *id,
+             const char *codec,
+             db_paste_raw_fn fn,
+             void *data,
+             struct db *db)
+{
+	assert(id);
+	assert(fn);
+	assert(db);
+
+	struct raw raw = {
+		.codec = codec,
+		.fn = fn,
+		.data = data,
+		.db = db
+	};
+
+	if (db_iterate(db, raw_row, &raw, (const char *)sql_paste_raw, "s", id) < 0)
+		return -1;
+
+	return raw.found;
+}
+
+int
+db_paste_lines(const char *id, struct db_paste_lines *lines, struct db *db)
+{
+	assert(id);
+	assert(lines);
+	assert(lines->count);
+	assert(db);
+
+	struct span sp = {
+		.lines = lines,
+		.db = db
+	};
+	int rv;
+
+	lines->more = 0;
+	sp.fp = eopen_memstream(&lines->text, &lines->textsz);
+	rv = db_iterate(db, span_row, &sp, (const char *)sql_paste_span, "s", id);
+	fclose(sp.fp);
+
+	if (rv < 0 || !sp.found) {
+		free(lines->text);
+		lines->text = NULL;
+		lines->textsz = 0;
+		return rv < 0 ? -1 : 0;
+	}
+
+	return 1;
+}
+
+int
+db_paste_stat(struct paste *paste, const char *id, struct db *db)
+{
+	assert(paste);
+	assert(id);
+	assert(db);
+
 	struct db_select select = {
 		.data = paste,
 		.datasz = 1,
@@ -81,23 +1308,77 @@ db_paste_get(struct paste *paste, const char *id, struct db *db)
 		.get = get
 	};
 
-	return db_select(db, &select, (const char *)sql_paste_get, "s", id);
+	return db_select(db, &select, (const char *)sql_paste_stat, "s", id);
+}
+
+int
+db_paste_search(const char *terms,
+                size_t limit,
+                db_paste_search_fn fn,
+                void *data,
+                struct db *db)
+{
+	assert(terms);
+	assert(fn);
+	assert(db);
+
+	struct search search = {
+		.fn = fn,
+		.data = data
+	};
+	char *query;
+	int rv = 0;
+
+	if (*(query = match(terms)))
+		rv = db_iterate(db, search_row, &search, (const char *)sql_paste_search,
+		    "stz", query, time(NULL), limit);
+
+	free(query);
+
+	return rv;
 }
 
-ssize_t
-db_paste_recents(struct paste *pastes, size_t pastesz, struct db *db)
+int
+db_paste_list(const char *ids, int code, db_paste_fn fn, void *data, struct db *db)
 {
-	assert(pastes);
+	assert(ids);
+	assert(fn);
 	assert(db);
 
-	struct db_select select = {
-		.data = pastes,
-		.datasz = pastesz,
-		.elemsz = sizeof (*pastes),
-		.get = get
+	struct list list = {
+		.fn = fn,
+		.data = data,
+		.db = db
 	};
 
-	return db_select(db, &select, (const char *)sql_paste_recents, "z", pastesz);
+	return db_iterate(db, list_row, &list, (const char *)sql_paste_list, "ds",
+	    code, ids);
+}
+
+int
+db_paste_recents(time_t start,
+                 const char *id,
+                 size_t limit,
+                 db_paste_fn fn,
+                 void *data,
+                 struct db *db)
+{
+	assert(fn);
+	assert(db);
+
+	struct list list = {
+		.fn = fn,
+		.data = data,
+		.db = db
+	};
+
+	/* The first page starts before any possible item. */
+	if (!id || !*id)
+		return db_iterate(db, list_row, &list, (const char *)sql_paste_recents,
+		    "jsz", INTMAX_MAX, "", limit);
+
+	return db_iterate(db, list_row, &list, (const char *)sql_paste_recents,
+	    "tsz", start, id, limit);
 }
 
 int
@@ -106,7 +1387,18 @@ db_paste_delete(struct paste *paste, struct db *db)
 	assert(paste);
 	assert(db);
 
-	return db_execf(db, (const char *)sql_paste_delete, "s", paste->id);
+	int rv;
+
+	if (db_exec(db, "savepoint paste") < 0)
+		return -1;
+
+	rv = end(db, rebase_all(paste->id, 0, db) < 0 ||
+	    db_execf(db, (const char *)sql_paste_delete, "s", paste->id) < 0 ? -1 : 0);
+
+	/* Rebasing the forks cached it again. */
+	cache_evict(paste->id);
+
+	return rv;
 }
 
 int
@@ -114,5 +1406,11 @@ db_paste_prune(struct db *db)
 {
 	assert(db);
 
-	return db_execf(db, (const char *)sql_paste_prune, "t", time(NULL));
+	time_t now = time(NULL);
+
+	if (db_exec(db, "savepoint paste") < 0)
+		return -1;
+
+	return end(db, rebase_all(NULL, now, db) < 0 ||
+	    expire(now, db) < 0 ? -1 : 0);
 }
@@ -29,10 +29,120 @@
 struct db;
 struct paste;
 
+/**
+ * \struct db_paste_lines
+ * \brief Range of lines of a paste.
+ */
+struct db_paste_lines {
+	/**
+	 * (read-write)
+	 *
+	 * First line wanted, starting from 0.
+	 */
+	size_t first;
+
+	/**
+	 * (read-write)
+	 *
+	 * Number of lines wanted.
+	 */
+	size_t count;
+
+	/**
+	 * (read-only)
+	 *
+	 * Lines found with their newlines, to be freed.
+	 */
+	char *text;
+
+	/**
+	 * (read-only)
+	 *
+	 * Length of text.
+	 */
+	size_t textsz;
+
+	/**
+	 * (read-only)
+	 *
+	 * Non-zero if more lines follow the ones found.
+	 */
+	int more;
+};
+
+/**
+ * Callback function for ::db_paste_list.
+ *
+ * The paste fields are borrowed from the database and only valid during the
+ * call, the code is NULL if it was not requested.
+ *
+ * \param paste the paste
+ * \param data optional user data
+ * \return 0 on success or -1 to stop
+ */
+typedef int (*db_paste_fn)(const struct paste *paste, void *data);
+
+/**
+ * \def DB_PASTE_MARK_OPEN
+ * Character starting a match in a search snippet.
+ */
+#define DB_PASTE_MARK_OPEN '\002'
+
+/**
+ * \def DB_PASTE_MARK_CLOSE
+ * Character ending a match in a search snippet.
+ */
+#define DB_PASTE_MARK_CLOSE '\003'
+
+/**
+ * Callback function for ::db_paste_search.
+ *
+ * The paste comes without its code, its fields and the snippet are borrowed
+ * from the database and only valid during the call.
+ *
+ * \param paste the paste
+ * \param snippet the text around the best match, each match between the
+ * ::DB_PASTE_MARK_OPEN and ::DB_PASTE_MARK_CLOSE characters
+ * \param data optional user data
+ * \return 0 on success or -1 to stop
+ */
+typedef int (*db_paste_search_fn)(const struct paste *paste,
+                                  const char *snippet,
+                                  void *data);
+
+/**
+ * Callback function for ::db_paste_raw.
+ *
+ * The code is only valid during the call.
+ *
+ * \param codec the codec the code is compressed with or NULL if not
+ * \param code the paste code
+ * \param codesz the code length in bytes
+ * \param length the original code length in bytes
+ * \param data optional user data
+ */
+typedef void (*db_paste_raw_fn)(const char *codec,
+                                const void *code,
+                                size_t codesz,
+                                size_t length,
+                                void *data);
+
+/**
+ * Register the SQL functions the pastes schema needs, must be called on every
+ * connection writing or searching pastes.
+ *
+ * \pre db != NULL
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_paste_register(struct db *db);
+
 /**
  * Save a paste into the database.
  *
- * Field id must be set prior to insertion.
+ * Field id must be set prior to insertion. The code is stored compressed
+ * when it shrinks, its size, lines and preview are computed once here.
  *
  * \pre paste != NULL
  * \pre db != NULL
@@ -43,6 +153,68 @@ struct paste;
 int
 db_paste_save(struct paste *paste, struct db *db);
 
+/**
+ * Save a paste forked from another one.
+ *
+ * The parent is recorded and the code is stored as a delta of the parent
+ * code when it is much smaller than the whole code. The paste is saved
+ * like ::db_paste_save if the parent does not exist anymore.
+ *
+ * \pre paste != NULL
+ * \pre parent != NULL
+ * \pre db != NULL
+ * \param paste the paste
+ * \param parent the parent paste identifier
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_paste_fork(struct paste *paste, const char *parent, struct db *db);
+
+/**
+ * Compress the code of a paste inserted by other means than
+ * ::db_paste_save.
+ *
+ * \pre id != NULL
+ * \pre db != NULL
+ * \param id the paste identifier
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_paste_compress(const char *id, struct db *db);
+
+/**
+ * Set the secret token allowing to append to a paste.
+ *
+ * \pre id != NULL
+ * \pre token != NULL
+ * \pre db != NULL
+ * \param id the paste identifier
+ * \param token the token
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_paste_set_token(const char *id, const char *token, struct db *db);
+
+/**
+ * Append data to a paste, stored as a new chunk so that the paste row is
+ * never rewritten. The paste size, lines and preview are updated too.
+ *
+ * \pre id != NULL
+ * \pre token != NULL
+ * \pre data != NULL
+ * \pre db != NULL
+ * \param id the paste identifier
+ * \param token the paste token
+ * \param data the data to append
+ * \param db the database
+ * \return 1 if appended, 0 if the paste or the token is unknown or -1 on error
+ */
+int
+db_paste_append(const char *id, const char *token, const char *data, struct db *db);
+
 /**
  * Get a unique paste from database.
  *
@@ -58,22 +230,135 @@ int
 db_paste_get(struct paste *paste, const char *id, struct db *db);
 
 /**
- * Get a list of most recent pastes.
+ * Get only the code of a paste.
+ *
+ * If the paste is stored compressed with the codec given and nothing was
+ * appended since, the compressed code is passed as is without copy.
+ * Otherwise the code is decompressed.
+ *
+ * \pre id != NULL
+ * \pre fn != NULL
+ * \pre db != NULL
+ * \param id the paste identifier
+ * \param codec the codec accepted by the caller (may be NULL)
+ * \param fn the function called with the code if found
+ * \param data the function user data
+ * \param db the database
+ * \return 1 if found, 0 if not found or -1 on error
+ */
+int
+db_paste_raw(const char *id,
+             const char *codec,
+             db_paste_raw_fn fn,
+             void *data,
+             struct db *db);
+
+/**
+ * Get a range of lines of a paste.
+ *
+ * The line index stored with the paste is used to only read the part of
+ * the code holding the lines, a compressed code is only decompressed from
+ * the closest block.
+ *
+ * \pre id != NULL
+ * \pre lines != NULL
+ * \pre lines->count > 0
+ * \pre db != NULL
+ * \param id the paste identifier
+ * \param lines the range wanted and the lines to set
+ * \param db the database
+ * \return 1 if found, 0 if not found or -1 on error
+ */
+int
+db_paste_lines(const char *id, struct db_paste_lines *lines, struct db *db);
+
+/**
+ * Get a unique paste from database without its code.
+ *
+ * The code is left empty, use ::db_paste_lines or ::db_paste_raw to read it.
+ *
+ * \pre paste != NULL
+ * \pre id != NULL
+ * \pre db != NULL
+ * \param paste the paste
+ * \param id the paste identifier
+ * \param db the database
+ * \return 1 if found, 0 if not found or -1 on error
+ */
+int
+db_paste_stat(struct paste *paste, const char *id, struct db *db);
+
+/**
+ * Iterate over the pastes matching a list of identifiers with one query,
+ * in the order of the list. Unknown identifiers are ignored.
+ *
+ * \pre ids != NULL
+ * \pre fn != NULL
+ * \pre db != NULL
+ * \param ids the identifiers as a JSON array of strings
+ * \param code non-zero to fetch the code too
+ * \param fn the function to call for each paste
+ * \param data the function user data
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_paste_list(const char *ids, int code, db_paste_fn fn, void *data, struct db *db);
+
+/**
+ * Search the visible pastes by their title, author, filename and code as
+ * saved, best matches first.
+ *
+ * Every word must match, a word ending with a star matches as a prefix.
+ *
+ * \pre terms != NULL
+ * \pre fn != NULL
+ * \pre db != NULL
+ * \param terms the words to search
+ * \param limit the maximum number of pastes
+ * \param fn the function to call for each paste
+ * \param data the function user data
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_paste_search(const char *terms,
+                size_t limit,
+                db_paste_search_fn fn,
+                void *data,
+                struct db *db);
+
+/**
+ * Iterate over the most recent visible pastes without their code, from the
+ * newest or from the one created right before the given paste.
  *
- * \pre pastes != NULL
+ * The order is the creation date then the identifier, both descending, so
+ * that any page costs the same whatever the number of pastes before it.
+ *
+ * \pre fn != NULL
  * \pre db != NULL
- * \param pastes array of pastes to fill
- * \param pastesz number of pastes to load at most
+ * \param start the creation date of the paste to start after
+ * \param id the identifier of the paste to start after, NULL or empty to
+ * start from the newest
+ * \param limit the number of pastes to load at most
+ * \param fn the function to call for each paste
+ * \param data the function user data
  * \param db the database
- * \return the number of pastes loaded or -1 on error
+ * \return 0 on success or -1 on error
  */
-ssize_t
-db_paste_recents(struct paste *pastes, size_t pastesz, struct db *db);
+int
+db_paste_recents(time_t start,
+                 const char *id,
+                 size_t limit,
+                 db_paste_fn fn,
+                 void *data,
+                 struct db *db);
 
 /**
  * Delete the specified paste from database.
  *
- * The paste isn't cleaned up, ::paste_finish must still be called.
+ * Forks stored as a delta of the paste are stored whole first. The paste
+ * isn't cleaned up, ::paste_finish must still be called.
  *
  * \pre img != NULL
  * \pre db != NULL
@@ -87,6 +372,9 @@ db_paste_delete(struct paste *paste, struct db *db);
 /**
  * Delete outdated pastes from database.
  *
+ * Forks still alive stored as a delta of an outdated paste are stored
+ * whole first, the pastes are then deleted from the most recent.
+ *
  * \pre db != NULL
  * \param db the database
  * \return 0 on success or -1 on error
@@ -0,0 +1,120 @@
+/*
+ * db-thumb.c -- storage helpers for image thumbnails
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+
+#include "db-thumb.h"
+#include "db.h"
+#include "thumb.h"
+#include "util.h"
+
+#include "sql/thumb-get.h"
+#include "sql/thumb-pending.h"
+#include "sql/thumb-save.h"
+
+static void
+get(sqlite3_stmt *stmt, void *data)
+{
+	struct thumb *thumb = data;
+	const char *mime;
+	const void *blob;
+
+	/* Both are NULL when the original image is used instead. */
+	if ((mime = (const char *)sqlite3_column_text(stmt, 0)))
+		thumb->mime = estrdup(mime);
+	if ((blob = sqlite3_column_blob(stmt, 1))) {
+		thumb->datasz = sqlite3_column_bytes(stmt, 1);
+		thumb->data = ememdup(blob, thumb->datasz);
+	}
+}
+
+static void
+pending(sqlite3_stmt *stmt, void *data)
+{
+	char **id = data;
+
+	*id = estrdup((const char *)sqlite3_column_text(stmt, 0));
+}
+
+int
+db_thumb_get(struct thumb *thumb, const char *id, struct db *db)
+{
+	assert(thumb);
+	assert(id);
+	assert(db);
+
+	struct db_select select = {
+		.data = thumb,
+		.datasz = 1,
+		.elemsz = sizeof (*thumb),
+		.get = get
+	};
+
+	thumb->mime = NULL;
+	thumb->data = NULL;
+	thumb->datasz = 0;
+
+	return db_select(db, &select, (const char *)sql_thumb_get, "su",
+	    id, thumb->size);
+}
+
+ssize_t
+db_thumb_pending(char **ids, size_t idsz, struct db *db)
+{
+	assert(ids);
+	assert(db);
+
+	struct db_select select = {
+		.data = ids,
+		.datasz = idsz,
+		.elemsz = sizeof (*ids),
+		.get = pending
+	};
+
+	return db_select(db, &select, (const char *)sql_thumb_pending, "z", idsz);
+}
+
+int
+db_thumb_save(const char *id, const struct thumb *thumbs, size_t thumbsz, struct db *db)
+{
+	assert(id);
+	assert(thumbs);
+	assert(db);
+
+	const struct thumb *th;
+
+	if (db_exec(db, "begin") < 0)
+		return -1;
+
+	for (size_t i = 0; i < thumbsz; ++i) {
+		th = &thumbs[i];
+
+		if (db_execf(db, (const char *)sql_thumb_save, "susbs", id,
+		    th->size, th->mime, th->data, th->datasz, id) < 0) {
+			sqlite3_exec(db->handle, "rollback", NULL, NULL, NULL);
+			return -1;
+		}
+	}
+
+	if (db_exec(db, "commit") < 0) {
+		sqlite3_exec(db->handle, "rollback", NULL, NULL, NULL);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * db-thumb.h -- storage helpers for image thumbnails
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_DB_THUMB_H
+#define TMPUPD_DB_THUMB_H
+
+/**
+ * \file db-thumb.h
+ * \brief Storage helpers for image thumbnails.
+ *
+ * Thumbnails are removed along with their image.
+ */
+
+#include <sys/types.h>
+
+#include "db.h"
+
+struct thumb;
+
+/**
+ * Get the thumbnail of an image for the size set in the thumb argument.
+ *
+ * \pre thumb != NULL
+ * \pre id != NULL
+ * \pre db != NULL
+ * \param thumb the thumbnail
+ * \param id the image identifier
+ * \param db the database
+ * \return 1 if found, 0 if not generated yet or -1 on error
+ */
+int
+db_thumb_get(struct thumb *thumb, const char *id, struct db *db);
+
+/**
+ * Collect identifiers of images that have no thumbnails yet.
+ *
+ * Each identifier is dynamically allocated and must be freed.
+ *
+ * \pre ids != NULL
+ * \pre db != NULL
+ * \param ids the array of identifiers to fill
+ * \param idsz the maximum number of identifiers
+ * \param db the database
+ * \return the number of identifiers or -1 on error
+ */
+ssize_t
+db_thumb_pending(char **ids, size_t idsz, struct db *db);
+
+/**
+ * Save all thumbnails of an image at once, nothing is saved if the image has
+ * been removed meanwhile.
+ *
+ * \pre id != NULL
+ * \pre thumbs != NULL
+ * \pre db != NULL
+ * \param id the image identifier
+ * \param thumbs the thumbnails
+ * \param thumbsz the number of thumbnails
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_thumb_save(const char *id, const struct thumb *thumbs, size_t thumbsz, struct db *db);
+
+#endif /* !TMPUPD_DB_THUMB_H */
@@ -0,0 +1,188 @@
+/*
+ * db-upload.c -- storage helpers for upload sessions
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include "db-paste.h"
+#include "db-upload.h"
+#include "db.h"
+#include "upload.h"
+#include "util.h"
+
+#include "sql/upload-delete.h"
+#include "sql/upload-get.h"
+#include "sql/upload-image.h"
+#include "sql/upload-paste.h"
+#include "sql/upload-prune.h"
+#include "sql/upload-received.h"
+#include "sql/upload-save.h"
+
+static void
+get(sqlite3_stmt *stmt, void *data)
+{
+	struct upload *upload = data;
+
+	upload->row = sqlite3_column_int64(stmt, 0);
+	upload->id = estrdup((const char *)sqlite3_column_text(stmt, 1));
+	upload->type = estrdup((const char *)sqlite3_column_text(stmt, 2));
+	upload->title = estrdup((const char *)sqlite3_column_text(stmt, 3));
+	upload->author = estrdup((const char *)sqlite3_column_text(stmt, 4));
+	upload->filename = estrdup((const char *)sqlite3_column_text(stmt, 5));
+	upload->language = estrdup((const char *)sqlite3_column_text(stmt, 6));
+	upload->size = (size_t)sqlite3_column_int64(stmt, 7);
+	upload->received = (size_t)sqlite3_column_int64(stmt, 8);
+	upload->start = (time_t)sqlite3_column_int64(stmt, 9);
+	upload->end = (time_t)sqlite3_column_int64(stmt, 10);
+	upload->expires = (time_t)sqlite3_column_int64(stmt, 11);
+	upload->visible = sqlite3_column_int(stmt, 12);
+}
+
+int
+db_upload_save(struct upload *upload, struct db *db)
+{
+	assert(upload);
+	assert(db);
+
+	intmax_t row;
+
+	row = db_insert(db, (const char *)sql_upload_save, "ssssssjjtttd",
+		upload->id,
+		upload->type,
+		upload->title,
+		upload->author,
+		upload->filename,
+		upload->language,
+		(intmax_t)upload->size,
+		(intmax_t)upload->size,
+		upload->start,
+		upload->end,
+		upload->expires,
+		upload->visible
+	);
+
+	if (row < 0)
+		return -1;
+
+	upload->row = row;
+
+	return 0;
+}
+
+int
+db_upload_get(struct upload *upload, const char *id, struct db *db)
+{
+	assert(upload);
+	assert(id);
+	assert(db);
+
+	struct db_select select = {
+		.data = upload,
+		.datasz = 1,
+		.elemsz = sizeof (*upload),
+		.get = get
+	};
+
+	return db_select(db, &select, (const char *)sql_upload_get, "st", id, time(NULL));
+}
+
+int
+db_upload_write(struct upload *upload, db_read_fn read, void *data, struct db *db)
+{
+	assert(upload);
+	assert(read);
+	assert(db);
+
+	char error[DB_ERR_MAX];
+	size_t written;
+	int rv;
+
+	rv = db_blob_put(db, "upload", "data", upload->row, upload->received,
+	    read, data, &written);
+
+	if (written == 0)
+		return rv;
+
+	/* Keep the first error, the progress is recorded anyway. */
+	memcpy(error, db->error, sizeof (error));
+	upload->received += written;
+
+	if (db_execf(db, (const char *)sql_upload_received, "js",
+	    (intmax_t)upload->received, upload->id) < 0)
+		return -1;
+	if (rv < 0)
+		memcpy(db->error, error, sizeof (error));
+
+	return rv;
+}
+
+int
+db_upload_read(const struct upload *upload,
+               size_t offset,
+               size_t length,
+               db_write_fn write,
+               void *data,
+               struct db *db)
+{
+	assert(upload);
+	assert(write);
+	assert(db);
+
+	return db_blob_read(db, "upload", "data", upload->row, offset, length,
+	    write, data);
+}
+
+int
+db_upload_commit(const struct upload *upload, const char *id, struct db *db)
+{
+	assert(upload);
+	assert(id);
+	assert(db);
+
+	const char *sql;
+	int paste;
+
+	if ((paste = strcmp(upload->type, "image") != 0))
+		sql = (const char *)sql_upload_paste;
+	else
+		sql = (const char *)sql_upload_image;
+
+	if (db_exec(db, "begin") < 0)
+		return -1;
+	if (db_execf(db, sql, "ss", id, upload->id) < 0 ||
+	    (paste && db_paste_compress(id, db) < 0) ||
+	    db_execf(db, (const char *)sql_upload_delete, "s", upload->id) < 0) {
+		sqlite3_exec(db->handle, "rollback", NULL, NULL, NULL);
+		return -1;
+	}
+	if (db_exec(db, "commit") < 0) {
+		sqlite3_exec(db->handle, "rollback", NULL, NULL, NULL);
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+db_upload_prune(struct db *db)
+{
+	assert(db);
+
+	return db_execf(db, (const char *)sql_upload_prune, "t", time(NULL));
+}
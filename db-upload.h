@@ -0,0 +1,123 @@
+/*
+ * db-upload.h -- storage helpers for upload sessions
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_DB_UPLOAD_H
+#define TMPUPD_DB_UPLOAD_H
+
+/**
+ * \file db-upload.h
+ * \brief Storage helpers for upload sessions.
+ */
+
+#include "db.h"
+
+struct upload;
+
+/**
+ * Save a new session with room for the announced content length, the upload
+ * row field is set on success.
+ *
+ * \pre upload != NULL
+ * \pre db != NULL
+ * \param upload the session
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_upload_save(struct upload *upload, struct db *db);
+
+/**
+ * Get an unexpired session from database.
+ *
+ * \pre upload != NULL
+ * \pre id != NULL
+ * \pre db != NULL
+ * \param upload the session
+ * \param id the session identifier
+ * \param db the database
+ * \return 1 if found, 0 if not found or -1 on error
+ */
+int
+db_upload_get(struct upload *upload, const char *id, struct db *db);
+
+/**
+ * Append data at the end of the received content and record the progress.
+ *
+ * The received field is updated with what has been stored even on error so
+ * that the client can resume from there.
+ *
+ * \pre upload != NULL
+ * \pre read != NULL
+ * \pre db != NULL
+ * \param upload the session
+ * \param read the function providing the data
+ * \param data the function user data
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_upload_write(struct upload *upload, db_read_fn read, void *data, struct db *db);
+
+/**
+ * Read a portion of the received content in chunks.
+ *
+ * \pre upload != NULL
+ * \pre write != NULL
+ * \pre db != NULL
+ * \param upload the session
+ * \param offset the first byte to read
+ * \param length the number of bytes to read
+ * \param write the function receiving the data
+ * \param data the function user data
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_upload_read(const struct upload *upload,
+               size_t offset,
+               size_t length,
+               db_write_fn write,
+               void *data,
+               struct db *db);
+
+/**
+ * Convert a complete session into its final paste or image and delete it,
+ * in a single transaction.
+ *
+ * \pre upload != NULL
+ * \pre id != NULL
+ * \pre db != NULL
+ * \param upload the session
+ * \param id the new item identifier
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_upload_commit(const struct upload *upload, const char *id, struct db *db);
+
+/**
+ * Delete expired sessions from database.
+ *
+ * \pre db != NULL
+ * \param db the database
+ * \return 0 on success or -1 on error
+ */
+int
+db_upload_prune(struct db *db);
+
+#endif /* !TMPUPD_DB_UPLOAD_H */
@@ -239,6 +239,163 @@ db_execf(struct db *db, const char *sql, const char *fmt, ...)
 	return ret;
 }
 
+int
+db_blob_write(struct db *db,
+              const char *table,
+              const char *column,
+              intmax_t row,
+              db_read_fn read,
+              void *data)
+{
+	assert(db);
+	assert(table);
+	assert(column);
+	assert(read);
+
+	sqlite3_blob *blob;
+	char buf[BUFSIZ * 8];
+	ssize_t nr = 0;
+	int offset = 0, size, ret = 0;
+
+	if (sqlite3_blob_open(db->handle, "main", table, column, row, 1, &blob) != SQLITE_OK)
+		return db_set_error(db);
+
+	size = sqlite3_blob_bytes(blob);
+
+	while (offset < size && (nr = read(data, buf, sizeof (buf))) > 0) {
+		if (nr > size - offset)
+			break;
+		if (sqlite3_blob_write(blob, buf, nr, offset) != SQLITE_OK) {
+			ret = db_set_error(db);
+			break;
+		}
+
+		offset += nr;
+	}
+
+	if (ret == 0 && nr < 0) {
+		snprintf(db->error, sizeof (db->error), "%s", strerror(errno));
+		ret = -1;
+	} else if (ret == 0 && offset != size) {
+		snprintf(db->error, sizeof (db->error), "blob length mismatch");
+		ret = -1;
+	}
+
+	sqlite3_blob_close(blob);
+
+	return ret;
+}
+
+int
+db_blob_put(struct db *db,
+            const char *table,
+            const char *column,
+            intmax_t row,
+            size_t offset,
+            db_read_fn read,
+            void *data,
+            size_t *written)
+{
+	assert(db);
+	assert(table);
+	assert(column);
+	assert(read);
+	assert(written);
+
+	sqlite3_blob *blob;
+	char buf[BUFSIZ * 8];
+	size_t size, len;
+	ssize_t nr;
+	int ret = 0;
+
+	*written = 0;
+
+	if (sqlite3_blob_open(db->handle, "main", table, column, row, 1, &blob) != SQLITE_OK)
+		return db_set_error(db);
+
+	size = sqlite3_blob_bytes(blob);
+
+	if (offset > size) {
+		snprintf(db->error, sizeof (db->error), "blob offset out of bounds");
+		ret = -1;
+	}
+
+	while (ret == 0) {
+		/* Ask for one byte at the end to detect extra data. */
+		if ((len = size - offset) > sizeof (buf))
+			len = sizeof (buf);
+		else if (len == 0)
+			len = 1;
+
+		if ((nr = read(data, buf, len)) == 0)
+			break;
+		if (nr < 0) {
+			snprintf(db->error, sizeof (db->error), "%s", strerror(errno));
+			ret = -1;
+		} else if ((size_t)nr > size - offset) {
+			snprintf(db->error, sizeof (db->error), "blob length exceeded");
+			ret = -1;
+		} else if (sqlite3_blob_write(blob, buf, nr, offset) != SQLITE_OK)
+			ret = db_set_error(db);
+		else {
+			offset += nr;
+			*written += nr;
+		}
+	}
+
+	sqlite3_blob_close(blob);
+
+	return ret;
+}
+
+int
+db_blob_read(struct db *db,
+             const char *table,
+             const char *column,
+             intmax_t row,
+             size_t offset,
+             size_t length,
+             db_write_fn write,
+             void *data)
+{
+	assert(db);
+	assert(table);
+	assert(column);
+	assert(write);
+
+	sqlite3_blob *blob;
+	char buf[BUFSIZ * 8];
+	size_t len;
+	int ret = 0;
+
+	if (sqlite3_blob_open(db->handle, "main", table, column, row, 0, &blob) != SQLITE_OK)
+		return db_set_error(db);
+
+	if (offset > (size_t)sqlite3_blob_bytes(blob) ||
+	    length > (size_t)sqlite3_blob_bytes(blob) - offset) {
+		snprintf(db->error, sizeof (db->error), "blob range out of bounds");
+		ret = -1;
+	}
+
+	while (ret == 0 && length) {
+		len = length < sizeof (buf) ? length : sizeof (buf);
+
+		if (sqlite3_blob_read(blob, buf, len, offset) != SQLITE_OK)
+			ret = db_set_error(db);
+		else if (write(data, buf, len) < 0) {
+			strcpy(db->error, "user function abort");
+			ret = -1;
+		}
+
+		offset += len;
+		length -= len;
+	}
+
+	sqlite3_blob_close(blob);
+
+	return ret;
+}
+
 int
 db_exec(struct db *db, const char *sql)
 {
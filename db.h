@@ -89,6 +89,26 @@ struct db {
  */
 typedef int (*db_iterate_fn)(sqlite3_stmt *stmt, size_t row, void *data);
 
+/**
+ * Callback function for db_blob_write().
+ *
+ * \param data optional user data
+ * \param buf the destination buffer
+ * \param bufsz the maximum number of bytes to read
+ * \return the number of bytes read, 0 at the end or -1 on error
+ */
+typedef ssize_t (*db_read_fn)(void *data, void *buf, size_t bufsz);
+
+/**
+ * Callback function for db_blob_read().
+ *
+ * \param data optional user data
+ * \param buf the data read
+ * \param bufsz the data length
+ * \return 0 on success or -1 to stop
+ */
+typedef int (*db_write_fn)(void *data, const void *buf, size_t bufsz);
+
 /**
  * \struct db_select
  * \brief Convenient interface for SELECT-like queries.
@@ -227,6 +247,92 @@ db_insert(struct db *db, const char *sql, const char *fmt, ...);
 int
 db_execf(struct db *db, const char *sql, const char *fmt, ...);
 
+/**
+ * Fill a blob previously allocated using zeroblob(N).
+ *
+ * The content is read in small chunks so that the blob never has to be held
+ * in memory, it is an error if the function does not provide exactly the
+ * blob length.
+ *
+ * \pre db != NULL
+ * \pre table != NULL
+ * \pre column != NULL
+ * \pre read != NULL
+ * \param db the database handle
+ * \param table the table name
+ * \param column the blob column
+ * \param row the rowid
+ * \param read the function providing the content
+ * \param data optional user data passed to read
+ * \return 0 on success or -1 on error
+ */
+int
+db_blob_write(struct db *db,
+              const char *table,
+              const char *column,
+              intmax_t row,
+              db_read_fn read,
+              void *data);
+
+/**
+ * Write into a blob from a given offset until the function provides no more
+ * data, it is an error if the data goes past the blob length.
+ *
+ * The number of bytes written is set even on error.
+ *
+ * \pre db != NULL
+ * \pre table != NULL
+ * \pre column != NULL
+ * \pre read != NULL
+ * \pre written != NULL
+ * \param db the database handle
+ * \param table the table name
+ * \param column the blob column
+ * \param row the rowid
+ * \param offset the first byte to write
+ * \param read the function providing the content
+ * \param data optional user data passed to read
+ * \param written the number of bytes written to set
+ * \return 0 on success or -1 on error
+ */
+int
+db_blob_put(struct db *db,
+            const char *table,
+            const char *column,
+            intmax_t row,
+            size_t offset,
+            db_read_fn read,
+            void *data,
+            size_t *written);
+
+/**
+ * Read a portion of a blob in small chunks so that it never has to be held
+ * in memory.
+ *
+ * \pre db != NULL
+ * \pre table != NULL
+ * \pre column != NULL
+ * \pre write != NULL
+ * \param db the database handle
+ * \param table the table name
+ * \param column the blob column
+ * \param row the rowid
+ * \param offset the first byte to read
+ * \param length the number of bytes to read
+ * \param write the function receiving the content
+ * \param data optional user data passed to write
+ * \return 0 on success or -1 on error
+ */
+int
+db_blob_read(struct db *db,
+             const char *table,
+             const char *column,
+             intmax_t row,
+             size_t offset,
+             size_t length,
+             db_write_fn write,
+             void *data);
+
 /**
  * Exec one or more statements as raw SQL.
  *
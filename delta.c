@@ -0,0 +1,289 @@
+/*
+ * delta.c -- line based deltas
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta.h"
+#include "util.h"
+
+/* Shorter matches are inserted, a copy operation would not be cheaper. */
+#define COPY_MIN 16
+
+/* Base lines tried for each line of the text. */
+#define CANDIDATES 32
+
+/*
+ * Text split in lines, line i spans offs[i] to offs[i + 1] and its hash is
+ * hashes[i].
+ */
+struct lines {
+	const char *text;
+	size_t *offs;
+	uint64_t *hashes;
+	size_t n;
+};
+
+/*
+ * Hash table of the base lines, heads is indexed by the hash and holds the
+ * line index plus one of a chain continued by next.
+ */
+struct index {
+	size_t *heads;
+	size_t *next;
+	size_t mask;
+};
+
+static uint64_t
+hash(const char *p, size_t n)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	while (n--) {
+		h ^= (unsigned char)*p++;
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
+static void
+split(struct lines *lines, const char *text, size_t textsz)
+{
+	const char *p, *end = text + textsz;
+	size_t n = 0;
+
+	for (p = text; p < end && (p = memchr(p, '\n', end - p)); ++p)
+		n++;
+	if (textsz && text[textsz - 1] != '\n')
+		n++;
+
+	lines->text = text;
+	lines->n = n;
+	lines->offs = ecalloc(n + 1, sizeof (*lines->offs));
+	lines->hashes = ecalloc(n + 1, sizeof (*lines->hashes));
+
+	for (size_t i = 0, off = 0; i < n; ++i) {
+		if ((p = memchr(text + off, '\n', textsz - off)))
+			lines->offs[i + 1] = p - text + 1;
+		else
+			lines->offs[i + 1] = textsz;
+
+		lines->hashes[i] = hash(text + off, lines->offs[i + 1] - off);
+		off = lines->offs[i + 1];
+	}
+}
+
+static void
+index_init(struct index *index, const struct lines *lines)
+{
+	size_t size = 1, bucket;
+
+	while (size < lines->n * 2)
+		size *= 2;
+
+	index->heads = ecalloc(size, sizeof (*index->heads));
+	index->next = ecalloc(lines->n + 1, sizeof (*index->next));
+	index->mask = size - 1;
+
+	/* Walk backwards so that chains start with the first occurrence. */
+	for (size_t i = lines->n; i--; ) {
+		bucket = lines->hashes[i] & index->mask;
+		index->next[i] = index->heads[bucket];
+		index->heads[bucket] = i + 1;
+	}
+}
+
+static inline int
+same(const struct lines *a, size_t i, const struct lines *b, size_t j)
+{
+	size_t len = a->offs[i + 1] - a->offs[i];
+
+	return a->hashes[i] == b->hashes[j] &&
+	    len == b->offs[j + 1] - b->offs[j] &&
+	    memcmp(a->text + a->offs[i], b->text + b->offs[j], len) == 0;
+}
+
+static void
+varint(FILE *fp, size_t value)
+{
+	while (value >= 0x80) {
+		putc((value & 0x7f) | 0x80, fp);
+		value >>= 7;
+	}
+
+	putc(value, fp);
+}
+
+static void
+insert(FILE *fp, const char *data, size_t datasz)
+{
+	if (datasz) {
+		varint(fp, datasz << 1);
+		fwrite(data, 1, datasz, fp);
+	}
+}
+
+static void
+copy(FILE *fp, size_t offset, size_t length)
+{
+	varint(fp, length << 1 | 1);
+	varint(fp, offset);
+}
+
+unsigned char *
+delta_encode(const char *base,
+             size_t basesz,
+             const char *text,
+             size_t textsz,
+             size_t *outsz)
+{
+	assert(base);
+	assert(text);
+	assert(outsz);
+
+	struct lines bl, tl;
+	struct index index;
+	char *out;
+	size_t pending = 0, best, bestoff = 0, bestn = 0, k, tries;
+	FILE *fp;
+
+	split(&bl, base, basesz);
+	split(&tl, text, textsz);
+	index_init(&index, &bl);
+	fp = eopen_memstream(&out, outsz);
+
+	for (size_t t = 0; t < tl.n; ) {
+		best = 0;
+		tries = 0;
+
+		/* Longest run of lines equal in both texts starting here. */
+		for (size_t c = index.heads[tl.hashes[t] & index.mask];
+		     c && tries < CANDIDATES; c = index.next[c - 1], ++tries) {
+			for (k = 0; c - 1 + k < bl.n && t + k < tl.n &&
+			    same(&bl, c - 1 + k, &tl, t + k); ++k)
+				continue;
+
+			if (k && bl.offs[c - 1 + k] - bl.offs[c - 1] > best) {
+				best = bl.offs[c - 1 + k] - bl.offs[c - 1];
+				bestoff = bl.offs[c - 1];
+				bestn = k;
+			}
+		}
+
+		if (best < COPY_MIN) {
+			t++;
+			continue;
+		}
+
+		insert(fp, text + pending, tl.offs[t] - pending);
+		copy(fp, bestoff, best);
+		t += bestn;
+		pending = tl.offs[t];
+	}
+
+	insert(fp, text + pending, textsz - pending);
+	fclose(fp);
+
+	free(index.heads);
+	free(index.next);
+	free(bl.offs);
+	free(bl.hashes);
+	free(tl.offs);
+	free(tl.hashes);
+
+	return (unsigned char *)out;
+}
+
+static int
+getvarint(const unsigned char **p, const unsigned char *end, size_t *value)
+{
+	*value = 0;
+
+	for (unsigned int shift = 0; *p < end && shift < 64; shift += 7) {
+		*value |= (size_t)(**p & 0x7f) << shift;
+
+		if (!(*(*p)++ & 0x80))
+			return 0;
+	}
+
+	return -1;
+}
+
+static int
+apply(char *out,
+      size_t length,
+      const unsigned char *p,
+      const unsigned char *end,
+      const char *base,
+      size_t basesz)
+{
+	size_t pos = 0, op, n, offset;
+
+	while (p < end) {
+		if (getvarint(&p, end, &op) < 0 || (n = op >> 1) > length - pos)
+			return -1;
+
+		if (op & 1) {
+			if (getvarint(&p, end, &offset) < 0 || offset > basesz ||
+			    n > basesz - offset)
+				return -1;
+
+			memcpy(out + pos, base + offset, n);
+		} else {
+			if (n > (size_t)(end - p))
+				return -1;
+
+			memcpy(out + pos, p, n);
+			p += n;
+		}
+
+		pos += n;
+	}
+
+	return pos == length ? 0 : -1;
+}
+
+char *
+delta_apply(const void *delta,
+            size_t deltasz,
+            const char *base,
+            size_t basesz,
+            size_t length)
+{
+	assert(delta);
+	assert(base);
+
+	char *out;
+
+	out = emalloc(length + 1, 1);
+
+	if (apply(out, length, delta, (const unsigned char *)delta + deltasz,
+	    base, basesz) < 0) {
+		free(out);
+		return NULL;
+	}
+
+	out[length] = '\0';
+
+	return out;
+}
@@ -0,0 +1,75 @@
+/*
+ * delta.h -- line based deltas
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef TMPUPD_DELTA_H
+#define TMPUPD_DELTA_H
+
+/**
+ * \file delta.h
+ * \brief Line based deltas.
+ *
+ * A delta rebuilds a text from a base text as a sequence of operations
+ * either copying a range of the base or inserting new bytes. Ranges are
+ * found by matching whole lines which suits pastes edited here and there.
+ */
+
+#include <stddef.h>
+
+/**
+ * Compute the delta producing a text from a base.
+ *
+ * \pre base != NULL
+ * \pre text != NULL
+ * \pre outsz != NULL
+ * \param base the base text
+ * \param basesz the base length
+ * \param text the text to produce
+ * \param textsz the text length
+ * \param outsz the delta length to set
+ * \return the dynamically allocated delta
+ */
+unsigned char *
+delta_encode(const char *base,
+             size_t basesz,
+             const char *text,
+             size_t textsz,
+             size_t *outsz);
+
+/**
+ * Rebuild a text from its base and delta.
+ *
+ * The returned text is NUL terminated.
+ *
+ * \pre delta != NULL
+ * \pre base != NULL
+ * \param delta the delta
+ * \param deltasz the delta length
+ * \param base the base text
+ * \param basesz the base length
+ * \param length the text length
+ * \return the dynamically allocated text or NULL if the delta is corrupted
+ */
+char *
+delta_apply(const void *delta,
+            size_t deltasz,
+            const char *base,
+            size_t basesz,
+            size_t length);
+
+#endif /* !TMPUPD_DELTA_H */
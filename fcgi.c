@@ -0,0 +1,167 @@
+/*
+ * fcgi.c -- FastCGI protocol
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "fcgi.h"
+
+#define FCGI_VERSION_1 1
+
+/*
+ * Lengths below 128 are encoded in one byte, otherwise in four bytes with
+ * the high bit set.
+ */
+static int
+length_decode(unsigned char **p, const unsigned char *end, size_t *len)
+{
+	unsigned char *s = *p;
+
+	if (s >= end)
+		return -1;
+
+	if (!(s[0] & 0x80)) {
+		*len = s[0];
+		*p = s + 1;
+	} else {
+		if (end - s < 4)
+			return -1;
+
+		*len = ((size_t)(s[0] & 0x7f) << 24) | (s[1] << 16) | (s[2] << 8) | s[3];
+		*p = s + 4;
+	}
+
+	return 0;
+}
+
+static size_t
+length_encode(unsigned char *p, size_t len)
+{
+	if (len < 0x80) {
+		p[0] = len;
+		return 1;
+	}
+
+	p[0] = (len >> 24) | 0x80;
+	p[1] = len >> 16;
+	p[2] = len >> 8;
+	p[3] = len;
+
+	return 4;
+}
+
+int
+fcgi_header_decode(struct fcgi_header *hdr, const unsigned char *data)
+{
+	assert(hdr);
+	assert(data);
+
+	if (data[0] != FCGI_VERSION_1)
+		return -1;
+
+	hdr->type = data[1];
+	hdr->id = (data[2] << 8) | data[3];
+	hdr->length = (data[4] << 8) | data[5];
+	hdr->padding = data[6];
+
+	return 0;
+}
+
+void
+fcgi_header_encode(unsigned char *data, enum fcgi_type type, uint16_t id, uint16_t length)
+{
+	assert(data);
+
+	data[0] = FCGI_VERSION_1;
+	data[1] = type;
+	data[2] = id >> 8;
+	data[3] = id;
+	data[4] = length >> 8;
+	data[5] = length;
+	data[6] = 0;
+	data[7] = 0;
+}
+
+void
+fcgi_end_encode(unsigned char *data, uint16_t id, enum fcgi_status status)
+{
+	assert(data);
+
+	fcgi_header_encode(data, FCGI_END_REQUEST, id, 8);
+
+	/* appStatus (4 bytes), protocolStatus, reserved (3 bytes). */
+	memset(data + FCGI_HEADER_LEN, 0, 8);
+	data[FCGI_HEADER_LEN + 4] = status;
+}
+
+int
+fcgi_pair_decode(char **p, char *end, char **name, char **value)
+{
+	assert(p && *p);
+	assert(end);
+	assert(name);
+	assert(value);
+
+	unsigned char *s = (unsigned char *)*p;
+	char *start = *p;
+	size_t namesz, valuesz;
+
+	if (*p >= end)
+		return 0;
+	if (length_decode(&s, (unsigned char *)end, &namesz) < 0 ||
+	    length_decode(&s, (unsigned char *)end, &valuesz) < 0)
+		return -1;
+	if ((size_t)(end - (char *)s) < namesz || (size_t)(end - (char *)s) - namesz < valuesz)
+		return -1;
+
+	/*
+	 * The prefix is at least two bytes long so moving both strings
+	 * backwards leaves enough room for their terminators.
+	 */
+	*name = start;
+	memmove(*name, s, namesz);
+	(*name)[namesz] = '\0';
+
+	*value = *name + namesz + 1;
+	memmove(*value, s + namesz, valuesz);
+	(*value)[valuesz] = '\0';
+
+	*p = (char *)s + namesz + valuesz;
+
+	return 1;
+}
+
+size_t
+fcgi_pair_encode(unsigned char *data, size_t datasz, const char *name, const char *value)
+{
+	assert(data);
+	assert(name);
+	assert(value);
+
+	size_t namesz = strlen(name), valuesz = strlen(value), len;
+
+	if (datasz < 8 + namesz + valuesz)
+		return 0;
+
+	len = length_encode(data, namesz);
+	len += length_encode(data + len, valuesz);
+	memcpy(data + len, name, namesz);
+	memcpy(data + len + namesz, value, valuesz);
+
+	return len + namesz + valuesz;
+}
@@ -0,0 +1,171 @@
+/*
+ * fcgi.h -- FastCGI protocol
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_FCGI_H
+#define TMPUPD_FCGI_H
+
+/**
+ * \file fcgi.h
+ * \brief FastCGI protocol.
+ *
+ * Record encoding and decoding as described in the FastCGI specification
+ * version 1.0, without any I/O.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \def FCGI_HEADER_LEN
+ * Length of a record header.
+ */
+#define FCGI_HEADER_LEN 8
+
+/**
+ * \def FCGI_CONTENT_MAX
+ * Maximum content length of a record.
+ */
+#define FCGI_CONTENT_MAX 65535
+
+/**
+ * \def FCGI_KEEP_CONN
+ * Flag in FCGI_BEGIN_REQUEST to keep the connection open.
+ */
+#define FCGI_KEEP_CONN 1
+
+/**
+ * \enum fcgi_type
+ * \brief Record types.
+ */
+enum fcgi_type {
+	FCGI_BEGIN_REQUEST = 1,         /*!< Start a request. */
+	FCGI_ABORT_REQUEST,             /*!< Abort a request. */
+	FCGI_END_REQUEST,               /*!< Request finished. */
+	FCGI_PARAMS,                    /*!< Request parameters stream. */
+	FCGI_STDIN,                     /*!< Request body stream. */
+	FCGI_STDOUT,                    /*!< Response stream. */
+	FCGI_STDERR,                    /*!< Error stream. */
+	FCGI_DATA,                      /*!< Filter data stream. */
+	FCGI_GET_VALUES,                /*!< Query application variables. */
+	FCGI_GET_VALUES_RESULT,         /*!< Reply to FCGI_GET_VALUES. */
+	FCGI_UNKNOWN_TYPE               /*!< Reply to unknown records. */
+};
+
+/**
+ * \enum fcgi_role
+ * \brief Application roles.
+ */
+enum fcgi_role {
+	FCGI_RESPONDER = 1,             /*!< Regular request. */
+	FCGI_AUTHORIZER,                /*!< Authorization. */
+	FCGI_FILTER                     /*!< Filter. */
+};
+
+/**
+ * \enum fcgi_status
+ * \brief Protocol status in FCGI_END_REQUEST.
+ */
+enum fcgi_status {
+	FCGI_REQUEST_COMPLETE,          /*!< Normal end of request. */
+	FCGI_CANT_MPX_CONN,             /*!< Multiplexing refused. */
+	FCGI_OVERLOADED,                /*!< Out of resources. */
+	FCGI_UNKNOWN_ROLE               /*!< Role not supported. */
+};
+
+/**
+ * \struct fcgi_header
+ * \brief Decoded record header.
+ */
+struct fcgi_header {
+	uint8_t type;                   /*!< Record type (::fcgi_type). */
+	uint16_t id;                    /*!< Request identifier. */
+	uint16_t length;                /*!< Content length. */
+	uint8_t padding;                /*!< Padding length. */
+};
+
+/**
+ * Decode a record header.
+ *
+ * \pre hdr != NULL
+ * \pre data != NULL
+ * \param hdr the header to fill
+ * \param data the FCGI_HEADER_LEN bytes to decode
+ * \return 0 on success or -1 if the version is not supported
+ */
+int
+fcgi_header_decode(struct fcgi_header *hdr, const unsigned char *data);
+
+/**
+ * Encode a record header.
+ *
+ * \pre data != NULL
+ * \param data the FCGI_HEADER_LEN bytes to fill
+ * \param type the record type
+ * \param id the request identifier
+ * \param length the content length
+ */
+void
+fcgi_header_encode(unsigned char *data, enum fcgi_type type, uint16_t id, uint16_t length);
+
+/**
+ * Encode a complete FCGI_END_REQUEST record.
+ *
+ * \pre data != NULL
+ * \param data the FCGI_HEADER_LEN + 8 bytes to fill
+ * \param id the request identifier
+ * \param status the protocol status
+ */
+void
+fcgi_end_encode(unsigned char *data, uint16_t id, enum fcgi_status status);
+
+/**
+ * Decode the next name-value pair in place.
+ *
+ * The name and value are moved backwards over their length prefix so that
+ * both can be NUL terminated without any allocation, the pointers returned
+ * point inside the original buffer.
+ *
+ * \pre p != NULL && *p != NULL
+ * \pre end != NULL
+ * \pre name != NULL
+ * \pre value != NULL
+ * \param p the current position, updated to the next pair
+ * \param end the end of the buffer
+ * \param name the name to set
+ * \param value the value to set
+ * \return 1 if a pair was decoded, 0 at the end or -1 on malformed data
+ */
+int
+fcgi_pair_decode(char **p, char *end, char **name, char **value);
+
+/**
+ * Encode a name-value pair.
+ *
+ * \pre data != NULL
+ * \pre name != NULL
+ * \pre value != NULL
+ * \param data the destination buffer
+ * \param datasz the destination buffer size
+ * \param name the name
+ * \param value the value
+ * \return the number of bytes written or 0 if the buffer is too small
+ */
+size_t
+fcgi_pair_encode(unsigned char *data, size_t datasz, const char *name, const char *value);
+
+#endif /* !TMPUPD_FCGI_H */
@@ -0,0 +1,235 @@
+/*
+ * html.c -- HTML output and templates
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "html.h"
+#include "req.h"
+#include "util.h"
+
+/* Elements that must not be closed. */
+static const char * const voids[] = {
+	"br",
+	"hr",
+	"img",
+	"input",
+	"link",
+	"meta"
+};
+
+static int
+is_void(const char *elem)
+{
+	for (size_t i = 0; i < LEN(voids); ++i)
+		if (strcmp(voids[i], elem) == 0)
+			return 1;
+
+	return 0;
+}
+
+static void
+escape(struct req *r, const char *text, size_t textsz)
+{
+	const char *start = text, *end = text + textsz, *rep;
+
+	for (; text < end; ++text) {
+		switch (*text) {
+		case '&':
+			rep = "&amp;";
+			break;
+		case '<':
+			rep = "&lt;";
+			break;
+		case '>':
+			rep = "&gt;";
+			break;
+		case '"':
+			rep = "&quot;";
+			break;
+		case '\'':
+			rep = "&#39;";
+			break;
+		default:
+			continue;
+		}
+
+		req_write(r, start, text - start);
+		req_write(r, rep, strlen(rep));
+		start = text + 1;
+	}
+
+	req_write(r, start, text - start);
+}
+
+/*
+ * Find the next @@ marker in [text, end).
+ */
+static const char *
+marker(const char *text, const char *end)
+{
+	for (; (text = memchr(text, '@', end - text)) && text + 1 < end; ++text)
+		if (text[1] == '@')
+			return text;
+
+	return NULL;
+}
+
+static void
+push(struct html *html, const char *elem)
+{
+	if (is_void(elem))
+		return;
+
+	assert(html->elemsz < LEN(html->elems));
+
+	html->elems[html->elemsz++] = elem;
+}
+
+void
+html_open(struct html *html, struct req *r)
+{
+	assert(html);
+	assert(r);
+
+	memset(html, 0, sizeof (*html));
+	html->req = r;
+}
+
+void
+html_elem(struct html *html, const char *elem)
+{
+	assert(html);
+	assert(elem);
+
+	req_printf(html->req, "<%s>", elem);
+	push(html, elem);
+}
+
+void
+html_attr(struct html *html, const char *elem, ...)
+{
+	assert(html);
+	assert(elem);
+
+	va_list ap;
+	const char *key, *val;
+
+	req_printf(html->req, "<%s", elem);
+	va_start(ap, elem);
+
+	while ((key = va_arg(ap, const char *))) {
+		val = va_arg(ap, const char *);
+		req_printf(html->req, " %s=\"", key);
+		escape(html->req, val, strlen(val));
+		req_write(html->req, "\"", 1);
+	}
+
+	va_end(ap);
+	req_write(html->req, ">", 1);
+	push(html, elem);
+}
+
+void
+html_printf(struct html *html, const char *fmt, ...)
+{
+	assert(html);
+	assert(fmt);
+
+	va_list ap;
+	char *str = NULL;
+	size_t strsz = 0;
+	FILE *fp;
+
+	fp = eopen_memstream(&str, &strsz);
+	va_start(ap, fmt);
+	vfprintf(fp, fmt, ap);
+	va_end(ap);
+	fclose(fp);
+
+	escape(html->req, str, strsz);
+	free(str);
+}
+
+void
+html_closeelem(struct html *html, size_t count)
+{
+	assert(html);
+
+	if (count == 0 || count > html->elemsz)
+		count = html->elemsz;
+
+	while (count--)
+		req_printf(html->req, "</%s>", html->elems[--html->elemsz]);
+}
+
+void
+html_close(struct html *html)
+{
+	assert(html);
+
+	html_closeelem(html, 0);
+}
+
+void
+html_template(struct req *r,
+              const struct html_template *kt,
+              const char *text,
+              size_t textsz)
+{
+	assert(r);
+	assert(text);
+
+	const char *end = text + textsz, *p, *key, *keyend;
+	size_t keysz, i;
+
+	while (text < end) {
+		if (!kt || !(p = marker(text, end))) {
+			req_write(r, text, end - text);
+			return;
+		}
+
+		req_write(r, text, p - text);
+		key = p + 2;
+
+		if (!(keyend = marker(key, end))) {
+			req_write(r, p, end - p);
+			return;
+		}
+
+		keysz = keyend - key;
+
+		for (i = 0; i < kt->keysz; ++i)
+			if (strlen(kt->key[i]) == keysz && strncmp(kt->key[i], key, keysz) == 0)
+				break;
+
+		if (i == kt->keysz) {
+			/* Unknown keyword, keep the first @@ and retry after. */
+			req_write(r, p, 2);
+			text = key;
+		} else {
+			if (!kt->cb(i, kt->arg))
+				return;
+
+			text = keyend + 2;
+		}
+	}
+}
@@ -0,0 +1,145 @@
+/*
+ * html.h -- HTML output and templates
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_HTML_H
+#define TMPUPD_HTML_H
+
+/**
+ * \file html.h
+ * \brief HTML output and templates.
+ */
+
+#include <stddef.h>
+
+/**
+ * \def HTML_DEPTH_MAX
+ * Maximum number of nested elements.
+ */
+#define HTML_DEPTH_MAX 32
+
+struct req;
+
+/**
+ * \struct html
+ * \brief HTML writer.
+ *
+ * Every text written through this object is escaped.
+ */
+struct html {
+	struct req *req;                        /*!< Request to write to. */
+	const char *elems[HTML_DEPTH_MAX];      /*!< Open elements. */
+	size_t elemsz;                          /*!< Number of open elements. */
+};
+
+/**
+ * \struct html_template
+ * \brief Template substitution.
+ *
+ * Every occurrence of `@@key@@` in the template where key is one of the keys
+ * is replaced by a call to cb with its index in the array.
+ */
+struct html_template {
+	const char * const *key;                /*!< Array of keywords. */
+	size_t keysz;                           /*!< Number of keywords. */
+	int (*cb)(size_t index, void *arg);     /*!< Substitution function. */
+	void *arg;                              /*!< User data to cb. */
+};
+
+/**
+ * Open the HTML writer.
+ *
+ * \pre html != NULL
+ * \pre r != NULL
+ * \param html the writer
+ * \param r the request to write to
+ */
+void
+html_open(struct html *html, struct req *r);
+
+/**
+ * Open an element without attributes.
+ *
+ * \pre html != NULL
+ * \pre elem != NULL
+ * \param html the writer
+ * \param elem the element name
+ */
+void
+html_elem(struct html *html, const char *elem);
+
+/**
+ * Open an element with attributes.
+ *
+ * Variadic arguments are pairs of attribute names and values terminated by a
+ * NULL attribute name.
+ *
+ * \pre html != NULL
+ * \pre elem != NULL
+ * \param html the writer
+ * \param elem the element name
+ */
+void
+html_attr(struct html *html, const char *elem, ...);
+
+/**
+ * Write escaped text.
+ *
+ * \pre html != NULL
+ * \pre fmt != NULL
+ * \param html the writer
+ * \param fmt the printf(3) format string
+ */
+void
+html_printf(struct html *html, const char *fmt, ...);
+
+/**
+ * Close the given number of open elements or all of them if count is 0.
+ *
+ * \pre html != NULL
+ * \param html the writer
+ * \param count the number of elements to close
+ */
+void
+html_closeelem(struct html *html, size_t count);
+
+/**
+ * Close every remaining element.
+ *
+ * \pre html != NULL
+ * \param html the writer
+ */
+void
+html_close(struct html *html);
+
+/**
+ * Write the template into the request while substituting keywords.
+ *
+ * \pre r != NULL
+ * \pre text != NULL
+ * \param r the request to write to
+ * \param kt the template keywords (may be NULL)
+ * \param text the template text
+ * \param textsz the template length
+ */
+void
+html_template(struct req *r,
+              const struct html_template *kt,
+              const char *text,
+              size_t textsz);
+
+#endif /* !TMPUPD_HTML_H */
@@ -0,0 +1,1306 @@
+/*
+ * http-fcgi.c -- FastCGI backend
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fcgi.h"
+#include "http-fcgi.h"
+#include "http.h"
+#include "log.h"
+#include "pool.h"
+#include "req.h"
+#include "util.h"
+
+#define TAG "http-fcgi: "
+
+/* Maximum length of all parameters of a request. */
+#define PARAMS_MAX      (64 * 1024)
+
+/* Maximum number of concurrent requests per connection. */
+#define REQUESTS_MAX    16
+
+/* Bodies up to this length are received before calling the route. */
+#define BODY_INLINE     (1024 * 1024)
+
+/* Maximum length of body buffered for a request, see record(). */
+#define INPUT_MAX       BODY_INLINE
+
+/* Maximum length of body buffered for all requests of a connection. */
+#define CONN_INPUT_MAX  (4 * BODY_INLINE)
+
+/* Output is sent to the front server once it exceeds this length. */
+#define FLUSH_MAX       (64 * 1024)
+
+/* Writes larger than this are sent directly instead of being copied. */
+#define DIRECT_MIN      (4 * 1024)
+
+/*
+ * Seconds before an inactive connection is closed or a request without
+ * progress is interrupted, large bodies on slow links are not.
+ */
+#define IDLE_TIMEOUT    60
+
+/* Seconds the front server may take to send the parameters of a request. */
+#define PARAMS_TIMEOUT  30
+
+/* Maximum number of events per epoll_wait(2) call. */
+#define EVENTS_MAX      64
+
+/* Size of one complete record, including padding. */
+#define RECORD_MAX      (FCGI_HEADER_LEN + FCGI_CONTENT_MAX + 255)
+
+struct conn;
+
+struct request {
+	uint16_t id;
+	time_t deadline;        /* Limit to receive the parameters. */
+	time_t last;            /* Last body record received. */
+	int keepconn;
+	int ready;
+	int started;
+	int eof;
+	int aborted;
+	struct conn *conn;
+
+	/*
+	 * Parameters are copied once from the records as the receive buffer is
+	 * reused while the request runs, they are decoded in place once
+	 * complete.
+	 */
+	char *params;
+	size_t paramsz;
+
+	/* Buffered body, pending data is in [in + inoff, in + inoff + inlen). */
+	char *in;
+	size_t inoff;
+	size_t inlen;
+	size_t incap;
+
+	struct req req;
+	struct request *next;
+};
+
+/*
+ * The loop owns the socket and never blocks, routes run in threads and
+ * exchange data with it through the buffers. Everything below is protected
+ * by the mutex and the threads wait on the condition for room in the output
+ * or more input.
+ */
+struct conn {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int fd;
+	time_t last;
+	uint32_t events;
+	int eof;
+	int closing;
+	int blocked;
+	int dead;
+
+	/* Input buffer, pending data is in [in + inoff, in + inoff + inlen). */
+	unsigned char *in;
+	size_t inoff;
+	size_t inlen;
+	size_t incap;
+
+	/* Output buffer, pending data is in [out + outoff, out + outlen). */
+	unsigned char *out;
+	size_t outoff;
+	size_t outlen;
+	size_t outcap;
+
+	/* Length of the body buffered in every request. */
+	size_t buffered;
+
+	struct request *requests;
+	size_t requestsz;
+	size_t running;
+
+	/* Queued for the loop, protected by the global mutex. */
+	int queued;
+	struct conn *wake;
+
+	struct conn *prev;
+	struct conn *next;
+};
+
+static int epfd = -1;
+static int pipefd[2] = { -1, -1 };
+static struct conn *conns;
+
+/* Connections freed at the end of the current loop iteration. */
+static struct conn *graveyard;
+
+/* Connections changed by the threads, the loop is woken by wakefd. */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct conn *woken;
+static int wakefd[2] = { -1, -1 };
+
+/*
+ * Ask the loop to look at the connection again, the connection lock must be
+ * held.
+ */
+static void
+notify(struct conn *c)
+{
+	int wake = 0;
+
+	pthread_mutex_lock(&mutex);
+
+	if (!c->queued) {
+		c->queued = wake = 1;
+		c->wake = woken;
+		woken = c;
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	if (wake && write(wakefd[1], "", 1) < 0 && errno != EAGAIN)
+		log_warn(TAG "write: %s", strerror(errno));
+}
+
+/*
+ * Wait for the loop, no longer than IDLE_TIMEOUT since the last progress
+ * which callers loop on so that every progress rearms it. The connection
+ * lock must be held.
+ */
+static int
+wait_for(struct request *rq, time_t last)
+{
+	struct timespec ts = {
+		.tv_sec = last + IDLE_TIMEOUT
+	};
+	int rv;
+
+	if ((rv = pthread_cond_timedwait(&rq->conn->cond, &rq->conn->mutex, &ts)) != 0) {
+		errno = rv;
+		return -1;
+	}
+
+	return 0;
+}
+
+static inline size_t
+pending(const struct conn *c)
+{
+	return c->outlen - c->outoff;
+}
+
+static void
+append(struct conn *c, const void *data, size_t datasz)
+{
+	if (c->outcap - c->outlen < datasz) {
+		if (c->outoff) {
+			memmove(c->out, c->out + c->outoff, pending(c));
+			c->outlen -= c->outoff;
+			c->outoff = 0;
+		}
+
+		if (c->outcap - c->outlen < datasz) {
+			c->outcap = c->outlen + datasz + BUFSIZ;
+			c->out = erealloc(c->out, c->outcap, 1);
+		}
+	}
+
+	memcpy(c->out + c->outlen, data, datasz);
+	c->outlen += datasz;
+}
+
+static int
+flush(struct conn *c)
+{
+	ssize_t ns;
+
+	while (pending(c)) {
+		if ((ns = send(c->fd, c->out + c->outoff, pending(c), MSG_NOSIGNAL)) > 0)
+			c->outoff += ns;
+		else if (errno == EINTR)
+			continue;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return -1;
+		else
+			break;
+	}
+
+	if (c->outoff == c->outlen)
+		c->outoff = c->outlen = 0;
+
+	return 0;
+}
+
+/*
+ * Try to send a record header and its content using a single system call
+ * without copying the content into the output buffer, returns the number of
+ * bytes sent which may be less than requested.
+ */
+static ssize_t
+sendrecord(struct conn *c, const unsigned char *hdr, const void *data, size_t datasz)
+{
+	struct iovec iov[2] = {
+		{ .iov_base = (void *)hdr, .iov_len = FCGI_HEADER_LEN },
+		{ .iov_base = (void *)data, .iov_len = datasz }
+	};
+	struct msghdr msg = {
+		.msg_iov = iov,
+		.msg_iovlen = 2
+	};
+	ssize_t ns;
+
+	while ((ns = sendmsg(c->fd, &msg, MSG_NOSIGNAL)) < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		if (errno != EINTR)
+			return -1;
+	}
+
+	return ns;
+}
+
+/*
+ * Append stdout records without sending them, used by the loop.
+ */
+static void
+put(struct conn *c, uint16_t id, const void *data, size_t datasz)
+{
+	unsigned char hdr[FCGI_HEADER_LEN];
+	const char *p = data;
+	size_t len;
+
+	while (datasz) {
+		len = datasz > FCGI_CONTENT_MAX ? FCGI_CONTENT_MAX : datasz;
+		fcgi_header_encode(hdr, FCGI_STDOUT, id, len);
+		append(c, hdr, sizeof (hdr));
+		append(c, p, len);
+
+		p += len;
+		datasz -= len;
+	}
+}
+
+static void
+putf(struct conn *c, uint16_t id, const char *fmt, ...)
+{
+	char buf[1024];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof (buf), fmt, ap);
+	va_end(ap);
+
+	/* Only used for status line and headers. */
+	if (len > 0)
+		put(c, id, buf, (size_t)len < sizeof (buf) ? (size_t)len : sizeof (buf) - 1);
+}
+
+/*
+ * Write stdout records from a route, waiting for the loop to send what is
+ * pending when the output is full. The connection lock must be held.
+ */
+static int
+output(struct request *rq, const void *data, size_t datasz)
+{
+	struct conn *c = rq->conn;
+	unsigned char hdr[FCGI_HEADER_LEN];
+	const char *p = data;
+	size_t len;
+	ssize_t ns;
+
+	/* An empty record would end the stream. */
+	if (datasz == 0)
+		return 0;
+
+	do {
+		/* Any output sent by the loop is progress. */
+		while (!c->dead && pending(c) >= FLUSH_MAX)
+			if (wait_for(rq, c->last) < 0)
+				return -1;
+
+		if (c->dead) {
+			errno = ECONNRESET;
+			return -1;
+		}
+
+		len = datasz > FCGI_CONTENT_MAX ? FCGI_CONTENT_MAX : datasz;
+		fcgi_header_encode(hdr, FCGI_STDOUT, rq->id, len);
+
+		/* Large writes are sent directly if nothing is pending. */
+		if (len >= DIRECT_MIN && !pending(c)) {
+			if ((ns = sendrecord(c, hdr, p, len)) < 0)
+				return -1;
+			if (ns > 0)
+				c->last = time(NULL);
+			if ((size_t)ns < sizeof (hdr)) {
+				append(c, hdr + ns, sizeof (hdr) - ns);
+				append(c, p, len);
+			} else
+				append(c, p + (ns - sizeof (hdr)), len - (ns - sizeof (hdr)));
+		} else {
+			append(c, hdr, sizeof (hdr));
+			append(c, p, len);
+		}
+
+		p += len;
+		datasz -= len;
+	} while (datasz);
+
+	if (pending(c))
+		notify(c);
+
+	return 0;
+}
+
+static void
+end(struct conn *c, uint16_t id, enum fcgi_status status)
+{
+	unsigned char rec[FCGI_HEADER_LEN * 2];
+
+	/* Empty stdout record closes the stream. */
+	if (status == FCGI_REQUEST_COMPLETE) {
+		fcgi_header_encode(rec, FCGI_STDOUT, id, 0);
+		append(c, rec, FCGI_HEADER_LEN);
+	}
+
+	fcgi_end_encode(rec, id, status);
+	append(c, rec, sizeof (rec));
+}
+
+static int
+on_head(struct req *r)
+{
+	struct request *rq = r->data;
+	char *head = NULL;
+	size_t headsz = 0;
+	FILE *fp;
+	int rv;
+
+	/* Build headers at once to send them in a single record. */
+	fp = eopen_memstream(&head, &headsz);
+	fprintf(fp, "Status: %d %s\r\n", r->status, req_reason(r->status));
+
+	for (size_t i = 0; i < r->respsz; ++i)
+		fprintf(fp, "%s: %s\r\n", r->resps[i].key, r->resps[i].val);
+
+	fprintf(fp, "\r\n");
+	fclose(fp);
+
+	pthread_mutex_lock(&rq->conn->mutex);
+	rv = output(rq, head, headsz);
+	pthread_mutex_unlock(&rq->conn->mutex);
+	free(head);
+
+	return rv;
+}
+
+static int
+on_write(struct req *r, const void *data, size_t datasz)
+{
+	struct request *rq = r->data;
+	int rv;
+
+	pthread_mutex_lock(&rq->conn->mutex);
+	rv = output(rq, data, datasz);
+	pthread_mutex_unlock(&rq->conn->mutex);
+
+	return rv;
+}
+
+static ssize_t
+on_read(struct req *r, void *buf, size_t bufsz)
+{
+	struct request *rq = r->data;
+	struct conn *c = rq->conn;
+	ssize_t nr = -1;
+
+	pthread_mutex_lock(&c->mutex);
+
+	/* The loop fills the body as records arrive. */
+	while (!rq->inlen && !rq->eof && !rq->aborted && !c->dead && !c->eof)
+		if (wait_for(rq, rq->last) < 0)
+			break;
+
+	if (rq->inlen) {
+		nr = bufsz < rq->inlen ? bufsz : rq->inlen;
+		memcpy(buf, rq->in + rq->inoff, nr);
+		c->buffered -= nr;
+
+		if ((rq->inlen -= nr) == 0)
+			rq->inoff = 0;
+		else
+			rq->inoff += nr;
+
+		/* There is room again for the records left in place. */
+		if (c->blocked)
+			notify(c);
+	} else if (rq->eof)
+		nr = 0;
+	else if (errno != ETIMEDOUT)
+		errno = ECONNRESET;
+
+	pthread_mutex_unlock(&c->mutex);
+
+	return nr;
+}
+
+static const struct req_ops ops = {
+	.head = on_head,
+	.write = on_write,
+	.read = on_read
+};
+
+static struct request *
+find(struct conn *c, uint16_t id)
+{
+	struct request *rq;
+
+	for (rq = c->requests; rq && rq->id != id; rq = rq->next)
+		continue;
+
+	return rq;
+}
+
+static void
+destroy(struct conn *c, struct request *rq)
+{
+	struct request **p;
+
+	for (p = &c->requests; *p != rq; p = &(*p)->next)
+		continue;
+
+	*p = rq->next;
+	c->requestsz--;
+	c->buffered -= rq->inlen;
+
+	/* Avoid sending headers of an unfinished request. */
+	rq->req.body = 1;
+	req_finish(&rq->req);
+
+	free(rq->params);
+	free(rq->in);
+	free(rq);
+}
+
+/*
+ * Convert HTTP_USER_AGENT into User-Agent in place.
+ */
+static char *
+header_name(char *name)
+{
+	int upper = 1;
+
+	name += 5;
+
+	for (char *p = name; *p; ++p) {
+		if (*p == '_') {
+			*p = '-';
+			upper = 1;
+		} else {
+			if (!upper && *p >= 'A' && *p <= 'Z')
+				*p += 'a' - 'A';
+
+			upper = 0;
+		}
+	}
+
+	return name;
+}
+
+/*
+ * Decode parameters in place, returns a HTTP status code to reject the
+ * request or 0 to accept it.
+ */
+static int
+parse(struct request *rq)
+{
+	struct req *r = &rq->req;
+	char *p = rq->params, *end = rq->params + rq->paramsz, *name, *value;
+	const char *path = NULL, *uri = NULL, *errstr;
+	int rv;
+	long long len;
+
+	while ((rv = fcgi_pair_decode(&p, end, &name, &value)) > 0) {
+		if (strncmp(name, "HTTP_", 5) == 0)
+			req_add_header(r, header_name(name), value);
+		else if (strcmp(name, "REQUEST_METHOD") == 0)
+			r->method = req_method(value);
+		else if (strcmp(name, "PATH_INFO") == 0 && *value)
+			path = value;
+		else if (strcmp(name, "REQUEST_URI") == 0)
+			uri = value;
+		else if (strcmp(name, "QUERY_STRING") == 0)
+			req_parse_query(r, value);
+		else if (strcmp(name, "CONTENT_TYPE") == 0 && *value) {
+			r->ctype = value;
+			req_add_header(r, "Content-Type", value);
+		} else if (strcmp(name, "CONTENT_LENGTH") == 0 && *value) {
+			len = bstrtonum(value, 0, LLONG_MAX, &errstr);
+
+			if (errstr)
+				return 400;
+			if ((unsigned long long)len > HTTP_BODY_MAX)
+				return 413;
+
+			r->length = len;
+			req_add_header(r, "Content-Length", value);
+		}
+	}
+
+	if (rv < 0)
+		return 400;
+
+	/* Use the request URI without the query if the server has no path. */
+	if (path)
+		r->path = path;
+	else if (uri) {
+		r->path = uri;
+		((char *)uri)[strcspn(uri, "?")] = '\0';
+	}
+
+	return 0;
+}
+
+static void
+reject(struct conn *c, struct request *rq, int code)
+{
+	const char *msg = req_reason(code);
+
+	putf(c, rq->id, "Status: %d %s\r\nContent-Type: %s\r\n\r\n%s\n",
+	    code, msg, req_mimes[REQ_MIME_TEXT_HTML], msg);
+	end(c, rq->id, FCGI_REQUEST_COMPLETE);
+
+	if (!rq->keepconn)
+		c->closing = 1;
+
+	destroy(c, rq);
+}
+
+static void
+begin(struct conn *c, const struct fcgi_header *hdr, const unsigned char *data)
+{
+	struct request *rq;
+	int role;
+
+	if (hdr->length < 8 || find(c, hdr->id))
+		return;
+
+	role = (data[0] << 8) | data[1];
+
+	if (role != FCGI_RESPONDER) {
+		end(c, hdr->id, FCGI_UNKNOWN_ROLE);
+		return;
+	}
+	if (c->requestsz >= REQUESTS_MAX) {
+		end(c, hdr->id, FCGI_OVERLOADED);
+		return;
+	}
+
+	rq = ecalloc(1, sizeof (*rq));
+	rq->id = hdr->id;
+	rq->keepconn = data[2] & FCGI_KEEP_CONN;
+	rq->last = time(NULL);
+	rq->deadline = rq->last + PARAMS_TIMEOUT;
+	rq->conn = c;
+	req_init(&rq->req, &ops, rq);
+
+	rq->next = c->requests;
+	c->requests = rq;
+	c->requestsz++;
+}
+
+static void
+params(struct conn *c, struct request *rq, const unsigned char *data, size_t datasz)
+{
+	int code;
+
+	if (rq->ready)
+		return;
+
+	/* Empty record marks the end of the stream. */
+	if (datasz == 0) {
+		rq->ready = 1;
+
+		if ((code = parse(rq)))
+			reject(c, rq, code);
+
+		return;
+	}
+
+	if (rq->paramsz + datasz > PARAMS_MAX) {
+		reject(c, rq, 431);
+		return;
+	}
+
+	rq->params = erealloc(rq->params, rq->paramsz + datasz, 1);
+	memcpy(rq->params + rq->paramsz, data, datasz);
+	rq->paramsz += datasz;
+}
+
+static void
+input(struct conn *c, struct request *rq, const unsigned char *data, size_t datasz)
+{
+	if (datasz == 0) {
+		rq->eof = 1;
+		return;
+	}
+
+	if (rq->incap - rq->inoff - rq->inlen < datasz) {
+		if (rq->inoff) {
+			memmove(rq->in, rq->in + rq->inoff, rq->inlen);
+			rq->inoff = 0;
+		}
+		if (rq->incap - rq->inlen < datasz) {
+			rq->incap = rq->inlen + datasz;
+			rq->in = erealloc(rq->in, rq->incap, 1);
+		}
+	}
+
+	memcpy(rq->in + rq->inoff + rq->inlen, data, datasz);
+	rq->inlen += datasz;
+	rq->last = time(NULL);
+	c->buffered += datasz;
+}
+
+/*
+ * The variables are only needed for the reply, they are decoded in place in
+ * the record already consumed from the receive buffer.
+ */
+static void
+values(struct conn *c, unsigned char *data, size_t datasz)
+{
+	static const char * const vars[][2] = {
+		{ "FCGI_MAX_CONNS",     "64"    },
+		{ "FCGI_MAX_REQS",      "16"    },
+		{ "FCGI_MPXS_CONNS",    "1"     }
+	};
+	unsigned char reply[256];
+	char *p = (char *)data, *end = p + datasz, *name, *value;
+	size_t len = FCGI_HEADER_LEN;
+
+	while (fcgi_pair_decode(&p, end, &name, &value) > 0)
+		for (size_t i = 0; i < LEN(vars); ++i)
+			if (strcmp(vars[i][0], name) == 0)
+				len += fcgi_pair_encode(reply + len, sizeof (reply) - len,
+				    vars[i][0], vars[i][1]);
+
+	fcgi_header_encode(reply, FCGI_GET_VALUES_RESULT, 0, len - FCGI_HEADER_LEN);
+	append(c, reply, len);
+}
+
+/*
+ * Handle the next complete record in the input buffer, returns 1 if one was
+ * processed, 0 if more data is needed or -1 on protocol error.
+ *
+ * A body record is left in place while the body already buffered is too
+ * large, the connection is then blocked until a route reads it.
+ */
+static int
+record(struct conn *c)
+{
+	struct fcgi_header hdr;
+	struct request *rq;
+	unsigned char *data, unknown[FCGI_HEADER_LEN * 2] = {0};
+	size_t total;
+
+	if (c->inlen < FCGI_HEADER_LEN)
+		return 0;
+	if (fcgi_header_decode(&hdr, c->in + c->inoff) < 0)
+		return -1;
+
+	total = FCGI_HEADER_LEN + hdr.length + hdr.padding;
+
+	if (c->inlen < total)
+		return 0;
+
+	if (hdr.type == FCGI_STDIN && (rq = find(c, hdr.id)) && rq->inlen &&
+	    (rq->inlen + hdr.length > INPUT_MAX || c->buffered + hdr.length > CONN_INPUT_MAX)) {
+		c->blocked = 1;
+		return 0;
+	}
+
+	data = c->in + c->inoff + FCGI_HEADER_LEN;
+	c->inoff += total;
+	c->inlen -= total;
+
+	if (hdr.id == 0) {
+		if (hdr.type == FCGI_GET_VALUES)
+			values(c, data, hdr.length);
+		else {
+			fcgi_header_encode(unknown, FCGI_UNKNOWN_TYPE, 0, 8);
+			unknown[FCGI_HEADER_LEN] = hdr.type;
+			append(c, unknown, sizeof (unknown));
+		}
+
+		return 1;
+	}
+
+	if (hdr.type == FCGI_BEGIN_REQUEST) {
+		begin(c, &hdr, data);
+		return 1;
+	}
+
+	/* Records for finished or unknown requests are ignored. */
+	if (!(rq = find(c, hdr.id)))
+		return 1;
+
+	switch (hdr.type) {
+	case FCGI_PARAMS:
+		params(c, rq, data, hdr.length);
+		break;
+	case FCGI_STDIN:
+		input(c, rq, data, hdr.length);
+		break;
+	case FCGI_ABORT_REQUEST:
+		/* The route currently reading will notice by itself. */
+		if (rq->started)
+			rq->aborted = 1;
+		else {
+			end(c, rq->id, FCGI_REQUEST_COMPLETE);
+			destroy(c, rq);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return 1;
+}
+
+/*
+ * Run the route in a thread, the request is destroyed once done.
+ */
+static void
+run(void *data)
+{
+	struct request *rq = data;
+	struct conn *c = rq->conn;
+	int dead;
+
+	pthread_mutex_lock(&c->mutex);
+	dead = c->dead;
+	pthread_mutex_unlock(&c->mutex);
+
+	if (!dead) {
+		http_process(&rq->req);
+		req_body(&rq->req);
+	}
+
+	pthread_mutex_lock(&c->mutex);
+
+	if (!c->dead) {
+		if (rq->req.error)
+			c->closing = 1;
+		else {
+			end(c, rq->id, FCGI_REQUEST_COMPLETE);
+
+			if (!rq->keepconn)
+				c->closing = 1;
+		}
+	}
+
+	destroy(c, rq);
+	c->running--;
+	notify(c);
+
+	pthread_mutex_unlock(&c->mutex);
+}
+
+/*
+ * Find a request that can be started: parameters are complete and small
+ * bodies have been received entirely, unless the connection is blocked in
+ * which case the routes must read them.
+ */
+static struct request *
+runnable(struct conn *c)
+{
+	struct request *rq;
+
+	for (rq = c->requests; rq; rq = rq->next) {
+		if (!rq->ready || rq->started)
+			continue;
+		if (rq->eof || rq->req.length > BODY_INLINE ||
+		    rq->inlen >= rq->req.length || c->blocked)
+			return rq;
+	}
+
+	return NULL;
+}
+
+static int
+fill(struct conn *c)
+{
+	ssize_t nr;
+
+	for (;;) {
+		if (c->inoff) {
+			memmove(c->in, c->in + c->inoff, c->inlen);
+			c->inoff = 0;
+		}
+		if (c->incap < RECORD_MAX) {
+			c->incap = RECORD_MAX;
+			c->in = erealloc(c->in, c->incap, 1);
+		}
+		if (c->inlen == c->incap)
+			return 0;
+
+		nr = recv(c->fd, c->in + c->inlen, c->incap - c->inlen, 0);
+
+		if (nr > 0)
+			c->inlen += nr;
+		else if (nr == 0) {
+			c->eof = 1;
+			return 0;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		else if (errno != EINTR)
+			return -1;
+	}
+}
+
+/*
+ * Close the connection, the requests not started are destroyed and the
+ * running ones fail on their next read or write. The connection is freed
+ * by settle() once they are done.
+ */
+static void
+drop(struct conn *c)
+{
+	struct request *rq, *next;
+
+	c->dead = 1;
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	shutdown(c->fd, SHUT_RDWR);
+
+	for (rq = c->requests; rq; rq = next) {
+		next = rq->next;
+
+		if (!rq->started)
+			destroy(c, rq);
+	}
+}
+
+static void
+release(struct conn *c)
+{
+	while (c->requests)
+		destroy(c, c->requests);
+
+	pthread_mutex_destroy(&c->mutex);
+	pthread_cond_destroy(&c->cond);
+	close(c->fd);
+	free(c->in);
+	free(c->out);
+	free(c);
+}
+
+static void
+update(struct conn *c)
+{
+	struct epoll_event ev = {
+		.data.ptr = c
+	};
+
+	/* Stop reading while output or input is piling up. */
+	ev.events = pending(c) ? EPOLLOUT : 0;
+
+	if (!c->blocked && pending(c) < FLUSH_MAX)
+		ev.events |= EPOLLIN;
+
+	if (ev.events != c->events) {
+		c->events = ev.events;
+		epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	}
+}
+
+/*
+ * Finish the work of the loop on a connection and release its lock, the
+ * connection may be freed.
+ */
+static void
+settle(struct conn *c)
+{
+	int gone;
+
+	if (!c->dead) {
+		if (flush(c) < 0)
+			drop(c);
+		else if ((c->closing || c->eof) && !c->running && !pending(c))
+			drop(c);
+		else
+			update(c);
+	}
+
+	/* Wake up the routes waiting for input or room in the output. */
+	pthread_cond_broadcast(&c->cond);
+
+	if ((gone = c->dead && !c->running)) {
+		pthread_mutex_lock(&mutex);
+		gone = !c->queued;
+		pthread_mutex_unlock(&mutex);
+	}
+
+	pthread_mutex_unlock(&c->mutex);
+
+	/* Events may still be pending for it in this iteration. */
+	if (gone) {
+		if (c->prev)
+			c->prev->next = c->next;
+		else
+			conns = c->next;
+		if (c->next)
+			c->next->prev = c->prev;
+
+		c->next = graveyard;
+		graveyard = c;
+	}
+}
+
+static void
+process(struct conn *c)
+{
+	struct request *rq;
+	int rv;
+
+	c->blocked = 0;
+
+	/* Consume every record available first. */
+	while ((rv = record(c)) > 0)
+		continue;
+
+	if (rv < 0) {
+		drop(c);
+		return;
+	}
+
+	/* Each request runs in its own thread as soon as possible. */
+	while (!c->closing && (rq = runnable(c))) {
+		rq->started = 1;
+		c->running++;
+		pool_submit(run, rq);
+	}
+}
+
+static void
+handle(struct conn *c, uint32_t events)
+{
+	if (c->dead)
+		return;
+
+	pthread_mutex_lock(&c->mutex);
+	c->last = time(NULL);
+
+	if (events & EPOLLERR)
+		drop(c);
+	else if ((events & EPOLLOUT) && flush(c) < 0)
+		drop(c);
+	else if ((events & EPOLLHUP) && c->blocked)
+		drop(c);
+	else if ((events & (EPOLLIN | EPOLLHUP)) && fill(c) < 0)
+		drop(c);
+	else
+		process(c);
+
+	settle(c);
+}
+
+/*
+ * Look at the connections changed by the threads.
+ */
+static void
+resume(void)
+{
+	struct conn *c;
+	char buf[64];
+
+	while (read(wakefd[0], buf, sizeof (buf)) > 0)
+		continue;
+
+	for (;;) {
+		pthread_mutex_lock(&mutex);
+
+		if ((c = woken)) {
+			woken = c->wake;
+			c->queued = 0;
+		}
+
+		pthread_mutex_unlock(&mutex);
+
+		if (!c)
+			break;
+
+		pthread_mutex_lock(&c->mutex);
+
+		if (!c->dead)
+			process(c);
+
+		settle(c);
+	}
+}
+
+static void
+bury(void)
+{
+	struct conn *c;
+
+	while ((c = graveyard)) {
+		graveyard = c->next;
+		release(c);
+	}
+}
+
+static void
+accept_all(void)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN
+	};
+	struct conn *c;
+	int fd;
+
+	for (;;) {
+		if ((fd = accept(STDIN_FILENO, NULL, NULL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				log_warn(TAG "accept: %s", strerror(errno));
+
+			break;
+		}
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+		c = ecalloc(1, sizeof (*c));
+		pthread_mutex_init(&c->mutex, NULL);
+		pthread_cond_init(&c->cond, NULL);
+		c->fd = fd;
+		c->last = time(NULL);
+		c->events = EPOLLIN;
+
+		ev.data.ptr = c;
+
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			log_warn(TAG "epoll_ctl: %s", strerror(errno));
+			release(c);
+			continue;
+		}
+
+		if ((c->next = conns))
+			conns->prev = c;
+
+		conns = c;
+	}
+}
+
+static void
+sweep(void)
+{
+	struct conn *c, *next;
+	struct request *rq, *rqnext;
+	time_t now = time(NULL);
+
+	for (c = conns; c; c = next) {
+		next = c->next;
+
+		if (c->dead)
+			continue;
+
+		pthread_mutex_lock(&c->mutex);
+
+		/* Requests still waiting for their parameters or body. */
+		for (rq = c->requests; rq; rq = rqnext) {
+			rqnext = rq->next;
+
+			if (rq->started)
+				continue;
+			if ((!rq->ready && now >= rq->deadline) || now - rq->last >= IDLE_TIMEOUT)
+				reject(c, rq, 408);
+		}
+
+		/* Best effort for the requests rejected above. */
+		if (!c->running && now - c->last >= IDLE_TIMEOUT) {
+			flush(c);
+			drop(c);
+		}
+
+		settle(c);
+	}
+}
+
+/*
+ * Close every connection so that the routes still running fail quickly.
+ */
+static void
+interrupt(void)
+{
+	struct conn *c, *next;
+
+	for (c = conns; c; c = next) {
+		next = c->next;
+
+		pthread_mutex_lock(&c->mutex);
+
+		if (!c->dead)
+			drop(c);
+
+		settle(c);
+	}
+}
+
+void
+http_fcgi_bind(const char *path, mode_t mode)
+{
+	assert(path);
+
+	struct sockaddr_un addr = {
+		.sun_family = AF_UNIX
+	};
+	int fd;
+
+	if (bstrlcpy(addr.sun_path, path, sizeof (addr.sun_path)) >= sizeof (addr.sun_path))
+		die("abort: %s: path too long\n", path);
+
+	/* Remove a socket left by a previous instance. */
+	unlink(path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		die("abort: socket: %s\n", strerror(errno));
+	if (bind(fd, (const struct sockaddr *)&addr, sizeof (addr)) < 0 ||
+	    listen(fd, SOMAXCONN) < 0)
+		die("abort: %s: %s\n", path, strerror(errno));
+
+	/* The front server may run as a different user. */
+	if (chmod(path, mode) < 0)
+		die("abort: %s: %s\n", path, strerror(errno));
+
+	if (fd != STDIN_FILENO) {
+		if (dup2(fd, STDIN_FILENO) < 0)
+			die("abort: dup2: %s\n", strerror(errno));
+
+		close(fd);
+	}
+}
+
+void
+http_fcgi_init(void)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN
+	};
+	int listening = 0;
+	socklen_t len = sizeof (listening);
+
+	/* FastCGI applications receive the listening socket as stdin. */
+	if (getsockopt(STDIN_FILENO, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0 || !listening)
+		die("abort: standard input is not a listening socket\n");
+
+	fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		die("abort: epoll_create1: %s\n", strerror(errno));
+	if (pipe(pipefd) < 0 || pipe(wakefd) < 0)
+		die("abort: pipe: %s\n", strerror(errno));
+
+	/* Threads never wait for the loop. */
+	for (int i = 0; i < 2; ++i)
+		fcntl(wakefd[i], F_SETFL, fcntl(wakefd[i], F_GETFL) | O_NONBLOCK);
+
+	ev.data.ptr = &epfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev);
+	ev.data.ptr = pipefd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, pipefd[0], &ev);
+	ev.data.ptr = wakefd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd[0], &ev);
+}
+
+void
+http_fcgi_run(void)
+{
+	struct epoll_event evs[EVENTS_MAX];
+	int n;
+
+	for (;;) {
+		if ((n = epoll_wait(epfd, evs, LEN(evs), 1000)) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			log_warn(TAG "epoll_wait: %s", strerror(errno));
+			return;
+		}
+
+		for (int i = 0; i < n; ++i) {
+			if (evs[i].data.ptr == &epfd)
+				accept_all();
+			else if (evs[i].data.ptr == pipefd) {
+				interrupt();
+				bury();
+				return;
+			} else if (evs[i].data.ptr == wakefd)
+				resume();
+			else
+				handle(evs[i].data.ptr, evs[i].events);
+		}
+
+		sweep();
+		bury();
+	}
+}
+
+void
+http_fcgi_stop(void)
+{
+	if (write(pipefd[1], "", 1) < 0)
+		log_warn(TAG "write: %s", strerror(errno));
+}
+
+void
+http_fcgi_finish(void)
+{
+	struct conn *c;
+
+	/* The threads are stopped, requests they did not run remain. */
+	woken = NULL;
+
+	while ((c = conns)) {
+		conns = c->next;
+		release(c);
+	}
+
+	close(epfd);
+	close(pipefd[0]);
+	close(pipefd[1]);
+	close(wakefd[0]);
+	close(wakefd[1]);
+
+	epfd = pipefd[0] = pipefd[1] = wakefd[0] = wakefd[1] = -1;
+}
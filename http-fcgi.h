@@ -0,0 +1,74 @@
+/*
+ * http-fcgi.h -- FastCGI backend
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_HTTP_FCGI_H
+#define TMPUPD_HTTP_FCGI_H
+
+/**
+ * \file http-fcgi.h
+ * \brief FastCGI backend.
+ *
+ * The listening socket is the standard input as usual for FastCGI
+ * applications (spawn-fcgi, kfcgi). Connections from the front server are
+ * multiplexed using epoll(7) and may be kept open between requests. The
+ * event loop owns the sockets while the routes run in threads, request
+ * bodies are buffered up to a limit after which the front server is no
+ * longer read until the routes consume them.
+ */
+
+#include <sys/types.h>
+
+/**
+ * Create a UNIX socket and make it the standard input, exits on failure.
+ *
+ * This must be called before forking workers so that they all share it. The
+ * front server may run as a different user, the mode must allow it to
+ * connect.
+ *
+ * \pre path != NULL
+ * \param path the socket path
+ * \param mode the socket permissions
+ */
+void
+http_fcgi_bind(const char *path, mode_t mode);
+
+/**
+ * Prepare the event loop, exits on failure.
+ */
+void
+http_fcgi_init(void);
+
+/**
+ * Run the event loop until ::http_fcgi_stop is called.
+ */
+void
+http_fcgi_run(void);
+
+/**
+ * Ask the event loop to stop, can be called from any thread.
+ */
+void
+http_fcgi_stop(void);
+
+/**
+ * Close every connection.
+ */
+void
+http_fcgi_finish(void);
+
+#endif /* !TMPUPD_HTTP_FCGI_H */
@@ -0,0 +1,1273 @@
+/*
+ * http-native.c -- built-in HTTP/1.1 server
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "http-native.h"
+#include "http.h"
+#include "log.h"
+#include "pool.h"
+#include "req.h"
+#include "util.h"
+
+#define TAG "http-native: "
+
+/* Maximum length of the request line and headers. */
+#define HEADER_MAX      (16 * 1024)
+
+/* Maximum number of request headers. */
+#define HEADERS_MAX     64
+
+/* Bodies up to this length are received before calling the route. */
+#define BODY_INLINE     (1024 * 1024)
+
+/* Output is sent to the client once it exceeds this length. */
+#define FLUSH_MAX       (64 * 1024)
+
+/* Maximum length of a chunk size or trailer line in a request body. */
+#define CHUNK_LINE_MAX  1024
+
+/*
+ * Seconds before an inactive connection is closed, it is rearmed by every
+ * read or write so that large bodies on slow links are not interrupted.
+ */
+#define IDLE_TIMEOUT    30
+
+/* Seconds a client may take to send the request headers. */
+#define HEADER_TIMEOUT  30
+
+/* Maximum number of events per epoll_wait(2) call. */
+#define EVENTS_MAX      64
+
+/* Decoding state of a chunked request body. */
+enum chunk {
+	CHUNK_SIZE,
+	CHUNK_DATA,
+	CHUNK_END,
+	CHUNK_TRAILER,
+	CHUNK_DONE
+};
+
+struct conn {
+	int fd;
+	time_t last;
+	time_t deadline;        /* Limit to receive the headers, 0 once parsed. */
+	int unsent;             /* Bytes not sent by the kernel at last sweep. */
+	uint32_t events;
+
+	/* Input buffer, pending data is in [in + inoff, in + inoff + inlen). */
+	char *in;
+	size_t inoff;
+	size_t inlen;
+	size_t incap;
+
+	/* Output buffer, pending data is in [out + outoff, out + outlen). */
+	char *out;
+	size_t outoff;
+	size_t outlen;
+	size_t outcap;
+
+	/* Current request, headers are copied so that input can move. */
+	struct req req;
+	char *hdr;
+	size_t bodyleft;
+	int parsed;
+	int http10;
+	int head;
+	int keepalive;
+	int chunked;
+	int expect;
+	int eof;
+	int closing;
+
+	/*
+	 * Chunked request body, small ones are decoded in
+	 * [body + bodyoff, body + bodyoff + bodylen) before calling the route.
+	 */
+	int inchunked;
+	enum chunk chunkstate;
+	size_t chunkleft;
+	size_t bodytotal;
+	char *body;
+	size_t bodyoff;
+	size_t bodylen;
+	size_t bodycap;
+
+	/* The route is running in a thread which owns the connection. */
+	int busy;
+
+	struct conn *prev;
+	struct conn *next;
+	struct conn *done;
+};
+
+static int lfd = -1;
+static int epfd = -1;
+static int pipefd[2] = { -1, -1 };
+static struct conn *conns;
+
+/* Connections given back by the threads, the loop is woken by wakefd. */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct conn *finished;
+static int wakefd[2] = { -1, -1 };
+
+/*
+ * Tell how many bytes of output the kernel did not send yet, a client
+ * slowly reading a large reply keeps the socket unwritable for long while
+ * this still decreases.
+ */
+static inline int
+unsent(const struct conn *c)
+{
+	int n;
+
+	return ioctl(c->fd, TIOCOUTQ, &n) < 0 ? -1 : n;
+}
+
+/*
+ * Wait until the socket is ready, no longer than the connection may stay
+ * inactive.
+ */
+static int
+wait_for(struct conn *c, short events)
+{
+	struct pollfd pfd = {
+		.fd = c->fd,
+		.events = events
+	};
+	int rv, before;
+
+	do {
+		before = events & POLLOUT ? unsent(c) : -1;
+
+		while ((rv = poll(&pfd, 1, IDLE_TIMEOUT * 1000)) < 0 && errno == EINTR)
+			continue;
+	} while (rv == 0 && before > 0 && unsent(c) < before);
+
+	if (rv == 0)
+		errno = ETIMEDOUT;
+
+	return rv > 0 ? 0 : -1;
+}
+
+static inline size_t
+pending(const struct conn *c)
+{
+	return c->outlen - c->outoff;
+}
+
+static void
+append(struct conn *c, const void *data, size_t datasz)
+{
+	if (c->outcap - c->outlen < datasz) {
+		/* Move pending data to the beginning first. */
+		if (c->outoff) {
+			memmove(c->out, c->out + c->outoff, pending(c));
+			c->outlen -= c->outoff;
+			c->outoff = 0;
+		}
+
+		if (c->outcap - c->outlen < datasz) {
+			c->outcap = c->outlen + datasz + BUFSIZ;
+			c->out = erealloc(c->out, c->outcap, 1);
+		}
+	}
+
+	memcpy(c->out + c->outlen, data, datasz);
+	c->outlen += datasz;
+}
+
+static void
+appendf(struct conn *c, const char *fmt, ...)
+{
+	char buf[1024];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof (buf), fmt, ap);
+	va_end(ap);
+
+	/* Only used for status line and headers. */
+	if (len > 0)
+		append(c, buf, (size_t)len < sizeof (buf) ? (size_t)len : sizeof (buf) - 1);
+}
+
+static ssize_t
+sendall(struct conn *c, const char *data, size_t datasz, int block)
+{
+	ssize_t ns;
+	size_t sent = 0;
+
+	while (sent < datasz) {
+		if ((ns = send(c->fd, data + sent, datasz - sent, MSG_NOSIGNAL)) > 0)
+			sent += ns;
+		else if (errno == EINTR)
+			continue;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return -1;
+		else if (!block)
+			break;
+		else if (wait_for(c, POLLOUT) < 0)
+			return -1;
+	}
+
+	return sent;
+}
+
+static int
+flush(struct conn *c, int block)
+{
+	ssize_t ns;
+
+	if ((ns = sendall(c, c->out + c->outoff, pending(c), block)) < 0)
+		return -1;
+
+	if ((c->outoff += ns) == c->outlen)
+		c->outoff = c->outlen = 0;
+
+	return 0;
+}
+
+/*
+ * Tell the client which announced Expect: 100-continue to send the body,
+ * unless the route already replied without it.
+ */
+static int
+proceed(struct conn *c, int block)
+{
+	static const char msg[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+	if (!c->expect)
+		return 0;
+
+	c->expect = 0;
+
+	if (c->req.body)
+		return 0;
+
+	append(c, msg, sizeof (msg) - 1);
+
+	return flush(c, block);
+}
+
+/*
+ * Make room for at least want bytes after the pending input.
+ */
+static void
+more(struct conn *c, size_t want)
+{
+	if (c->inoff) {
+		memmove(c->in, c->in + c->inoff, c->inlen);
+		c->inoff = 0;
+	}
+	if (c->incap - c->inlen < want) {
+		c->incap = c->inlen + want;
+		c->in = erealloc(c->in, c->incap, 1);
+	}
+}
+
+/*
+ * Receive more input from a route, waiting for it while the client is not
+ * inactive.
+ */
+static int
+receive(struct conn *c)
+{
+	ssize_t nr;
+
+	more(c, BUFSIZ);
+
+	while ((nr = recv(c->fd, c->in + c->inlen, c->incap - c->inlen, 0)) < 0) {
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return -1;
+		if (wait_for(c, POLLIN) < 0)
+			return -1;
+	}
+
+	/* Premature end of body. */
+	if (nr == 0) {
+		c->eof = 1;
+		errno = ECONNRESET;
+		return -1;
+	}
+
+	c->inlen += nr;
+
+	return 0;
+}
+
+/*
+ * Take a chunk size or trailer line from the input, returns 1 if found, 0 if
+ * incomplete or -1 if too long.
+ */
+static int
+chunkline(struct conn *c, char **ret)
+{
+	char *start = c->in + c->inoff, *nl;
+	size_t len;
+
+	if (!(nl = memchr(start, '\n', c->inlen))) {
+		if (c->inlen > CHUNK_LINE_MAX) {
+			errno = EBADMSG;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if ((len = nl - start + 1) > CHUNK_LINE_MAX) {
+		errno = EBADMSG;
+		return -1;
+	}
+
+	*nl = '\0';
+	start[strcspn(start, "\r")] = '\0';
+	c->inoff += len;
+	c->inlen -= len;
+	*ret = start;
+
+	return 1;
+}
+
+/*
+ * Decode the chunked body from the input already received, returns the
+ * number of bytes written in buf which is 0 once the body is complete or if
+ * more input is required.
+ */
+static ssize_t
+unchunk(struct conn *c, char *buf, size_t bufsz)
+{
+	unsigned long long size;
+	size_t len = 0, n;
+	char *l, *end;
+	int rv;
+
+	while (c->chunkstate != CHUNK_DONE && len < bufsz) {
+		if (c->chunkstate == CHUNK_DATA) {
+			if (!c->inlen)
+				break;
+
+			n = bufsz - len;
+			n = n < c->chunkleft ? n : c->chunkleft;
+			n = n < c->inlen ? n : c->inlen;
+			memcpy(buf + len, c->in + c->inoff, n);
+
+			c->inoff += n;
+			c->inlen -= n;
+			len += n;
+
+			if ((c->chunkleft -= n) == 0)
+				c->chunkstate = CHUNK_END;
+
+			continue;
+		}
+
+		if ((rv = chunkline(c, &l)) < 0)
+			return -1;
+		if (rv == 0)
+			break;
+
+		switch (c->chunkstate) {
+		case CHUNK_SIZE:
+			/* Size in hexadecimal followed by optional extensions. */
+			errno = 0;
+			size = isxdigit((unsigned char)*l) ? strtoull(l, &end, 16) : 0;
+
+			if (!isxdigit((unsigned char)*l) || errno ||
+			    (*end && *end != ';' && *end != ' ' && *end != '\t')) {
+				errno = EBADMSG;
+				return -1;
+			}
+			if (size > HTTP_BODY_MAX - c->bodytotal) {
+				errno = EFBIG;
+				return -1;
+			}
+
+			c->bodytotal += size;
+			c->chunkleft = size;
+			c->chunkstate = size ? CHUNK_DATA : CHUNK_TRAILER;
+			break;
+		case CHUNK_END:
+			if (*l) {
+				errno = EBADMSG;
+				return -1;
+			}
+
+			c->chunkstate = CHUNK_SIZE;
+			break;
+		default:
+			/* Trailer fields are ignored. */
+			if (!*l)
+				c->chunkstate = CHUNK_DONE;
+			break;
+		}
+	}
+
+	return len;
+}
+
+static int
+on_head(struct req *r)
+{
+	struct conn *c = r->data;
+	int length = 0;
+
+	appendf(c, "HTTP/1.1 %d %s\r\n", r->status, req_reason(r->status));
+
+	for (size_t i = 0; i < r->respsz; ++i) {
+		if (strcasecmp(r->resps[i].key, "Content-Length") == 0)
+			length = 1;
+
+		appendf(c, "%s: %s\r\n", r->resps[i].key, r->resps[i].val);
+	}
+
+	/*
+	 * Without a length, use chunked encoding if the client supports it or
+	 * close the connection to indicate the end of the body.
+	 */
+	if (!length && !c->head && r->status != 204 && r->status != 304) {
+		if (c->http10)
+			c->keepalive = 0;
+		else {
+			c->chunked = 1;
+			appendf(c, "Transfer-Encoding: chunked\r\n");
+		}
+	}
+
+	if (!c->keepalive)
+		appendf(c, "Connection: close\r\n");
+	else if (c->http10)
+		appendf(c, "Connection: keep-alive\r\n");
+
+	append(c, "\r\n", 2);
+
+	return 0;
+}
+
+static int
+on_write(struct req *r, const void *data, size_t datasz)
+{
+	struct conn *c = r->data;
+
+	if (c->head)
+		return 0;
+	if (c->chunked)
+		appendf(c, "%zx\r\n", datasz);
+
+	/* Large writes are sent directly without copying. */
+	if (pending(c) + datasz > FLUSH_MAX) {
+		if (flush(c, 1) < 0)
+			return -1;
+
+		if (datasz >= FLUSH_MAX) {
+			if (sendall(c, data, datasz, 1) < 0)
+				return -1;
+		} else
+			append(c, data, datasz);
+	} else
+		append(c, data, datasz);
+
+	if (c->chunked)
+		append(c, "\r\n", 2);
+
+	return 0;
+}
+
+static ssize_t
+on_read_chunked(struct conn *c, void *buf, size_t bufsz)
+{
+	ssize_t nr;
+
+	/* Start with what was decoded before calling the route. */
+	if (c->bodylen) {
+		nr = bufsz < c->bodylen ? bufsz : c->bodylen;
+		memcpy(buf, c->body + c->bodyoff, nr);
+		c->bodyoff += nr;
+		c->bodylen -= nr;
+
+		return nr;
+	}
+
+	while ((nr = unchunk(c, buf, bufsz)) == 0 && c->chunkstate != CHUNK_DONE)
+		if (receive(c) < 0)
+			return -1;
+
+	return nr;
+}
+
+static ssize_t
+on_read(struct req *r, void *buf, size_t bufsz)
+{
+	struct conn *c = r->data;
+	ssize_t nr;
+
+	if (proceed(c, 1) < 0)
+		return -1;
+	if (c->inchunked)
+		return on_read_chunked(c, buf, bufsz);
+	if (c->bodyleft == 0)
+		return 0;
+	if (bufsz > c->bodyleft)
+		bufsz = c->bodyleft;
+
+	if (c->inlen) {
+		nr = bufsz < c->inlen ? bufsz : c->inlen;
+		memcpy(buf, c->in + c->inoff, nr);
+		c->inoff += nr;
+		c->inlen -= nr;
+	} else {
+		while ((nr = recv(c->fd, buf, bufsz, 0)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return -1;
+			if (wait_for(c, POLLIN) < 0)
+				return -1;
+		}
+
+		/* Premature end of body. */
+		if (nr == 0) {
+			c->eof = 1;
+			errno = ECONNRESET;
+			return -1;
+		}
+	}
+
+	c->bodyleft -= nr;
+
+	return nr;
+}
+
+static const struct req_ops ops = {
+	.head = on_head,
+	.write = on_write,
+	.read = on_read
+};
+
+static void
+reset(struct conn *c)
+{
+	req_finish(&c->req);
+	req_init(&c->req, &ops, c);
+
+	free(c->hdr);
+	free(c->body);
+	c->hdr = c->body = NULL;
+	c->deadline = 0;
+	c->bodyleft = c->chunkleft = c->bodytotal = 0;
+	c->bodyoff = c->bodylen = c->bodycap = 0;
+	c->chunkstate = CHUNK_SIZE;
+	c->parsed = c->head = c->chunked = c->expect = c->inchunked = 0;
+}
+
+/*
+ * Send a response without calling any route, used for malformed requests.
+ * The connection is closed afterwards.
+ */
+static void
+reject(struct conn *c, int code)
+{
+	const char *msg = req_reason(code);
+
+	appendf(c, "HTTP/1.1 %d %s\r\n", code, msg);
+	appendf(c, "Content-Type: %s\r\n", req_mimes[REQ_MIME_TEXT_HTML]);
+	appendf(c, "Content-Length: %zu\r\n", strlen(msg) + 1);
+	appendf(c, "Connection: close\r\n\r\n%s\n", msg);
+
+	/* Don't let the request send its own headers. */
+	c->req.body = 1;
+	c->closing = 1;
+	reset(c);
+}
+
+static inline char *
+trim(char *str)
+{
+	char *end;
+
+	while (*str == ' ' || *str == '\t')
+		++str;
+
+	for (end = str + strlen(str); end > str && (end[-1] == ' ' || end[-1] == '\t'); )
+		*--end = '\0';
+
+	return str;
+}
+
+/*
+ * Find the end of the header block which is terminated by an empty line,
+ * returns its length including the empty line or 0 if incomplete.
+ */
+static size_t
+header_length(const char *data, size_t datasz)
+{
+	const char *p = data, *end = data + datasz, *nl;
+
+	while ((nl = memchr(p, '\n', end - p))) {
+		if (nl == p || (nl == p + 1 && *p == '\r'))
+			return nl - data + 1;
+
+		p = nl + 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Parse the request line and headers, returns 1 if a request is ready, 0 if
+ * more data is required or -1 if the request was rejected.
+ */
+static int
+parse(struct conn *c)
+{
+	struct req *r = &c->req;
+	char *line, *p, *method, *target, *version, *key, *val;
+	const char *length, *coding, *expect, *conn, *errstr;
+	size_t hdrsz;
+	long long len = 0;
+
+	if (!(hdrsz = header_length(c->in + c->inoff, c->inlen))) {
+		if (c->inlen >= HEADER_MAX)
+			return reject(c, 431), -1;
+
+		return 0;
+	}
+	if (hdrsz > HEADER_MAX)
+		return reject(c, 431), -1;
+
+	c->hdr = emalloc(hdrsz + 1, 1);
+	memcpy(c->hdr, c->in + c->inoff, hdrsz);
+	c->hdr[hdrsz] = '\0';
+	c->inoff += hdrsz;
+	c->inlen -= hdrsz;
+
+	/* Request line: METHOD target HTTP/1.x */
+	p = c->hdr;
+	line = strsep(&p, "\n");
+	line[strcspn(line, "\r")] = '\0';
+
+	if (!(method = strsep(&line, " ")) || !(target = strsep(&line, " ")) ||
+	    !(version = line) || *target != '/')
+		return reject(c, 400), -1;
+
+	if (strcmp(version, "HTTP/1.1") == 0)
+		c->http10 = 0;
+	else if (strcmp(version, "HTTP/1.0") == 0)
+		c->http10 = 1;
+	else
+		return reject(c, 400), -1;
+
+	r->method = req_method(method);
+	r->path = target;
+
+	if ((val = strchr(target, '?'))) {
+		*val++ = '\0';
+		req_parse_query(r, val);
+	}
+
+	/* Headers: Key: value */
+	while ((line = strsep(&p, "\n"))) {
+		line[strcspn(line, "\r")] = '\0';
+
+		if (*line == '\0')
+			break;
+		if (r->headersz >= HEADERS_MAX)
+			return reject(c, 431), -1;
+		if (!(val = strchr(line, ':')) || *line == ' ' || *line == '\t')
+			return reject(c, 400), -1;
+
+		*val++ = '\0';
+		key = line;
+		req_add_header(r, key, trim(val));
+	}
+
+	coding = req_header(r, "Transfer-Encoding");
+	length = req_header(r, "Content-Length");
+
+	/* Only chunked request bodies are supported, without a length. */
+	if (coding && length)
+		return reject(c, 400), -1;
+	if (coding && strcasecmp(coding, "chunked") != 0)
+		return reject(c, 501), -1;
+
+	/* HTTP/1.0 clients don't know about 100 Continue. */
+	if ((expect = req_header(r, "Expect")) && !c->http10) {
+		if (strcasecmp(expect, "100-continue") != 0)
+			return reject(c, 417), -1;
+
+		c->expect = 1;
+	}
+
+	if (length) {
+		len = bstrtonum(length, 0, LLONG_MAX, &errstr);
+
+		if (errstr)
+			return reject(c, 400), -1;
+		if ((unsigned long long)len > HTTP_BODY_MAX)
+			return reject(c, 413), -1;
+	}
+
+	conn = req_header(r, "Connection");
+
+	if (c->http10)
+		c->keepalive = conn && strcasecmp(conn, "keep-alive") == 0;
+	else
+		c->keepalive = !conn || strcasecmp(conn, "close") != 0;
+
+	r->ctype = req_header(r, "Content-Type");
+	r->length = len;
+	c->bodyleft = len;
+	c->inchunked = coding != NULL;
+	c->head = r->method == REQ_METHOD_HEAD;
+	c->parsed = 1;
+	c->deadline = 0;
+
+	return 1;
+}
+
+/*
+ * Run the route in a thread, the connection is given back to the loop once
+ * done.
+ */
+static void
+work(void *data)
+{
+	struct conn *c = data;
+	char buf[BUFSIZ];
+
+	http_process(&c->req);
+
+	/* Routes may not write anything. */
+	req_body(&c->req);
+
+	if (c->chunked && !c->head)
+		append(c, "0\r\n\r\n", 5);
+	if (c->req.error || !c->keepalive)
+		c->closing = 1;
+
+	/* Skip what the route did not read if possible. */
+	if (c->inchunked) {
+		while (c->chunkstate != CHUNK_DONE && unchunk(c, buf, sizeof (buf)) > 0)
+			continue;
+
+		if (c->chunkstate != CHUNK_DONE)
+			c->closing = 1;
+	} else if (c->bodyleft) {
+		if (c->bodyleft <= c->inlen) {
+			c->inoff += c->bodyleft;
+			c->inlen -= c->bodyleft;
+		} else
+			c->closing = 1;
+	}
+
+	reset(c);
+
+	pthread_mutex_lock(&mutex);
+	c->done = finished;
+	finished = c;
+	pthread_mutex_unlock(&mutex);
+
+	if (write(wakefd[1], "", 1) < 0 && errno != EAGAIN)
+		log_warn(TAG "write: %s", strerror(errno));
+}
+
+/*
+ * Read as much as needed: the header block or the body if it should be
+ * received before calling the route.
+ */
+static int
+fill(struct conn *c)
+{
+	size_t want;
+	ssize_t nr;
+
+	for (;;) {
+		if (!c->parsed)
+			want = HEADER_MAX;
+		else if (c->inchunked || c->bodyleft > BODY_INLINE)
+			want = BODY_INLINE;
+		else
+			want = c->bodyleft;
+
+		if (c->inlen >= want)
+			return 0;
+
+		if (c->inoff) {
+			memmove(c->in, c->in + c->inoff, c->inlen);
+			c->inoff = 0;
+		}
+		if (c->incap < want) {
+			c->incap = want;
+			c->in = erealloc(c->in, c->incap, 1);
+		}
+
+		nr = recv(c->fd, c->in + c->inlen, c->incap - c->inlen, 0);
+
+		if (nr > 0)
+			c->inlen += nr;
+		else if (nr == 0) {
+			c->eof = 1;
+			return 0;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		else if (errno != EINTR)
+			return -1;
+	}
+}
+
+static void
+drop(struct conn *c)
+{
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		conns = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+
+	/* Avoid sending headers of the unfinished request. */
+	c->req.body = 1;
+	req_finish(&c->req);
+
+	close(c->fd);
+	free(c->hdr);
+	free(c->body);
+	free(c->in);
+	free(c->out);
+	free(c);
+}
+
+static void
+update(struct conn *c)
+{
+	struct epoll_event ev = {
+		.data.ptr = c
+	};
+
+	/* Stop reading while output is pending to limit memory usage. */
+	ev.events = pending(c) ? EPOLLOUT : EPOLLIN;
+
+	if (ev.events != c->events) {
+		c->events = ev.events;
+		epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	}
+}
+
+/*
+ * Decode a chunked body as long as it is small, the route reads the
+ * remaining by itself otherwise. The length is known once complete.
+ */
+static int
+prefetch(struct conn *c)
+{
+	ssize_t nr;
+
+	while (c->chunkstate != CHUNK_DONE && c->bodylen < BODY_INLINE) {
+		if (c->bodycap == c->bodylen) {
+			c->bodycap = c->bodycap ? c->bodycap * 2 : BUFSIZ;
+			c->bodycap = c->bodycap < BODY_INLINE ? c->bodycap : BODY_INLINE;
+			c->body = erealloc(c->body, c->bodycap, 1);
+		}
+
+		if ((nr = unchunk(c, c->body + c->bodylen, c->bodycap - c->bodylen)) < 0)
+			return -1;
+		if (nr == 0)
+			break;
+
+		c->bodylen += nr;
+	}
+
+	if (c->chunkstate == CHUNK_DONE)
+		c->req.length = c->bodytotal;
+
+	return 0;
+}
+
+/*
+ * Tell if the route can be called, returns 1 if ready, 0 if more data is
+ * required or -1 if the request was rejected.
+ */
+static int
+ready(struct conn *c)
+{
+	if (c->inchunked) {
+		if (prefetch(c) < 0)
+			return reject(c, errno == EFBIG ? 413 : 400), -1;
+		if (c->chunkstate == CHUNK_DONE || c->bodylen >= BODY_INLINE)
+			return 1;
+	} else if (c->bodyleft > BODY_INLINE || c->inlen >= c->bodyleft)
+		return 1;
+
+	/* Small bodies are received here, ask for it. */
+	if (proceed(c, 0) < 0)
+		return -1;
+
+	return 0;
+}
+
+static void
+start(struct conn *c)
+{
+	/* The thread owns the connection until it is given back. */
+	epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	c->events = 0;
+	c->busy = 1;
+	pool_submit(work, c);
+}
+
+static void
+process(struct conn *c)
+{
+	int rv;
+
+	while (!c->closing && pending(c) < FLUSH_MAX) {
+		if (!c->parsed && !c->deadline && c->inlen)
+			c->deadline = time(NULL) + HEADER_TIMEOUT;
+
+		if (!c->parsed) {
+			if ((rv = parse(c)) < 0)
+				break;
+			if (rv == 0) {
+				if (c->eof)
+					c->closing = 1;
+				break;
+			}
+		}
+
+		if ((rv = ready(c)) < 0)
+			break;
+		if (rv == 0) {
+			if (c->eof)
+				c->closing = 1;
+			break;
+		}
+
+		start(c);
+		return;
+	}
+
+	if (flush(c, 0) < 0 || (c->closing && !pending(c)))
+		drop(c);
+	else
+		update(c);
+}
+
+static void
+handle(struct conn *c, uint32_t events)
+{
+	c->last = time(NULL);
+
+	if (events & EPOLLERR) {
+		drop(c);
+		return;
+	}
+	if (events & EPOLLOUT) {
+		if (flush(c, 0) < 0) {
+			drop(c);
+			return;
+		}
+	}
+	if (events & (EPOLLIN | EPOLLHUP)) {
+		if (fill(c) < 0) {
+			drop(c);
+			return;
+		}
+	}
+
+	process(c);
+}
+
+static void
+accept_all(void)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN
+	};
+	struct conn *c;
+	int fd, one = 1;
+
+	for (;;) {
+		if ((fd = accept(lfd, NULL, NULL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				log_warn(TAG "accept: %s", strerror(errno));
+
+			break;
+		}
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+		c = ecalloc(1, sizeof (*c));
+		c->fd = fd;
+		c->last = time(NULL);
+		c->events = EPOLLIN;
+		req_init(&c->req, &ops, c);
+
+		ev.data.ptr = c;
+
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			log_warn(TAG "epoll_ctl: %s", strerror(errno));
+			close(fd);
+			free(c);
+			continue;
+		}
+
+		if ((c->next = conns))
+			conns->prev = c;
+
+		conns = c;
+	}
+}
+
+static void
+resume(void)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN
+	};
+	struct conn *c, *next;
+	char buf[64];
+
+	while (read(wakefd[0], buf, sizeof (buf)) > 0)
+		continue;
+
+	pthread_mutex_lock(&mutex);
+	c = finished;
+	finished = NULL;
+	pthread_mutex_unlock(&mutex);
+
+	for (; c; c = next) {
+		next = c->done;
+
+		c->busy = 0;
+		c->last = time(NULL);
+		c->events = ev.events;
+		ev.data.ptr = c;
+
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0)
+			drop(c);
+		else
+			process(c);
+	}
+}
+
+static void
+sweep(void)
+{
+	struct conn *c, *next;
+	time_t now = time(NULL);
+	int queued;
+
+	for (c = conns; c; c = next) {
+		next = c->next;
+
+		if (c->busy)
+			continue;
+
+		/* Output still being read counts as activity. */
+		if (pending(c) && (queued = unsent(c)) >= 0) {
+			if (queued < c->unsent)
+				c->last = now;
+
+			c->unsent = queued;
+		}
+
+		if (now - c->last < IDLE_TIMEOUT && (!c->deadline || now < c->deadline))
+			continue;
+
+		/* Best effort for started requests, it is closed anyway. */
+		if ((c->parsed || c->inlen) && !pending(c) && !c->req.body) {
+			reject(c, 408);
+			flush(c, 0);
+		}
+
+		drop(c);
+	}
+}
+
+/*
+ * Wake up the threads waiting for slow clients so that they finish quickly.
+ */
+static void
+interrupt(void)
+{
+	for (struct conn *c = conns; c; c = c->next)
+		if (c->busy)
+			shutdown(c->fd, SHUT_RDWR);
+}
+
+void
+http_native_init(const char *addr)
+{
+	assert(addr);
+
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+		.ai_flags = AI_PASSIVE
+	}, *res, *ai;
+	struct epoll_event ev = {
+		.events = EPOLLIN
+	};
+	char buf[256], *host = NULL, *port = buf, *end;
+	int rv, one = 1;
+
+	if (bstrlcpy(buf, addr, sizeof (buf)) >= sizeof (buf))
+		die("abort: %s: address too long\n", addr);
+
+	/* [host]:port, host:port or port. */
+	if (buf[0] == '[' && (end = strstr(buf, "]:"))) {
+		*end = '\0';
+		host = buf + 1;
+		port = end + 2;
+	} else if ((end = strrchr(buf, ':'))) {
+		*end = '\0';
+		host = buf;
+		port = end + 1;
+	}
+
+	/* Empty host or * means any address. */
+	if (host && (host[0] == '\0' || strcmp(host, "*") == 0))
+		host = NULL;
+
+	if ((rv = getaddrinfo(host, port, &hints, &res)) != 0)
+		die("abort: %s: %s\n", addr, gai_strerror(rv));
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		if ((lfd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK, ai->ai_protocol)) < 0)
+			continue;
+
+		/*
+		 * Every worker binds its own socket to the same address so that
+		 * the kernel balances connections between them.
+		 */
+		setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+		setsockopt(lfd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof (one));
+
+		if (bind(lfd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(lfd, SOMAXCONN) == 0)
+			break;
+
+		close(lfd);
+		lfd = -1;
+	}
+
+	freeaddrinfo(res);
+
+	if (lfd < 0)
+		die("abort: %s: %s\n", addr, strerror(errno));
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		die("abort: epoll_create1: %s\n", strerror(errno));
+	if (pipe(pipefd) < 0 || pipe(wakefd) < 0)
+		die("abort: pipe: %s\n", strerror(errno));
+
+	/* Threads never wait for the loop. */
+	for (int i = 0; i < 2; ++i)
+		fcntl(wakefd[i], F_SETFL, fcntl(wakefd[i], F_GETFL) | O_NONBLOCK);
+
+	ev.data.ptr = &lfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+	ev.data.ptr = pipefd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, pipefd[0], &ev);
+	ev.data.ptr = wakefd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd[0], &ev);
+
+	log_info(TAG "listening on %s", addr);
+}
+
+void
+http_native_run(void)
+{
+	struct epoll_event evs[EVENTS_MAX];
+	int n;
+
+	for (;;) {
+		if ((n = epoll_wait(epfd, evs, LEN(evs), 1000)) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			log_warn(TAG "epoll_wait: %s", strerror(errno));
+			return;
+		}
+
+		for (int i = 0; i < n; ++i) {
+			if (evs[i].data.ptr == &lfd)
+				accept_all();
+			else if (evs[i].data.ptr == pipefd) {
+				interrupt();
+				return;
+			} else if (evs[i].data.ptr == wakefd)
+				resume();
+			else
+				handle(evs[i].data.ptr, evs[i].events);
+		}
+
+		sweep();
+	}
+}
+
+void
+http_native_stop(void)
+{
+	if (write(pipefd[1], "", 1) < 0)
+		log_warn(TAG "write: %s", strerror(errno));
+}
+
+void
+http_native_finish(void)
+{
+	/* The threads are stopped, connections given back are still listed. */
+	finished = NULL;
+
+	while (conns)
+		drop(conns);
+
+	close(lfd);
+	close(epfd);
+	close(pipefd[0]);
+	close(pipefd[1]);
+	close(wakefd[0]);
+	close(wakefd[1]);
+
+	lfd = epfd = pipefd[0] = pipefd[1] = wakefd[0] = wakefd[1] = -1;
+}
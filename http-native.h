@@ -0,0 +1,58 @@
+/*
+ * http-native.h -- built-in HTTP/1.1 server
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_HTTP_NATIVE_H
+#define TMPUPD_HTTP_NATIVE_H
+
+/**
+ * \file http-native.h
+ * \brief Built-in HTTP/1.1 server.
+ *
+ * Non-blocking server based on epoll(7) supporting persistent connections
+ * and pipelining. Routes are still executed synchronously from the event
+ * loop, only the network input/output is multiplexed.
+ */
+
+/**
+ * Create the listening socket, exits on failure.
+ *
+ * \pre addr != NULL
+ * \param addr the address in the form `[host:]port`
+ */
+void
+http_native_init(const char *addr);
+
+/**
+ * Run the event loop until ::http_native_stop is called.
+ */
+void
+http_native_run(void);
+
+/**
+ * Ask the event loop to stop, can be called from any thread.
+ */
+void
+http_native_stop(void);
+
+/**
+ * Close every connection and the listening socket.
+ */
+void
+http_native_finish(void);
+
+#endif /* !TMPUPD_HTTP_NATIVE_H */
@@ -20,49 +20,92 @@
 #include <pthread.h>
 #include <regex.h>
 #include <signal.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "http-fcgi.h"
+#include "http-native.h"
 #include "http.h"
 #include "log.h"
+#include "pool.h"
 #include "route-api-v0-image.h"
 #include "route-api-v0-paste.h"
+#include "route-api-v1-batch.h"
+#include "route-api-v1-image.h"
+#include "route-api-v1-paste.h"
+#include "route-api-v1-search.h"
+#include "route-api-v1-stats.h"
+#include "route-api-v1-upload.h"
 #include "route-image.h"
 #include "route-index.h"
 #include "route-paste.h"
+#include "route-search.h"
 #include "route-static.h"
+#include "route-stats.h"
 #include "route.h"
+#include "stats.h"
 #include "util.h"
 
 /* Need to use this to avoid "uninitialized regex field". smh. */
-#define GET(p, e)       { .method = KMETHOD_GET,  .path = p, .exec = e }
-#define POST(p, e)      { .method = KMETHOD_POST, .path = p, .exec = e }
+#define GET(p, e)       { .method = REQ_METHOD_GET,  .path = p, .exec = e }
+#define POST(p, e)      { .method = REQ_METHOD_POST, .path = p, .exec = e }
+
+/* POST routes reading the body by themselves. */
+#define STREAM(p, e)    { .method = REQ_METHOD_POST, .path = p, .exec = e, .stream = 1 }
+
+/* PUT routes always read the body by themselves. */
+#define PUT(p, e)       { .method = REQ_METHOD_PUT,  .path = p, .exec = e, .stream = 1 }
+
+#define TAG "http: "
 
 struct route {
-	enum kmethod method;
+	enum req_method method;
 	const char *path;
-	void (*exec)(struct kreq *, const char * const *);
+	void (*exec)(struct req *, const char * const *);
+	int stream;
 	regex_t regex;
 };
 
 static struct route routes[] = {
-	GET  ("^/$",                            route_index),
-	GET  ("^/image/download/([a-z0-9]+)$",  route_image_download),
-	GET  ("^/image/new",                    route_image_new),
-	POST ("^/image/new",                    route_image_new),
-	GET  ("^/image/([a-z0-9]+)$",           route_image),
-	GET  ("^/paste/download/([a-z0-9]+)$",  route_paste_download),
-	GET  ("^/paste/fork/([a-z0-9]+)?$",     route_paste_new),
-	GET  ("^/paste/raw/([a-z0-9]+)$",       route_paste_raw),
-	GET  ("^/paste/new",                    route_paste_new),
-	POST ("^/paste/new",                    route_paste_new),
-	GET  ("^/paste/([a-z0-9]+)$",           route_paste),
-	POST ("^/api/v0/image$",                route_api_v0_image),
-	POST ("^/api/v0/paste$",                route_api_v0_paste),
-	GET  ("^/static/(.*)",                  route_static)
+	GET   ("^/$",                                  route_index),
+	GET   ("^/image/download/([a-z0-9]+)$",        route_image_download),
+	GET   ("^/image/new",                          route_image_new),
+	GET   ("^/image/thumb/([a-z0-9]+)$",           route_image_thumb),
+	STREAM("^/image/new",                          route_image_new),
+	GET   ("^/image/([a-z0-9]+)$",                 route_image),
+	GET   ("^/images$",                            route_images),
+	GET   ("^/paste/download/([a-z0-9]+)$",        route_paste_download),
+	GET   ("^/paste/fork/([a-z0-9]+)?$",           route_paste_new),
+	GET   ("^/paste/raw/([a-z0-9]+)$",             route_paste_raw),
+	GET   ("^/paste/new",                          route_paste_new),
+	POST  ("^/paste/new",                          route_paste_new),
+	GET   ("^/paste/([a-z0-9]+)$",                 route_paste),
+	GET   ("^/pastes$",                            route_pastes),
+	GET   ("^/search$",                            route_search),
+	GET   ("^/stats$",                             route_stats),
+	STREAM("^/api/v0/image$",                      route_api_v0_image),
+	STREAM("^/api/v0/paste$",                      route_api_v0_paste),
+	STREAM("^/api/v1/batch$",                      route_api_v1_batch),
+	GET   ("^/api/v1/image$",                      route_api_v1_image),
+	STREAM("^/api/v1/image$",                      route_api_v1_image),
+	GET   ("^/api/v1/images$",                     route_api_v1_images),
+	GET   ("^/api/v1/paste$",                      route_api_v1_paste),
+	STREAM("^/api/v1/paste$",                      route_api_v1_paste),
+	STREAM("^/api/v1/paste/([a-z0-9]+)/append$",   route_api_v1_paste),
+	GET   ("^/api/v1/pastes$",                     route_api_v1_pastes),
+	GET   ("^/api/v1/search$",                     route_api_v1_search),
+	GET   ("^/api/v1/stats$",                      route_api_v1_stats),
+	POST  ("^/api/v1/upload$",                     route_api_v1_upload),
+	GET   ("^/api/v1/upload/([a-z0-9]+)$",         route_api_v1_upload),
+	PUT   ("^/api/v1/upload/([a-z0-9]+)$",         route_api_v1_upload),
+	POST  ("^/api/v1/upload/([a-z0-9]+)$",         route_api_v1_upload),
+	GET   ("^/static/(.*)",                        route_static)
 };
 
 static pthread_t thread;
+static const char *address;
 
 static inline char **
 makeargs(const char *path, const regmatch_t *matches, size_t len)
@@ -72,7 +115,8 @@ makeargs(const char *path, const regmatch_t *matches, size_t len)
 
 	for (size_t i = 1; i < len && matches[i].rm_so != -1; ++i) {
 		list = ereallocarray(list, listsz + 1, sizeof (char *));
-		list[listsz++] = estrndup(path + matches[i].rm_so, matches[i].rm_eo);
+		list[listsz++] = estrndup(path + matches[i].rm_so,
+		    matches[i].rm_eo - matches[i].rm_so);
 	}
 
 	/* Terminate as NULL. */
@@ -91,33 +135,20 @@ freeargs(char **list)
 	free(list);
 }
 
-static void
-process(struct kreq *r)
+static int
+body(struct req *r, const struct route *route)
 {
-	assert(r);
-
-	regmatch_t matches[8];
-	struct route *route = NULL, *iter;
-	char **args;
-
-	for (size_t i = 0; i < LEN(routes); ++i) {
-		iter = &routes[i];
-
-		if (r->method != iter->method)
-			continue;
-		if (regexec(&iter->regex, r->fullpath, LEN(matches), matches, 0) == 0) {
-			route = iter;
-			break;
+	/* Only check the announced length, the route reads the body. */
+	if (route->stream) {
+		if (r->length > HTTP_BODY_MAX) {
+			errno = EFBIG;
+			return -1;
 		}
-	}
 
-	if (!route)
-		route_status(r, KHTTP_404, KMIME_TEXT_HTML);
-	else {
-		args = makeargs(r->fullpath, matches, LEN(matches));
-		route->exec(r, (const char * const *)args);
-		freeargs(args);
+		return 0;
 	}
+
+	return req_parse_body(r, HTTP_BODY_MAX);
 }
 
 static void *
@@ -125,31 +156,19 @@ routine(void *data)
 {
 	(void)data;
 
-	struct kfcgi *fcgi;
-	struct kreq req;
-	int run = 1;
-
-	if (khttp_fcgi_init(&fcgi, NULL, 0, NULL, 0, 0) != KCGI_OK)
-		die("abort: could not allocate FastCGI");
-
-	while (run) {
-		if (khttp_fcgi_parse(fcgi, &req) == KCGI_OK) {
-			process(&req);
-			khttp_free(&req);
-		} else {
-			/* Indicate to main thread to quit. */
-			kill(getpid(), SIGINT);
-			run = 0;
-		}
-	}
+	if (address)
+		http_native_run();
+	else
+		http_fcgi_run();
 
-	khttp_fcgi_free(fcgi);
+	/* Indicate to main thread to quit. */
+	kill(getpid(), SIGINT);
 
 	return NULL;
 }
 
 void
-http_init(void)
+http_init(const char *listen)
 {
 	struct route *route;
 	int rv;
@@ -165,15 +184,68 @@ http_init(void)
 		}
 	}
 
+	if ((address = listen))
+		http_native_init(listen);
+	else
+		http_fcgi_init();
+
+	pool_init(HTTP_THREADS);
+
 	if ((rv = pthread_create(&thread, NULL, routine, NULL)) != 0)
 		die("abort: pthread_create: %s\n", strerror(rv));
 }
 
+void
+http_process(struct req *r)
+{
+	assert(r);
+
+	regmatch_t matches[8];
+	struct route *route = NULL, *iter;
+	char **args;
+
+	for (size_t i = 0; i < LEN(routes); ++i) {
+		iter = &routes[i];
+
+		/* HEAD is served by the GET routes, without a body. */
+		if (r->method != iter->method &&
+		    (r->method != REQ_METHOD_HEAD || iter->method != REQ_METHOD_GET))
+			continue;
+		if (regexec(&iter->regex, r->path, LEN(matches), matches, 0) == 0) {
+			route = iter;
+			break;
+		}
+	}
+
+	if (!route)
+		route_status(r, 404, REQ_MIME_TEXT_HTML);
+	else if (body(r, route) < 0) {
+		log_warn(TAG "%s: unable to read body: %s", r->path, strerror(errno));
+		route_status(r, errno == EFBIG ? 413 : 400, REQ_MIME_TEXT_HTML);
+	} else {
+		args = makeargs(r->path, matches, LEN(matches));
+		route->exec(r, (const char * const *)args);
+		freeargs(args);
+	}
+
+	stats_request(r->status, r->length, r->sent);
+}
+
 void
 http_finish(void)
 {
-	pthread_kill(thread, SIGTERM);
+	if (address)
+		http_native_stop();
+	else
+		http_fcgi_stop();
+
 	pthread_join(thread, NULL);
+	pool_finish();
+
+	if (address)
+		http_native_finish();
+	else
+		http_fcgi_finish();
 
 	for (size_t i = 0; i < LEN(routes); ++i)
 		regfree(&routes[i].regex);
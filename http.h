@@ -24,11 +24,42 @@
  * \brief HTTP request handling.
  */
 
+/**
+ * \def HTTP_BODY_MAX
+ * Maximum request body length accepted.
+ */
+#define HTTP_BODY_MAX (32UL * 1024 * 1024)
+
+/**
+ * \def HTTP_THREADS
+ * Number of threads running the routes.
+ */
+#define HTTP_THREADS 8
+
+struct req;
+
 /**
  * Initialize HTTP system.
+ *
+ * If listen is NULL, requests are read from FastCGI on the standard input,
+ * otherwise the built-in HTTP server is bound to the given address in the
+ * form `[host:]port`.
+ *
+ * \param listen the address to listen to (may be NULL)
+ */
+void
+http_init(const char *listen);
+
+/**
+ * Dispatch the request to the appropriate route.
+ *
+ * This function is called by the backends.
+ *
+ * \pre r != NULL
+ * \param r the request
  */
 void
-http_init(void);
+http_process(struct req *r);
 
 /**
  * Cleanup HTTP system.
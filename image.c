@@ -25,9 +25,76 @@
 #include "check.h"
 #include "default-image.h"
 #include "image.h"
+#include "json-read.h"
 #include "tmp.h"
 #include "util.h"
 
+/*
+ * Context for decoding the JSON data property directly into the final image
+ * buffer while it is being read.
+ */
+struct sink {
+	unsigned char *data;
+	size_t datasz;
+	size_t len;
+};
+
+static void
+init(struct image *image,
+     const char *id,
+     const char *title,
+     const char *author,
+     const char *filename,
+     time_t start,
+     time_t end,
+     int visible)
+{
+	memset(image, 0, sizeof (*image));
+
+	if (id)
+		image->id = estrdup(id);
+	else
+		image->id = tmp_id();
+
+	image->title = estrdup(title ? title : TMP_DEFAULT_TITLE);
+	image->author = estrdup(author ? author : TMP_DEFAULT_AUTHOR);
+	image->filename = estrdup(filename ? filename : TMP_DEFAULT_FILENAME);
+	image->start = start;
+	image->end = end;
+	image->visible = visible;
+}
+
+/*
+ * Reject the upload as soon as the beginning of the image is decoded so that
+ * the rest of the payload is not decoded for nothing, decoded pieces can be
+ * as small as three bytes so they are checked once gathered. Smaller images
+ * are checked when the document ends.
+ */
+static int
+sink(void *data, const unsigned char *buf, size_t bufsz)
+{
+	struct sink *sk = data;
+	size_t len = sk->len;
+
+	if (sk->datasz - sk->len < bufsz) {
+		while (sk->datasz - sk->len < bufsz)
+			sk->datasz = sk->datasz ? sk->datasz * 2 : 65536;
+
+		sk->data = erealloc(sk->data, sk->datasz, 1);
+	}
+
+	memcpy(sk->data + sk->len, buf, bufsz);
+	sk->len += bufsz;
+
+	if (len < CHECK_IMAGE_HEAD && sk->len >= CHECK_IMAGE_HEAD &&
+	    check_image(sk->data, sk->len) < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
 void
 image_init(struct image *image,
            const char *id,
@@ -43,16 +110,7 @@ image_init(struct image *image,
 	assert(image);
 	assert(end > start);
 
-	memset(image, 0, sizeof (*image));
-
-	if (id)
-		image->id = estrdup(id);
-	else
-		image->id = tmp_id();
-
-	image->title = estrdup(title ? title : TMP_DEFAULT_TITLE);
-	image->author = estrdup(author ? author : TMP_DEFAULT_AUTHOR);
-	image->filename = estrdup(filename ? filename : TMP_DEFAULT_FILENAME);
+	init(image, id, title, author, filename, start, end, visible);
 
 	/* Add some fun to trollers. */
 	if (data) {
@@ -62,10 +120,6 @@ image_init(struct image *image,
 		image->data = ememdup(wow, sizeof (wow));
 		image->datasz = sizeof (wow);
 	}
-
-	image->start = start;
-	image->end = end;
-	image->visible = visible;
 }
 
 void
@@ -111,54 +165,75 @@ image_dump(const struct image *image)
 	return ret;
 }
 
+static int
+decode(void *data, const char *buf, size_t bufsz)
+{
+	return b64_decoder_update(data, buf, bufsz);
+}
+
 int
-image_parse(struct image *image, const char *text, char *error, size_t errorsz)
+image_read(struct image *image,
+           json_read_fn read,
+           void *data,
+           size_t max,
+           char *error,
+           size_t errorsz)
 {
-	const char *title = NULL, *author = NULL, *filename = NULL, *data = NULL;
-	json_int_t start = 0, end = 0;
-	size_t datasz = 0, decsz;
-	json_t *doc = NULL;
-	json_error_t err;
+	assert(image);
+	assert(read);
+	assert(error);
+
+	char *title = NULL, *author = NULL, *filename = NULL;
+	intmax_t start = 0, end = 0;
 	int rv, visible = 0;
-	unsigned char *dec;
+	struct json_read jr;
+	struct b64_decoder dec;
+	struct sink sk = {0};
+	struct json_read_key keys[] = {
+		{ .name = "title",     .type = JSON_READ_STR,   .value = &title },
+		{ .name = "author",    .type = JSON_READ_STR,   .value = &author },
+		{ .name = "filename",  .type = JSON_READ_STR,   .value = &filename },
+		{ .name = "data",      .type = JSON_READ_SINK,  .value = &dec, .sink = decode },
+		{ .name = "start",     .type = JSON_READ_INT,   .value = &start },
+		{ .name = "end",       .type = JSON_READ_INT,   .value = &end },
+		{ .name = "visible",   .type = JSON_READ_BOOL,  .value = &visible }
+	};
 
 	memset(image, 0, sizeof (*image));
 
-	rv = tmp_parse(&doc, &err, text, "{s?s s?s s?s s?s% s?I s?I s?b}",
-		"title",        &title,
-		"author",       &author,
-		"filename",     &filename,
-		"data",         &data, &datasz,
-		"start",        &start,
-		"end",          &end,
-		"visible",      &visible
-	);
-
-	if (rv < 0) {
-		bstrlcpy(error, err.text, errorsz);
-		return -1;
-	}
-	if (check_duration(start, end, error, errorsz) < 0)
-		return -1;
-
 	/*
-	 * Allocate large enough bytes to decode data but get the real number
-	 * of bytes just after decoding.
+	 * The data property is decoded as it arrives, the real number of bytes
+	 * is only known once the whole document has been read.
 	 */
-	decsz = B64_DECODE_LENGTH(datasz) + 8;
-	dec = ecalloc(decsz, 1);
-	decsz = b64_decode(data, datasz, dec, decsz);
-
-	if (decsz == (size_t)-1) {
-		rv = -1;
+	b64_decoder_init(&dec, sink, &sk);
+	json_read_init(&jr, read, data, max);
+
+	if ((rv = json_read_object(&jr, keys, LEN(keys))) < 0) {
+		if (errno == EINVAL)
+			bstrlcpy(error, "not a valid image", errorsz);
+		else
+			bstrlcpy(error, jr.error, errorsz);
+	} else if ((rv = b64_decoder_final(&dec)) < 0)
 		bstrlcpy(error, strerror(errno), errorsz);
-	} else {
-		rv = 0;
-		image_init(image, NULL, title, author, filename, dec, decsz, start, end, visible);
+	else if ((rv = check_duration(start, end, error, errorsz)) < 0)
+		errno = EINVAL;
+	else if (sk.len < CHECK_IMAGE_HEAD && check_image(sk.data, sk.len) < 0) {
+		rv = -1;
+		errno = EINVAL;
+		bstrlcpy(error, "not a valid image", errorsz);
+	}
+
+	if (rv < 0)
+		free(sk.data);
+	else {
+		init(image, NULL, title, author, filename, start, end, visible);
+		image->data = sk.data ? sk.data : emalloc(1, 1);
+		image->datasz = sk.len;
 	}
 
-	free(dec);
-	json_decref(doc);
+	free(title);
+	free(author);
+	free(filename);
 
 	return rv;
 }
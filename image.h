@@ -27,6 +27,8 @@
 #include <stddef.h>
 #include <time.h>
 
+#include "json-read.h"
+
 /**
  * \struct image
  * \brief Image definition structure
@@ -137,16 +139,29 @@ char *
 image_dump(const struct image *image);
 
 /**
- * Try to parse the JSON text as an image.
+ * Read a JSON document as an image without loading it entirely, the data
+ * property is decoded while the document is being read.
+ *
+ * On error, errno is set to EFBIG if the document exceeds max bytes.
  *
  * \pre image != NULL
- * \param text JSON document to parse
+ * \pre read != NULL
+ * \pre error != NULL
+ * \param image the image to fill
+ * \param read the input function
+ * \param data the input function user data
+ * \param max the maximum document length
  * \param error the error string to fill
- * \param errosz maximum error length
+ * \param errorsz maximum error length
  * \return 0 on success or -1 on error
  */
 int
-image_parse(struct image *image, const char *text, char *error, size_t errorsz);
+image_read(struct image *image,
+           json_read_fn read,
+           void *data,
+           size_t max,
+           char *error,
+           size_t errorsz);
 
 /**
  * Cleanup the image.
@@ -0,0 +1,727 @@
+/*
+ * json-read.c -- streaming JSON reader
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json-read.h"
+#include "util.h"
+
+/* Return values of peek() besides a character. */
+#define END     -1
+#define ERR     -2
+
+/* Position in a sequence of objects read with json_read_next(). */
+enum {
+	STATE_START,
+	STATE_STREAM,
+	STATE_ARRAY,
+	STATE_DONE
+};
+
+/* Maximum nesting of skipped values. */
+#define DEPTH   32
+
+/* Longest key name that can match. */
+#define KEY_MAX 64
+
+/* Destination for JSON_READ_STR values. */
+struct str {
+	char *data;
+	size_t len;
+	size_t cap;
+};
+
+/* Destination for key names, longer names are truncated. */
+struct key {
+	char data[KEY_MAX];
+	size_t len;
+	int overflow;
+};
+
+static int
+fail(struct json_read *jr, int err, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(jr->error, sizeof (jr->error), fmt, ap);
+	va_end(ap);
+
+	errno = err;
+
+	return -1;
+}
+
+static int
+syntax(struct json_read *jr, const char *what)
+{
+	return fail(jr, EBADMSG, "%s near byte %zu", what, jr->total - (jr->len - jr->pos));
+}
+
+/*
+ * Make sure there is at least one byte available in the buffer, return 1 if
+ * so, 0 at the end of input or -1 on error.
+ */
+static int
+fill(struct json_read *jr)
+{
+	ssize_t nr;
+
+	if (jr->pos < jr->len)
+		return 1;
+	if (jr->eof)
+		return 0;
+
+	if ((nr = jr->read(jr->data, jr->buf, sizeof (jr->buf))) < 0)
+		return fail(jr, errno, "%s", strerror(errno));
+	if (nr == 0) {
+		jr->eof = 1;
+		return 0;
+	}
+	if ((jr->total += nr) > jr->max)
+		return fail(jr, EFBIG, "%s", strerror(EFBIG));
+
+	jr->pos = 0;
+	jr->len = nr;
+
+	return 1;
+}
+
+static int
+peek(struct json_read *jr)
+{
+	int rc;
+
+	if ((rc = fill(jr)) < 0)
+		return ERR;
+	if (rc == 0)
+		return END;
+
+	return (unsigned char)jr->buf[jr->pos];
+}
+
+/*
+ * Skip white spaces and return the next character without consuming it.
+ */
+static int
+next(struct json_read *jr)
+{
+	int c;
+
+	while ((c = peek(jr)) == ' ' || c == '\t' || c == '\n' || c == '\r')
+		jr->pos++;
+
+	return c;
+}
+
+static int
+expect(struct json_read *jr, int expected, const char *what)
+{
+	int c;
+
+	if ((c = next(jr)) == ERR)
+		return -1;
+	if (c != expected)
+		return syntax(jr, what);
+
+	jr->pos++;
+
+	return 0;
+}
+
+static int
+emit(struct json_read *jr, json_read_sink sink, void *data, const char *buf, size_t bufsz)
+{
+	if (!sink || bufsz == 0)
+		return 0;
+	if (sink(data, buf, bufsz) < 0)
+		return fail(jr, errno, "%s", strerror(errno));
+
+	return 0;
+}
+
+static int
+str_sink(void *data, const char *buf, size_t bufsz)
+{
+	struct str *str = data;
+
+	if (str->cap - str->len <= bufsz) {
+		while (str->cap - str->len <= bufsz)
+			str->cap = str->cap ? str->cap * 2 : 64;
+
+		str->data = erealloc(str->data, str->cap, 1);
+	}
+
+	memcpy(str->data + str->len, buf, bufsz);
+	str->len += bufsz;
+	str->data[str->len] = '\0';
+
+	return 0;
+}
+
+static int
+key_sink(void *data, const char *buf, size_t bufsz)
+{
+	struct key *key = data;
+
+	if (key->len + bufsz >= sizeof (key->data))
+		key->overflow = 1;
+	else {
+		memcpy(key->data + key->len, buf, bufsz);
+		key->len += bufsz;
+		key->data[key->len] = '\0';
+	}
+
+	return 0;
+}
+
+static int
+hex(struct json_read *jr, unsigned int *cp)
+{
+	int c;
+
+	*cp = 0;
+
+	for (int i = 0; i < 4; ++i) {
+		if ((c = peek(jr)) == ERR)
+			return -1;
+		if (c >= '0' && c <= '9')
+			*cp = (*cp << 4) | (c - '0');
+		else if (c >= 'a' && c <= 'f')
+			*cp = (*cp << 4) | (c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F')
+			*cp = (*cp << 4) | (c - 'A' + 10);
+		else
+			return syntax(jr, "invalid \\u escape");
+
+		jr->pos++;
+	}
+
+	return 0;
+}
+
+/*
+ * Decode an escape sequence, the backslash being already consumed.
+ */
+static int
+escape(struct json_read *jr, json_read_sink sink, void *data)
+{
+	unsigned int cp, lo;
+	char out[4];
+	size_t outsz = 1;
+	int c;
+
+	if ((c = peek(jr)) == ERR)
+		return -1;
+	if (c == END)
+		return syntax(jr, "unterminated string");
+
+	jr->pos++;
+
+	switch (c) {
+	case '"':
+	case '\\':
+	case '/':
+		out[0] = c;
+		break;
+	case 'b':
+		out[0] = '\b';
+		break;
+	case 'f':
+		out[0] = '\f';
+		break;
+	case 'n':
+		out[0] = '\n';
+		break;
+	case 'r':
+		out[0] = '\r';
+		break;
+	case 't':
+		out[0] = '\t';
+		break;
+	case 'u':
+		if (hex(jr, &cp) < 0)
+			return -1;
+		if (cp >= 0xdc00 && cp <= 0xdfff)
+			return syntax(jr, "invalid Unicode surrogate");
+
+		/* High surrogate, a low one must follow. */
+		if (cp >= 0xd800 && cp <= 0xdbff) {
+			if (peek(jr) != '\\')
+				return syntax(jr, "invalid Unicode surrogate");
+
+			jr->pos++;
+
+			if (peek(jr) != 'u')
+				return syntax(jr, "invalid Unicode surrogate");
+
+			jr->pos++;
+
+			if (hex(jr, &lo) < 0)
+				return -1;
+			if (lo < 0xdc00 || lo > 0xdfff)
+				return syntax(jr, "invalid Unicode surrogate");
+
+			cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+		}
+
+		if (cp == 0)
+			return syntax(jr, "\\u0000 is not allowed");
+
+		if (cp < 0x80)
+			out[0] = cp;
+		else if (cp < 0x800) {
+			out[0] = 0xc0 | (cp >> 6);
+			out[1] = 0x80 | (cp & 0x3f);
+			outsz = 2;
+		} else if (cp < 0x10000) {
+			out[0] = 0xe0 | (cp >> 12);
+			out[1] = 0x80 | ((cp >> 6) & 0x3f);
+			out[2] = 0x80 | (cp & 0x3f);
+			outsz = 3;
+		} else {
+			out[0] = 0xf0 | (cp >> 18);
+			out[1] = 0x80 | ((cp >> 12) & 0x3f);
+			out[2] = 0x80 | ((cp >> 6) & 0x3f);
+			out[3] = 0x80 | (cp & 0x3f);
+			outsz = 4;
+		}
+		break;
+	default:
+		return syntax(jr, "invalid escape");
+	}
+
+	return emit(jr, sink, data, out, outsz);
+}
+
+/*
+ * Read a string, the opening quote being already consumed. Unescaped runs
+ * are given to the sink directly from the input buffer.
+ */
+static int
+string(struct json_read *jr, json_read_sink sink, void *data)
+{
+	/* Remaining UTF-8 continuation bytes. */
+	int need = 0;
+	unsigned char c;
+	size_t start;
+
+	for (;;) {
+		switch (fill(jr)) {
+		case -1:
+			return -1;
+		case 0:
+			return syntax(jr, "unterminated string");
+		default:
+			break;
+		}
+
+		for (start = jr->pos; jr->pos < jr->len; jr->pos++) {
+			c = jr->buf[jr->pos];
+
+			if (need) {
+				if ((c & 0xc0) != 0x80)
+					return syntax(jr, "invalid UTF-8");
+
+				need--;
+				continue;
+			}
+
+			if (c == '"' || c == '\\' || c < 0x20)
+				break;
+			if (c < 0x80)
+				continue;
+			if (c >= 0xc2 && c <= 0xdf)
+				need = 1;
+			else if (c >= 0xe0 && c <= 0xef)
+				need = 2;
+			else if (c >= 0xf0 && c <= 0xf4)
+				need = 3;
+			else
+				return syntax(jr, "invalid UTF-8");
+		}
+
+		if (emit(jr, sink, data, jr->buf + start, jr->pos - start) < 0)
+			return -1;
+		if (jr->pos == jr->len)
+			continue;
+
+		c = jr->buf[jr->pos++];
+
+		if (c == '"')
+			return 0;
+		if (c < 0x20)
+			return syntax(jr, "control character in string");
+		if (escape(jr, sink, data) < 0)
+			return -1;
+	}
+}
+
+static int
+literal(struct json_read *jr, const char *word)
+{
+	for (; *word; ++word) {
+		if (peek(jr) != (unsigned char)*word)
+			return syntax(jr, "invalid literal");
+
+		jr->pos++;
+	}
+
+	return 0;
+}
+
+/*
+ * Read a number, if value is not NULL it must be an integer which fits in
+ * intmax_t.
+ */
+static int
+number(struct json_read *jr, intmax_t *value)
+{
+	uintmax_t n = 0, limit = INTMAX_MAX;
+	int c, neg = 0, digits = 0, real = 0;
+
+	if (peek(jr) == '-') {
+		neg = 1;
+		limit = (uintmax_t)INTMAX_MAX + 1;
+		jr->pos++;
+	}
+
+	while ((c = peek(jr)) >= '0' && c <= '9') {
+		if (digits++ == 1 && n == 0)
+			return syntax(jr, "invalid number");
+		if (n > (limit - (c - '0')) / 10)
+			return syntax(jr, "integer overflow");
+
+		n = n * 10 + (c - '0');
+		jr->pos++;
+	}
+
+	if (c == ERR)
+		return -1;
+	if (!digits)
+		return syntax(jr, "invalid number");
+
+	/* Fraction and exponent, only validated. */
+	while ((c = peek(jr)) == '.' || c == 'e' || c == 'E' || c == '+' ||
+	    c == '-' || (real && c >= '0' && c <= '9')) {
+		real = 1;
+		jr->pos++;
+	}
+
+	if (c == ERR)
+		return -1;
+	if (value) {
+		if (real)
+			return syntax(jr, "integer expected");
+
+		*value = neg ? (intmax_t)(0 - n) : (intmax_t)n;
+	}
+
+	return 0;
+}
+
+static int
+skip(struct json_read *jr, int depth);
+
+static int
+skip_container(struct json_read *jr, int close, int depth)
+{
+	int c;
+
+	if (depth >= DEPTH)
+		return syntax(jr, "too many nested values");
+
+	/* Opening character. */
+	jr->pos++;
+
+	if ((c = next(jr)) == ERR)
+		return -1;
+	if (c == close) {
+		jr->pos++;
+		return 0;
+	}
+
+	for (;;) {
+		if (close == '}') {
+			if (expect(jr, '"', "string expected") < 0 ||
+			    string(jr, NULL, NULL) < 0 ||
+			    expect(jr, ':', "':' expected") < 0)
+				return -1;
+		}
+		if (skip(jr, depth + 1) < 0)
+			return -1;
+		if ((c = next(jr)) == ERR)
+			return -1;
+		if (c != ',' && c != close)
+			return syntax(jr, "',' expected");
+
+		jr->pos++;
+
+		if (c == close)
+			return 0;
+	}
+}
+
+static int
+skip(struct json_read *jr, int depth)
+{
+	switch (next(jr)) {
+	case ERR:
+		return -1;
+	case '"':
+		jr->pos++;
+		return string(jr, NULL, NULL);
+	case '{':
+		return skip_container(jr, '}', depth);
+	case '[':
+		return skip_container(jr, ']', depth);
+	case 't':
+		return literal(jr, "true");
+	case 'f':
+		return literal(jr, "false");
+	case 'n':
+		return literal(jr, "null");
+	default:
+		return number(jr, NULL);
+	}
+}
+
+static int
+value(struct json_read *jr, struct json_read_key *key)
+{
+	struct str str = {0};
+	intmax_t n;
+	int c;
+
+	if ((c = next(jr)) == ERR)
+		return -1;
+	if (c == END)
+		return syntax(jr, "unexpected end of input");
+	if (c == 'n')
+		return literal(jr, "null");
+
+	switch (key->type) {
+	case JSON_READ_STR:
+	case JSON_READ_SINK:
+		if (c != '"')
+			break;
+
+		jr->pos++;
+
+		if (key->type == JSON_READ_SINK) {
+			key->set = 1;
+			return string(jr, key->sink, key->value);
+		}
+		if (string(jr, str_sink, &str) < 0) {
+			free(str.data);
+			return -1;
+		}
+
+		*(char **)key->value = str.data ? str.data : estrdup("");
+		key->set = 1;
+		return 0;
+	case JSON_READ_INT:
+		if (c != '-' && (c < '0' || c > '9'))
+			break;
+		if (number(jr, &n) < 0)
+			return -1;
+
+		*(intmax_t *)key->value = n;
+		key->set = 1;
+		return 0;
+	case JSON_READ_BOOL:
+		if (c != 't' && c != 'f')
+			break;
+		if (literal(jr, c == 't' ? "true" : "false") < 0)
+			return -1;
+
+		*(int *)key->value = c == 't';
+		key->set = 1;
+		return 0;
+	default:
+		break;
+	}
+
+	return fail(jr, EBADMSG, "invalid type for key '%s'", key->name);
+}
+
+static struct json_read_key *
+find(struct json_read_key *keys, size_t keysz, const struct key *key)
+{
+	if (key->overflow)
+		return NULL;
+
+	for (size_t i = 0; i < keysz; ++i)
+		if (strcmp(keys[i].name, key->data) == 0)
+			return &keys[i];
+
+	return NULL;
+}
+
+/*
+ * Read one object, the set flags are cleared first so that the same keys
+ * can be reused for consecutive objects.
+ */
+static int
+object(struct json_read *jr, struct json_read_key *keys, size_t keysz)
+{
+	struct json_read_key *found;
+	struct key key;
+	int c;
+
+	for (size_t i = 0; i < keysz; ++i)
+		keys[i].set = 0;
+
+	if (expect(jr, '{', "'{' expected") < 0)
+		return -1;
+	if ((c = next(jr)) == ERR)
+		return -1;
+	if (c == '}') {
+		jr->pos++;
+		return 0;
+	}
+
+	do {
+		key.len = 0;
+		key.overflow = 0;
+		key.data[0] = '\0';
+
+		if (expect(jr, '"', "string expected") < 0 ||
+		    string(jr, key_sink, &key) < 0 ||
+		    expect(jr, ':', "':' expected") < 0)
+			return -1;
+
+		if (!(found = find(keys, keysz, &key))) {
+			if (skip(jr, 0) < 0)
+				return -1;
+		} else {
+			if (found->set)
+				return fail(jr, EBADMSG, "duplicate key '%s'", found->name);
+			if (value(jr, found) < 0)
+				return -1;
+		}
+
+		if ((c = next(jr)) == ERR)
+			return -1;
+		if (c != ',' && c != '}')
+			return syntax(jr, "'}' expected");
+
+		jr->pos++;
+	} while (c == ',');
+
+	return 0;
+}
+
+/*
+ * Nothing but white spaces may follow the document.
+ */
+static int
+end(struct json_read *jr)
+{
+	int c;
+
+	if ((c = next(jr)) == ERR)
+		return -1;
+	if (c != END)
+		return syntax(jr, "end of input expected");
+
+	return 0;
+}
+
+void
+json_read_init(struct json_read *jr, json_read_fn read, void *data, size_t max)
+{
+	assert(jr);
+	assert(read);
+
+	memset(jr, 0, sizeof (*jr));
+	jr->read = read;
+	jr->data = data;
+	jr->max = max;
+}
+
+int
+json_read_object(struct json_read *jr, struct json_read_key *keys, size_t keysz)
+{
+	assert(jr);
+	assert(keys);
+
+	if (object(jr, keys, keysz) < 0)
+		return -1;
+
+	return end(jr);
+}
+
+int
+json_read_next(struct json_read *jr, struct json_read_key *keys, size_t keysz)
+{
+	assert(jr);
+	assert(keys);
+
+	int c;
+
+	if ((c = next(jr)) == ERR)
+		return -1;
+
+	switch (jr->state) {
+	case STATE_START:
+		if (c == '[') {
+			jr->pos++;
+			jr->state = STATE_ARRAY;
+
+			if ((c = next(jr)) == ERR)
+				return -1;
+			if (c == ']') {
+				jr->pos++;
+				jr->state = STATE_DONE;
+				return end(jr) < 0 ? -1 : 0;
+			}
+			break;
+		}
+
+		jr->state = STATE_STREAM;
+		/* FALLTHROUGH */
+	case STATE_STREAM:
+		if (c == END)
+			return 0;
+		break;
+	case STATE_ARRAY:
+		if (c == ']') {
+			jr->pos++;
+			jr->state = STATE_DONE;
+			return end(jr) < 0 ? -1 : 0;
+		}
+		if (c != ',')
+			return syntax(jr, "',' expected");
+
+		jr->pos++;
+		break;
+	default:
+		return 0;
+	}
+
+	if (object(jr, keys, keysz) < 0)
+		return -1;
+
+	return 1;
+}
@@ -0,0 +1,153 @@
+/*
+ * json-read.h -- streaming JSON reader
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_JSON_READ_H
+#define TMPUPD_JSON_READ_H
+
+/**
+ * \file json-read.h
+ * \brief Streaming JSON reader.
+ *
+ * Extract a set of known keys from a flat JSON object in one pass over the
+ * input without building a document. String values are either copied or
+ * handed unescaped to a sink as they are read, unknown keys are skipped.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * \def JSON_READ_BUF
+ * Size of the input buffer.
+ */
+#define JSON_READ_BUF 16384
+
+/**
+ * Input function.
+ *
+ * \param data optional user data
+ * \param buf the destination buffer
+ * \param bufsz the maximum number of bytes to read
+ * \return the number of bytes read, 0 at the end or -1 on error
+ */
+typedef ssize_t (*json_read_fn)(void *data, void *buf, size_t bufsz);
+
+/**
+ * String sink, called as many times as needed with consecutive pieces of
+ * an unescaped string value.
+ *
+ * \param data optional user data
+ * \param buf the string piece (not NUL terminated)
+ * \param bufsz the string piece length
+ * \return 0 on success or -1 on error with errno set
+ */
+typedef int (*json_read_sink)(void *data, const char *buf, size_t bufsz);
+
+/**
+ * \enum json_read_type
+ * \brief Expected value type.
+ */
+enum json_read_type {
+	JSON_READ_STR,                  /*!< String copied (char **). */
+	JSON_READ_INT,                  /*!< Integer (intmax_t *). */
+	JSON_READ_BOOL,                 /*!< Boolean (int *). */
+	JSON_READ_SINK                  /*!< String given to sink. */
+};
+
+/**
+ * \struct json_read_key
+ * \brief Key to extract.
+ *
+ * A null value is accepted for every type and leaves the key unset. Strings
+ * are dynamically allocated and must be freed by the caller.
+ */
+struct json_read_key {
+	const char *name;               /*!< Key name. */
+	enum json_read_type type;       /*!< Expected type. */
+	void *value;                    /*!< Destination or sink user data. */
+	json_read_sink sink;            /*!< Sink for JSON_READ_SINK. */
+	int set;                        /*!< (read-only) Key was found. */
+};
+
+/**
+ * \struct json_read
+ * \brief Streaming JSON reader.
+ */
+struct json_read {
+	char error[128];                /*!< (read-only) Last error. */
+	json_read_fn read;              /*!< (private) Input function. */
+	void *data;                     /*!< (private) Input user data. */
+	size_t max;                     /*!< (private) Input limit. */
+	size_t total;                   /*!< (private) Bytes read so far. */
+	char buf[JSON_READ_BUF];        /*!< (private) Input buffer. */
+	size_t pos;                     /*!< (private) Position in buf. */
+	size_t len;                     /*!< (private) Bytes in buf. */
+	int eof;                        /*!< (private) Input fully read. */
+	int state;                      /*!< (private) ::json_read_next state. */
+};
+
+/**
+ * Initialize the reader.
+ *
+ * \pre jr != NULL
+ * \pre read != NULL
+ * \param jr the reader to initialize
+ * \param read the input function
+ * \param data the input function user data
+ * \param max the maximum number of bytes to accept
+ */
+void
+json_read_init(struct json_read *jr, json_read_fn read, void *data, size_t max);
+
+/**
+ * Read the whole input as one JSON object and extract the given keys.
+ *
+ * On error, errno is set to EFBIG if the input exceeds the limit, to
+ * EBADMSG if the document is invalid or keeps the value set by the input
+ * function or a sink. Strings already extracted must still be freed.
+ *
+ * \pre jr != NULL
+ * \pre keys != NULL
+ * \param jr the reader
+ * \param keys the keys to extract
+ * \param keysz number of keys
+ * \return 0 on success or -1 on error
+ */
+int
+json_read_object(struct json_read *jr, struct json_read_key *keys, size_t keysz);
+
+/**
+ * Read the next object of a sequence, either a JSON array of objects or
+ * objects separated by white spaces such as newline delimited JSON.
+ *
+ * The keys are reset before each object, strings extracted from the
+ * previous object must have been freed or kept by the caller. Errors are
+ * reported as in ::json_read_object and the reader can not be used after.
+ *
+ * \pre jr != NULL
+ * \pre keys != NULL
+ * \param jr the reader
+ * \param keys the keys to extract
+ * \param keysz number of keys
+ * \return 1 if an object was read, 0 at the end or -1 on error
+ */
+int
+json_read_next(struct json_read *jr, struct json_read_key *keys, size_t keysz);
+
+#endif /* !TMPUPD_JSON_READ_H */
@@ -0,0 +1,447 @@
+/*
+ * json-write.c -- streaming JSON writer
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "json-write.h"
+#include "util.h"
+
+/* U+FFFD, used in place of invalid UTF-8 sequences. */
+#define REPLACEMENT "\xef\xbf\xbd"
+
+static void
+flush(struct json_write *jw)
+{
+	if (jw->len && !jw->error && jw->write(jw->data, jw->buf, jw->len) < 0)
+		jw->error = 1;
+
+	jw->len = 0;
+}
+
+static void
+put(struct json_write *jw, const char *data, size_t datasz)
+{
+	size_t len;
+
+	while (datasz) {
+		if (jw->len == sizeof (jw->buf))
+			flush(jw);
+
+		len = sizeof (jw->buf) - jw->len;
+
+		if (len > datasz)
+			len = datasz;
+
+		memcpy(jw->buf + jw->len, data, len);
+		jw->len += len;
+		data += len;
+		datasz -= len;
+	}
+}
+
+static inline void
+putch(struct json_write *jw, char c)
+{
+	put(jw, &c, 1);
+}
+
+/*
+ * Insert a comma if the current container already has a value, values that
+ * follow a key never need one.
+ */
+static void
+separate(struct json_write *jw)
+{
+	if (jw->key) {
+		jw->key = 0;
+		return;
+	}
+	if (jw->depth && jw->count[jw->depth - 1]++)
+		putch(jw, ',');
+}
+
+/*
+ * Return the length of the UTF-8 sequence announced by the lead byte c or 0
+ * if it can't start one.
+ */
+static inline size_t
+lead(unsigned char c)
+{
+	if (c >= 0xc2 && c <= 0xdf)
+		return 2;
+	if (c >= 0xe0 && c <= 0xef)
+		return 3;
+	if (c >= 0xf0 && c <= 0xf4)
+		return 4;
+
+	return 0;
+}
+
+/*
+ * Return the length of the valid UTF-8 sequence starting at s or 0.
+ */
+static size_t
+sequence(const unsigned char *s, size_t avail)
+{
+	size_t len;
+
+	if (!(len = lead(s[0])) || len > avail)
+		return 0;
+
+	for (size_t i = 1; i < len; ++i)
+		if ((s[i] & 0xc0) != 0x80)
+			return 0;
+
+	return len;
+}
+
+/*
+ * Return the length of the UTF-8 sequence cut by the end of the piece, this
+ * is only the beginning of a sequence whose remaining bytes are expected in
+ * the next piece.
+ */
+static size_t
+truncated(const unsigned char *s, size_t len)
+{
+	for (size_t i = 1; i < 4 && i <= len; ++i) {
+		if ((s[len - i] & 0xc0) == 0x80)
+			continue;
+
+		return lead(s[len - i]) > i ? i : 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Write the string content without the quotes.
+ */
+static void
+escape(struct json_write *jw, const char *str, size_t strsz)
+{
+	const unsigned char *s = (const unsigned char *)str, *end = s + strsz, *start;
+	char esc[8];
+	size_t len;
+
+	while (s < end) {
+		/* Copy runs of characters that need no escaping at once. */
+		for (start = s; s < end && *s >= 0x20 && *s < 0x80 && *s != '"' && *s != '\\'; ++s)
+			continue;
+
+		put(jw, (const char *)start, s - start);
+
+		if (s == end)
+			break;
+
+		switch (*s) {
+		case '"':
+			put(jw, "\\\"", 2);
+			break;
+		case '\\':
+			put(jw, "\\\\", 2);
+			break;
+		case '\b':
+			put(jw, "\\b", 2);
+			break;
+		case '\f':
+			put(jw, "\\f", 2);
+			break;
+		case '\n':
+			put(jw, "\\n", 2);
+			break;
+		case '\r':
+			put(jw, "\\r", 2);
+			break;
+		case '\t':
+			put(jw, "\\t", 2);
+			break;
+		default:
+			if (*s < 0x20) {
+				snprintf(esc, sizeof (esc), "\\u%04x", *s);
+				put(jw, esc, 6);
+			} else if ((len = sequence(s, end - s))) {
+				put(jw, (const char *)s, len);
+				s += len;
+				continue;
+			} else
+				put(jw, REPLACEMENT, sizeof (REPLACEMENT) - 1);
+			break;
+		}
+
+		++s;
+	}
+}
+
+static void
+string(struct json_write *jw, const char *str, size_t strsz)
+{
+	putch(jw, '"');
+	escape(jw, str, strsz);
+	putch(jw, '"');
+}
+
+static void
+begin(struct json_write *jw, char c)
+{
+	assert(jw->depth < JSON_WRITE_DEPTH);
+
+	separate(jw);
+	putch(jw, c);
+
+	jw->stack[jw->depth] = c;
+	jw->count[jw->depth++] = 0;
+}
+
+void
+json_write_init(struct json_write *jw, json_write_fn write, void *data)
+{
+	assert(jw);
+	assert(write);
+
+	memset(jw, 0, sizeof (*jw));
+	jw->write = write;
+	jw->data = data;
+}
+
+void
+json_write_object(struct json_write *jw)
+{
+	assert(jw);
+
+	begin(jw, '{');
+}
+
+void
+json_write_array(struct json_write *jw)
+{
+	assert(jw);
+
+	begin(jw, '[');
+}
+
+void
+json_write_close(struct json_write *jw)
+{
+	assert(jw);
+	assert(jw->depth);
+	assert(!jw->key);
+
+	putch(jw, jw->stack[--jw->depth] == '{' ? '}' : ']');
+}
+
+void
+json_write_key(struct json_write *jw, const char *key)
+{
+	assert(jw);
+	assert(key);
+	assert(jw->depth && jw->stack[jw->depth - 1] == '{');
+	assert(!jw->key);
+
+	separate(jw);
+	string(jw, key, strlen(key));
+	putch(jw, ':');
+
+	jw->key = 1;
+}
+
+void
+json_write_str(struct json_write *jw, const char *str)
+{
+	assert(jw);
+
+	if (!str)
+		json_write_null(jw);
+	else {
+		separate(jw);
+		string(jw, str, strlen(str));
+	}
+}
+
+void
+json_write_str_open(struct json_write *jw)
+{
+	assert(jw);
+
+	separate(jw);
+	putch(jw, '"');
+}
+
+void
+json_write_str_append(struct json_write *jw, const char *str, size_t strsz)
+{
+	assert(jw);
+	assert(str);
+
+	const unsigned char *s = (const unsigned char *)str;
+	size_t cut;
+
+	/* Complete the sequence left by the previous piece first. */
+	if (jw->partsz) {
+		while (strsz && jw->partsz < lead(jw->part[0]) && (*s & 0xc0) == 0x80) {
+			jw->part[jw->partsz++] = *s++;
+			strsz--;
+		}
+
+		if (jw->partsz < lead(jw->part[0]) && !strsz)
+			return;
+
+		escape(jw, (const char *)jw->part, jw->partsz);
+		jw->partsz = 0;
+	}
+
+	cut = truncated(s, strsz);
+	escape(jw, (const char *)s, strsz - cut);
+	memcpy(jw->part, s + strsz - cut, cut);
+	jw->partsz = cut;
+}
+
+void
+json_write_str_close(struct json_write *jw)
+{
+	assert(jw);
+
+	/* The string ended in the middle of a sequence. */
+	if (jw->partsz) {
+		put(jw, REPLACEMENT, sizeof (REPLACEMENT) - 1);
+		jw->partsz = 0;
+	}
+
+	putch(jw, '"');
+}
+
+void
+json_write_int(struct json_write *jw, intmax_t value)
+{
+	assert(jw);
+
+	char num[32];
+	int len;
+
+	separate(jw);
+	len = snprintf(num, sizeof (num), "%" PRIdMAX, value);
+	put(jw, num, len);
+}
+
+void
+json_write_bool(struct json_write *jw, int value)
+{
+	assert(jw);
+
+	separate(jw);
+
+	if (value)
+		put(jw, "true", 4);
+	else
+		put(jw, "false", 5);
+}
+
+void
+json_write_null(struct json_write *jw)
+{
+	assert(jw);
+
+	separate(jw);
+	put(jw, "null", 4);
+}
+
+void
+json_write_vpack(struct json_write *jw, const char *fmt, va_list ap)
+{
+	assert(jw);
+	assert(fmt);
+
+	const char *str;
+
+	for (; *fmt; ++fmt) {
+		switch (*fmt) {
+		case '{':
+			json_write_object(jw);
+			break;
+		case '[':
+			json_write_array(jw);
+			break;
+		case '}':
+		case ']':
+			json_write_close(jw);
+			break;
+		case 's':
+			str = va_arg(ap, const char *);
+
+			if (fmt[1] == '?')
+				++fmt;
+			else
+				assert(str);
+
+			/* Strings are keys when an object expects one. */
+			if (jw->depth && jw->stack[jw->depth - 1] == '{' && !jw->key)
+				json_write_key(jw, str);
+			else
+				json_write_str(jw, str);
+			break;
+		case 'i':
+			json_write_int(jw, va_arg(ap, int));
+			break;
+		case 'b':
+			json_write_bool(jw, va_arg(ap, int));
+			break;
+		case 'I':
+			json_write_int(jw, va_arg(ap, intmax_t));
+			break;
+		case 'n':
+			json_write_null(jw);
+			break;
+		case ' ':
+		case '\t':
+		case '\n':
+		case ':':
+		case ',':
+			break;
+		default:
+			die("abort: invalid JSON format '%c'\n", *fmt);
+			break;
+		}
+	}
+}
+
+void
+json_write_pack(struct json_write *jw, const char *fmt, ...)
+{
+	assert(jw);
+	assert(fmt);
+
+	va_list ap;
+
+	va_start(ap, fmt);
+	json_write_vpack(jw, fmt, ap);
+	va_end(ap);
+}
+
+int
+json_write_finish(struct json_write *jw)
+{
+	assert(jw);
+	assert(jw->depth == 0);
+
+	putch(jw, '\n');
+	flush(jw);
+
+	return jw->error ? -1 : 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * json-write.h -- streaming JSON writer
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_JSON_WRITE_H
+#define TMPUPD_JSON_WRITE_H
+
+/**
+ * \file json-write.h
+ * \brief Streaming JSON writer.
+ *
+ * Emit compact JSON through a small buffer without building a document.
+ * Separators are inserted automatically, the caller only describes the
+ * values in order.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \def JSON_WRITE_BUF
+ * Size of the output buffer.
+ */
+#define JSON_WRITE_BUF 1024
+
+/**
+ * \def JSON_WRITE_DEPTH
+ * Maximum nesting of objects and arrays.
+ */
+#define JSON_WRITE_DEPTH 32
+
+/**
+ * Output function.
+ *
+ * \param data optional user data
+ * \param buf the data to write
+ * \param bufsz the data length
+ * \return 0 on success or -1 on error
+ */
+typedef int (*json_write_fn)(void *data, const void *buf, size_t bufsz);
+
+/**
+ * \struct json_write
+ * \brief Streaming JSON writer.
+ */
+struct json_write {
+	json_write_fn write;            /*!< (private) Output function. */
+	void *data;                     /*!< (private) Output user data. */
+	char buf[JSON_WRITE_BUF];       /*!< (private) Output buffer. */
+	size_t len;                     /*!< (private) Bytes in buf. */
+	size_t depth;                   /*!< (private) Current nesting. */
+	char stack[JSON_WRITE_DEPTH];   /*!< (private) Opened containers. */
+	int count[JSON_WRITE_DEPTH];    /*!< (private) Values per level. */
+	int key;                        /*!< (private) Key just written. */
+	unsigned char part[4];          /*!< (private) Incomplete UTF-8 sequence. */
+	size_t partsz;                  /*!< (private) Bytes in part. */
+	int error;                      /*!< (read-only) Output failed. */
+};
+
+/**
+ * Initialize the writer.
+ *
+ * \pre jw != NULL
+ * \pre write != NULL
+ * \param jw the writer to initialize
+ * \param write the output function
+ * \param data the output function user data
+ */
+void
+json_write_init(struct json_write *jw, json_write_fn write, void *data);
+
+/**
+ * Open an object.
+ *
+ * \pre jw != NULL
+ * \param jw the writer
+ */
+void
+json_write_object(struct json_write *jw);
+
+/**
+ * Open an array.
+ *
+ * \pre jw != NULL
+ * \param jw the writer
+ */
+void
+json_write_array(struct json_write *jw);
+
+/**
+ * Close the last object or array opened.
+ *
+ * \pre jw != NULL
+ * \param jw the writer
+ */
+void
+json_write_close(struct json_write *jw);
+
+/**
+ * Write an object key, the next value written is its value.
+ *
+ * \pre jw != NULL
+ * \pre key != NULL
+ * \param jw the writer
+ * \param key the key
+ */
+void
+json_write_key(struct json_write *jw, const char *key);
+
+/**
+ * Write a string value, invalid UTF-8 sequences are replaced.
+ *
+ * \pre jw != NULL
+ * \param jw the writer
+ * \param str the string (may be NULL for null)
+ */
+void
+json_write_str(struct json_write *jw, const char *str);
+
+/**
+ * Start a string value written in several pieces.
+ *
+ * \pre jw != NULL
+ * \param jw the writer
+ */
+void
+json_write_str_open(struct json_write *jw);
+
+/**
+ * Append a piece to the string value started with ::json_write_str_open.
+ *
+ * A UTF-8 sequence split between two pieces is kept until the next one
+ * completes it.
+ *
+ * \pre jw != NULL
+ * \pre str != NULL
+ * \param jw the writer
+ * \param str the piece
+ * \param strsz the piece length
+ */
+void
+json_write_str_append(struct json_write *jw, const char *str, size_t strsz);
+
+/**
+ * Terminate the string value started with ::json_write_str_open.
+ *
+ * \pre jw != NULL
+ * \param jw the writer
+ */
+void
+json_write_str_close(struct json_write *jw);
+
+/**
+ * Write an integer value.
+ *
+ * \pre jw != NULL
+ * \param jw the writer
+ * \param value the value
+ */
+void
+json_write_int(struct json_write *jw, intmax_t value);
+
+/**
+ * Write a boolean value.
+ *
+ * \pre jw != NULL
+ * \param jw the writer
+ * \param value the value
+ */
+void
+json_write_bool(struct json_write *jw, int value);
+
+/**
+ * Write a null value.
+ *
+ * \pre jw != NULL
+ * \param jw the writer
+ */
+void
+json_write_null(struct json_write *jw);
+
+/**
+ * Write a document described by a subset of the jansson json_pack format.
+ *
+ * Supported characters are `{`, `}`, `[`, `]`, `s` (const char *), `s?`
+ * (const char * or null), `i` (int), `I` (intmax_t), `b` (int) and `n`.
+ * White spaces, `:` and `,` are ignored. Containers may be left open and
+ * closed by a later call.
+ *
+ * \pre jw != NULL
+ * \pre fmt != NULL
+ * \param jw the writer
+ * \param fmt the format string
+ * \param ap the arguments
+ */
+void
+json_write_vpack(struct json_write *jw, const char *fmt, va_list ap);
+
+/**
+ * Same function as ::json_write_vpack using variadic arguments.
+ *
+ * \pre jw != NULL
+ * \pre fmt != NULL
+ * \param jw the writer
+ * \param fmt the format string
+ */
+void
+json_write_pack(struct json_write *jw, const char *fmt, ...);
+
+/**
+ * Terminate the document with a new line and flush the remaining output.
+ *
+ * \pre jw != NULL
+ * \param jw the writer
+ * \return 0 on success or -1 if any write failed
+ */
+int
+json_write_finish(struct json_write *jw);
+
+#endif /* !TMPUPD_JSON_WRITE_H */
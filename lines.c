@@ -0,0 +1,180 @@
+/*
+ * lines.c -- line scanning and index
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#       define LINES_X86
+#       include <immintrin.h>
+#endif
+
+#include "lines.h"
+#include "util.h"
+
+/* Every entry is a 64 bits little endian offset. */
+#define ENTRY 8
+
+#if defined(LINES_X86)
+
+/*
+ * SSE2 is always available on x86_64, every bit of the mask tells if the
+ * byte at that position is a newline.
+ */
+static inline uint64_t
+newlines64(const char *p)
+{
+	const __m128i nl = _mm_set1_epi8('\n');
+	uint64_t m0, m1, m2, m3;
+
+	m0 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), nl));
+	m1 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 16)), nl));
+	m2 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 32)), nl));
+	m3 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 48)), nl));
+
+	return m0 | m1 << 16 | m2 << 32 | m3 << 48;
+}
+
+#endif
+
+size_t
+lines_count(const char *text, size_t textsz)
+{
+	assert(text);
+
+	size_t n = 0, i = 0;
+
+#if defined(LINES_X86)
+	for (; textsz - i >= 64; i += 64)
+		n += __builtin_popcountll(newlines64(text + i));
+#endif
+
+	for (; i < textsz; ++i)
+		n += text[i] == '\n';
+
+	return n + (textsz && text[textsz - 1] != '\n');
+}
+
+size_t
+lines_skip(const char *text, size_t textsz, size_t *n)
+{
+	assert(text);
+	assert(n);
+
+	size_t i = 0;
+
+	if (*n == 0)
+		return 0;
+
+#if defined(LINES_X86)
+	for (uint64_t mask, c; textsz - i >= 64; i += 64) {
+		mask = newlines64(text + i);
+
+		if ((c = __builtin_popcountll(mask)) < *n) {
+			*n -= c;
+			continue;
+		}
+
+		/* The last newline to skip is in this block. */
+		while (--*n)
+			mask &= mask - 1;
+
+		return i + __builtin_ctzll(mask) + 1;
+	}
+#endif
+
+	for (; i < textsz; ++i)
+		if (text[i] == '\n' && --*n == 0)
+			return i + 1;
+
+	return textsz;
+}
+
+char *
+lines_preview(const char *text, size_t textsz, size_t n, size_t max)
+{
+	assert(text);
+
+	size_t len;
+
+	if ((len = lines_skip(text, textsz, &n)) && text[len - 1] == '\n')
+		--len;
+
+	/* Back to the start of a multibyte sequence cut in the middle. */
+	if (len > max)
+		for (len = max; len && ((unsigned char)text[len] & 0xc0) == 0x80; )
+			--len;
+
+	return estrndup(text, len);
+}
+
+unsigned char *
+lines_index(const char *text, size_t textsz, size_t *indexsz)
+{
+	assert(text);
+	assert(indexsz);
+
+	char *index;
+	size_t n;
+	FILE *fp;
+
+	fp = eopen_memstream(&index, indexsz);
+
+	for (size_t off = 0; off < textsz; ) {
+		for (int i = 0; i < ENTRY; ++i)
+			putc(((uint64_t)off >> (i * 8)) & 0xff, fp);
+
+		n = LINES_STEP;
+		off += lines_skip(text + off, textsz - off, &n);
+	}
+
+	fclose(fp);
+
+	return (unsigned char *)index;
+}
+
+size_t
+lines_offset(const void *index, size_t indexsz, size_t line, size_t *at)
+{
+	assert(index);
+	assert(at);
+
+	const unsigned char *p;
+	size_t entry;
+	uint64_t off = 0;
+
+	if (indexsz < ENTRY) {
+		*at = 0;
+		return 0;
+	}
+
+	if ((entry = line / LINES_STEP) >= indexsz / ENTRY)
+		entry = indexsz / ENTRY - 1;
+
+	p = (const unsigned char *)index + entry * ENTRY;
+
+	for (int i = 0; i < ENTRY; ++i)
+		off |= (uint64_t)p[i] << (i * 8);
+
+	*at = entry * LINES_STEP;
+
+	return off;
+}
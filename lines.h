@@ -0,0 +1,106 @@
+/*
+ * lines.h -- line scanning and index
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef TMPUPD_LINES_H
+#define TMPUPD_LINES_H
+
+/**
+ * \file lines.h
+ * \brief Line scanning and index.
+ *
+ * An index holds the offset of every ::LINES_STEP line of a text so that a
+ * range of lines is found without scanning the text from its start.
+ */
+
+#include <stddef.h>
+
+/**
+ * \def LINES_STEP
+ * Number of lines between two entries of an index.
+ */
+#define LINES_STEP 128
+
+/**
+ * Count the lines of a text, a last line without a newline counts too.
+ *
+ * \pre text != NULL
+ * \param text the text
+ * \param textsz the text length
+ * \return the number of lines
+ */
+size_t
+lines_count(const char *text, size_t textsz);
+
+/**
+ * Skip lines at the beginning of a text.
+ *
+ * \pre text != NULL
+ * \pre n != NULL
+ * \param text the text
+ * \param textsz the text length
+ * \param n the number of lines to skip, decremented by the number of
+ * newlines found
+ * \return the offset after the last newline skipped or textsz if there were
+ * fewer lines
+ */
+size_t
+lines_skip(const char *text, size_t textsz, size_t *n);
+
+/**
+ * Get the first lines of a text without the last newline, cut at a
+ * character boundary if they are too long.
+ *
+ * \pre text != NULL
+ * \param text the UTF-8 text
+ * \param textsz the text length
+ * \param n the number of lines wanted
+ * \param max the maximum length in bytes
+ * \return the dynamically allocated lines
+ */
+char *
+lines_preview(const char *text, size_t textsz, size_t n, size_t max);
+
+/**
+ * Build the index of a text.
+ *
+ * \pre text != NULL
+ * \pre indexsz != NULL
+ * \param text the text
+ * \param textsz the text length
+ * \param indexsz the index length to set
+ * \return the dynamically allocated index
+ */
+unsigned char *
+lines_index(const char *text, size_t textsz, size_t *indexsz);
+
+/**
+ * Find the closest line preceding another in an index.
+ *
+ * \pre index != NULL
+ * \pre at != NULL
+ * \param index the index
+ * \param indexsz the index length
+ * \param line the line wanted, from 0
+ * \param at the line found to set
+ * \return the offset of the line found
+ */
+size_t
+lines_offset(const void *index, size_t indexsz, size_t line, size_t *at);
+
+#endif /* !TMPUPD_LINES_H */
@@ -33,7 +33,7 @@ void
 log_open(enum log_level level)
 {
 	verbosity = level;
-	openlog("tmpup", 0, LOG_USER);
+	openlog("tmpup", LOG_PID, LOG_USER);
 }
 
 void
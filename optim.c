@@ -0,0 +1,466 @@
+/*
+ * optim.c -- lossless image recompression
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jpeglib.h>
+#include <png.h>
+
+#include "check.h"
+#include "optim.h"
+#include "util.h"
+
+/* Exif tag telling how the image must be rotated or flipped. */
+#define EXIF_ORIENTATION 0x0112
+
+/*
+ * libjpeg reports errors by calling error_exit which must not return.
+ */
+struct error {
+	struct jpeg_error_mgr mgr;
+	jmp_buf env;
+};
+
+/*
+ * Original PNG being read.
+ */
+struct input {
+	const unsigned char *data;
+	size_t datasz;
+	size_t offset;
+};
+
+static inline uint32_t
+be32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline unsigned int
+u16(const unsigned char *p, int le)
+{
+	return le ? p[0] | p[1] << 8 : p[0] << 8 | p[1];
+}
+
+static inline uint32_t
+u32(const unsigned char *p, int le)
+{
+	return le ? (uint32_t)u16(p + 2, 1) << 16 | u16(p, 1) : be32(p);
+}
+
+static void
+error_exit(j_common_ptr info)
+{
+	longjmp(((struct error *)info->err)->env, 1);
+}
+
+static void
+error_output(j_common_ptr info)
+{
+	(void)info;
+}
+
+static void
+error_png(png_structp png, png_const_charp msg)
+{
+	(void)msg;
+
+	png_longjmp(png, 1);
+}
+
+static void
+warning_png(png_structp png, png_const_charp msg)
+{
+	(void)png;
+	(void)msg;
+}
+
+static void
+input_read(png_structp png, png_bytep buf, size_t len)
+{
+	struct input *in = png_get_io_ptr(png);
+
+	if (in->datasz - in->offset < len)
+		png_error(png, "truncated");
+
+	memcpy(buf, in->data + in->offset, len);
+	in->offset += len;
+}
+
+static void
+output_write(png_structp png, png_bytep buf, size_t len)
+{
+	if (fwrite(buf, 1, len, png_get_io_ptr(png)) != len)
+		png_error(png, "write error");
+}
+
+static void
+output_flush(png_structp png)
+{
+	(void)png;
+}
+
+/*
+ * Check the header before decoding anything, animations are stored in
+ * chunks that libpng does not know and would be lost.
+ */
+static int
+usable(const unsigned char *p, size_t len)
+{
+	uint32_t chunksz;
+
+	if (len < 24 || (uintmax_t)be32(p + 16) * be32(p + 20) > OPTIM_PIXELS_MAX)
+		return 0;
+
+	for (size_t i = 8; len - i >= 8; i += 12 + chunksz) {
+		if ((chunksz = be32(p + i)) > len)
+			return 0;
+		if (memcmp(p + i + 4, "acTL", 4) == 0)
+			return 0;
+
+		/* The animation control chunk must precede the data. */
+		if (memcmp(p + i + 4, "IDAT", 4) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Copy the chunks affecting how the image is displayed, textual and time
+ * chunks are left behind.
+ */
+static void
+copy_chunks(png_structp rd, png_infop rinfo, png_structp wr, png_infop winfo)
+{
+	png_colorp palette;
+	png_bytep trans, profile;
+	png_color_16p color;
+	png_color_8p sig;
+	png_charp name;
+	png_fixed_point gamma, wx, wy, rx, ry, gx, gy, bx, by;
+	png_uint_32 proflen, resx, resy;
+	int num, compression, unit;
+
+	if (png_get_PLTE(rd, rinfo, &palette, &num))
+		png_set_PLTE(wr, winfo, palette, num);
+	if (png_get_tRNS(rd, rinfo, &trans, &num, &color))
+		png_set_tRNS(wr, winfo, trans, num, color);
+	if (png_get_bKGD(rd, rinfo, &color))
+		png_set_bKGD(wr, winfo, color);
+	if (png_get_sBIT(rd, rinfo, &sig))
+		png_set_sBIT(wr, winfo, sig);
+	if (png_get_gAMA_fixed(rd, rinfo, &gamma))
+		png_set_gAMA_fixed(wr, winfo, gamma);
+	if (png_get_cHRM_fixed(rd, rinfo, &wx, &wy, &rx, &ry, &gx, &gy, &bx, &by))
+		png_set_cHRM_fixed(wr, winfo, wx, wy, rx, ry, gx, gy, bx, by);
+	if (png_get_sRGB(rd, rinfo, &num))
+		png_set_sRGB(wr, winfo, num);
+	if (png_get_iCCP(rd, rinfo, &name, &compression, &profile, &proflen))
+		png_set_iCCP(wr, winfo, name, compression, profile, proflen);
+	if (png_get_pHYs(rd, rinfo, &resx, &resy, &unit))
+		png_set_pHYs(wr, winfo, resx, resy, unit);
+}
+
+/*
+ * Write the rows read as they are, interlacing is removed since it only
+ * makes the image larger.
+ */
+static int
+write_png(FILE *fp, png_structp rd, png_infop rinfo)
+{
+	png_structp wr;
+	png_infop winfo;
+	png_uint_32 width, height;
+	int depth, color;
+
+	if (!(wr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL,
+	    error_png, warning_png)))
+		return -1;
+	if (!(winfo = png_create_info_struct(wr))) {
+		png_destroy_write_struct(&wr, NULL);
+		return -1;
+	}
+	if (setjmp(png_jmpbuf(wr))) {
+		png_destroy_write_struct(&wr, &winfo);
+		return -1;
+	}
+
+	png_get_IHDR(rd, rinfo, &width, &height, &depth, &color, NULL, NULL, NULL);
+	png_set_write_fn(wr, fp, output_write, output_flush);
+	png_set_IHDR(wr, winfo, width, height, depth, color, PNG_INTERLACE_NONE,
+	    PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+	copy_chunks(rd, rinfo, wr, winfo);
+
+	/* Filters don't help palettes and packed pixels. */
+	if (color == PNG_COLOR_TYPE_PALETTE || depth < 8)
+		png_set_filter(wr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+	else
+		png_set_filter(wr, PNG_FILTER_TYPE_BASE, PNG_ALL_FILTERS);
+
+	png_set_compression_level(wr, 9);
+	png_set_compression_mem_level(wr, 9);
+	png_set_rows(wr, winfo, png_get_rows(rd, rinfo));
+	png_write_png(wr, winfo, PNG_TRANSFORM_IDENTITY, NULL);
+	png_destroy_write_struct(&wr, &winfo);
+
+	return 0;
+}
+
+/*
+ * The rows are read as they are stored, without any transformation, so
+ * that they are written back bit for bit.
+ */
+static int
+recompress_png(FILE *fp, const void *data, size_t datasz)
+{
+	struct input in = {
+		.data = data,
+		.datasz = datasz
+	};
+	png_structp rd;
+	png_infop rinfo;
+	int rv;
+
+	if (!(rd = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+	    error_png, warning_png)))
+		return -1;
+	if (!(rinfo = png_create_info_struct(rd))) {
+		png_destroy_read_struct(&rd, NULL, NULL);
+		return -1;
+	}
+	if (setjmp(png_jmpbuf(rd))) {
+		png_destroy_read_struct(&rd, &rinfo, NULL);
+		return -1;
+	}
+
+	png_set_read_fn(rd, &in, input_read);
+	png_read_png(rd, rinfo, PNG_TRANSFORM_IDENTITY, NULL);
+
+	rv = write_png(fp, rd, rinfo);
+	png_destroy_read_struct(&rd, &rinfo, NULL);
+
+	return rv;
+}
+
+/*
+ * Extract the orientation from an Exif segment, 1 means upright.
+ */
+static unsigned int
+orientation(const unsigned char *p, size_t len)
+{
+	const unsigned char *tiff, *entry;
+	size_t ifd, count;
+	unsigned int value;
+	int le;
+
+	if (len < 14 || memcmp(p, "Exif\0\0", 6) != 0)
+		return 1;
+
+	tiff = p + 6;
+	len -= 6;
+
+	if (memcmp(tiff, "II*\0", 4) == 0)
+		le = 1;
+	else if (memcmp(tiff, "MM\0*", 4) == 0)
+		le = 0;
+	else
+		return 1;
+
+	if ((ifd = u32(tiff + 4, le)) > len - 2)
+		return 1;
+
+	count = u16(tiff + ifd, le);
+
+	for (size_t i = 0; i < count && ifd + 2 + (i + 1) * 12 <= len; ++i) {
+		entry = tiff + ifd + 2 + i * 12;
+
+		/* A SHORT value stored in the entry itself. */
+		if (u16(entry, le) == EXIF_ORIENTATION && u16(entry + 2, le) == 3) {
+			value = u16(entry + 8, le);
+			return value >= 1 && value <= 8 ? value : 1;
+		}
+	}
+
+	return 1;
+}
+
+static void
+copy_markers(j_compress_ptr dst, j_decompress_ptr src)
+{
+	/* Big endian TIFF with a single IFD entry. */
+	unsigned char exif[] = {
+		'E', 'x', 'i', 'f', 0, 0,
+		'M', 'M', 0, 42, 0, 0, 0, 8,
+		0, 1,
+		EXIF_ORIENTATION >> 8, EXIF_ORIENTATION & 0xff, 0, 3, 0, 0, 0, 1, 0, 0, 0, 0,
+		0, 0, 0, 0
+	};
+	unsigned int value;
+
+	for (jpeg_saved_marker_ptr m = src->marker_list; m; m = m->next) {
+		if (m->marker == JPEG_APP0 + 2 && m->data_length > 12 &&
+		    memcmp(m->data, "ICC_PROFILE", 12) == 0)
+			jpeg_write_marker(dst, m->marker, m->data, m->data_length);
+		else if (m->marker == JPEG_APP0 + 1 &&
+		    (value = orientation(m->data, m->data_length)) != 1) {
+			exif[25] = value;
+			jpeg_write_marker(dst, m->marker, exif, sizeof (exif));
+		}
+	}
+}
+
+/*
+ * Transcode the DCT coefficients as they are, the image is not decoded.
+ */
+static int
+transcode_jpeg(FILE *fp, const void *data, size_t datasz, int progressive)
+{
+	struct jpeg_decompress_struct src = {0};
+	struct jpeg_compress_struct dst = {0};
+	struct error err;
+	jvirt_barray_ptr *coefs;
+
+	jpeg_std_error(&err.mgr);
+	err.mgr.error_exit = error_exit;
+	err.mgr.output_message = error_output;
+	src.err = &err.mgr;
+	dst.err = &err.mgr;
+
+	if (setjmp(err.env)) {
+		jpeg_destroy_compress(&dst);
+		jpeg_destroy_decompress(&src);
+		return -1;
+	}
+
+	jpeg_create_decompress(&src);
+	jpeg_create_compress(&dst);
+	jpeg_mem_src(&src, data, datasz);
+	jpeg_save_markers(&src, JPEG_APP0 + 1, 0xffff);
+	jpeg_save_markers(&src, JPEG_APP0 + 2, 0xffff);
+	jpeg_read_header(&src, TRUE);
+
+	coefs = jpeg_read_coefficients(&src);
+	jpeg_copy_critical_parameters(&src, &dst);
+
+	/* The pixel density is not a critical parameter. */
+	if (src.saw_JFIF_marker) {
+		dst.density_unit = src.density_unit;
+		dst.X_density = src.X_density;
+		dst.Y_density = src.Y_density;
+	}
+
+	dst.optimize_coding = TRUE;
+
+	if (progressive)
+		jpeg_simple_progression(&dst);
+
+	jpeg_stdio_dest(&dst, fp);
+	jpeg_write_coefficients(&dst, coefs);
+	copy_markers(&dst, &src);
+	jpeg_finish_compress(&dst);
+	jpeg_finish_decompress(&src);
+	jpeg_destroy_compress(&dst);
+	jpeg_destroy_decompress(&src);
+
+	return fflush(fp) == EOF ? -1 : 0;
+}
+
+/*
+ * Run one encoding into a new buffer and keep it if it is the smallest so
+ * far.
+ */
+static int
+attempt(unsigned char **out,
+        size_t *outsz,
+        const void *data,
+        size_t datasz,
+        int (*encode)(FILE *, const void *, size_t, int),
+        int arg)
+{
+	char *buf = NULL;
+	size_t bufsz = 0;
+	FILE *fp;
+	int rv;
+
+	fp = eopen_memstream(&buf, &bufsz);
+	rv = encode(fp, data, datasz, arg);
+	fclose(fp);
+
+	if (rv < 0 || bufsz >= *outsz) {
+		free(buf);
+		return rv;
+	}
+
+	free(*out);
+	*out = (unsigned char *)buf;
+	*outsz = bufsz;
+
+	return 0;
+}
+
+static int
+encode_png(FILE *fp, const void *data, size_t datasz, int arg)
+{
+	(void)arg;
+
+	return recompress_png(fp, data, datasz);
+}
+
+int
+optim_image(unsigned char **out, size_t *outsz, const void *data, size_t datasz)
+{
+	assert(out);
+	assert(outsz);
+	assert(data);
+
+	int rv;
+
+	*out = NULL;
+	*outsz = datasz;
+
+	switch (check_image_format(data, datasz)) {
+	case CHECK_IMAGE_PNG:
+		if (!usable(data, datasz))
+			return -1;
+
+		rv = attempt(out, outsz, data, datasz, encode_png, 0);
+		break;
+	case CHECK_IMAGE_JPEG:
+		/* Progressive is usually smaller except for small images. */
+		if ((rv = attempt(out, outsz, data, datasz, transcode_jpeg, 0)) == 0)
+			rv = attempt(out, outsz, data, datasz, transcode_jpeg, 1);
+		break;
+	default:
+		return -1;
+	}
+
+	if (rv < 0) {
+		free(*out);
+		*out = NULL;
+		*outsz = datasz;
+		return -1;
+	}
+
+	return *out != NULL;
+}
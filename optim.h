@@ -0,0 +1,59 @@
+/*
+ * optim.h -- lossless image recompression
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_OPTIM_H
+#define TMPUPD_OPTIM_H
+
+/**
+ * \file optim.h
+ * \brief Lossless image recompression.
+ *
+ * PNG images are deflated again with the best level and a filter chosen per
+ * row, JPEG images are transcoded without decoding the pixels using optimized
+ * Huffman tables and progressive mode whichever is smaller.
+ *
+ * Metadata is dropped except what changes how the image is displayed: the
+ * color chunks and physical size for PNG, the ICC profile and the Exif
+ * orientation for JPEG. Animated PNG are left untouched.
+ */
+
+#include <stddef.h>
+
+/**
+ * \def OPTIM_PIXELS_MAX
+ * Maximum number of pixels of PNG images, they have to be decoded.
+ */
+#define OPTIM_PIXELS_MAX (32UL * 1024 * 1024)
+
+/**
+ * Recompress an image without changing its pixels.
+ *
+ * \pre out != NULL
+ * \pre outsz != NULL
+ * \pre data != NULL
+ * \param out the dynamically allocated image to set
+ * \param outsz the new image length to set
+ * \param data the original image
+ * \param datasz the original image length
+ * \return 1 if a smaller image was produced, 0 if not or -1 if the image is
+ * not supported
+ */
+int
+optim_image(unsigned char **out, size_t *outsz, const void *data, size_t datasz);
+
+#endif /* !TMPUPD_OPTIM_H */
@@ -17,6 +17,7 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -248,6 +249,7 @@ paste_finish(struct paste *paste)
 	free(paste->author);
 	free(paste->language);
 	free(paste->code);
+	free(paste->preview);
 	memset(paste, 0, sizeof (*paste));
 }
 
@@ -270,39 +272,57 @@ paste_dump(const struct paste *paste)
 }
 
 int
-paste_parse(struct paste *paste, const char *text, char *error, size_t errorsz)
+paste_read(struct paste *paste,
+           json_read_fn read,
+           void *data,
+           size_t max,
+           char *error,
+           size_t errorsz)
 {
-	const char *title = NULL, *author = NULL, *filename = NULL, *language = NULL, *code = NULL;
-	json_int_t start = 0, end = 0;
-	json_t *doc;
-	json_error_t err;
+	assert(paste);
+	assert(read);
+	assert(error);
+
+	char *title = NULL, *author = NULL, *filename = NULL, *language = NULL, *code = NULL;
+	intmax_t start = 0, end = 0;
 	int rv, visible = 0;
+	struct json_read jr;
+	struct json_read_key keys[] = {
+		{ .name = "title",     .type = JSON_READ_STR,   .value = &title },
+		{ .name = "author",    .type = JSON_READ_STR,   .value = &author },
+		{ .name = "filename",  .type = JSON_READ_STR,   .value = &filename },
+		{ .name = "language",  .type = JSON_READ_STR,   .value = &language },
+		{ .name = "code",      .type = JSON_READ_STR,   .value = &code },
+		{ .name = "start",     .type = JSON_READ_INT,   .value = &start },
+		{ .name = "end",       .type = JSON_READ_INT,   .value = &end },
+		{ .name = "visible",   .type = JSON_READ_BOOL,  .value = &visible }
+	};
 
 	memset(paste, 0, sizeof (*paste));
+	json_read_init(&jr, read, data, max);
 
-	rv = tmp_parse(&doc, &err, text, "{s?s s?s s?s s?s s?s s?I s?I s?b}",
-		"title",        &title,
-		"author",       &author,
-		"filename",     &filename,
-		"language",     &language,
-		"code",         &code,
-		"start",        &start,
-		"end",          &end,
-		"visible",      &visible
-	);
+	if ((rv = json_read_object(&jr, keys, LEN(keys))) < 0)
+		bstrlcpy(error, jr.error, errorsz);
+	else if ((language && check_language(language, error, errorsz) < 0) ||
+	    check_duration(start, end, error, errorsz) < 0) {
+		rv = -1;
+		errno = EINVAL;
+	} else {
+		paste_init(paste, NULL, title, author, filename, language, NULL, start, end, visible);
 
-	if (rv < 0) {
-		bstrlcpy(error, err.text, errorsz);
-		return -1;
+		/* Take ownership of the code rather than copying it again. */
+		if (code) {
+			free(paste->code);
+			paste->code = code;
+			code = NULL;
+		}
 	}
 
-	/* Check language exists. */
-	if (check_language(language, error, errorsz) < 0 ||
-	    check_duration(start, end, error, errorsz) < 0)
-		return -1;
-
-	paste_init(paste, NULL, title, author, filename, language, code, start, end, visible);
-	json_decref(doc);
+	free(title);
+	free(author);
+	free(filename);
+	free(language);
+	free(code);
 
-	return 0;
+	return rv;
 }
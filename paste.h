@@ -27,6 +27,8 @@
 #include <stddef.h>
 #include <time.h>
 
+#include "json-read.h"
+
 /**
  * \struct paste
  * \brief Paste definition structure
@@ -94,6 +96,27 @@ struct paste {
 	 * If non-zero lists the paste in the index and searches.
 	 */
 	int visible;
+
+	/**
+	 * (read-only)
+	 *
+	 * Code length in bytes, computed when saved.
+	 */
+	size_t size;
+
+	/**
+	 * (read-only)
+	 *
+	 * Number of lines of the code, computed when saved.
+	 */
+	size_t lines;
+
+	/**
+	 * (read-only)
+	 *
+	 * First lines of the code or NULL if unknown.
+	 */
+	char *preview;
 };
 
 /**
@@ -148,16 +171,29 @@ char *
 paste_dump(const struct paste *paste);
 
 /**
- * Try to parse the JSON text as an paste.
+ * Read a JSON document as a paste without building the whole document in
+ * memory, the code is read only once into the paste.
+ *
+ * On error, errno is set to EFBIG if the document exceeds max bytes.
  *
  * \pre paste != NULL
- * \param text JSON document to parse
+ * \pre read != NULL
+ * \pre error != NULL
+ * \param paste the paste to fill
+ * \param read the input function
+ * \param data the input function user data
+ * \param max the maximum document length
  * \param error the error string to fill
- * \param errosz maximum error length
+ * \param errorsz maximum error length
  * \return 0 on success or -1 on error
  */
 int
-paste_parse(struct paste *paste, const char *text, char *error, size_t errorsz);
+paste_read(struct paste *paste,
+           json_read_fn read,
+           void *data,
+           size_t max,
+           char *error,
+           size_t errorsz);
 
 /**
  * Cleanup the paste.
@@ -0,0 +1,129 @@
+/*
+ * pool.c -- threads running the requests
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+#include "util.h"
+
+struct job {
+	pool_fn fn;
+	void *data;
+	struct job *next;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *threads;
+static size_t threadsz;
+
+/* Jobs are run in the order submitted. */
+static struct job *head, **tail = &head;
+static int stopping;
+
+static void *
+routine(void *data)
+{
+	struct job *job;
+
+	(void)data;
+
+	for (;;) {
+		pthread_mutex_lock(&mutex);
+
+		while (!head && !stopping)
+			pthread_cond_wait(&cond, &mutex);
+
+		if (stopping) {
+			pthread_mutex_unlock(&mutex);
+			break;
+		}
+
+		job = head;
+
+		if (!(head = job->next))
+			tail = &head;
+
+		pthread_mutex_unlock(&mutex);
+
+		job->fn(job->data);
+		free(job);
+	}
+
+	return NULL;
+}
+
+void
+pool_init(size_t n)
+{
+	assert(n);
+
+	int rv;
+
+	threads = ecalloc(n, sizeof (*threads));
+
+	for (threadsz = 0; threadsz < n; ++threadsz)
+		if ((rv = pthread_create(&threads[threadsz], NULL, routine, NULL)) != 0)
+			die("abort: pthread_create: %s\n", strerror(rv));
+}
+
+void
+pool_submit(pool_fn fn, void *data)
+{
+	assert(fn);
+
+	struct job *job;
+
+	job = ecalloc(1, sizeof (*job));
+	job->fn = fn;
+	job->data = data;
+
+	pthread_mutex_lock(&mutex);
+	*tail = job;
+	tail = &job->next;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+void
+pool_finish(void)
+{
+	struct job *job;
+
+	pthread_mutex_lock(&mutex);
+	stopping = 1;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+
+	for (size_t i = 0; i < threadsz; ++i)
+		pthread_join(threads[i], NULL);
+
+	while ((job = head)) {
+		head = job->next;
+		free(job);
+	}
+
+	free(threads);
+	threads = NULL;
+	threadsz = 0;
+	tail = &head;
+	stopping = 0;
+}
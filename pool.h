@@ -0,0 +1,66 @@
+/*
+ * pool.h -- threads running the requests
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_POOL_H
+#define TMPUPD_POOL_H
+
+/**
+ * \file pool.h
+ * \brief Threads running the requests.
+ *
+ * The backends read requests from a single event loop and run the routes in
+ * these threads so that a slow client or a long query never holds the other
+ * connections.
+ */
+
+#include <stddef.h>
+
+/**
+ * Function run by a thread.
+ *
+ * \param data the job user data
+ */
+typedef void (*pool_fn)(void *data);
+
+/**
+ * Start the threads, exits on failure.
+ *
+ * \pre threads > 0
+ * \param threads the number of threads
+ */
+void
+pool_init(size_t threads);
+
+/**
+ * Queue a job, it is run by the first thread available.
+ *
+ * \pre fn != NULL
+ * \param fn the function to run
+ * \param data the function user data
+ */
+void
+pool_submit(pool_fn fn, void *data);
+
+/**
+ * Wait for the jobs running and stop the threads, the jobs not started yet
+ * are discarded.
+ */
+void
+pool_finish(void);
+
+#endif /* !TMPUPD_POOL_H */
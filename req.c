@@ -0,0 +1,775 @@
+/*
+ * req.c -- HTTP request abstraction
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "req.h"
+#include "util.h"
+
+static const struct reason {
+	int code;
+	const char *message;
+} reasons[] = {
+	{ 200, "OK"                             },
+	{ 201, "Created"                        },
+	{ 204, "No Content"                     },
+	{ 206, "Partial Content"                },
+	{ 302, "Found"                          },
+	{ 304, "Not Modified"                   },
+	{ 400, "Bad Request"                    },
+	{ 403, "Forbidden"                      },
+	{ 404, "Not Found"                      },
+	{ 405, "Method Not Allowed"             },
+	{ 408, "Request Timeout"                },
+	{ 409, "Conflict"                       },
+	{ 411, "Length Required"                },
+	{ 413, "Payload Too Large"              },
+	{ 416, "Range Not Satisfiable"          },
+	{ 417, "Expectation Failed"             },
+	{ 431, "Request Header Fields Too Large"},
+	{ 500, "Internal Server Error"          },
+	{ 501, "Not Implemented"                },
+	{ 503, "Service Unavailable"            }
+};
+
+static const char * const methods[] = {
+	[REQ_METHOD_GET]        = "GET",
+	[REQ_METHOD_HEAD]       = "HEAD",
+	[REQ_METHOD_POST]       = "POST",
+	[REQ_METHOD_PUT]        = "PUT",
+	[REQ_METHOD_DELETE]     = "DELETE"
+};
+
+const char * const req_mimes[] = {
+	[REQ_MIME_APP_JSON]             = "application/json",
+	[REQ_MIME_APP_OCTET_STREAM]     = "application/octet-stream",
+	[REQ_MIME_TEXT_CSS]             = "text/css",
+	[REQ_MIME_TEXT_HTML]            = "text/html",
+	[REQ_MIME_TEXT_PLAIN]           = "text/plain"
+};
+
+static int
+cmp_reason(const void *key, const void *value)
+{
+	const int *code = key;
+	const struct reason *reason = value;
+
+	return *code - reason->code;
+}
+
+static inline int
+hexval(unsigned char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+/*
+ * Decode a percent encoded string in place, the destination is always shorter
+ * or equal to the source.
+ */
+static size_t
+urldecode(char *str)
+{
+	char *dst = str, *start = str;
+	int hi, lo;
+
+	for (; *str; ++str) {
+		if (*str == '+')
+			*dst++ = ' ';
+		else if (*str == '%' && (hi = hexval(str[1])) >= 0 && (lo = hexval(str[2])) >= 0) {
+			*dst++ = (hi << 4) | lo;
+			str += 2;
+		} else
+			*dst++ = *str;
+	}
+
+	*dst = '\0';
+
+	return dst - start;
+}
+
+static const char *
+find(const char *hay, size_t haysz, const char *needle, size_t needlesz)
+{
+	const char *p, *end;
+
+	if (needlesz > haysz)
+		return NULL;
+
+	end = hay + haysz - needlesz;
+
+	for (p = hay; (p = memchr(p, needle[0], end - p + 1)); ++p)
+		if (memcmp(p, needle, needlesz) == 0)
+			return p;
+
+	return NULL;
+}
+
+/*
+ * Find a parameter in a header value such as:
+ *
+ * multipart/form-data; boundary=foo
+ * form-data; name="file"; filename="foo.png"
+ *
+ * The function returns a pointer to the value and stores its length, the
+ * header value is left untouched.
+ */
+static char *
+locate(char *value, const char *name, size_t *len)
+{
+	size_t namesz = strlen(name);
+	char *p, *end;
+
+	for (p = value; (p = strchr(p, ';')); ) {
+		for (++p; *p == ' ' || *p == '\t'; ++p)
+			continue;
+
+		if (strncasecmp(p, name, namesz) != 0 || p[namesz] != '=')
+			continue;
+
+		p += namesz + 1;
+
+		if (*p == '"') {
+			if (!(end = strchr(++p, '"')))
+				return NULL;
+		} else
+			end = p + strcspn(p, "; \t");
+
+		*len = end - p;
+
+		return p;
+	}
+
+	return NULL;
+}
+
+/*
+ * Same as locate but the value is terminated in place, the parameters after
+ * it can't be found anymore.
+ */
+static char *
+param(char *value, const char *name)
+{
+	char *p;
+	size_t len;
+
+	if ((p = locate(value, name, &len)))
+		p[len] = '\0';
+
+	return p;
+}
+
+static inline int
+is_ctype(const struct req *r, const char *mime)
+{
+	return r->ctype && strncasecmp(r->ctype, mime, strlen(mime)) == 0;
+}
+
+void
+req_init(struct req *r, const struct req_ops *ops, void *data)
+{
+	assert(r);
+	assert(ops);
+
+	memset(r, 0, sizeof (*r));
+	r->method = REQ_METHOD_OTHER;
+	r->path = "/";
+	r->status = 200;
+	r->ops = ops;
+	r->data = data;
+}
+
+enum req_method
+req_method(const char *name)
+{
+	assert(name);
+
+	for (size_t i = 0; i < LEN(methods); ++i)
+		if (strcmp(methods[i], name) == 0)
+			return i;
+
+	return REQ_METHOD_OTHER;
+}
+
+const char *
+req_reason(int code)
+{
+	const struct reason *rv;
+
+	rv = bsearch(&code, reasons, LEN(reasons), sizeof (*rv), cmp_reason);
+
+	return rv ? rv->message : "Unknown";
+}
+
+void
+req_add_header(struct req *r, const char *key, const char *val)
+{
+	assert(r);
+	assert(key);
+	assert(val);
+
+	r->headers = ereallocarray(r->headers, r->headersz + 1, sizeof (*r->headers));
+	r->headers[r->headersz].key = key;
+	r->headers[r->headersz++].val = val;
+}
+
+void
+req_add_field(struct req *r,
+              const char *key,
+              const char *val,
+              size_t valsz,
+              const char *file)
+{
+	assert(r);
+	assert(key);
+	assert(val);
+
+	r->fields = ereallocarray(r->fields, r->fieldsz + 1, sizeof (*r->fields));
+	r->fields[r->fieldsz].key = key;
+	r->fields[r->fieldsz].val = val;
+	r->fields[r->fieldsz].valsz = valsz;
+	r->fields[r->fieldsz++].file = file;
+}
+
+void
+req_parse_query(struct req *r, char *str)
+{
+	assert(r);
+	assert(str);
+
+	char *pair, *key, *val;
+
+	while ((pair = strsep(&str, "&"))) {
+		key = pair;
+
+		if ((val = strchr(pair, '=')))
+			*val++ = '\0';
+		else
+			val = pair + strlen(pair);
+
+		urldecode(key);
+
+		if (*key)
+			req_add_field(r, key, val, urldecode(val), NULL);
+	}
+}
+
+int
+req_parse_multipart(struct req *r, char *body, size_t bodysz)
+{
+	assert(r);
+	assert(body);
+
+	char ctype[256], delim[128], *boundary, *p, *end, *hdrend, *line, *disp;
+	char *name, *file;
+	const char *next;
+	size_t delimsz, namesz, filesz;
+
+	if (!r->ctype || strlen(r->ctype) >= sizeof (ctype))
+		return -1;
+
+	/* Don't modify the original header. */
+	strcpy(ctype, r->ctype);
+
+	if (!(boundary = param(ctype, "boundary")))
+		return -1;
+
+	delimsz = snprintf(delim, sizeof (delim), "\r\n--%s", boundary);
+
+	if (delimsz >= sizeof (delim))
+		return -1;
+
+	end = body + bodysz;
+
+	/* The first delimiter may not be preceded by CRLF. */
+	if (bodysz >= delimsz - 2 && memcmp(body, delim + 2, delimsz - 2) == 0)
+		p = body + delimsz - 2;
+	else if ((next = find(body, bodysz, delim, delimsz)))
+		p = (char *)next + delimsz;
+	else
+		return -1;
+
+	for (;;) {
+		/* Closing delimiter. */
+		if (end - p >= 2 && p[0] == '-' && p[1] == '-')
+			return 0;
+		if (end - p < 2 || p[0] != '\r' || p[1] != '\n')
+			return -1;
+
+		p += 2;
+
+		if (!(next = find(p, end - p, "\r\n\r\n", 4)))
+			return -1;
+
+		hdrend = (char *)next;
+		*hdrend = '\0';
+		name = file = NULL;
+
+		/* Only Content-Disposition is interesting. */
+		while ((line = strsep(&p, "\r\n"))) {
+			if (strncasecmp(line, "Content-Disposition:", 20) != 0)
+				continue;
+
+			/*
+			 * Values are terminated in place once both are found,
+			 * they come in any order.
+			 */
+			disp = line + 20;
+			file = locate(disp, "filename", &filesz);
+			name = locate(disp, "name", &namesz);
+
+			if (file)
+				file[filesz] = '\0';
+			if (name)
+				name[namesz] = '\0';
+		}
+
+		p = hdrend + 4;
+
+		if (!(next = find(p, end - p, delim, delimsz)))
+			return -1;
+
+		/* Terminate the value in place, delimiter starts with \r. */
+		*(char *)next = '\0';
+
+		if (name)
+			req_add_field(r, name, p, next - p, file);
+
+		p = (char *)next + delimsz;
+	}
+}
+
+/*
+ * Move the remaining input at the beginning of the buffer and read more.
+ *
+ * Returns the number of bytes read, 0 if nothing can be read anymore (end of
+ * body or buffer full) or -1 on error.
+ */
+static ssize_t
+multipart_fill(struct req_multipart *mp)
+{
+	ssize_t nr;
+
+	if (mp->pos) {
+		memmove(mp->buf, mp->buf + mp->pos, mp->len - mp->pos);
+		mp->len -= mp->pos;
+		mp->pos = 0;
+	}
+
+	if (mp->eof || mp->len == sizeof (mp->buf))
+		return 0;
+	if ((nr = req_read(mp->req, mp->buf + mp->len, sizeof (mp->buf) - mp->len)) < 0)
+		return -1;
+	if (nr == 0)
+		mp->eof = 1;
+
+	mp->len += nr;
+
+	return nr;
+}
+
+int
+req_multipart_init(struct req_multipart *mp, struct req *r)
+{
+	assert(mp);
+	assert(r);
+
+	char ctype[256], *boundary;
+
+	if (!is_ctype(r, "multipart/form-data") || strlen(r->ctype) >= sizeof (ctype))
+		return -1;
+
+	strcpy(ctype, r->ctype);
+
+	if (!(boundary = param(ctype, "boundary")))
+		return -1;
+
+	memset(mp, 0, sizeof (*mp));
+	mp->req = r;
+	mp->delimsz = snprintf(mp->delim, sizeof (mp->delim), "\r\n--%s", boundary);
+
+	if (mp->delimsz >= sizeof (mp->delim))
+		return -1;
+
+	/*
+	 * The first delimiter may not be preceded by CRLF, add one so that
+	 * the preamble is just skipped as a regular part.
+	 */
+	memcpy(mp->buf, "\r\n", 2);
+	mp->len = 2;
+
+	return 0;
+}
+
+int
+req_multipart_next(struct req_multipart *mp)
+{
+	assert(mp);
+
+	char scratch[1024], disp[512], *hdr, *end, *line, *val;
+	const char *next;
+	ssize_t nr;
+
+	if (mp->last)
+		return 0;
+
+	while ((nr = req_multipart_read(mp, scratch, sizeof (scratch))) > 0)
+		continue;
+
+	if (nr < 0)
+		return -1;
+
+	/*
+	 * Search the end of headers from the CRLF that follows the delimiter
+	 * so that a part without headers is found as well.
+	 */
+	for (;;) {
+		if (mp->len - mp->pos >= 2 && memcmp(mp->buf + mp->pos, "--", 2) == 0) {
+			mp->last = 1;
+			return 0;
+		}
+		if ((next = find(mp->buf + mp->pos, mp->len - mp->pos, "\r\n\r\n", 4)))
+			break;
+		if ((nr = multipart_fill(mp)) < 0)
+			return -1;
+		if (nr == 0) {
+			errno = EBADMSG;
+			return -1;
+		}
+	}
+
+	if (memcmp(mp->buf + mp->pos, "\r\n", 2) != 0) {
+		errno = EBADMSG;
+		return -1;
+	}
+
+	hdr = mp->buf + mp->pos + 2;
+	end = (char *)next;
+	*end = '\0';
+	mp->name[0] = mp->file[0] = '\0';
+
+	/* Only Content-Disposition is interesting. */
+	while (hdr < end && (line = strsep(&hdr, "\r\n"))) {
+		if (strncasecmp(line, "Content-Disposition:", 20) != 0)
+			continue;
+
+		/* Values are terminated in place, work on copies. */
+		bstrlcpy(disp, line + 20, sizeof (disp));
+
+		if ((val = param(disp, "name")))
+			bstrlcpy(mp->name, val, sizeof (mp->name));
+
+		bstrlcpy(disp, line + 20, sizeof (disp));
+
+		if ((val = param(disp, "filename")))
+			bstrlcpy(mp->file, val, sizeof (mp->file));
+	}
+
+	mp->pos = end + 4 - mp->buf;
+	mp->done = 0;
+
+	return 1;
+}
+
+ssize_t
+req_multipart_read(struct req_multipart *mp, void *buf, size_t bufsz)
+{
+	assert(mp);
+	assert(buf);
+
+	const char *next;
+	size_t avail;
+	ssize_t nr;
+
+	if (mp->done)
+		return 0;
+
+	for (;;) {
+		avail = mp->len - mp->pos;
+
+		if ((next = find(mp->buf + mp->pos, avail, mp->delim, mp->delimsz))) {
+			avail = next - (mp->buf + mp->pos);
+
+			if (avail == 0) {
+				mp->pos += mp->delimsz;
+				mp->done = 1;
+				return 0;
+			}
+
+			break;
+		}
+
+		/* Keep what could be the beginning of a delimiter. */
+		if (avail >= mp->delimsz) {
+			avail -= mp->delimsz - 1;
+			break;
+		}
+
+		if ((nr = multipart_fill(mp)) < 0)
+			return -1;
+		if (nr == 0) {
+			errno = EBADMSG;
+			return -1;
+		}
+	}
+
+	if (avail > bufsz)
+		avail = bufsz;
+
+	memcpy(buf, mp->buf + mp->pos, avail);
+	mp->pos += avail;
+
+	return avail;
+}
+
+int
+req_parse_body(struct req *r, size_t max)
+{
+	assert(r);
+
+	size_t bodysz;
+
+	if (!is_ctype(r, "application/x-www-form-urlencoded") &&
+	    !is_ctype(r, "multipart/form-data"))
+		return 0;
+	if (!(r->buf = req_slurp(r, max, &bodysz)))
+		return -1;
+	if (!is_ctype(r, "multipart/form-data"))
+		req_parse_query(r, r->buf);
+	else if (req_parse_multipart(r, r->buf, bodysz) < 0) {
+		errno = EBADMSG;
+		return -1;
+	}
+
+	return 0;
+}
+
+const char *
+req_header(const struct req *r, const char *key)
+{
+	assert(r);
+	assert(key);
+
+	for (size_t i = 0; i < r->headersz; ++i)
+		if (strcasecmp(r->headers[i].key, key) == 0)
+			return r->headers[i].val;
+
+	return NULL;
+}
+
+const char *
+req_field(const struct req *r, const char *key)
+{
+	assert(r);
+	assert(key);
+
+	for (size_t i = 0; i < r->fieldsz; ++i)
+		if (strcmp(r->fields[i].key, key) == 0)
+			return r->fields[i].val;
+
+	return NULL;
+}
+
+void
+req_status(struct req *r, int code)
+{
+	assert(r);
+	assert(!r->body);
+
+	r->status = code;
+}
+
+void
+req_head(struct req *r, const char *key, const char *fmt, ...)
+{
+	assert(r);
+	assert(key);
+	assert(fmt);
+	assert(!r->body);
+
+	va_list ap;
+	char *val = NULL;
+	size_t valsz = 0;
+	FILE *fp;
+
+	fp = eopen_memstream(&val, &valsz);
+	va_start(ap, fmt);
+	vfprintf(fp, fmt, ap);
+	va_end(ap);
+	fclose(fp);
+
+	r->resps = ereallocarray(r->resps, r->respsz + 1, sizeof (*r->resps));
+	r->resps[r->respsz].key = key;
+	r->resps[r->respsz++].val = val;
+}
+
+void
+req_body(struct req *r)
+{
+	assert(r);
+
+	if (r->body)
+		return;
+
+	r->body = 1;
+
+	if (r->ops->head(r) < 0)
+		r->error = 1;
+}
+
+void
+req_write(struct req *r, const void *data, size_t datasz)
+{
+	assert(r);
+	assert(data);
+
+	req_body(r);
+
+	/* Responses to HEAD only have headers. */
+	if (r->error || datasz == 0 || r->method == REQ_METHOD_HEAD)
+		return;
+	if (r->ops->write(r, data, datasz) < 0)
+		r->error = 1;
+	else
+		r->sent += datasz;
+}
+
+void
+req_printf(struct req *r, const char *fmt, ...)
+{
+	assert(r);
+	assert(fmt);
+
+	va_list ap;
+
+	va_start(ap, fmt);
+	req_vprintf(r, fmt, ap);
+	va_end(ap);
+}
+
+void
+req_vprintf(struct req *r, const char *fmt, va_list ap)
+{
+	assert(r);
+	assert(fmt);
+
+	char buf[1024], *str = buf;
+	va_list cp;
+	int len;
+
+	va_copy(cp, ap);
+	len = vsnprintf(buf, sizeof (buf), fmt, cp);
+	va_end(cp);
+
+	if (len < 0)
+		return;
+
+	/* Rare but possible, allocate a larger buffer. */
+	if ((size_t)len >= sizeof (buf)) {
+		str = emalloc(len + 1, 1);
+		vsnprintf(str, len + 1, fmt, ap);
+	}
+
+	req_write(r, str, len);
+
+	if (str != buf)
+		free(str);
+}
+
+ssize_t
+req_read(struct req *r, void *buf, size_t bufsz)
+{
+	assert(r);
+	assert(buf);
+
+	if (!r->ops->read)
+		return 0;
+
+	return r->ops->read(r, buf, bufsz);
+}
+
+char *
+req_slurp(struct req *r, size_t max, size_t *bodysz)
+{
+	assert(r);
+	assert(bodysz);
+
+	char *body = NULL;
+	size_t cap = 0, len = 0;
+	ssize_t nr;
+
+	if (r->length > max) {
+		errno = EFBIG;
+		return NULL;
+	}
+
+	/* Allocate the announced length at once, grow otherwise. */
+	cap = r->length ? r->length + 1 : BUFSIZ;
+	body = emalloc(cap, 1);
+
+	for (;;) {
+		if (cap - len <= 1)
+			body = erealloc(body, cap *= 2, 1);
+		if ((nr = req_read(r, body + len, cap - len - 1)) <= 0)
+			break;
+		if ((len += nr) > max) {
+			nr = -1;
+			errno = EFBIG;
+			break;
+		}
+	}
+
+	if (nr < 0) {
+		free(body);
+		return NULL;
+	}
+
+	body[len] = '\0';
+	*bodysz = len;
+
+	return body;
+}
+
+void
+req_finish(struct req *r)
+{
+	assert(r);
+
+	req_body(r);
+
+	for (size_t i = 0; i < r->respsz; ++i)
+		free((char *)r->resps[i].val);
+
+	free(r->resps);
+	free(r->headers);
+	free(r->fields);
+	free(r->buf);
+	memset(r, 0, sizeof (*r));
+}
@@ -0,0 +1,540 @@
+/*
+ * req.h -- HTTP request abstraction
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_REQ_H
+#define TMPUPD_REQ_H
+
+/**
+ * \file req.h
+ * \brief HTTP request abstraction.
+ *
+ * Routes only see this structure, the underlying protocol (FastCGI or the
+ * built-in HTTP server) is implemented through the ::req_ops functions.
+ *
+ * Strings referenced by a request are borrowed from the backend and stay
+ * valid until ::req_finish is called.
+ */
+
+#include <sys/types.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+/**
+ * \def REQ_MULTIPART_BUF
+ * Buffer size of a ::req_multipart reader, part headers must fit in it.
+ */
+#define REQ_MULTIPART_BUF 16384
+
+/**
+ * \enum req_method
+ * \brief Request method.
+ */
+enum req_method {
+	REQ_METHOD_GET,         /*!< GET */
+	REQ_METHOD_HEAD,        /*!< HEAD */
+	REQ_METHOD_POST,        /*!< POST */
+	REQ_METHOD_PUT,         /*!< PUT */
+	REQ_METHOD_DELETE,      /*!< DELETE */
+	REQ_METHOD_OTHER        /*!< Anything else. */
+};
+
+/**
+ * \enum req_mime
+ * \brief Common content types.
+ */
+enum req_mime {
+	REQ_MIME_APP_JSON,              /*!< application/json */
+	REQ_MIME_APP_OCTET_STREAM,      /*!< application/octet-stream */
+	REQ_MIME_TEXT_CSS,              /*!< text/css */
+	REQ_MIME_TEXT_HTML,             /*!< text/html */
+	REQ_MIME_TEXT_PLAIN             /*!< text/plain */
+};
+
+/**
+ * \struct req_field
+ * \brief Query or form field.
+ */
+struct req_field {
+	const char *key;        /*!< Field name. */
+	const char *val;        /*!< Field value (always NUL terminated). */
+	size_t valsz;           /*!< Field value length. */
+	const char *file;       /*!< Multipart filename (may be NULL). */
+};
+
+/**
+ * \struct req_header
+ * \brief Request or response header.
+ */
+struct req_header {
+	const char *key;        /*!< Header name. */
+	const char *val;        /*!< Header value. */
+};
+
+struct req;
+
+/**
+ * \struct req_multipart
+ * \brief Streaming multipart/form-data reader.
+ *
+ * Parts are read one after the other through a fixed buffer so the memory
+ * used does not depend on the body length.
+ */
+struct req_multipart {
+	char name[64];                  /*!< (read-only) Part name. */
+	char file[256];                 /*!< (read-only) Part filename (may be empty). */
+	struct req *req;                /*!< (private) Request. */
+	char delim[80];                 /*!< (private) CRLF, dashes and boundary. */
+	size_t delimsz;                 /*!< (private) Delimiter length. */
+	char buf[REQ_MULTIPART_BUF];    /*!< (private) Input buffer. */
+	size_t pos;                     /*!< (private) Position in buf. */
+	size_t len;                     /*!< (private) Bytes in buf. */
+	int eof;                        /*!< (private) Request body fully read. */
+	int done;                       /*!< (private) Current part fully read. */
+	int last;                       /*!< (private) Closing delimiter seen. */
+};
+
+/**
+ * \struct req_ops
+ * \brief Backend functions.
+ */
+struct req_ops {
+	/**
+	 * Send the status and the response headers.
+	 *
+	 * \param r the request
+	 * \return 0 on success or -1 on error
+	 */
+	int (*head)(struct req *r);
+
+	/**
+	 * Send a part of the response body.
+	 *
+	 * \param r the request
+	 * \param data the data to write
+	 * \param datasz the data length
+	 * \return 0 on success or -1 on error
+	 */
+	int (*write)(struct req *r, const void *data, size_t datasz);
+
+	/**
+	 * Read a part of the request body.
+	 *
+	 * \param r the request
+	 * \param buf the destination buffer
+	 * \param bufsz the maximum number of bytes to read
+	 * \return the number of bytes read, 0 on end of body or -1 on error
+	 */
+	ssize_t (*read)(struct req *r, void *buf, size_t bufsz);
+};
+
+/**
+ * \struct req
+ * \brief HTTP request.
+ */
+struct req {
+	/**
+	 * (read-only)
+	 *
+	 * Request method.
+	 */
+	enum req_method method;
+
+	/**
+	 * (read-only)
+	 *
+	 * Path without the query string.
+	 */
+	const char *path;
+
+	/**
+	 * (read-only)
+	 *
+	 * Request content type (may be NULL).
+	 */
+	const char *ctype;
+
+	/**
+	 * (read-only)
+	 *
+	 * Request body length as announced by the client.
+	 */
+	size_t length;
+
+	/**
+	 * (read-only)
+	 *
+	 * Fields from query string and forms.
+	 */
+	struct req_field *fields;
+
+	/**
+	 * (read-only)
+	 *
+	 * Number of fields.
+	 */
+	size_t fieldsz;
+
+	/**
+	 * (read-only)
+	 *
+	 * Request headers.
+	 */
+	struct req_header *headers;
+
+	/**
+	 * (read-only)
+	 *
+	 * Number of request headers.
+	 */
+	size_t headersz;
+
+	/**
+	 * (read-only)
+	 *
+	 * HTTP status code of the response.
+	 */
+	int status;
+
+	/**
+	 * (read-only)
+	 *
+	 * Response headers set through ::req_head.
+	 */
+	struct req_header *resps;
+
+	/**
+	 * (read-only)
+	 *
+	 * Number of response headers.
+	 */
+	size_t respsz;
+
+	/**
+	 * (read-only)
+	 *
+	 * Non-zero once ::req_body has been called.
+	 */
+	int body;
+
+	/**
+	 * (read-only)
+	 *
+	 * Number of body bytes written so far.
+	 */
+	size_t sent;
+
+	/**
+	 * (read-only)
+	 *
+	 * Non-zero if a backend error occurred, further writes are discarded.
+	 */
+	int error;
+
+	/**
+	 * (private)
+	 *
+	 * Request body read by ::req_parse_body.
+	 */
+	char *buf;
+
+	/**
+	 * (read-write)
+	 *
+	 * Backend functions.
+	 */
+	const struct req_ops *ops;
+
+	/**
+	 * (read-write)
+	 *
+	 * Backend private data.
+	 */
+	void *data;
+};
+
+/**
+ * Mime type strings indexed by ::req_mime.
+ */
+extern const char * const req_mimes[];
+
+/**
+ * Initialize the request.
+ *
+ * \pre r != NULL
+ * \pre ops != NULL
+ * \param r the request
+ * \param ops the backend functions
+ * \param data the backend private data
+ */
+void
+req_init(struct req *r, const struct req_ops *ops, void *data);
+
+/**
+ * Convert a method name to the enumeration.
+ *
+ * \pre name != NULL
+ * \param name the method name (e.g. GET)
+ * \return the method
+ */
+enum req_method
+req_method(const char *name);
+
+/**
+ * Return the standard reason phrase for the HTTP status code.
+ *
+ * \param code the HTTP status code
+ * \return a compile-time string
+ */
+const char *
+req_reason(int code);
+
+/**
+ * Append a request header.
+ *
+ * \pre r != NULL
+ * \pre key != NULL
+ * \pre val != NULL
+ * \param r the request
+ * \param key the header name (borrowed)
+ * \param val the header value (borrowed)
+ */
+void
+req_add_header(struct req *r, const char *key, const char *val);
+
+/**
+ * Append a field.
+ *
+ * \pre r != NULL
+ * \pre key != NULL
+ * \pre val != NULL
+ * \param r the request
+ * \param key the field name (borrowed)
+ * \param val the field value (borrowed and NUL terminated)
+ * \param valsz the field value length
+ * \param file the optional multipart filename (borrowed)
+ */
+void
+req_add_field(struct req *r,
+              const char *key,
+              const char *val,
+              size_t valsz,
+              const char *file);
+
+/**
+ * Decode an application/x-www-form-urlencoded string in place and append
+ * every pair as fields.
+ *
+ * \pre r != NULL
+ * \pre str != NULL
+ * \param r the request
+ * \param str the string to decode (modified)
+ */
+void
+req_parse_query(struct req *r, char *str);
+
+/**
+ * Decode a multipart/form-data body in place and append every part as
+ * fields.
+ *
+ * \pre r != NULL
+ * \pre body != NULL
+ * \param r the request
+ * \param body the body to decode (modified)
+ * \param bodysz the body length
+ * \return 0 on success or -1 on malformed body
+ */
+int
+req_parse_multipart(struct req *r, char *body, size_t bodysz);
+
+/**
+ * Prepare a streaming multipart/form-data reader on the request body.
+ *
+ * Call ::req_multipart_next to go to the first part.
+ *
+ * \pre mp != NULL
+ * \pre r != NULL
+ * \param mp the reader to initialize
+ * \param r the request
+ * \return 0 on success or -1 if the request isn't multipart/form-data
+ */
+int
+req_multipart_init(struct req_multipart *mp, struct req *r);
+
+/**
+ * Skip what remains of the current part and go to the next one.
+ *
+ * \pre mp != NULL
+ * \param mp the reader
+ * \return 1 if a part is available, 0 at the end or -1 on error and errno
+ *         is set (EBADMSG on malformed body)
+ */
+int
+req_multipart_next(struct req_multipart *mp);
+
+/**
+ * Read a part of the current multipart data.
+ *
+ * \pre mp != NULL
+ * \pre buf != NULL
+ * \param mp the reader
+ * \param buf the destination buffer
+ * \param bufsz the maximum number of bytes to read
+ * \return the number of bytes read, 0 at the end of the part or -1 on error
+ *         and errno is set (EBADMSG on malformed body)
+ */
+ssize_t
+req_multipart_read(struct req_multipart *mp, void *buf, size_t bufsz);
+
+/**
+ * Read and parse the request body if it is a form.
+ *
+ * Bodies with other content types are left untouched so that routes can
+ * read them using ::req_read.
+ *
+ * \pre r != NULL
+ * \param r the request
+ * \param max the maximum body length accepted
+ * \return 0 on success or -1 on error and errno is set (EFBIG if too large)
+ */
+int
+req_parse_body(struct req *r, size_t max);
+
+/**
+ * Find a request header by name (case insensitive).
+ *
+ * \pre r != NULL
+ * \pre key != NULL
+ * \param r the request
+ * \param key the header name
+ * \return the header value or NULL if not found
+ */
+const char *
+req_header(const struct req *r, const char *key);
+
+/**
+ * Find the first field by name.
+ *
+ * \pre r != NULL
+ * \pre key != NULL
+ * \param r the request
+ * \param key the field name
+ * \return the field value or NULL if not found
+ */
+const char *
+req_field(const struct req *r, const char *key);
+
+/**
+ * Set the response status code.
+ *
+ * \pre r != NULL
+ * \param r the request
+ * \param code the HTTP status code
+ */
+void
+req_status(struct req *r, int code);
+
+/**
+ * Append a response header.
+ *
+ * \pre r != NULL
+ * \pre key != NULL
+ * \pre fmt != NULL
+ * \param r the request
+ * \param key the header name
+ * \param fmt the printf(3) format string
+ */
+void
+req_head(struct req *r, const char *key, const char *fmt, ...);
+
+/**
+ * Send the status and headers, further calls write the body.
+ *
+ * \pre r != NULL
+ * \param r the request
+ */
+void
+req_body(struct req *r);
+
+/**
+ * Write raw data into the response body.
+ *
+ * \pre r != NULL
+ * \pre data != NULL
+ * \param r the request
+ * \param data the data to write
+ * \param datasz the data length
+ */
+void
+req_write(struct req *r, const void *data, size_t datasz);
+
+/**
+ * Write a formatted string into the response body.
+ *
+ * \pre r != NULL
+ * \pre fmt != NULL
+ * \param r the request
+ * \param fmt the printf(3) format string
+ */
+void
+req_printf(struct req *r, const char *fmt, ...);
+
+/**
+ * Same function as ::req_printf but using `va_list` instead.
+ */
+void
+req_vprintf(struct req *r, const char *fmt, va_list ap);
+
+/**
+ * Read a part of the request body.
+ *
+ * \pre r != NULL
+ * \pre buf != NULL
+ * \param r the request
+ * \param buf the destination buffer
+ * \param bufsz the maximum number of bytes to read
+ * \return the number of bytes read, 0 on end of body or -1 on error
+ */
+ssize_t
+req_read(struct req *r, void *buf, size_t bufsz);
+
+/**
+ * Read the whole request body into a dynamically allocated NUL terminated
+ * buffer.
+ *
+ * \pre r != NULL
+ * \pre bodysz != NULL
+ * \param r the request
+ * \param max the maximum body length accepted
+ * \param bodysz the body length to set
+ * \return the body or NULL on error or if too large
+ */
+char *
+req_slurp(struct req *r, size_t max, size_t *bodysz);
+
+/**
+ * Cleanup the request.
+ *
+ * Response headers are sent if ::req_body was not called.
+ *
+ * \pre r != NULL
+ * \param r the request
+ */
+void
+req_finish(struct req *r);
+
+#endif /* !TMPUPD_REQ_H */
@@ -17,9 +17,9 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
 
-#include "check.h"
 #include "db-image.h"
 #include "db.h"
 #include "http.h"
@@ -31,48 +31,54 @@
 
 #define TAG "route-api-v0-image: "
 
+static ssize_t
+readbody(void *data, void *buf, size_t bufsz)
+{
+	return req_read(data, buf, bufsz);
+}
+
 static void
-post(struct kreq *r)
+post(struct req *r)
 {
 	struct image image;
 	struct db db;
-	char error[128] = "invalid input";
+	char error[128];
+
+	if (image_read(&image, readbody, r, HTTP_BODY_MAX, error, sizeof (error)) < 0) {
+		if (errno == EFBIG)
+			route_status(r, 413, REQ_MIME_APP_JSON);
+		else
+			route_json(r, 400, "{ss}", "error", error);
 
-	if (!r->fieldsz || image_parse(&image, r->fields[0].val, error, sizeof (error)) < 0) {
-		route_json(r, KHTTP_400, "{ss}", "error", error);
 		return;
 	}
 
-	if (check_image(image.data, image.datasz) < 0)
-		route_json(r, KHTTP_400, "{ss}", "error", "not a valid image");
+	if (tmpupd_open(&db, DB_RDWR) < 0)
+		route_status(r, 500, REQ_MIME_APP_JSON);
 	else {
-		if (tmpupd_open(&db, DB_RDWR) < 0)
-			route_status(r, KHTTP_500, KMIME_APP_JSON);
-		else {
-			if (db_image_save(&image, &db) < 0) {
-				log_warn(TAG "unable to create image: %s", db.error);
-				route_status(r, KHTTP_500, KMIME_APP_JSON);
-			} else {
-				log_info(TAG "created image '%s'", image.id);
-				route_json(r, KHTTP_201, "{ss}", "id", image.id);
-			}
-
-			db_finish(&db);
+		if (db_image_save(&image, &db) < 0) {
+			log_warn(TAG "unable to create image: %s", db.error);
+			route_status(r, 500, REQ_MIME_APP_JSON);
+		} else {
+			log_info(TAG "created image '%s'", image.id);
+			route_json(r, 201, "{ss}", "id", image.id);
 		}
+
+		db_finish(&db);
 	}
 
 	image_finish(&image);
 }
 
 void
-route_api_v0_image(struct kreq *r, const char * const *args)
+route_api_v0_image(struct req *r, const char * const *args)
 {
 	assert(r);
 
 	(void)args;
 
 	switch (r->method) {
-	case KMETHOD_POST:
+	case REQ_METHOD_POST:
 		post(r);
 		break;
 	default:
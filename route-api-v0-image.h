@@ -19,12 +19,12 @@
 #ifndef TMPUPD_ROUTE_API_V0_IMAGE
 #define TMPUPD_ROUTE_API_V0_IMAGE
 
-struct kreq;
+struct req;
 
 /**
  * Implement /api/v0/image route
  */
 void
-route_api_v0_image(struct kreq *r, const char * const *args);
+route_api_v0_image(struct req *r, const char * const *args);
 
 #endif /* !TMPUPD_ROUTE_API_V0_IMAGE */
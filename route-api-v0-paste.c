@@ -17,6 +17,7 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
 
 #include "db-paste.h"
@@ -30,27 +31,37 @@
 
 #define TAG "route-api-v0-paste: "
 
+static ssize_t
+readbody(void *data, void *buf, size_t bufsz)
+{
+	return req_read(data, buf, bufsz);
+}
+
 static void
-post(struct kreq *r)
+post(struct req *r)
 {
 	struct paste paste;
 	struct db db;
-	char error[128] = "invalid input";
+	char error[128];
+
+	if (paste_read(&paste, readbody, r, HTTP_BODY_MAX, error, sizeof (error)) < 0) {
+		if (errno == EFBIG)
+			route_status(r, 413, REQ_MIME_APP_JSON);
+		else
+			route_json(r, 400, "{ss}", "error", error);
 
-	if (!r->fieldsz || paste_parse(&paste, r->fields[0].val, error, sizeof (error)) < 0) {
-		route_json(r, KHTTP_400, "{ss}", "error", error);
 		return;
 	}
 
 	if (tmpupd_open(&db, DB_RDWR) < 0)
-		route_status(r, KHTTP_500, KMIME_APP_JSON);
+		route_status(r, 500, REQ_MIME_APP_JSON);
 	else {
 		if (db_paste_save(&paste, &db) < 0) {
 			log_warn(TAG "unable to create paste: %s", db.error);
-			route_status(r, KHTTP_500, KMIME_APP_JSON);
+			route_status(r, 500, REQ_MIME_APP_JSON);
 		} else {
 			log_info(TAG "created paste '%s'", paste.id);
-			route_json(r, KHTTP_201, "{ss}", "id", paste.id);
+			route_json(r, 201, "{ss}", "id", paste.id);
 		}
 
 		db_finish(&db);
@@ -60,14 +71,14 @@ post(struct kreq *r)
 }
 
 void
-route_api_v0_paste(struct kreq *r, const char * const *args)
+route_api_v0_paste(struct req *r, const char * const *args)
 {
 	assert(r);
 
 	(void)args;
 
 	switch (r->method) {
-	case KMETHOD_POST:
+	case REQ_METHOD_POST:
 		post(r);
 		break;
 	default:
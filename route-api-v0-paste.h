@@ -24,12 +24,12 @@
  * \brief Route /api/v0/paste.
  */
 
-struct kreq;
+struct req;
 
 /**
  * Implement /api/v0/paste route
  */
 void
-route_api_v0_paste(struct kreq *r, const char * const *args);
+route_api_v0_paste(struct req *r, const char * const *args);
 
 #endif /* !TMPUPD_ROUTE_API_V0_PASTE */
@@ -0,0 +1,357 @@
+/*
+ * route-api-v1-batch.c -- route /api/v1/batch
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "base64.h"
+#include "check.h"
+#include "db-image.h"
+#include "db-paste.h"
+#include "db.h"
+#include "http.h"
+#include "image.h"
+#include "json-read.h"
+#include "log.h"
+#include "paste.h"
+#include "route-api-v1-batch.h"
+#include "route.h"
+#include "tmp.h"
+#include "tmpupd.h"
+#include "util.h"
+
+#define TAG "route-api-v1-batch: "
+
+/*
+ * Outcome of one item, written once the transaction is committed.
+ */
+struct result {
+	char *id;
+	char error[128];
+};
+
+/*
+ * Values of the current item, the same storage is reused for every item.
+ */
+struct item {
+	char *type;
+	char *title;
+	char *author;
+	char *filename;
+	char *language;
+	char *code;
+	intmax_t start;
+	intmax_t end;
+	int visible;
+	struct b64_decoder dec;
+	unsigned char *data;
+	size_t datasz;
+	size_t datacap;
+};
+
+struct batch {
+	struct req *req;
+	struct db db;
+	struct json_read jr;
+	struct item item;
+	struct result *results;
+	size_t resultsz;
+};
+
+static ssize_t
+readbody(void *data, void *buf, size_t bufsz)
+{
+	return req_read(data, buf, bufsz);
+}
+
+static int
+append(void *data, const unsigned char *buf, size_t bufsz)
+{
+	struct item *item = data;
+
+	if (item->datacap - item->datasz < bufsz) {
+		while (item->datacap - item->datasz < bufsz)
+			item->datacap = item->datacap ? item->datacap * 2 : 65536;
+
+		item->data = erealloc(item->data, item->datacap, 1);
+	}
+
+	memcpy(item->data + item->datasz, buf, bufsz);
+	item->datasz += bufsz;
+
+	return 0;
+}
+
+static int
+decode(void *data, const char *buf, size_t bufsz)
+{
+	return b64_decoder_update(data, buf, bufsz);
+}
+
+static void
+clear(struct item *item)
+{
+	free(item->type);
+	free(item->title);
+	free(item->author);
+	free(item->filename);
+	free(item->language);
+	free(item->code);
+
+	item->type = item->title = item->author = NULL;
+	item->filename = item->language = item->code = NULL;
+	item->start = item->end = 0;
+	item->visible = 0;
+	item->datasz = 0;
+
+	b64_decoder_init(&item->dec, append, item);
+}
+
+static inline char *
+value(char *val, const char *def)
+{
+	return val ? val : (char *)def;
+}
+
+/*
+ * Save the current item as a paste, returns -1 only on database errors.
+ */
+static int
+paste(struct batch *bt, struct result *res)
+{
+	struct item *item = &bt->item;
+	struct paste paste = {0};
+
+	if ((item->language && check_language(item->language, res->error, sizeof (res->error)) < 0) ||
+	    check_duration(item->start, item->end, res->error, sizeof (res->error)) < 0)
+		return 0;
+
+	/* Values are only borrowed, the paste is not finished. */
+	paste.id = tmp_id();
+	paste.title = value(item->title, TMP_DEFAULT_TITLE);
+	paste.author = value(item->author, TMP_DEFAULT_AUTHOR);
+	paste.filename = value(item->filename, TMP_DEFAULT_FILENAME);
+	paste.language = value(item->language, TMP_DEFAULT_LANG);
+	paste.code = value(item->code, TMP_DEFAULT_CODE);
+	paste.start = item->start;
+	paste.end = item->end;
+	paste.visible = item->visible;
+
+	if (db_paste_save(&paste, &bt->db) < 0) {
+		free(paste.id);
+		return -1;
+	}
+
+	res->id = paste.id;
+
+	return 0;
+}
+
+/*
+ * Save the current item as an image, returns -1 only on database errors.
+ */
+static int
+image(struct batch *bt, struct result *res)
+{
+	struct item *item = &bt->item;
+	struct image image = {0};
+
+	if (b64_decoder_final(&item->dec) < 0) {
+		bstrlcpy(res->error, strerror(errno), sizeof (res->error));
+		return 0;
+	}
+	if (check_duration(item->start, item->end, res->error, sizeof (res->error)) < 0)
+		return 0;
+	if (item->datasz == 0) {
+		bstrlcpy(res->error, "empty image", sizeof (res->error));
+		return 0;
+	}
+	if (check_image(item->data, item->datasz) < 0) {
+		bstrlcpy(res->error, "not a valid image", sizeof (res->error));
+		return 0;
+	}
+
+	image.id = tmp_id();
+	image.title = value(item->title, TMP_DEFAULT_TITLE);
+	image.author = value(item->author, TMP_DEFAULT_AUTHOR);
+	image.filename = value(item->filename, TMP_DEFAULT_FILENAME);
+	image.data = item->data;
+	image.datasz = item->datasz;
+	image.start = item->start;
+	image.end = item->end;
+	image.visible = item->visible;
+
+	if (db_image_save(&image, &bt->db) < 0) {
+		free(image.id);
+		return -1;
+	}
+
+	res->id = image.id;
+
+	return 0;
+}
+
+/*
+ * Read and save items one at a time inside the transaction, only their
+ * result is kept. Returns -1 on input or database errors.
+ */
+static int
+items(struct batch *bt)
+{
+	struct item *item = &bt->item;
+	struct result *res;
+	struct json_read_key keys[] = {
+		{ .name = "type",      .type = JSON_READ_STR,   .value = &item->type },
+		{ .name = "title",     .type = JSON_READ_STR,   .value = &item->title },
+		{ .name = "author",    .type = JSON_READ_STR,   .value = &item->author },
+		{ .name = "filename",  .type = JSON_READ_STR,   .value = &item->filename },
+		{ .name = "language",  .type = JSON_READ_STR,   .value = &item->language },
+		{ .name = "code",      .type = JSON_READ_STR,   .value = &item->code },
+		{ .name = "data",      .type = JSON_READ_SINK,  .value = &item->dec, .sink = decode },
+		{ .name = "start",     .type = JSON_READ_INT,   .value = &item->start },
+		{ .name = "end",       .type = JSON_READ_INT,   .value = &item->end },
+		{ .name = "visible",   .type = JSON_READ_BOOL,  .value = &item->visible }
+	};
+	int rv;
+
+	clear(item);
+
+	while ((rv = json_read_next(&bt->jr, keys, LEN(keys))) > 0) {
+		bt->results = ereallocarray(bt->results, bt->resultsz + 1, sizeof (*res));
+		res = &bt->results[bt->resultsz++];
+		memset(res, 0, sizeof (*res));
+
+		if (!item->type)
+			bstrlcpy(res->error, "missing type", sizeof (res->error));
+		else if (strcmp(item->type, "paste") == 0)
+			rv = paste(bt, res);
+		else if (strcmp(item->type, "image") == 0)
+			rv = image(bt, res);
+		else
+			bstrlcpy(res->error, "invalid type", sizeof (res->error));
+
+		clear(item);
+
+		if (rv < 0)
+			return -1;
+	}
+
+	return rv;
+}
+
+static void
+reply(struct batch *bt)
+{
+	struct json_write jw;
+
+	route_json_open(bt->req, 200, &jw);
+	json_write_object(&jw);
+	json_write_key(&jw, "items");
+	json_write_array(&jw);
+
+	for (size_t i = 0; i < bt->resultsz; ++i) {
+		json_write_object(&jw);
+
+		if (bt->results[i].id) {
+			json_write_key(&jw, "id");
+			json_write_str(&jw, bt->results[i].id);
+		} else {
+			json_write_key(&jw, "error");
+			json_write_str(&jw, bt->results[i].error);
+		}
+
+		json_write_close(&jw);
+	}
+
+	json_write_close(&jw);
+	json_write_close(&jw);
+	json_write_finish(&jw);
+}
+
+static void
+post(struct req *r)
+{
+	struct batch bt = { .req = r };
+	size_t created = 0;
+
+	if (tmpupd_open(&bt.db, DB_RDWR) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		return;
+	}
+	if (db_exec(&bt.db, "begin") < 0) {
+		log_warn(TAG "unable to begin transaction: %s", bt.db.error);
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		db_finish(&bt.db);
+		return;
+	}
+
+	json_read_init(&bt.jr, readbody, r, HTTP_BODY_MAX);
+
+	if (items(&bt) < 0) {
+		/* Input and database errors are reported after the rollback. */
+		if (bt.jr.error[0]) {
+			if (errno == EFBIG)
+				route_status(r, 413, REQ_MIME_APP_JSON);
+			else
+				route_json(r, 400, "{ss}", "error", bt.jr.error);
+		} else {
+			log_warn(TAG "unable to save item: %s", bt.db.error);
+			route_status(r, 500, REQ_MIME_APP_JSON);
+		}
+
+		sqlite3_exec(bt.db.handle, "rollback", NULL, NULL, NULL);
+	} else if (db_exec(&bt.db, "commit") < 0) {
+		log_warn(TAG "unable to commit transaction: %s", bt.db.error);
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		sqlite3_exec(bt.db.handle, "rollback", NULL, NULL, NULL);
+	} else {
+		for (size_t i = 0; i < bt.resultsz; ++i)
+			created += bt.results[i].id != NULL;
+
+		log_info(TAG "created %zu of %zu items", created, bt.resultsz);
+		reply(&bt);
+	}
+
+	for (size_t i = 0; i < bt.resultsz; ++i)
+		free(bt.results[i].id);
+
+	free(bt.results);
+	free(bt.item.data);
+	clear(&bt.item);
+	db_finish(&bt.db);
+}
+
+void
+route_api_v1_batch(struct req *r, const char * const *args)
+{
+	assert(r);
+
+	(void)args;
+
+	switch (r->method) {
+	case REQ_METHOD_POST:
+		post(r);
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,40 @@
+/*
+ * route-api-v1-batch.h -- route /api/v1/batch
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_ROUTE_API_V1_BATCH
+#define TMPUPD_ROUTE_API_V1_BATCH
+
+/**
+ * \file route-api-v1-batch.h
+ * \brief Route /api/v1/batch.
+ */
+
+struct req;
+
+/**
+ * Implement /api/v1/batch route.
+ *
+ * The body is a JSON array or a newline delimited sequence of objects, each
+ * one having the same properties as the v0 API plus a type property being
+ * either "paste" or "image". All items are saved in one transaction and the
+ * reply lists an id or an error for each item in order.
+ */
+void
+route_api_v1_batch(struct req *r, const char * const *args);
+
+#endif /* !TMPUPD_ROUTE_API_V1_BATCH */
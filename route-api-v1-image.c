@@ -0,0 +1,331 @@
+/*
+ * route-api-v1-image.c -- route /api/v1/image
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base64.h"
+#include "check.h"
+#include "db-image.h"
+#include "db.h"
+#include "image.h"
+#include "log.h"
+#include "route-api-v1-image.h"
+#include "route.h"
+#include "tmp.h"
+#include "tmpupd.h"
+#include "util.h"
+
+#define TAG "route-api-v1-image: "
+
+/* Enough for libmagic to guess the content type. */
+#define HEAD_MAX CHECK_IMAGE_HEAD
+
+/*
+ * The first bytes of the body are read before saving to check the image,
+ * they are then given back to the database before the rest of the body.
+ */
+struct upload {
+	struct req *req;
+	unsigned char head[HEAD_MAX];
+	size_t headsz;
+	size_t headpos;
+};
+
+static ssize_t
+readbody(void *data, void *buf, size_t bufsz)
+{
+	struct upload *up = data;
+	size_t len;
+
+	if (up->headpos < up->headsz) {
+		len = up->headsz - up->headpos;
+
+		if (len > bufsz)
+			len = bufsz;
+
+		memcpy(buf, up->head + up->headpos, len);
+		up->headpos += len;
+
+		return len;
+	}
+
+	return req_read(up->req, buf, bufsz);
+}
+
+static int
+readhead(struct upload *up)
+{
+	ssize_t nr = 0;
+
+	while (up->headsz < sizeof (up->head) &&
+	    (nr = req_read(up->req, up->head + up->headsz, sizeof (up->head) - up->headsz)) > 0)
+		up->headsz += nr;
+
+	return nr < 0 ? -1 : 0;
+}
+
+/*
+ * Fields are only borrowed by the image as it is only read when saving.
+ */
+static inline char *
+field(const struct req *r, const char *key, const char *def)
+{
+	const char *val = req_field(r, key);
+
+	return (char *)(val && *val ? val : def);
+}
+
+/* Bytes encoded at once, multiple of 3 so that only the end is padded. */
+#define ENCODE_CHUNK 3072
+
+static int
+item(const struct image *image, void *data)
+{
+	struct json_write *jw = data;
+	char enc[B64_ENCODE_LENGTH(ENCODE_CHUNK) + 8];
+	size_t len, encsz;
+
+	json_write_pack(jw, "{ss ss ss ss sI sI sI sb",
+		"id",           image->id,
+		"title",        image->title,
+		"author",       image->author,
+		"filename",     image->filename,
+		"size",         (intmax_t)image->datasz,
+		"start",        (intmax_t)image->start,
+		"end",          (intmax_t)image->end,
+		"visible",      image->visible
+	);
+
+	/* Encode the data in pieces straight into the reply. */
+	if (image->data) {
+		json_write_key(jw, "data");
+		json_write_str_open(jw);
+
+		for (size_t i = 0; i < image->datasz; i += len) {
+			if ((len = image->datasz - i) > ENCODE_CHUNK)
+				len = ENCODE_CHUNK;
+
+			encsz = b64_encode(image->data + i, len, enc, sizeof (enc));
+			json_write_str_append(jw, enc, encsz);
+		}
+
+		json_write_str_close(jw);
+	}
+
+	json_write_close(jw);
+
+	return jw->error ? -1 : 0;
+}
+
+/*
+ * One more image than asked is loaded to tell if there is a next page, the
+ * cursor of the last image written starts it.
+ */
+struct page {
+	struct json_write *jw;
+	size_t limit;
+	size_t count;
+	char next[64];
+};
+
+static int
+page_item(const struct image *image, void *data)
+{
+	struct page *page = data;
+
+	if (++page->count > page->limit)
+		return 0;
+
+	bstrlcpy(page->next, tmpupd_cursor(image->start, image->id), sizeof (page->next));
+
+	return item(image, page->jw);
+}
+
+/*
+ * All images are fetched with a single query and written as they are read
+ * from the database.
+ */
+static void
+get(struct req *r)
+{
+	struct json_write jw;
+	struct db db;
+	const char *content;
+	char error[128], *ids;
+	int full;
+
+	if (!(ids = tmpupd_ids(r, error, sizeof (error)))) {
+		route_json(r, 400, "{ss}", "error", error);
+		return;
+	}
+	if (tmpupd_open(&db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		free(ids);
+		return;
+	}
+
+	content = req_field(r, "content");
+	full = content && strcmp(content, "1") == 0;
+
+	route_json_open(r, 200, &jw);
+	json_write_pack(&jw, "{s[", "items");
+
+	if (db_image_list(ids, full, item, &jw, &db) < 0)
+		log_warn(TAG "unable to list images: %s", db.error);
+
+	json_write_pack(&jw, "]}");
+	json_write_finish(&jw);
+
+	db_finish(&db);
+	free(ids);
+}
+
+static void
+save(struct req *r, struct image *image, struct upload *up)
+{
+	struct db db;
+
+	if (tmpupd_open(&db, DB_RDWR) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		return;
+	}
+
+	if (db_image_save_stream(image, readbody, up, &db) < 0) {
+		log_warn(TAG "unable to create image: %s", db.error);
+		route_status(r, 500, REQ_MIME_APP_JSON);
+	} else {
+		log_info(TAG "created image '%s'", image->id);
+		route_json(r, 201, "{ss}", "id", image->id);
+	}
+
+	db_finish(&db);
+}
+
+/*
+ * The body is directly copied into the database in small chunks, without
+ * being entirely held in memory.
+ */
+static void
+post(struct req *r)
+{
+	struct upload up = { .req = r };
+	struct image image = {0};
+	const char *visible;
+	char error[128];
+
+	/* Large chunked bodies have no length, it is required to save. */
+	if (r->length == 0 && req_header(r, "Transfer-Encoding")) {
+		route_json(r, 411, "{ss}", "error", "length required");
+		return;
+	}
+	if (r->length == 0) {
+		route_json(r, 400, "{ss}", "error", "empty image");
+		return;
+	}
+	if (tmpupd_period(r, &image.start, &image.end, error, sizeof (error)) < 0) {
+		route_json(r, 400, "{ss}", "error", error);
+		return;
+	}
+	if (readhead(&up) < 0) {
+		log_warn(TAG "unable to read body: %s", strerror(errno));
+		route_status(r, 400, REQ_MIME_APP_JSON);
+		return;
+	}
+	if (check_image(up.head, up.headsz) < 0) {
+		route_json(r, 400, "{ss}", "error", "not a valid image");
+		return;
+	}
+
+	visible = req_field(r, "visible");
+
+	image.id = tmp_id();
+	image.title = field(r, "title", TMP_DEFAULT_TITLE);
+	image.author = field(r, "author", TMP_DEFAULT_AUTHOR);
+	image.filename = field(r, "filename", TMP_DEFAULT_FILENAME);
+	image.datasz = r->length;
+	image.visible = visible && strcmp(visible, "1") == 0;
+
+	save(r, &image, &up);
+	free(image.id);
+}
+
+void
+route_api_v1_image(struct req *r, const char * const *args)
+{
+	assert(r);
+
+	(void)args;
+
+	switch (r->method) {
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
+		get(r);
+		break;
+	case REQ_METHOD_POST:
+		post(r);
+		break;
+	default:
+		break;
+	}
+}
+
+void
+route_api_v1_images(struct req *r, const char * const *args)
+{
+	assert(r);
+
+	(void)args;
+
+	struct tmpupd_page tp;
+	struct json_write jw;
+	struct page page = {
+		.jw = &jw
+	};
+	struct db db;
+	char error[128];
+
+	if (tmpupd_page(r, &tp, error, sizeof (error)) < 0) {
+		route_json(r, 400, "{ss}", "error", error);
+		return;
+	}
+	if (tmpupd_open(&db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		return;
+	}
+
+	page.limit = tp.limit;
+
+	route_json_open(r, 200, &jw);
+	json_write_pack(&jw, "{s[", "items");
+
+	if (db_image_recents(tp.start, tp.id, tp.limit + 1, page_item, &page, &db) < 0)
+		log_warn(TAG "unable to list images: %s", db.error);
+
+	json_write_pack(&jw, "]");
+
+	if (page.count > page.limit)
+		json_write_pack(&jw, "ss", "next", page.next);
+
+	json_write_pack(&jw, "}");
+	json_write_finish(&jw);
+
+	db_finish(&db);
+}
@@ -0,0 +1,375 @@
+/*
+ * route-api-v1-paste.c -- route /api/v1/paste
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "db-paste.h"
+#include "db.h"
+#include "http.h"
+#include "log.h"
+#include "paste.h"
+#include "route-api-v1-paste.h"
+#include "route.h"
+#include "tmp.h"
+#include "tmpupd.h"
+#include "util.h"
+
+#define TAG "route-api-v1-paste: "
+
+static inline const char *
+field(const struct req *r, const char *key)
+{
+	const char *val = req_field(r, key);
+
+	return val && *val ? val : NULL;
+}
+
+/*
+ * Pastes are stored as text, a body with a NUL byte would be silently
+ * truncated so it is rejected instead.
+ */
+static inline int
+is_text(const char *body, size_t bodysz)
+{
+	return memchr(body, '\0', bodysz) == NULL;
+}
+
+static int
+item(const struct paste *paste, void *data)
+{
+	struct json_write *jw = data;
+
+	json_write_pack(jw, "{ss ss ss ss ss sI sI sb",
+		"id",           paste->id,
+		"title",        paste->title,
+		"author",       paste->author,
+		"filename",     paste->filename,
+		"language",     paste->language,
+		"start",        (intmax_t)paste->start,
+		"end",          (intmax_t)paste->end,
+		"visible",      paste->visible
+	);
+
+	/* Figures computed when saved, unknown for older pastes. */
+	if (paste->preview)
+		json_write_pack(jw, "sI sI ss",
+			"size",         (intmax_t)paste->size,
+			"lines",        (intmax_t)paste->lines,
+			"preview",      paste->preview
+		);
+
+	if (paste->code) {
+		json_write_key(jw, "code");
+		json_write_str(jw, paste->code);
+	}
+
+	json_write_close(jw);
+
+	return jw->error ? -1 : 0;
+}
+
+/*
+ * One more paste than asked is loaded to tell if there is a next page, the
+ * cursor of the last paste written starts it.
+ */
+struct page {
+	struct json_write *jw;
+	size_t limit;
+	size_t count;
+	char next[64];
+};
+
+static int
+page_item(const struct paste *paste, void *data)
+{
+	struct page *page = data;
+
+	if (++page->count > page->limit)
+		return 0;
+
+	bstrlcpy(page->next, tmpupd_cursor(paste->start, paste->id), sizeof (page->next));
+
+	return item(paste, page->jw);
+}
+
+/*
+ * The reply only starts with the first paste so that an error status can
+ * still be sent if the first one can't be read.
+ */
+struct list {
+	struct req *req;
+	struct json_write jw;
+	int opened;
+};
+
+static void
+list_open(struct list *list)
+{
+	if (list->opened)
+		return;
+
+	route_json_open(list->req, 200, &list->jw);
+	json_write_pack(&list->jw, "{s[", "items");
+	list->opened = 1;
+}
+
+static int
+list_item(const struct paste *paste, void *data)
+{
+	struct list *list = data;
+
+	list_open(list);
+
+	return item(paste, &list->jw);
+}
+
+/*
+ * All pastes are fetched with a single query and written as they are read
+ * from the database.
+ */
+static void
+get(struct req *r)
+{
+	struct list list = {
+		.req = r
+	};
+	struct db db;
+	const char *content;
+	char error[128], *ids;
+	int full, rv;
+
+	if (!(ids = tmpupd_ids(r, error, sizeof (error)))) {
+		route_json(r, 400, "{ss}", "error", error);
+		return;
+	}
+	if (tmpupd_open(&db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		free(ids);
+		return;
+	}
+
+	content = req_field(r, "content");
+	full = content && strcmp(content, "1") == 0;
+
+	if ((rv = db_paste_list(ids, full, list_item, &list, &db)) < 0)
+		log_warn(TAG "unable to list pastes: %s", db.error);
+
+	if (rv < 0 && !list.opened)
+		route_status(r, 500, REQ_MIME_APP_JSON);
+	else {
+		list_open(&list);
+		json_write_pack(&list.jw, "]");
+
+		/* Too late for an error status, the list must not look complete. */
+		if (rv < 0)
+			json_write_pack(&list.jw, "ss", "error", "unable to list pastes");
+
+		json_write_pack(&list.jw, "}");
+		json_write_finish(&list.jw);
+	}
+
+	db_finish(&db);
+	free(ids);
+}
+
+static void
+post(struct req *r)
+{
+	struct paste paste;
+	struct db db;
+	const char *language, *visible;
+	char error[128], *code, *token;
+	size_t codesz;
+	time_t start, end;
+
+	language = field(r, "language");
+	visible = field(r, "visible");
+
+	if (language && check_language(language, error, sizeof (error)) < 0) {
+		route_json(r, 400, "{ss}", "error", error);
+		return;
+	}
+	if (tmpupd_period(r, &start, &end, error, sizeof (error)) < 0) {
+		route_json(r, 400, "{ss}", "error", error);
+		return;
+	}
+	if (!(code = req_slurp(r, HTTP_BODY_MAX, &codesz))) {
+		route_status(r, 413, REQ_MIME_APP_JSON);
+		return;
+	}
+	if (!is_text(code, codesz)) {
+		route_json(r, 400, "{ss}", "error", "paste contains NUL byte");
+		free(code);
+		return;
+	}
+
+	paste_init(&paste, NULL,
+	    field(r, "title"),
+	    field(r, "author"),
+	    field(r, "filename"),
+	    language,
+	    codesz ? code : NULL,
+	    start,
+	    end,
+	    visible && strcmp(visible, "1") == 0
+	);
+	free(code);
+
+	token = tmp_token();
+
+	if (tmpupd_open(&db, DB_RDWR) < 0)
+		route_status(r, 500, REQ_MIME_APP_JSON);
+	else {
+		if (db_paste_save(&paste, &db) < 0 ||
+		    db_paste_set_token(paste.id, token, &db) < 0) {
+			log_warn(TAG "unable to create paste: %s", db.error);
+			route_status(r, 500, REQ_MIME_APP_JSON);
+		} else {
+			log_info(TAG "created paste '%s'", paste.id);
+			route_json(r, 201, "{ss ss}",
+				"id",           paste.id,
+				"token",        token
+			);
+		}
+
+		db_finish(&db);
+	}
+
+	paste_finish(&paste);
+	free(token);
+}
+
+/*
+ * Append the body to an existing paste, the token returned at creation is
+ * required.
+ */
+static void
+append(struct req *r, const char *id)
+{
+	struct db db;
+	const char *token;
+	char *data;
+	size_t datasz;
+
+	if (!(token = field(r, "token"))) {
+		route_json(r, 403, "{ss}", "error", "missing token");
+		return;
+	}
+	if (!(data = req_slurp(r, HTTP_BODY_MAX, &datasz))) {
+		route_status(r, 413, REQ_MIME_APP_JSON);
+		return;
+	}
+	if (!is_text(data, datasz)) {
+		route_json(r, 400, "{ss}", "error", "paste contains NUL byte");
+		free(data);
+		return;
+	}
+	if (tmpupd_open(&db, DB_RDWR) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		free(data);
+		return;
+	}
+
+	switch (db_paste_append(id, token, data, &db)) {
+	case 1:
+		log_debug(TAG "appended %zu bytes to paste '%s'", datasz, id);
+		route_json(r, 200, "{ss}", "id", id);
+		break;
+	case 0:
+		route_json(r, 403, "{ss}", "error", "invalid paste or token");
+		break;
+	default:
+		log_warn(TAG "unable to append to paste '%s': %s", id, db.error);
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		break;
+	}
+
+	db_finish(&db);
+	free(data);
+}
+
+void
+route_api_v1_paste(struct req *r, const char * const *args)
+{
+	assert(r);
+	assert(args);
+
+	if (args[0]) {
+		if (r->method == REQ_METHOD_POST)
+			append(r, args[0]);
+		return;
+	}
+
+	switch (r->method) {
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
+		get(r);
+		break;
+	case REQ_METHOD_POST:
+		post(r);
+		break;
+	default:
+		break;
+	}
+}
+
+void
+route_api_v1_pastes(struct req *r, const char * const *args)
+{
+	assert(r);
+
+	(void)args;
+
+	struct tmpupd_page tp;
+	struct json_write jw;
+	struct page page = {
+		.jw = &jw
+	};
+	struct db db;
+	char error[128];
+
+	if (tmpupd_page(r, &tp, error, sizeof (error)) < 0) {
+		route_json(r, 400, "{ss}", "error", error);
+		return;
+	}
+	if (tmpupd_open(&db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		return;
+	}
+
+	page.limit = tp.limit;
+
+	route_json_open(r, 200, &jw);
+	json_write_pack(&jw, "{s[", "items");
+
+	if (db_paste_recents(tp.start, tp.id, tp.limit + 1, page_item, &page, &db) < 0)
+		log_warn(TAG "unable to list pastes: %s", db.error);
+
+	json_write_pack(&jw, "]");
+
+	if (page.count > page.limit)
+		json_write_pack(&jw, "ss", "next", page.next);
+
+	json_write_pack(&jw, "}");
+	json_write_finish(&jw);
+
+	db_finish(&db);
+}
@@ -0,0 +1,54 @@
+/*
+ * route-api-v1-paste.h -- route /api/v1/paste
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_ROUTE_API_V1_PASTE
+#define TMPUPD_ROUTE_API_V1_PASTE
+
+/**
+ * \file route-api-v1-paste.h
+ * \brief Route /api/v1/paste.
+ */
+
+struct req;
+
+/**
+ * Implement /api/v1/paste route.
+ *
+ * On POST, the paste code is the raw request body, the optional title,
+ * author, filename, language, start, end and visible fields are taken from
+ * the query string. The reply holds the paste id and a secret token.
+ *
+ * On POST to /api/v1/paste/<id>/append, the raw request body is appended to
+ * the paste given the token query field.
+ *
+ * On GET, the metadata of every item named by the repeated `id` query field
+ * is returned in order, with the code as well if `content` is 1.
+ */
+void
+route_api_v1_paste(struct req *r, const char * const *args);
+
+/**
+ * Implement /api/v1/pastes route, the metadata of the visible pastes from
+ * the newest one page at a time given the optional `limit` and `after` query
+ * fields. The reply holds a `next` cursor to pass as `after` when there are
+ * older pastes.
+ */
+void
+route_api_v1_pastes(struct req *r, const char * const *args);
+
+#endif /* !TMPUPD_ROUTE_API_V1_PASTE */
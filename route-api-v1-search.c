@@ -0,0 +1,156 @@
+/*
+ * route-api-v1-search.c -- route /api/v1/search
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "db-paste.h"
+#include "db.h"
+#include "http.h"
+#include "log.h"
+#include "paste.h"
+#include "route-api-v1-search.h"
+#include "route.h"
+#include "tmpupd.h"
+#include "util.h"
+
+#define TAG "route-api-v1-search: "
+
+#define LIMIT 20
+#define LIMIT_MAX 100
+
+static const char marks[] = {
+	DB_PASTE_MARK_OPEN,
+	DB_PASTE_MARK_CLOSE,
+	'\0'
+};
+
+/*
+ * The snippet is written without the marks which become pairs of offsets
+ * in the text written.
+ */
+static void
+snippet(struct json_write *jw, const char *text)
+{
+	size_t len, off = 0;
+
+	json_write_key(jw, "snippet");
+	json_write_str_open(jw);
+
+	for (const char *p = text; *p; p += len)
+		if ((len = strcspn(p, marks)))
+			json_write_str_append(jw, p, len);
+		else
+			len = 1;
+
+	json_write_str_close(jw);
+	json_write_key(jw, "highlights");
+	json_write_array(jw);
+
+	for (const char *p = text; *p; ++p) {
+		if (*p == DB_PASTE_MARK_OPEN)
+			json_write_pack(jw, "[I", (intmax_t)off);
+		else if (*p == DB_PASTE_MARK_CLOSE)
+			json_write_pack(jw, "I]", (intmax_t)off);
+		else
+			++off;
+	}
+
+	json_write_close(jw);
+}
+
+static int
+item(const struct paste *paste, const char *text, void *data)
+{
+	struct json_write *jw = data;
+
+	json_write_pack(jw, "{ss ss ss ss ss sI sI sb",
+		"id",           paste->id,
+		"title",        paste->title,
+		"author",       paste->author,
+		"filename",     paste->filename,
+		"language",     paste->language,
+		"start",        (intmax_t)paste->start,
+		"end",          (intmax_t)paste->end,
+		"visible",      paste->visible
+	);
+
+	if (paste->preview)
+		json_write_pack(jw, "sI sI ss",
+			"size",         (intmax_t)paste->size,
+			"lines",        (intmax_t)paste->lines,
+			"preview",      paste->preview
+		);
+
+	snippet(jw, text);
+	json_write_close(jw);
+
+	return jw->error ? -1 : 0;
+}
+
+static void
+get(struct req *r)
+{
+	struct json_write jw;
+	struct db db;
+	const char *query, *val, *errstr = NULL;
+	size_t limit = LIMIT;
+
+	if (!(query = req_field(r, "q")) || !*query) {
+		route_json(r, 400, "{ss}", "error", "missing query");
+		return;
+	}
+	if ((val = req_field(r, "limit")))
+		limit = bstrtonum(val, 1, LIMIT_MAX, &errstr);
+	if (errstr) {
+		route_json(r, 400, "{ss}", "error", "invalid limit");
+		return;
+	}
+	if (tmpupd_open(&db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		return;
+	}
+
+	route_json_open(r, 200, &jw);
+	json_write_pack(&jw, "{s[", "items");
+
+	if (db_paste_search(query, limit, item, &jw, &db) < 0)
+		log_warn(TAG "unable to search '%s': %s", query, db.error);
+
+	json_write_pack(&jw, "]}");
+	json_write_finish(&jw);
+
+	db_finish(&db);
+}
+
+void
+route_api_v1_search(struct req *r, const char * const *args)
+{
+	assert(r);
+
+	(void)args;
+
+	switch (r->method) {
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
+		get(r);
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,40 @@
+/*
+ * route-api-v1-search.h -- route /api/v1/search
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_ROUTE_API_V1_SEARCH
+#define TMPUPD_ROUTE_API_V1_SEARCH
+
+/**
+ * \file route-api-v1-search.h
+ * \brief Route /api/v1/search.
+ */
+
+struct req;
+
+/**
+ * Implement /api/v1/search route.
+ *
+ * On GET, the visible pastes matching every word of the `q` query field are
+ * returned best first, at most `limit` of them. Each item has the paste
+ * metadata, a snippet of text around the best match and the byte offsets of
+ * the matches in the snippet as highlights.
+ */
+void
+route_api_v1_search(struct req *r, const char * const *args);
+
+#endif /* !TMPUPD_ROUTE_API_V1_SEARCH */
@@ -0,0 +1,187 @@
+/*
+ * route-api-v1-stats.c -- route /api/v1/stats
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "db-counter.h"
+#include "db.h"
+#include "http.h"
+#include "json-write.h"
+#include "log.h"
+#include "route-api-v1-stats.h"
+#include "route.h"
+#include "stats.h"
+#include "tmpupd.h"
+#include "util.h"
+
+#define TAG "route-api-v1-stats: "
+
+struct language {
+	char *name;
+	size_t count;
+};
+
+struct hour {
+	time_t start;
+	size_t pastes;
+	size_t images;
+};
+
+/*
+ * Everything is read before the reply is written so that no statement is
+ * still running while writing to a possibly slow client.
+ */
+struct snapshot {
+	struct db_counter counter;
+	struct stats server;
+	struct language *languages;
+	size_t languagesz;
+	struct hour hours[DB_COUNTER_HOURS];
+	size_t hoursz;
+};
+
+static int
+language(const char *name, size_t count, void *data)
+{
+	struct snapshot *snap = data;
+	struct language *language;
+
+	snap->languages = ereallocarray(snap->languages, snap->languagesz + 1,
+	    sizeof (*snap->languages));
+
+	language = &snap->languages[snap->languagesz++];
+	language->name = estrdup(name);
+	language->count = count;
+
+	return 0;
+}
+
+static int
+hour(time_t start, size_t pastes, size_t images, void *data)
+{
+	struct snapshot *snap = data;
+
+	if (snap->hoursz >= LEN(snap->hours))
+		return 0;
+
+	snap->hours[snap->hoursz].start = start;
+	snap->hours[snap->hoursz].pastes = pastes;
+	snap->hours[snap->hoursz++].images = images;
+
+	return 0;
+}
+
+static int
+load(struct snapshot *snap)
+{
+	struct db db;
+	int rv = 0;
+
+	if (tmpupd_open(&db, DB_RDONLY) < 0)
+		return -1;
+
+	if (db_counter_get(&snap->counter, &db) < 0) {
+		log_warn(TAG "unable to get counters: %s", db.error);
+		rv = -1;
+	} else {
+		if (db_counter_languages(language, snap, &db) < 0)
+			log_warn(TAG "unable to list languages: %s", db.error);
+		if (db_counter_hours(hour, snap, &db) < 0)
+			log_warn(TAG "unable to list hours: %s", db.error);
+	}
+
+	db_finish(&db);
+
+	/* Summed over every worker and the supervisor. */
+	stats_sum(&snap->server);
+
+	return rv;
+}
+
+static void
+get(struct req *r)
+{
+	struct snapshot snap = {0};
+	struct json_write jw;
+
+	if (load(&snap) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		free(snap.languages);
+		return;
+	}
+
+	route_json_open(r, 200, &jw);
+	json_write_pack(&jw, "{s{sI sI} s{sI sI} s{",
+		"pastes",
+			"count",        (intmax_t)snap.counter.pastes,
+			"bytes",        (intmax_t)snap.counter.pastes_bytes,
+		"images",
+			"count",        (intmax_t)snap.counter.images,
+			"bytes",        (intmax_t)snap.counter.images_bytes,
+		"languages"
+	);
+
+	for (size_t i = 0; i < snap.languagesz; ++i)
+		json_write_pack(&jw, "sI", snap.languages[i].name,
+		    (intmax_t)snap.languages[i].count);
+
+	json_write_pack(&jw, "} s[", "hours");
+
+	for (size_t i = 0; i < snap.hoursz; ++i)
+		json_write_pack(&jw, "{sI sI sI}",
+			"hour",         (intmax_t)snap.hours[i].start,
+			"pastes",       (intmax_t)snap.hours[i].pastes,
+			"images",       (intmax_t)snap.hours[i].images
+		);
+
+	json_write_pack(&jw, "] s{sI sI sI sI sI sI sI}}",
+		"server",
+			"requests",     (intmax_t)snap.server.requests,
+			"errors",       (intmax_t)snap.server.errors,
+			"received",     (intmax_t)snap.server.received,
+			"sent",         (intmax_t)snap.server.sent,
+			"optimized",    (intmax_t)snap.server.optimized,
+			"original",     (intmax_t)snap.server.original,
+			"shrunk",       (intmax_t)snap.server.shrunk
+	);
+	json_write_finish(&jw);
+
+	for (size_t i = 0; i < snap.languagesz; ++i)
+		free(snap.languages[i].name);
+
+	free(snap.languages);
+}
+
+void
+route_api_v1_stats(struct req *r, const char * const *args)
+{
+	assert(r);
+
+	(void)args;
+
+	switch (r->method) {
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
+		get(r);
+		break;
+	default:
+		break;
+	}
+}
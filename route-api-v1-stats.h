@@ -0,0 +1,39 @@
+/*
+ * route-api-v1-stats.h -- route /api/v1/stats
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_ROUTE_API_V1_STATS
+#define TMPUPD_ROUTE_API_V1_STATS
+
+/**
+ * \file route-api-v1-stats.h
+ * \brief Route /api/v1/stats.
+ */
+
+struct req;
+
+/**
+ * Implement /api/v1/stats route.
+ *
+ * On GET, the number of pastes and images stored with their size in bytes,
+ * the number of pastes per language and the number of items created in each
+ * of the last hours.
+ */
+void
+route_api_v1_stats(struct req *r, const char * const *args);
+
+#endif /* !TMPUPD_ROUTE_API_V1_STATS */
@@ -0,0 +1,312 @@
+/*
+ * route-api-v1-upload.c -- route /api/v1/upload
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "db-upload.h"
+#include "db.h"
+#include "http.h"
+#include "log.h"
+#include "route-api-v1-upload.h"
+#include "route.h"
+#include "tmp.h"
+#include "tmpupd.h"
+#include "upload.h"
+
+#define TAG "route-api-v1-upload: "
+
+/* Content read to check the image type before committing. */
+#define HEAD_MAX 8192
+
+struct head {
+	unsigned char data[HEAD_MAX];
+	size_t datasz;
+};
+
+static inline const char *
+field(const struct req *r, const char *key)
+{
+	const char *val = req_field(r, key);
+
+	return val && *val ? val : NULL;
+}
+
+static int
+number(const char *str, size_t max, size_t *val)
+{
+	unsigned long long num;
+	char *end;
+
+	if (!str || *str < '0' || *str > '9')
+		return -1;
+
+	errno = 0;
+	num = strtoull(str, &end, 10);
+
+	if (errno || *end || num > max)
+		return -1;
+
+	*val = num;
+
+	return 0;
+}
+
+static ssize_t
+readbody(void *data, void *buf, size_t bufsz)
+{
+	return req_read(data, buf, bufsz);
+}
+
+static int
+append(void *data, const void *buf, size_t bufsz)
+{
+	struct head *head = data;
+
+	memcpy(head->data + head->datasz, buf, bufsz);
+	head->datasz += bufsz;
+
+	return 0;
+}
+
+static inline void
+progress(struct req *r, int code, const struct upload *upload)
+{
+	route_json(r, code, "{ss sI sI}",
+		"id",           upload->id,
+		"size",         (intmax_t)upload->size,
+		"offset",       (intmax_t)upload->received
+	);
+}
+
+/*
+ * Open the database and find the session, replies on failure.
+ */
+static int
+find(struct req *r, struct upload *upload, const char *id, struct db *db)
+{
+	if (tmpupd_open(db, DB_RDWR) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		return -1;
+	}
+
+	switch (db_upload_get(upload, id, db)) {
+	case 1:
+		return 0;
+	case 0:
+		route_status(r, 404, REQ_MIME_APP_JSON);
+		break;
+	default:
+		log_warn(TAG "unable to get upload '%s': %s", id, db->error);
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		break;
+	}
+
+	db_finish(db);
+
+	return -1;
+}
+
+static void
+create(struct req *r)
+{
+	struct upload upload;
+	struct db db;
+	const char *type, *language, *visible;
+	char error[128];
+	size_t size;
+	time_t start, end;
+
+	type = field(r, "type");
+	language = field(r, "language");
+	visible = field(r, "visible");
+
+	if (!type || (strcmp(type, "paste") != 0 && strcmp(type, "image") != 0)) {
+		route_json(r, 400, "{ss}", "error", "invalid type");
+		return;
+	}
+	if (number(field(r, "size"), HTTP_BODY_MAX, &size) < 0 || size == 0) {
+		route_json(r, 400, "{ss}", "error", "invalid size");
+		return;
+	}
+	if (language && check_language(language, error, sizeof (error)) < 0) {
+		route_json(r, 400, "{ss}", "error", error);
+		return;
+	}
+	if (tmpupd_period(r, &start, &end, error, sizeof (error)) < 0) {
+		route_json(r, 400, "{ss}", "error", error);
+		return;
+	}
+	if (tmpupd_open(&db, DB_RDWR) < 0) {
+		route_status(r, 500, REQ_MIME_APP_JSON);
+		return;
+	}
+
+	upload_init(&upload, type,
+	    field(r, "title"),
+	    field(r, "author"),
+	    field(r, "filename"),
+	    language,
+	    size,
+	    start,
+	    end,
+	    visible && strcmp(visible, "1") == 0
+	);
+
+	if (db_upload_save(&upload, &db) < 0) {
+		log_warn(TAG "unable to create upload: %s", db.error);
+		route_status(r, 500, REQ_MIME_APP_JSON);
+	} else {
+		log_info(TAG "created upload '%s' of %zu bytes", upload.id, size);
+		progress(r, 201, &upload);
+	}
+
+	upload_finish(&upload);
+	db_finish(&db);
+}
+
+static void
+status(struct req *r, const char *id)
+{
+	struct upload upload;
+	struct db db;
+
+	if (find(r, &upload, id, &db) < 0)
+		return;
+
+	progress(r, 200, &upload);
+	upload_finish(&upload);
+	db_finish(&db);
+}
+
+/*
+ * Store one piece, what has been received is kept even if the connection is
+ * interrupted so that nothing has to be sent again.
+ */
+static void
+put(struct req *r, const char *id)
+{
+	struct upload upload;
+	struct db db;
+	size_t offset;
+
+	if (number(field(r, "offset"), SIZE_MAX, &offset) < 0) {
+		route_json(r, 400, "{ss}", "error", "invalid offset");
+		return;
+	}
+	if (find(r, &upload, id, &db) < 0)
+		return;
+
+	if (offset != upload.received)
+		route_json(r, 409, "{ss sI}",
+			"error",        "offset mismatch",
+			"offset",       (intmax_t)upload.received
+		);
+	else if (db_upload_write(&upload, readbody, r, &db) < 0) {
+		log_warn(TAG "unable to write upload '%s': %s", id, db.error);
+		route_json(r, 400, "{ss sI}",
+			"error",        db.error,
+			"offset",       (intmax_t)upload.received
+		);
+	} else
+		progress(r, 200, &upload);
+
+	upload_finish(&upload);
+	db_finish(&db);
+}
+
+static void
+commit(struct req *r, const char *id)
+{
+	struct upload upload;
+	struct head head = {0};
+	struct db db;
+	char *newid = NULL;
+
+	if (find(r, &upload, id, &db) < 0)
+		return;
+
+	if (upload.received != upload.size) {
+		route_json(r, 409, "{ss sI}",
+			"error",        "incomplete upload",
+			"offset",       (intmax_t)upload.received
+		);
+		goto end;
+	}
+
+	/* Images are checked from their first bytes, only now complete. */
+	if (strcmp(upload.type, "image") == 0) {
+		if (db_upload_read(&upload, 0, upload.size < HEAD_MAX ? upload.size : HEAD_MAX,
+		    append, &head, &db) < 0) {
+			log_warn(TAG "unable to read upload '%s': %s", id, db.error);
+			route_status(r, 500, REQ_MIME_APP_JSON);
+			goto end;
+		}
+		if (check_image(head.data, head.datasz) < 0) {
+			route_json(r, 400, "{ss}", "error", "not a valid image");
+			goto end;
+		}
+	}
+
+	newid = tmp_id();
+
+	if (db_upload_commit(&upload, newid, &db) < 0) {
+		log_warn(TAG "unable to commit upload '%s': %s", id, db.error);
+		route_status(r, 500, REQ_MIME_APP_JSON);
+	} else {
+		log_info(TAG "created %s '%s' from upload '%s'", upload.type, newid, id);
+		route_json(r, 201, "{ss}", "id", newid);
+	}
+
+end:
+	free(newid);
+	upload_finish(&upload);
+	db_finish(&db);
+}
+
+void
+route_api_v1_upload(struct req *r, const char * const *args)
+{
+	assert(r);
+	assert(args);
+
+	if (!args[0]) {
+		if (r->method == REQ_METHOD_POST)
+			create(r);
+		return;
+	}
+
+	switch (r->method) {
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
+		status(r, args[0]);
+		break;
+	case REQ_METHOD_PUT:
+		put(r, args[0]);
+		break;
+	case REQ_METHOD_POST:
+		commit(r, args[0]);
+		break;
+	default:
+		break;
+	}
+}
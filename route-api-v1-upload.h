@@ -0,0 +1,42 @@
+/*
+ * route-api-v1-upload.h -- route /api/v1/upload
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_ROUTE_API_V1_UPLOAD
+#define TMPUPD_ROUTE_API_V1_UPLOAD
+
+/**
+ * \file route-api-v1-upload.h
+ * \brief Route /api/v1/upload.
+ */
+
+struct req;
+
+/**
+ * Implement /api/v1/upload and /api/v1/upload/<id> routes.
+ *
+ * A POST on /api/v1/upload creates a session from the type (paste or image)
+ * and size query fields plus the same optional fields as the other v1 routes.
+ *
+ * On the session itself, PUT stores the body at the offset query field which
+ * must equal the number of bytes already received, GET tells that number and
+ * POST converts the complete session into the final item.
+ */
+void
+route_api_v1_upload(struct req *r, const char * const *args);
+
+#endif /* !TMPUPD_ROUTE_API_V1_UPLOAD */
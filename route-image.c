@@ -17,15 +17,21 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "check.h"
 #include "db-image.h"
+#include "db-thumb.h"
 #include "db.h"
 #include "http.h"
 #include "image.h"
 #include "log.h"
 #include "route-image.h"
 #include "route.h"
+#include "thumb.h"
 #include "tmp.h"
 #include "tmpupd.h"
 #include "util.h"
@@ -37,8 +43,8 @@
 
 struct self {
 	const struct image *image;
-	struct kreq *req;
-	struct khtmlreq html;
+	struct req *req;
+	struct html html;
 };
 
 enum {
@@ -71,38 +77,38 @@ format(size_t index, void *data)
 	switch (index) {
 	case KW_AUTHOR:
 		if (self->image)
-			khtml_printf(&self->html, "%s", self->image->author);
+			html_printf(&self->html, "%s", self->image->author);
 		break;
 	case KW_DEFAULT_AUTHOR:
-		khtml_printf(&self->html, "%s", TMP_DEFAULT_AUTHOR);
+		html_printf(&self->html, "%s", TMP_DEFAULT_AUTHOR);
 		break;
 	case KW_DEFAULT_TITLE:
-		khtml_printf(&self->html, "%s", TMP_DEFAULT_TITLE);
+		html_printf(&self->html, "%s", TMP_DEFAULT_TITLE);
 		break;
 	case KW_DURATIONS:
 		for (size_t i = 0; i < tmp_durationsz; ++i) {
-			khtml_attr(&self->html, KELEM_OPTION,
-			    KATTR_VALUE, tmp_durations[i],
-			    KATTR__MAX);
-			khtml_printf(&self->html, "%s", tmp_durations[i]);
-			khtml_closeelem(&self->html, 1);
+			html_attr(&self->html, "option",
+			    "value", tmp_durations[i],
+			    NULL);
+			html_printf(&self->html, "%s", tmp_durations[i]);
+			html_closeelem(&self->html, 1);
 		}
 		break;
 	case KW_EXPIRES:
 		if (self->image)
-			khtml_printf(&self->html, "%s", tmpupd_expiresin(self->image->end));
+			html_printf(&self->html, "%s", tmpupd_expiresin(self->image->end));
 		break;
 	case KW_ID:
 		if (self->image)
-			khtml_printf(&self->html, "%s", self->image->id);
+			html_printf(&self->html, "%s", self->image->id);
 		break;
 	case KW_TITLE:
 		if (self->image)
-			khtml_printf(&self->html, "%s", self->image->title);
+			html_printf(&self->html, "%s", self->image->title);
 		break;
 	case KW_VISIBILITY:
 		if (self->image)
-			khtml_printf(&self->html, "%s", tmpupd_visibility(self->image->visible));
+			html_printf(&self->html, "%s", tmpupd_visibility(self->image->visible));
 		break;
 	default:
 		break;
@@ -111,42 +117,46 @@ format(size_t index, void *data)
 	return 1;
 }
 
+/*
+ * The page only shows the thumbnail, the image data is not needed.
+ */
 static int
 find(struct image *img, const char *id)
 {
 	struct db db;
+	intmax_t row;
 	int rv;
 
 	if (tmpupd_open(&db, DB_RDONLY) < 0)
 		return -1;
 
-	rv = db_image_get(img, id, &db);
+	rv = db_image_stat(img, &row, id, &db);
 	db_finish(&db);
 
 	return rv;
 }
 
 static void
-render(struct kreq *r, const struct image *image, const unsigned char *html, size_t htmlsz)
+render(struct req *r, const struct image *image, const unsigned char *html, size_t htmlsz)
 {
 	struct self self = {
 		.req = r,
 		.image = image
 	};
-	struct ktemplate kt = {
+	struct html_template kt = {
 		.key = keywords,
 		.keysz = LEN(keywords),
 		.cb = format,
 		.arg = &self
 	};
 
-	khtml_open(&self.html, self.req, KHTML_PRETTY);
-	route_template(self.req, "image", KHTTP_200, &kt, html, htmlsz);
-	khtml_close(&self.html);
+	html_open(&self.html, self.req);
+	route_template(self.req, "image", 200, &kt, html, htmlsz);
+	html_close(&self.html);
 }
 
 static void
-get(struct kreq *r, const char * const *args)
+get(struct req *r, const char * const *args)
 {
 	struct image image;
 
@@ -156,41 +166,176 @@ get(struct kreq *r, const char * const *args)
 		image_finish(&image);
 		break;
 	case 0:
-		route_status(r, KHTTP_404, KMIME_TEXT_HTML);
+		route_status(r, 404, REQ_MIME_TEXT_HTML);
 		break;
 	default:
-		route_status(r, KHTTP_500, KMIME_TEXT_HTML);
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
 
+struct download {
+	struct req *req;
+	struct db *db;
+	intmax_t row;
+	const void *data;
+};
+
+static int
+output(void *data, const void *buf, size_t bufsz)
+{
+	struct req *r = data;
+
+	req_write(r, buf, bufsz);
+
+	return r->error ? -1 : 0;
+}
+
+static int
+chunk(void *data, size_t offset, size_t length)
+{
+	struct download *dl = data;
+
+	if (db_image_read(dl->row, offset, length, output, dl->req, dl->db) < 0) {
+		log_warn(TAG "unable to read image: %s", dl->db->error);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Only the metadata is fetched first, the data is then read in chunks for
+ * the requested ranges alone. Everything is read in a single transaction,
+ * the optimizer may replace the data in between otherwise.
+ */
 static void
-get_download(struct kreq *r, const char * const *args)
+get_download(struct req *r, const char * const *args)
 {
 	struct image image;
+	struct db db;
+	struct download dl = {
+		.req = r,
+		.db = &db
+	};
 
-	switch (find(&image, args[0])) {
+	if (tmpupd_open(&db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
+		return;
+	}
+	if (db_exec(&db, "begin") < 0) {
+		log_warn(TAG "unable to begin transaction: %s", db.error);
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
+		db_finish(&db);
+		return;
+	}
+
+	switch (db_image_stat(&image, &dl.row, args[0], &db)) {
 	case 1:
-		khttp_head(r, kresps[KRESP_CONTENT_TYPE], "%s", kmimetypes[KMIME_APP_OCTET_STREAM]);
-		khttp_head(r, kresps[KRESP_CONTENT_LENGTH], "%zu", image.datasz);
-		khttp_head(r, kresps[KRESP_CONNECTION], "keep-alive");
-		khttp_head(r, kresps[KRESP_CONTENT_DISPOSITION],
+		req_head(r, "Content-Disposition",
 		    "attachment; filename=\"%s\"", image.filename);
-		khttp_body(r);
-		khttp_write(r, (const char *)image.data, image.datasz);
+		route_download(r, req_mimes[REQ_MIME_APP_OCTET_STREAM],
+		    image.datasz, chunk, &dl);
 		image_finish(&image);
 		break;
 	case 0:
-		route_status(r, KHTTP_404, KMIME_TEXT_HTML);
+		route_status(r, 404, REQ_MIME_TEXT_HTML);
+		break;
+	default:
+		log_warn(TAG "unable to get image '%s': %s", args[0], db.error);
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
+		break;
+	}
+
+	/* Nothing was written, ending the transaction can't fail. */
+	db_exec(&db, "commit");
+	db_finish(&db);
+}
+
+static int
+thumb_chunk(void *data, size_t offset, size_t length)
+{
+	struct download *dl = data;
+	const struct thumb *thumb = dl->data;
+
+	req_write(dl->req, thumb->data + offset, length);
+
+	return dl->req->error ? -1 : 0;
+}
+
+static void
+redirect(struct req *r, const char *id)
+{
+	req_status(r, 302);
+	req_head(r, "Location", "/image/download/%s", id);
+	req_body(r);
+}
+
+/*
+ * Until the thumbnail is generated, or if the original is small enough, the
+ * client is sent to the original image.
+ */
+static void
+get_thumb(struct req *r, const char * const *args)
+{
+	struct thumb thumb = {0};
+	struct image image;
+	struct db db;
+	struct download dl = {
+		.req = r,
+		.data = &thumb
+	};
+	const char *size;
+
+	if (!(size = req_field(r, "size")) || strcmp(size, "256") == 0)
+		thumb.size = THUMB_SMALL;
+	else if (strcmp(size, "1024") == 0)
+		thumb.size = THUMB_LARGE;
+	else {
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
+		return;
+	}
+
+	if (tmpupd_open(&db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
+		return;
+	}
+
+	switch (db_thumb_get(&thumb, args[0], &db)) {
+	case 1:
+		if (thumb.data)
+			route_download(r, thumb.mime, thumb.datasz, thumb_chunk, &dl);
+		else
+			redirect(r, args[0]);
+
+		thumb_finish(&thumb);
+		break;
+	case 0:
+		switch (db_image_stat(&image, &dl.row, args[0], &db)) {
+		case 1:
+			redirect(r, args[0]);
+			image_finish(&image);
+			break;
+		case 0:
+			route_status(r, 404, REQ_MIME_TEXT_HTML);
+			break;
+		default:
+			log_warn(TAG "unable to get image '%s': %s", args[0], db.error);
+			route_status(r, 500, REQ_MIME_TEXT_HTML);
+			break;
+		}
 		break;
 	default:
-		route_status(r, KHTTP_500, KMIME_TEXT_HTML);
+		log_warn(TAG "unable to get thumbnail '%s': %s", args[0], db.error);
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
 		break;
 	}
+
+	db_finish(&db);
 }
 
 static void
-get_new(struct kreq *r)
+get_new(struct req *r)
 {
 	/*
 	 * Reuse render with a NULL image because in contrast to paste images
@@ -200,112 +345,256 @@ get_new(struct kreq *r)
 	render(r, NULL, html_image_new, sizeof (html_image_new));
 }
 
-static void
-post(struct kreq *r)
+/*
+ * Read a small form value, truncating it if too long.
+ */
+static int
+value(struct req_multipart *mp, char *buf, size_t bufsz)
+{
+	size_t len = 0;
+	ssize_t nr = 0;
+
+	while (len < bufsz - 1 && (nr = req_multipart_read(mp, buf + len, bufsz - len - 1)) > 0)
+		len += nr;
+
+	buf[len] = '\0';
+
+	return len < bufsz - 1 && nr < 0 ? -1 : 0;
+}
+
+/*
+ * Copy the file part into a temporary file, the content type is checked once
+ * the beginning of the file is gathered as reads may return any amount.
+ */
+static int
+spool(struct req_multipart *mp, FILE *fp, size_t *size)
+{
+	char buf[BUFSIZ * 8];
+	size_t len = 0;
+	ssize_t nr = 0;
+
+	while (len < CHECK_IMAGE_HEAD && (nr = req_multipart_read(mp, buf + len, sizeof (buf) - len)) > 0)
+		len += nr;
+
+	if (nr < 0)
+		return -1;
+	if (len && check_image(buf, len) < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (len) {
+		if (fwrite(buf, 1, len, fp) != len)
+			return -1;
+
+		*size += len;
+
+		if ((nr = req_multipart_read(mp, buf, sizeof (buf))) < 0)
+			return -1;
+
+		len = nr;
+	}
+
+	if (fflush(fp) == EOF)
+		return -1;
+
+	rewind(fp);
+
+	return 0;
+}
+
+static ssize_t
+readfile(void *data, void *buf, size_t bufsz)
+{
+	FILE *fp = data;
+	size_t nr;
+
+	if ((nr = fread(buf, 1, bufsz, fp)) == 0 && ferror(fp))
+		return -1;
+
+	return nr;
+}
+
+static int
+save(struct image *image, FILE *fp)
 {
 	struct db db;
-	struct image image;
-	const char *title = NULL,
-	           *author = NULL,
-	           *filename = NULL,
-	           *duration = "day";
-	const unsigned char *data = NULL;
-	time_t start, end;
-	int visible = 0;
-	size_t datasz = 0;
-
-	if (tmpupd_open(&db, DB_RDWR) < 0) {
-		route_status(r, KHTTP_500, KMIME_TEXT_HTML);
+	char *id = image->id;
+	int rv;
+
+	if (tmpupd_open(&db, DB_RDWR) < 0)
+		return -1;
+
+	/* No file sent, add some fun through image_init. */
+	if (image->datasz)
+		rv = db_image_save_stream(image, readfile, fp, &db);
+	else {
+		image_init(image, id, image->title, image->author,
+		    image->filename, NULL, 0, image->start, image->end,
+		    image->visible);
+		free(id);
+		rv = db_image_save(image, &db);
+	}
+
+	if (rv < 0)
+		log_warn(TAG "unable to create image: %s", db.error);
+
+	db_finish(&db);
+
+	return rv;
+}
+
+/*
+ * The form is read as a stream so that the uploaded file never has to be
+ * held in memory, it is spooled to a temporary file and then copied into the
+ * database in small chunks.
+ */
+static void
+post(struct req *r)
+{
+	struct req_multipart mp;
+	struct image image = {0};
+	char title[256] = {0},
+	     author[256] = {0},
+	     filename[256] = {0},
+	     duration[16] = "day",
+	     visible[8] = {0};
+	FILE *fp;
+	int rv = 0;
+
+	if (req_multipart_init(&mp, r) < 0) {
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
+		return;
+	}
+	if (!(fp = tmpfile())) {
+		log_warn(TAG "tmpfile: %s", strerror(errno));
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
 		return;
 	}
 
-	for (size_t i = 0; i < r->fieldsz; ++i) {
-		if (tmpupd_isdef(&r->fields[i], "title"))
-			title = r->fields[i].val;
-		else if (tmpupd_isdef(&r->fields[i], "author"))
-			author = r->fields[i].val;
-		else if (tmpupd_isdef(&r->fields[i], "filename"))
-			filename = r->fields[i].val;
-		else if (tmpupd_isdef(&r->fields[i], "duration"))
-			duration = r->fields[i].val;
-		else if (strcmp(r->fields[i].key, "file") == 0) {
-			if (r->fields[i].file)
-				filename = r->fields[i].file;
-
-			data = (const unsigned char *)r->fields[i].val;
-			datasz = r->fields[i].valsz;
-		} else if (tmpupd_isdef(&r->fields[i], "visible"))
-			visible = strcmp(r->fields[i].val, "on") == 0;
+	while (rv == 0 && (rv = req_multipart_next(&mp)) > 0) {
+		if (strcmp(mp.name, "title") == 0)
+			rv = value(&mp, title, sizeof (title));
+		else if (strcmp(mp.name, "author") == 0)
+			rv = value(&mp, author, sizeof (author));
+		else if (strcmp(mp.name, "filename") == 0)
+			rv = value(&mp, filename, sizeof (filename));
+		else if (strcmp(mp.name, "duration") == 0)
+			rv = value(&mp, duration, sizeof (duration));
+		else if (strcmp(mp.name, "visible") == 0)
+			rv = value(&mp, visible, sizeof (visible));
+		else if (strcmp(mp.name, "file") == 0) {
+			if (mp.file[0])
+				bstrlcpy(filename, mp.file, sizeof (filename));
+
+			rv = spool(&mp, fp, &image.datasz);
+		} else
+			rv = 0;
 	}
 
-	tmpupd_condamn(&start, &end, duration);
-	image_init(&image, NULL, title, author, filename, data, datasz, start, end, visible);
+	if (rv < 0) {
+		log_warn(TAG "unable to read upload: %s", strerror(errno));
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
+		fclose(fp);
+		return;
+	}
 
-	if (db_image_save(&image, &db) < 0) {
-		log_warn(TAG "unable to create image: %s", db.error);
-		route_status(r, KHTTP_500, KMIME_TEXT_HTML);
-	} else {
+	/* Fields are borrowed until image_init is eventually called. */
+	image.id = tmp_id();
+	image.title = title[0] ? title : TMP_DEFAULT_TITLE;
+	image.author = author[0] ? author : TMP_DEFAULT_AUTHOR;
+	image.filename = filename[0] ? filename : TMP_DEFAULT_FILENAME;
+	image.visible = strcmp(visible, "on") == 0;
+	tmpupd_condamn(&image.start, &image.end, duration[0] ? duration : "day");
+
+	if (save(&image, fp) < 0)
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
+	else {
 		/* Redirect to image details. */
 		log_debug(TAG "created new image '%s'", image.id);
-		khttp_head(r, kresps[KRESP_STATUS], "%s", khttps[KHTTP_302]);
-		khttp_head(r, kresps[KRESP_LOCATION], "/image/%s", image.id);
-		khttp_body(r);
+		req_status(r, 302);
+		req_head(r, "Location", "/image/%s", image.id);
+		req_body(r);
 	}
 
-	image_finish(&image);
-	db_finish(&db);
+	if (image.data)
+		image_finish(&image);
+	else
+		free(image.id);
+
+	fclose(fp);
 }
 
 void
-route_image(struct kreq *r, const char * const *args)
+route_image(struct req *r, const char * const *args)
 {
 	assert(r);
 	assert(args);
 
 	switch (r->method) {
-	case KMETHOD_GET:
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
 		get(r, args);
 		break;
-	case KMETHOD_POST:
+	case REQ_METHOD_POST:
 		post(r);
 		break;
 	default:
-		route_status(r, KHTTP_400, KMIME_TEXT_HTML);
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
 
 void
-route_image_download(struct kreq *r, const char * const *args)
+route_image_download(struct req *r, const char * const *args)
 {
 	assert(r);
 	assert(args);
 
 	switch (r->method) {
-	case KMETHOD_GET:
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
 		get_download(r, args);
 		break;
 	default:
-		route_status(r, KHTTP_400, KMIME_TEXT_HTML);
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
+		break;
+	}
+}
+
+void
+route_image_thumb(struct req *r, const char * const *args)
+{
+	assert(r);
+	assert(args);
+
+	switch (r->method) {
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
+		get_thumb(r, args);
+		break;
+	default:
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
 
 void
-route_image_new(struct kreq *r, const char * const *args)
+route_image_new(struct req *r, const char * const *args)
 {
 	assert(r);
 	assert(args);
 
 	switch (r->method) {
-	case KMETHOD_GET:
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
 		get_new(r);
 		break;
-	case KMETHOD_POST:
+	case REQ_METHOD_POST:
 		post(r);
 		break;
 	default:
-		route_status(r, KHTTP_400, KMIME_TEXT_HTML);
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
@@ -24,24 +24,30 @@
  * \brief Routes /image.
  */
 
-struct kreq;
+struct req;
 
 /**
  * Implement /image route.
  */
 void
-route_image(struct kreq *r, const char * const *args);
+route_image(struct req *r, const char * const *args);
 
 /**
  * Implement /image/download/<id> route.
  */
 void
-route_image_download(struct kreq *r, const char * const *args);
+route_image_download(struct req *r, const char * const *args);
+
+/**
+ * Implement /image/thumb/<id> route.
+ */
+void
+route_image_thumb(struct req *r, const char * const *args);
 
 /**
  * Implement /image/new route.
  */
 void
-route_image_new(struct kreq *r, const char * const *args);
+route_image_new(struct req *r, const char * const *args);
 
 #endif /* !TMPUPD_ROUTE_IMAGE */
@@ -1,5 +1,5 @@
 /*
- * route-index.c -- route /
+ * route-index.c -- route /, /pastes and /images
  *
  * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
  *
@@ -25,29 +25,40 @@
 #include "db.h"
 #include "http.h"
 #include "image.h"
+#include "log.h"
 #include "paste.h"
 #include "route-index.h"
 #include "route.h"
 #include "tmpupd.h"
 #include "util.h"
 
+#include "html/images.h"
 #include "html/index.h"
+#include "html/pastes.h"
+
+#define TAG "route-index: "
 
 #define LIMIT 10
 
 struct self {
 	struct db db;
-	struct kreq *req;
-	struct khtmlreq html;
+	struct req *req;
+	struct html html;
+	struct tmpupd_page page;
+	const char *path;
+	size_t count;
+	char next[64];
 };
 
 enum {
 	KW_IMAGES,
+	KW_PAGES,
 	KW_PASTES
 };
 
 static const char * const keywords[] = {
 	[KW_IMAGES] = "images",
+	[KW_PAGES]  = "pages",
 	[KW_PASTES] = "pastes",
 };
 
@@ -64,95 +75,173 @@ url(const char *fmt, ...)
 	return ret;
 }
 
-static void
-format_pastes(struct self *self)
+/*
+ * One more item than shown is loaded to tell if there is a next page, the
+ * cursor of the last item shown starts it.
+ */
+static int
+shown(struct self *self, time_t start, const char *id)
 {
-	struct paste pastes[LIMIT], *p;
-	ssize_t pastesz;
-
-	if ((pastesz = db_paste_recents(pastes, LEN(pastes), &self->db)) < 0)
-		return;
-
-	for (ssize_t i = 0; i < pastesz; ++i) {
-		p = &pastes[i];
-
-		khtml_elem(&self->html, KELEM_TR);
+	if (++self->count > self->page.limit)
+		return 0;
 
-		/* id */
-		khtml_elem(&self->html, KELEM_TD);
-		khtml_attr(&self->html, KELEM_A,
-		    KATTR_HREF, url("paste/%s", p->id),
-		    KATTR__MAX);
-		khtml_printf(&self->html, "%s", p->id);
-		khtml_closeelem(&self->html, 2);
+	bstrlcpy(self->next, tmpupd_cursor(start, id), sizeof (self->next));
 
-		/* title */
-		khtml_elem(&self->html, KELEM_TD);
-		khtml_printf(&self->html, "%s", p->title);
-		khtml_closeelem(&self->html, 1);
-
-		/* author */
-		khtml_elem(&self->html, KELEM_TD);
-		khtml_printf(&self->html, "%s", p->author);
-		khtml_closeelem(&self->html, 1);
+	return 1;
+}
 
-		/* language */
-		khtml_elem(&self->html, KELEM_TD);
-		khtml_printf(&self->html, "%s", p->language);
-		khtml_closeelem(&self->html, 1);
+static int
+format_paste(const struct paste *p, void *data)
+{
+	struct self *self = data;
+
+	if (!shown(self, p->start, p->id))
+		return 0;
+
+	html_elem(&self->html, "tr");
+
+	/* id */
+	html_elem(&self->html, "td");
+	html_attr(&self->html, "a",
+	    "href", url("paste/%s", p->id),
+	    NULL);
+	html_printf(&self->html, "%s", p->id);
+	html_closeelem(&self->html, 2);
+
+	/* title */
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", p->title);
+	html_closeelem(&self->html, 1);
+
+	/* author */
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", p->author);
+	html_closeelem(&self->html, 1);
+
+	/* language */
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", p->language);
+	html_closeelem(&self->html, 1);
+
+	/* size and lines, unknown for pastes older than the summaries */
+	html_elem(&self->html, "td");
+	if (p->preview)
+		html_printf(&self->html, "%s", tmpupd_size(p->size));
+	html_closeelem(&self->html, 1);
+
+	html_elem(&self->html, "td");
+	if (p->preview)
+		html_printf(&self->html, "%zu", p->lines);
+	html_closeelem(&self->html, 1);
+
+	/* preview */
+	html_elem(&self->html, "td");
+	html_elem(&self->html, "pre");
+	if (p->preview)
+		html_printf(&self->html, "%s", p->preview);
+	html_closeelem(&self->html, 2);
+
+	/* expiration */
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", tmpupd_expiresin(p->end));
+	html_closeelem(&self->html, 1);
+
+	html_closeelem(&self->html, 0);
+
+	return self->req->error ? -1 : 0;
+}
 
-		/* language */
-		khtml_elem(&self->html, KELEM_TD);
-		khtml_printf(&self->html, "%s", tmpupd_expiresin(p->end));
-		khtml_closeelem(&self->html, 1);
+static int
+format_image(const struct image *img, void *data)
+{
+	struct self *self = data;
+
+	if (!shown(self, img->start, img->id))
+		return 0;
+
+	html_elem(&self->html, "tr");
+
+	/* id */
+	html_elem(&self->html, "td");
+	html_attr(&self->html, "a",
+	    "href", url("image/%s", img->id),
+	    NULL);
+	html_printf(&self->html, "%s", img->id);
+	html_closeelem(&self->html, 2);
+
+	/* preview */
+	html_elem(&self->html, "td");
+	html_attr(&self->html, "a",
+	    "href", url("image/%s", img->id),
+	    NULL);
+	html_attr(&self->html, "img",
+	    "src", url("image/thumb/%s", img->id),
+	    "alt", img->title,
+	    "loading", "lazy",
+	    NULL);
+	html_closeelem(&self->html, 2);
+
+	/* title */
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", img->title);
+	html_closeelem(&self->html, 1);
+
+	/* author */
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", img->author);
+	html_closeelem(&self->html, 1);
+
+	/* expiration */
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", tmpupd_expiresin(img->end));
+	html_closeelem(&self->html, 1);
+
+	html_closeelem(&self->html, 0);
+
+	return self->req->error ? -1 : 0;
+}
 
-		khtml_closeelem(&self->html, 0);
+static void
+format_pastes(struct self *self)
+{
+	self->count = 0;
 
-		paste_finish(&pastes[i]);
-	}
+	if (db_paste_recents(self->page.start, self->page.id, self->page.limit + 1,
+	    format_paste, self, &self->db) < 0)
+		log_warn(TAG "unable to list pastes: %s", self->db.error);
 }
 
 static void
 format_images(struct self *self)
 {
-	struct image images[LIMIT], *img;
-	ssize_t imagesz;
-
-	if ((imagesz = db_image_recents(images, LEN(images), &self->db)) < 0)
-		return;
+	self->count = 0;
 
-	for (ssize_t i = 0; i < imagesz; ++i) {
-		img = &images[i];
-
-		khtml_elem(&self->html, KELEM_TR);
-
-		/* id */
-		khtml_elem(&self->html, KELEM_TD);
-		khtml_attr(&self->html, KELEM_A,
-		    KATTR_HREF, url("image/%s", img->id),
-		    KATTR__MAX);
-		khtml_printf(&self->html, "%s", img->id);
-		khtml_closeelem(&self->html, 2);
-
-		/* title */
-		khtml_elem(&self->html, KELEM_TD);
-		khtml_printf(&self->html, "%s", img->title);
-		khtml_closeelem(&self->html, 1);
-
-		/* author */
-		khtml_elem(&self->html, KELEM_TD);
-		khtml_printf(&self->html, "%s", img->author);
-		khtml_closeelem(&self->html, 1);
+	if (db_image_recents(self->page.start, self->page.id, self->page.limit + 1,
+	    format_image, self, &self->db) < 0)
+		log_warn(TAG "unable to list images: %s", self->db.error);
+}
 
-		/* expiration */
-		khtml_elem(&self->html, KELEM_TD);
-		khtml_printf(&self->html, "%s", tmpupd_expiresin(img->end));
-		khtml_closeelem(&self->html, 1);
+static void
+format_pages(struct self *self)
+{
+	html_elem(&self->html, "p");
 
-		khtml_closeelem(&self->html, 0);
+	if (self->page.id[0]) {
+		html_attr(&self->html, "a", "href", self->path, NULL);
+		html_printf(&self->html, "newest");
+		html_closeelem(&self->html, 1);
+		html_printf(&self->html, " ");
+	}
 
-		image_finish(img);
+	if (self->count > self->page.limit) {
+		html_attr(&self->html, "a",
+		    "href", url("%s?after=%s&limit=%zu", self->path, self->next, self->page.limit),
+		    NULL);
+		html_printf(&self->html, "older");
+		html_closeelem(&self->html, 1);
 	}
+
+	html_closeelem(&self->html, 1);
 }
 
 static int
@@ -165,6 +254,9 @@ format(size_t index, void *arg)
 	case KW_IMAGES:
 		format_images(arg);
 		break;
+	case KW_PAGES:
+		format_pages(arg);
+		break;
 	default:
 		break;
 	}
@@ -172,31 +264,89 @@ format(size_t index, void *arg)
 	return 1;
 }
 
+static void
+render(struct req *r,
+       struct self *self,
+       const char *title,
+       const unsigned char *html,
+       size_t htmlsz)
+{
+	struct html_template kt = {
+		.key = keywords,
+		.keysz = LEN(keywords),
+		.cb = format,
+		.arg = self
+	};
+
+	if (tmpupd_open(&self->db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
+		return;
+	}
+
+	html_open(&self->html, self->req);
+	route_template(r, title, 200, &kt, html, htmlsz);
+	html_close(&self->html);
+
+	db_finish(&self->db);
+}
+
+/*
+ * Listing of either pastes or images, the template shows only one of them.
+ */
+static void
+listing(struct req *r,
+        const char *path,
+        const char *title,
+        const unsigned char *html,
+        size_t htmlsz)
+{
+	struct self self = {
+		.req = r,
+		.path = path
+	};
+	char error[128];
+
+	if (tmpupd_page(r, &self.page, error, sizeof (error)) < 0) {
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
+		return;
+	}
+
+	render(r, &self, title, html, htmlsz);
+}
+
 void
-route_index(struct kreq *r, const char * const *args)
+route_index(struct req *r, const char * const *args)
 {
 	(void)args;
 
 	assert(r);
 
 	struct self self = {
-		.req = r
-	};
-	struct ktemplate kt = {
-		.key = keywords,
-		.keysz = LEN(keywords),
-		.cb = format,
-		.arg = &self
+		.req = r,
+		.page = {
+			.limit = LIMIT
+		}
 	};
 
-	if (tmpupd_open(&self.db, DB_RDONLY) < 0) {
-		route_status(r, KHTTP_500, KMIME_TEXT_HTML);
-		return;
-	}
+	render(r, &self, "tmpup", html_index, sizeof (html_index));
+}
+
+void
+route_pastes(struct req *r, const char * const *args)
+{
+	(void)args;
+
+	assert(r);
+
+	listing(r, "/pastes", "pastes", html_pastes, sizeof (html_pastes));
+}
 
-	khtml_open(&self.html, self.req, 0);
-	route_template(r, "tmpup", KHTTP_200, &kt, html_index, sizeof (html_index));
-	khtml_close(&self.html);
+void
+route_images(struct req *r, const char * const *args)
+{
+	(void)args;
+
+	assert(r);
 
-	db_finish(&self.db);
+	listing(r, "/images", "images", html_images, sizeof (html_images));
 }
@@ -21,15 +21,29 @@
 
 /**
  * \file route-index.h
- * \brief route /
+ * \brief route /, /pastes and /images
  */
 
-struct kreq;
+struct req;
 
 /**
  * Implement / route
  */
 void
-route_index(struct kreq *r, const char * const *args);
+route_index(struct req *r, const char * const *args);
+
+/**
+ * Implement /pastes route, the visible pastes from the newest one page at a
+ * time given the optional `limit` and `after` query fields.
+ */
+void
+route_pastes(struct req *r, const char * const *args);
+
+/**
+ * Implement /images route, the visible images from the newest one page at a
+ * time given the optional `limit` and `after` query fields.
+ */
+void
+route_images(struct req *r, const char * const *args);
 
 #endif /* !TMPUPD_ROUTE_INDEX */
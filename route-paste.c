@@ -17,11 +17,17 @@
  */
 
 #include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
+#include "codec.h"
 #include "db-paste.h"
 #include "db.h"
 #include "http.h"
+#include "lines.h"
 #include "log.h"
 #include "paste.h"
 #include "route-paste.h"
@@ -35,10 +41,15 @@
 
 #define TAG "route-paste: "
 
+/* Lines shown by default and the most shown at once. */
+#define PAGE_LINES 1000
+#define PAGE_LINES_MAX 10000
+
 struct self {
 	const struct paste *paste;
-	struct kreq *req;
-	struct khtmlreq html;
+	const struct db_paste_lines *lines;
+	struct req *req;
+	struct html html;
 };
 
 enum {
@@ -53,6 +64,7 @@ enum {
 	KW_FILENAME,
 	KW_ID,
 	KW_LANGUAGES,
+	KW_LINES,
 	KW_TITLE,
 	KW_VISIBILITY
 };
@@ -69,6 +81,7 @@ static const char * const keywords[] = {
 	[KW_FILENAME]         = "filename",
 	[KW_ID]               = "id",
 	[KW_LANGUAGES]        = "languages",
+	[KW_LINES]            = "lines",
 	[KW_TITLE]            = "title",
 	[KW_VISIBILITY]       = "visibility"
 };
@@ -82,6 +95,56 @@ is_this_language(const struct paste *paste, const char *language)
 	return strcmp(language, TMP_DEFAULT_LANG) == 0;
 }
 
+/*
+ * Navigation between the pages of a paste, nothing is shown when the whole
+ * paste fits in one.
+ */
+static void
+format_lines(struct self *self)
+{
+	const struct db_paste_lines *lines = self->lines;
+	const char *id = self->paste->id;
+	char href[128];
+	size_t shown, first;
+
+	if (!lines || (lines->first == 0 && !lines->more))
+		return;
+
+	shown = lines_count(self->paste->code, lines->textsz);
+
+	html_elem(&self->html, "p");
+
+	if (shown)
+		html_printf(&self->html, "lines %zu-%zu ", lines->first + 1, lines->first + shown);
+	else
+		html_printf(&self->html, "no lines after %zu ", lines->first);
+
+	if (lines->first) {
+		first = lines->first > lines->count ? lines->first - lines->count : 0;
+		snprintf(href, sizeof (href), "/paste/%s?lines=%zu-%zu",
+		    id, first + 1, first + lines->count);
+		html_attr(&self->html, "a", "href", href, NULL);
+		html_printf(&self->html, "previous");
+		html_closeelem(&self->html, 1);
+		html_printf(&self->html, " ");
+	}
+
+	if (lines->more) {
+		first = lines->first + lines->count;
+		snprintf(href, sizeof (href), "/paste/%s?lines=%zu-%zu",
+		    id, first + 1, first + lines->count);
+		html_attr(&self->html, "a", "href", href, NULL);
+		html_printf(&self->html, "next");
+		html_closeelem(&self->html, 1);
+		html_printf(&self->html, " ");
+	}
+
+	snprintf(href, sizeof (href), "/paste/raw/%s", id);
+	html_attr(&self->html, "a", "href", href, NULL);
+	html_printf(&self->html, "raw");
+	html_closeelem(&self->html, 2);
+}
+
 static int
 format(size_t index, void *data)
 {
@@ -90,45 +153,45 @@ format(size_t index, void *data)
 	switch (index) {
 	case KW_AUTHOR:
 		if (self->paste)
-			khtml_printf(&self->html, "%s", self->paste->author);
+			html_printf(&self->html, "%s", self->paste->author);
 		break;
 	case KW_CODE:
 		if (self->paste)
-			khtml_printf(&self->html, "%s", self->paste->code);
+			html_printf(&self->html, "%s", self->paste->code);
 		break;
 	case KW_DEFAULT_AUTHOR:
-		khtml_printf(&self->html, "%s", TMP_DEFAULT_AUTHOR);
+		html_printf(&self->html, "%s", TMP_DEFAULT_AUTHOR);
 		break;
 	case KW_DEFAULT_CODE:
-		khtml_printf(&self->html, "%s", TMP_DEFAULT_CODE);
+		html_printf(&self->html, "%s", TMP_DEFAULT_CODE);
 		break;
 	case KW_DEFAULT_FILENAME:
-		khtml_printf(&self->html, "%s", TMP_DEFAULT_FILENAME);
+		html_printf(&self->html, "%s", TMP_DEFAULT_FILENAME);
 		break;
 	case KW_DEFAULT_TITLE:
-		khtml_printf(&self->html, "%s", TMP_DEFAULT_TITLE);
+		html_printf(&self->html, "%s", TMP_DEFAULT_TITLE);
 		break;
 	case KW_DURATIONS:
 		for (size_t i = 0; i < tmp_durationsz; ++i) {
-			khtml_attr(&self->html, KELEM_OPTION,
-			    KATTR_VALUE, tmp_durations[i],
-			    KATTR__MAX);
-			khtml_printf(&self->html, "%s", tmp_durations[i]);
-			khtml_closeelem(&self->html, 1);
+			html_attr(&self->html, "option",
+			    "value", tmp_durations[i],
+			    NULL);
+			html_printf(&self->html, "%s", tmp_durations[i]);
+			html_closeelem(&self->html, 1);
 		}
 		break;
 	case KW_EXPIRES:
 		if (self->paste)
-			khtml_printf(&self->html, "%s",
+			html_printf(&self->html, "%s",
 			    tmpupd_expiresin(self->paste->end));
 		break;
 	case KW_ID:
 		if (self->paste)
-			khtml_printf(&self->html, "%s", self->paste->id);
+			html_printf(&self->html, "%s", self->paste->id);
 		break;
 	case KW_FILENAME:
 		if (self->paste)
-			khtml_printf(&self->html, "%s", self->paste->filename);
+			html_printf(&self->html, "%s", self->paste->filename);
 		break;
 	case KW_LANGUAGES:
 		for (size_t i = 0; i < paste_langsz; ++i) {
@@ -138,26 +201,30 @@ format(size_t index, void *data)
 			 * the default global language.
 			 */
 			if (is_this_language(self->paste, paste_langs[i]))
-				khtml_attr(&self->html, KELEM_OPTION,
-					KATTR_VALUE, paste_langs[i],
-					KATTR_SELECTED, "selected",
-					KATTR__MAX);
+				html_attr(&self->html, "option",
+					"value", paste_langs[i],
+					"selected", "selected",
+					NULL);
 			else
-				khtml_attr(&self->html, KELEM_OPTION,
-					KATTR_VALUE, paste_langs[i],
-					KATTR__MAX);
+				html_attr(&self->html, "option",
+					"value", paste_langs[i],
+					NULL);
 
-			khtml_printf(&self->html, "%s", paste_langs[i]);
-			khtml_closeelem(&self->html, 1);
+			html_printf(&self->html, "%s", paste_langs[i]);
+			html_closeelem(&self->html, 1);
 		}
 		break;
+	case KW_LINES:
+		if (self->paste)
+			format_lines(self);
+		break;
 	case KW_TITLE:
 		if (self->paste)
-			khtml_printf(&self->html, "%s", self->paste->title);
+			html_printf(&self->html, "%s", self->paste->title);
 		break;
 	case KW_VISIBILITY:
 		if (self->paste)
-			khtml_printf(&self->html, "%s", tmpupd_visibility(self->paste->visible));
+			html_printf(&self->html, "%s", tmpupd_visibility(self->paste->visible));
 		break;
 	default:
 		break;
@@ -181,92 +248,344 @@ find(struct paste *paste, const char *id)
 	return rv;
 }
 
+/*
+ * Parse the range of lines wanted as "first-last" or "first" counted from
+ * 1, the first page is used if not given.
+ */
+static int
+range(struct req *r, struct db_paste_lines *lines)
+{
+	const char *spec;
+	char *end;
+	unsigned long long first, last;
+
+	lines->first = 0;
+	lines->count = PAGE_LINES;
+
+	if (!(spec = req_field(r, "lines")))
+		return 0;
+	if (!isdigit((unsigned char)*spec))
+		return -1;
+
+	first = last = strtoull(spec, &end, 10);
+
+	if (*end == '-' && isdigit((unsigned char)end[1]))
+		last = strtoull(end + 1, &end, 10);
+	if (*end || first == 0 || last < first)
+		return -1;
+
+	lines->first = first - 1;
+	lines->count = last - first < PAGE_LINES_MAX ? last - first + 1 : PAGE_LINES_MAX;
+
+	return 0;
+}
+
+/*
+ * Get a paste with only a range of lines as code, the rest of the code is
+ * never read.
+ */
+static int
+find_lines(struct paste *paste, struct db_paste_lines *lines, const char *id)
+{
+	struct db db;
+	int rv;
+
+	if (tmpupd_open(&db, DB_RDONLY) < 0)
+		return -1;
+
+	/* The paste may have been pruned in between. */
+	if ((rv = db_paste_stat(paste, id, &db)) == 1) {
+		if ((rv = db_paste_lines(id, lines, &db)) == 1) {
+			free(paste->code);
+			paste->code = lines->text;
+			lines->text = NULL;
+		} else
+			paste_finish(paste);
+	}
+
+	if (rv < 0)
+		log_warn(TAG "unable to get paste '%s': %s", id, db.error);
+
+	db_finish(&db);
+
+	return rv;
+}
+
 static void
-render(struct kreq *r, const struct paste *paste, const unsigned char *html, size_t htmlsz)
+render(struct req *r,
+       const struct paste *paste,
+       const struct db_paste_lines *lines,
+       const unsigned char *html,
+       size_t htmlsz)
 {
 	struct self self = {
 		.req = r,
-		.paste = paste
+		.paste = paste,
+		.lines = lines
 	};
-	struct ktemplate kt = {
+	struct html_template kt = {
 		.key = keywords,
 		.keysz = LEN(keywords),
 		.cb = format,
 		.arg = &self
 	};
 
-	khtml_open(&self.html, self.req, KHTML_PRETTY);
-	route_template(self.req, "paste", KHTTP_200, &kt, html, htmlsz);
-	khtml_close(&self.html);
+	html_open(&self.html, self.req);
+	route_template(self.req, "paste", 200, &kt, html, htmlsz);
+	html_close(&self.html);
 }
 
 static void
-get(struct kreq *r, const char * const *args)
+get(struct req *r, const char * const *args)
 {
 	struct paste paste;
+	struct db_paste_lines lines;
 
-	switch (find(&paste, args[0])) {
+	if (range(r, &lines) < 0) {
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
+		return;
+	}
+
+	switch (find_lines(&paste, &lines, args[0])) {
 	case 1:
-		render(r, &paste, html_paste, sizeof (html_paste));
+		render(r, &paste, &lines, html_paste, sizeof (html_paste));
 		paste_finish(&paste);
 		break;
 	case 0:
-		route_status(r, KHTTP_404, KMIME_TEXT_HTML);
+		route_status(r, 404, REQ_MIME_TEXT_HTML);
 		break;
 	default:
-		route_status(r, KHTTP_500, KMIME_TEXT_HTML);
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
 
+struct download {
+	struct req *req;
+	const char *code;
+};
+
+static int
+slice(void *data, size_t offset, size_t length)
+{
+	struct download *dl = data;
+
+	req_write(dl->req, dl->code + offset, length);
+
+	return dl->req->error ? -1 : 0;
+}
+
 static void
-get_download(struct kreq *r, const char * const *args)
+get_download(struct req *r, const char * const *args)
 {
 	struct paste paste;
+	struct download dl = {
+		.req = r
+	};
 
 	switch (find(&paste, args[0])) {
 	case 1:
-		khttp_head(r, kresps[KRESP_CONTENT_TYPE], "%s", kmimetypes[KMIME_APP_OCTET_STREAM]);
-		khttp_head(r, kresps[KRESP_CONTENT_LENGTH], "%zu", strlen(paste.code));
-		khttp_head(r, kresps[KRESP_CONNECTION], "keep-alive");
-		khttp_head(r, kresps[KRESP_CONTENT_DISPOSITION],
+		dl.code = paste.code;
+		req_head(r, "Content-Disposition",
 		    "attachment; filename=\"%s\"", paste.filename);
-		khttp_body(r);
-		khttp_printf(r, "%s", paste.code);
+		route_download(r, req_mimes[REQ_MIME_APP_OCTET_STREAM],
+		    strlen(paste.code), slice, &dl);
 		paste_finish(&paste);
 		break;
 	case 0:
-		route_status(r, KHTTP_404, KMIME_TEXT_HTML);
+		route_status(r, 404, REQ_MIME_TEXT_HTML);
 		break;
 	default:
-		route_status(r, KHTTP_500, KMIME_TEXT_HTML);
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
 
+struct raw {
+	struct req *req;
+	const char *id;
+	char codec[16];
+	char *code;
+	size_t codesz;
+	size_t length;
+};
+
+/*
+ * Tell if the client accepts a content coding, a weight of zero refuses it.
+ */
+static int
+accepts(struct req *r, const char *coding)
+{
+	const char *p, *next, *q;
+	size_t len;
+
+	if (!(p = req_header(r, "Accept-Encoding")))
+		return 0;
+
+	len = strlen(coding);
+
+	for (; *p; p = next) {
+		p += strspn(p, " \t,");
+		next = p + strcspn(p, ",");
+
+		if (strncasecmp(p, coding, len) != 0 || !strchr(" \t;,", p[len]))
+			continue;
+
+		q = p + len + strspn(p + len, " \t;");
+
+		return next - q < 3 || strncasecmp(q, "q=", 2) != 0 ||
+		    strtod(q + 2, NULL) != 0;
+	}
+
+	return 0;
+}
+
+/*
+ * The code is copied out of the row so that the statement is done before
+ * writing to the client, which may be slow.
+ */
 static void
-get_raw(struct kreq *r, const char * const *args)
+keep(const char *codec, const void *code, size_t codesz, size_t length, void *data)
 {
-	struct paste paste;
-	struct khtmlreq html;
+	struct raw *raw = data;
 
-	switch (find(&paste, args[0])) {
+	bstrlcpy(raw->codec, codec ? codec : "", sizeof (raw->codec));
+	raw->code = ememdup(code, codesz);
+	raw->codesz = codesz;
+	raw->length = length;
+}
+
+static void
+emit(struct raw *raw)
+{
+	const char *match, *codec = raw->codec[0] ? raw->codec : NULL;
+	char etag[64];
+
+	/*
+	 * Pastes are only appended to, the length is enough to tell changes
+	 * but each encoding is a different representation.
+	 */
+	if (codec)
+		snprintf(etag, sizeof (etag), "\"%s-%zx-%s\"", raw->id, raw->length, codec);
+	else
+		snprintf(etag, sizeof (etag), "\"%s-%zx\"", raw->id, raw->length);
+
+	match = req_header(raw->req, "If-None-Match");
+
+	if (match && strcmp(match, etag) == 0) {
+		req_status(raw->req, 304);
+		req_head(raw->req, "ETag", "%s", etag);
+		req_head(raw->req, "Vary", "Accept-Encoding");
+		req_body(raw->req);
+		return;
+	}
+
+	req_status(raw->req, 200);
+	req_head(raw->req, "Content-Type", "%s; charset=utf-8",
+	    req_mimes[REQ_MIME_TEXT_PLAIN]);
+	req_head(raw->req, "Content-Length", "%zu", raw->codesz);
+
+	if (codec)
+		req_head(raw->req, "Content-Encoding", "%s", codec);
+
+	req_head(raw->req, "ETag", "%s", etag);
+	req_head(raw->req, "Vary", "Accept-Encoding");
+	req_body(raw->req);
+	req_write(raw->req, raw->code, raw->codesz);
+}
+
+/*
+ * Only the lines asked are read and sent, a Link header points to the next
+ * ones if any.
+ */
+static void
+get_raw_lines(struct req *r, const char *id)
+{
+	struct db_paste_lines lines;
+	struct db db;
+	size_t first;
+
+	if (range(r, &lines) < 0) {
+		route_status(r, 400, REQ_MIME_TEXT_PLAIN);
+		return;
+	}
+	if (tmpupd_open(&db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_TEXT_PLAIN);
+		return;
+	}
+
+	switch (db_paste_lines(id, &lines, &db)) {
 	case 1:
-		khtml_open(&html, r, KHTML_PRETTY);
-		khttp_head(r, kresps[KRESP_CONTENT_TYPE], "%s", kmimetypes[KMIME_TEXT_HTML]);
-		khttp_head(r, kresps[KRESP_STATUS], "%s", khttps[KHTTP_200]);
+		req_status(r, 200);
+		req_head(r, "Content-Type", "%s; charset=utf-8",
+		    req_mimes[REQ_MIME_TEXT_PLAIN]);
+		req_head(r, "Content-Length", "%zu", lines.textsz);
+
+		if (lines.more) {
+			first = lines.first + lines.count;
+			req_head(r, "Link", "</paste/raw/%s?lines=%zu-%zu>; rel=\"next\"",
+			    id, first + 1, first + lines.count);
+		}
+
+		req_body(r);
+		req_write(r, lines.text, lines.textsz);
+		free(lines.text);
+		break;
+	case 0:
+		route_status(r, 404, REQ_MIME_TEXT_PLAIN);
 		break;
+	default:
+		log_warn(TAG "unable to get paste '%s': %s", id, db.error);
+		route_status(r, 500, REQ_MIME_TEXT_PLAIN);
+		break;
+	}
+
+	db_finish(&db);
+}
+
+/*
+ * Compressed pastes are sent as stored to clients accepting gzip, without
+ * being decompressed nor escaped.
+ */
+static void
+get_raw(struct req *r, const char * const *args)
+{
+	struct raw raw = {
+		.req = r,
+		.id = args[0]
+	};
+	struct db db;
+
+	if (req_field(r, "lines")) {
+		get_raw_lines(r, args[0]);
+		return;
+	}
+	if (tmpupd_open(&db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_TEXT_PLAIN);
+		return;
+	}
+
+	switch (db_paste_raw(args[0], accepts(r, CODEC_GZIP) ? CODEC_GZIP : NULL,
+	    keep, &raw, &db)) {
+	case 1:
+		db_finish(&db);
+		emit(&raw);
+		free(raw.code);
+		return;
 	case 0:
-		route_status(r, KHTTP_404, KMIME_TEXT_HTML);
+		route_status(r, 404, REQ_MIME_TEXT_PLAIN);
 		break;
 	default:
-		route_status(r, KHTTP_500, KMIME_TEXT_HTML);
+		log_warn(TAG "unable to get paste '%s': %s", args[0], db.error);
+		route_status(r, 500, REQ_MIME_TEXT_PLAIN);
 		break;
 	}
+
+	db_finish(&db);
 }
 
 static void
-get_new(struct kreq *r, const char * const *args)
+get_new(struct req *r, const char * const *args)
 {
 	struct paste paste = {};
 
@@ -282,11 +601,11 @@ get_new(struct kreq *r, const char * const *args)
 	} else
 		log_debug(TAG "creating a new paste");
 
-	render(r, paste.id ? &paste : NULL, html_paste_new, sizeof (html_paste_new));
+	render(r, paste.id ? &paste : NULL, NULL, html_paste_new, sizeof (html_paste_new));
 }
 
 static void
-post(struct kreq *r)
+post(struct req *r)
 {
 	struct db db;
 	struct paste paste;
@@ -295,12 +614,13 @@ post(struct kreq *r)
 	           *filename = NULL,
 	           *language = NULL,
 	           *code = NULL,
+	           *parent = NULL,
 	           *duration = "day";
 	time_t start, end;
-	int visible = 0;
+	int visible = 0, rv;
 
 	if (tmpupd_open(&db, DB_RDWR) < 0) {
-		route_status(r, KHTTP_500, KMIME_TEXT_HTML);
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
 		return;
 	}
 
@@ -317,6 +637,8 @@ post(struct kreq *r)
 			code = r->fields[i].val;
 		else if (tmpupd_isdef(&r->fields[i], "duration"))
 			duration = r->fields[i].val;
+		else if (tmpupd_isdef(&r->fields[i], "parent"))
+			parent = r->fields[i].val;
 		else if (tmpupd_isdef(&r->fields[i], "visible"))
 			visible = strcmp(r->fields[i].val, "on") == 0;
 	}
@@ -324,15 +646,20 @@ post(struct kreq *r)
 	tmpupd_condamn(&start, &end, duration);
 	paste_init(&paste, NULL, title, author, filename, language, code, start, end, visible);
 
-	if (db_paste_save(&paste, &db) < 0) {
+	if (parent)
+		rv = db_paste_fork(&paste, parent, &db);
+	else
+		rv = db_paste_save(&paste, &db);
+
+	if (rv < 0) {
 		log_warn(TAG "unable to create paste: %s", db.error);
-		route_status(r, KHTTP_500, KMIME_TEXT_HTML);
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
 	} else {
 		/* Redirect to paste details. */
 		log_debug(TAG "created new paste '%s'", paste.id);
-		khttp_head(r, kresps[KRESP_STATUS], "%s", khttps[KHTTP_302]);
-		khttp_head(r, kresps[KRESP_LOCATION], "/paste/%s", paste.id);
-		khttp_body(r);
+		req_status(r, 302);
+		req_head(r, "Location", "/paste/%s", paste.id);
+		req_body(r);
 	}
 
 	paste_finish(&paste);
@@ -340,71 +667,75 @@ post(struct kreq *r)
 }
 
 void
-route_paste(struct kreq *r, const char * const *args)
+route_paste(struct req *r, const char * const *args)
 {
 	assert(r);
 	assert(args);
 
 	switch (r->method) {
-	case KMETHOD_GET:
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
 		get(r, args);
 		break;
-	case KMETHOD_POST:
+	case REQ_METHOD_POST:
 		post(r);
 		break;
 	default:
-		route_status(r, KHTTP_400, KMIME_TEXT_HTML);
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
 
 void
-route_paste_download(struct kreq *r, const char * const *args)
+route_paste_download(struct req *r, const char * const *args)
 {
 	assert(r);
 	assert(args);
 
 	switch (r->method) {
-	case KMETHOD_GET:
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
 		get_download(r, args);
 		break;
 	default:
-		route_status(r, KHTTP_400, KMIME_TEXT_HTML);
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
 
 void
-route_paste_raw(struct kreq *r, const char * const *args)
+route_paste_raw(struct req *r, const char * const *args)
 {
 	assert(r);
 	assert(args);
 
 	switch (r->method) {
-	case KMETHOD_GET:
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
 		get_raw(r, args);
 		break;
 	default:
-		route_status(r, KHTTP_400, KMIME_TEXT_HTML);
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
 
 void
-route_paste_new(struct kreq *r, const char * const *args)
+route_paste_new(struct req *r, const char * const *args)
 {
 	assert(r);
 	assert(args);
 
 	switch (r->method) {
-	case KMETHOD_GET:
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
 		get_new(r, args);
 		break;
-	case KMETHOD_POST:
+	case REQ_METHOD_POST:
 		post(r);
 		break;
 	default:
-		route_status(r, KHTTP_400, KMIME_TEXT_HTML);
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
@@ -24,25 +24,25 @@
  * \brief Routes /paste.
  */
 
-struct kreq;
+struct req;
 
 /**
  * Implement /paste route.
  */
 void
-route_paste(struct kreq *r, const char * const *args);
+route_paste(struct req *r, const char * const *args);
 
 /**
  * Implement /paste/download/<id> route.
  */
 void
-route_paste_download(struct kreq *r, const char * const *args);
+route_paste_download(struct req *r, const char * const *args);
 
 /**
  * Implement /paste/raw/<id> route.
  */
 void
-route_paste_raw(struct kreq *r, const char * const *args);
+route_paste_raw(struct req *r, const char * const *args);
 
 /**
  * Implements:
@@ -51,6 +51,6 @@ route_paste_raw(struct kreq *r, const char * const *args);
  * - /paste/new
  */
 void
-route_paste_new(struct kreq *r, const char * const *args);
+route_paste_new(struct req *r, const char * const *args);
 
 #endif /* !TMPUPD_ROUTE_PASTE */
@@ -0,0 +1,189 @@
+/*
+ * route-search.c -- route /search
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "db-paste.h"
+#include "db.h"
+#include "http.h"
+#include "log.h"
+#include "paste.h"
+#include "route-search.h"
+#include "route.h"
+#include "tmpupd.h"
+#include "util.h"
+
+#include "html/search.h"
+
+#define TAG "route-search: "
+
+#define LIMIT 20
+
+struct self {
+	struct db db;
+	struct req *req;
+	struct html html;
+	const char *query;
+};
+
+enum {
+	KW_QUERY,
+	KW_RESULTS
+};
+
+static const char * const keywords[] = {
+	[KW_QUERY]   = "query",
+	[KW_RESULTS] = "results"
+};
+
+static const char marks[] = {
+	DB_PASTE_MARK_OPEN,
+	DB_PASTE_MARK_CLOSE,
+	'\0'
+};
+
+static const char *
+url(const char *fmt, ...)
+{
+	static _Thread_local char ret[128];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(ret, sizeof (ret), fmt, ap);
+	va_end(ap);
+
+	return ret;
+}
+
+/*
+ * The text is escaped as usual and every match is wrapped in a mark
+ * element.
+ */
+static void
+format_snippet(struct self *self, const char *snippet)
+{
+	size_t len;
+
+	for (const char *p = snippet; *p; p += len) {
+		len = 1;
+
+		if (*p == DB_PASTE_MARK_OPEN)
+			html_elem(&self->html, "mark");
+		else if (*p == DB_PASTE_MARK_CLOSE)
+			html_closeelem(&self->html, 1);
+		else {
+			len = strcspn(p, marks);
+			html_printf(&self->html, "%.*s", (int)len, p);
+		}
+	}
+}
+
+static int
+result(const struct paste *paste, const char *snippet, void *data)
+{
+	struct self *self = data;
+
+	html_elem(&self->html, "tr");
+
+	/* id */
+	html_elem(&self->html, "td");
+	html_attr(&self->html, "a",
+	    "href", url("paste/%s", paste->id),
+	    NULL);
+	html_printf(&self->html, "%s", paste->id);
+	html_closeelem(&self->html, 2);
+
+	/* title */
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", paste->title);
+	html_closeelem(&self->html, 1);
+
+	/* author */
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", paste->author);
+	html_closeelem(&self->html, 1);
+
+	/* match */
+	html_elem(&self->html, "td");
+	html_elem(&self->html, "pre");
+	format_snippet(self, snippet);
+	html_closeelem(&self->html, 2);
+
+	/* expiration */
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", tmpupd_expiresin(paste->end));
+	html_closeelem(&self->html, 1);
+
+	html_closeelem(&self->html, 1);
+
+	return self->req->error ? -1 : 0;
+}
+
+static int
+format(size_t index, void *arg)
+{
+	struct self *self = arg;
+
+	switch (index) {
+	case KW_QUERY:
+		if (self->query)
+			html_printf(&self->html, "%s", self->query);
+		break;
+	case KW_RESULTS:
+		if (self->query && db_paste_search(self->query, LIMIT, result, self, &self->db) < 0)
+			log_warn(TAG "unable to search '%s': %s", self->query, self->db.error);
+		break;
+	default:
+		break;
+	}
+
+	return 1;
+}
+
+void
+route_search(struct req *r, const char * const *args)
+{
+	(void)args;
+
+	assert(r);
+
+	struct self self = {
+		.req = r,
+		.query = req_field(r, "q")
+	};
+	struct html_template kt = {
+		.key = keywords,
+		.keysz = LEN(keywords),
+		.cb = format,
+		.arg = &self
+	};
+
+	if (tmpupd_open(&self.db, DB_RDONLY) < 0) {
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
+		return;
+	}
+
+	html_open(&self.html, self.req);
+	route_template(r, "search", 200, &kt, html_search, sizeof (html_search));
+	html_close(&self.html);
+
+	db_finish(&self.db);
+}
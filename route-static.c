@@ -35,16 +35,16 @@
 static struct entry {
 	const char *path;
 	const unsigned char *data;
-	enum kmime mime;
+	enum req_mime mime;
 	size_t datasz;
 } table[] = {
-	STATIC("normalize.css", static_normalize, KMIME_TEXT_CSS),
-	STATIC("style.css",     static_style, KMIME_TEXT_CSS),
-	STATIC("dosis.ttf",     static_dosis, KMIME_APP_OCTET_STREAM)
+	STATIC("normalize.css", static_normalize, REQ_MIME_TEXT_CSS),
+	STATIC("style.css",     static_style, REQ_MIME_TEXT_CSS),
+	STATIC("dosis.ttf",     static_dosis, REQ_MIME_APP_OCTET_STREAM)
 };
 
 static void
-get(struct kreq *req, const char *file)
+get(struct req *req, const char *file)
 {
 	const struct entry *ent = NULL;
 
@@ -56,27 +56,28 @@ get(struct kreq *req, const char *file)
 	}
 
 	if (ent) {
-		khttp_head(req, kresps[KRESP_STATUS], "%s", khttps[KHTTP_200]);
-		khttp_head(req, kresps[KRESP_CONTENT_TYPE], "%s", kmimetypes[ent->mime]);
-		khttp_head(req, kresps[KRESP_CONTENT_LENGTH], "%zu", ent->datasz);
-		khttp_body(req);
-		khttp_write(req, (const char *)ent->data, ent->datasz);
+		req_status(req, 200);
+		req_head(req, "Content-Type", "%s", req_mimes[ent->mime]);
+		req_head(req, "Content-Length", "%zu", ent->datasz);
+		req_body(req);
+		req_write(req, ent->data, ent->datasz);
 	} else
-		route_status(req, KHTTP_404, KMIME_TEXT_HTML);
+		route_status(req, 404, REQ_MIME_TEXT_HTML);
 }
 
 void
-route_static(struct kreq *r, const char * const *args)
+route_static(struct req *r, const char * const *args)
 {
 	assert(r);
 	assert(args);
 
 	switch (r->method) {
-	case KMETHOD_GET:
+	case REQ_METHOD_GET:
+	case REQ_METHOD_HEAD:
 		get(r, args[0]);
 		break;
 	default:
-		route_status(r, KHTTP_400, KMIME_TEXT_HTML);
+		route_status(r, 400, REQ_MIME_TEXT_HTML);
 		break;
 	}
 }
@@ -24,12 +24,12 @@
  * \brief Route /static.
  */
 
-struct kreq;
+struct req;
 
 /**
  * Implement /static/<res> route.
  */
 void
-route_static(struct kreq *, const char * const * args);
+route_static(struct req *, const char * const * args);
 
 #endif /* !TMPUPD_ROUTE_STATIC_H */
@@ -0,0 +1,304 @@
+/*
+ * route-stats.c -- route /stats
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "db-counter.h"
+#include "db.h"
+#include "http.h"
+#include "log.h"
+#include "route-stats.h"
+#include "route.h"
+#include "stats.h"
+#include "tmpupd.h"
+#include "util.h"
+
+#include "html/stats.h"
+
+#define TAG "route-stats: "
+
+struct language {
+	char *name;
+	size_t count;
+};
+
+struct hour {
+	time_t start;
+	size_t pastes;
+	size_t images;
+};
+
+/*
+ * Everything is read before the page is written so that no statement is
+ * still running while writing to a possibly slow client.
+ */
+struct self {
+	struct req *req;
+	struct html html;
+	struct db_counter counter;
+	int counted;
+	struct stats server;
+	struct language *languages;
+	size_t languagesz;
+	struct hour hours[DB_COUNTER_HOURS];
+	size_t hoursz;
+};
+
+enum {
+	KW_HOURS,
+	KW_LANGUAGES,
+	KW_SERVER,
+	KW_TOTALS
+};
+
+static const char * const keywords[] = {
+	[KW_HOURS]     = "hours",
+	[KW_LANGUAGES] = "languages",
+	[KW_SERVER]    = "server",
+	[KW_TOTALS]    = "totals"
+};
+
+static int
+language(const char *name, size_t count, void *data)
+{
+	struct self *self = data;
+	struct language *language;
+
+	self->languages = ereallocarray(self->languages, self->languagesz + 1,
+	    sizeof (*self->languages));
+
+	language = &self->languages[self->languagesz++];
+	language->name = estrdup(name);
+	language->count = count;
+
+	return 0;
+}
+
+static int
+hour(time_t start, size_t pastes, size_t images, void *data)
+{
+	struct self *self = data;
+
+	/* Only the last hours are kept, it should not be more. */
+	if (self->hoursz >= LEN(self->hours))
+		return 0;
+
+	self->hours[self->hoursz].start = start;
+	self->hours[self->hoursz].pastes = pastes;
+	self->hours[self->hoursz++].images = images;
+
+	return 0;
+}
+
+static int
+load(struct self *self)
+{
+	struct db db;
+
+	if (tmpupd_open(&db, DB_RDONLY) < 0)
+		return -1;
+
+	if (db_counter_get(&self->counter, &db) < 0)
+		log_warn(TAG "unable to get counters: %s", db.error);
+	else
+		self->counted = 1;
+
+	if (db_counter_languages(language, self, &db) < 0)
+		log_warn(TAG "unable to list languages: %s", db.error);
+	if (db_counter_hours(hour, self, &db) < 0)
+		log_warn(TAG "unable to list hours: %s", db.error);
+
+	db_finish(&db);
+
+	/* Summed over every worker and the supervisor. */
+	stats_sum(&self->server);
+
+	return 0;
+}
+
+static void
+total(struct self *self, const char *name, size_t count, size_t bytes)
+{
+	html_elem(&self->html, "tr");
+
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", name);
+	html_closeelem(&self->html, 1);
+
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%zu", count);
+	html_closeelem(&self->html, 1);
+
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", tmpupd_size(bytes));
+	html_closeelem(&self->html, 1);
+
+	html_closeelem(&self->html, 1);
+}
+
+static void
+format_totals(struct self *self)
+{
+	if (!self->counted)
+		return;
+
+	total(self, "pastes", self->counter.pastes, self->counter.pastes_bytes);
+	total(self, "images", self->counter.images, self->counter.images_bytes);
+}
+
+static void
+counter(struct self *self, const char *name, const char *value)
+{
+	html_elem(&self->html, "tr");
+
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", name);
+	html_closeelem(&self->html, 1);
+
+	html_elem(&self->html, "td");
+	html_printf(&self->html, "%s", value);
+	html_closeelem(&self->html, 1);
+
+	html_closeelem(&self->html, 1);
+}
+
+static void
+format_server(struct self *self)
+{
+	const struct stats *st = &self->server;
+	char value[32];
+
+	snprintf(value, sizeof (value), "%ju", (uintmax_t)st->requests);
+	counter(self, "requests", value);
+	snprintf(value, sizeof (value), "%ju", (uintmax_t)st->errors);
+	counter(self, "errors", value);
+	counter(self, "received", tmpupd_size(st->received));
+	counter(self, "sent", tmpupd_size(st->sent));
+	snprintf(value, sizeof (value), "%ju", (uintmax_t)st->optimized);
+	counter(self, "images recompressed", value);
+	counter(self, "recompression saved", tmpupd_size(st->original - st->shrunk));
+}
+
+static void
+format_languages(struct self *self)
+{
+	for (size_t i = 0; i < self->languagesz && !self->req->error; ++i) {
+		html_elem(&self->html, "tr");
+
+		html_elem(&self->html, "td");
+		html_printf(&self->html, "%s", self->languages[i].name);
+		html_closeelem(&self->html, 1);
+
+		html_elem(&self->html, "td");
+		html_printf(&self->html, "%zu", self->languages[i].count);
+		html_closeelem(&self->html, 1);
+
+		html_closeelem(&self->html, 1);
+	}
+}
+
+static void
+format_hours(struct self *self)
+{
+	struct tm tm;
+	char date[32];
+
+	for (size_t i = 0; i < self->hoursz && !self->req->error; ++i) {
+		date[0] = '\0';
+
+		if (gmtime_r(&self->hours[i].start, &tm))
+			strftime(date, sizeof (date), "%Y-%m-%d %H:00 UTC", &tm);
+
+		html_elem(&self->html, "tr");
+
+		html_elem(&self->html, "td");
+		html_printf(&self->html, "%s", date);
+		html_closeelem(&self->html, 1);
+
+		html_elem(&self->html, "td");
+		html_printf(&self->html, "%zu", self->hours[i].pastes);
+		html_closeelem(&self->html, 1);
+
+		html_elem(&self->html, "td");
+		html_printf(&self->html, "%zu", self->hours[i].images);
+		html_closeelem(&self->html, 1);
+
+		html_closeelem(&self->html, 1);
+	}
+}
+
+static int
+format(size_t index, void *arg)
+{
+	struct self *self = arg;
+
+	switch (index) {
+	case KW_TOTALS:
+		format_totals(self);
+		break;
+	case KW_LANGUAGES:
+		format_languages(self);
+		break;
+	case KW_HOURS:
+		format_hours(self);
+		break;
+	case KW_SERVER:
+		format_server(self);
+		break;
+	default:
+		break;
+	}
+
+	return 1;
+}
+
+void
+route_stats(struct req *r, const char * const *args)
+{
+	(void)args;
+
+	assert(r);
+
+	struct self self = {
+		.req = r
+	};
+	struct html_template kt = {
+		.key = keywords,
+		.keysz = LEN(keywords),
+		.cb = format,
+		.arg = &self
+	};
+
+	if (load(&self) < 0) {
+		route_status(r, 500, REQ_MIME_TEXT_HTML);
+		return;
+	}
+
+	html_open(&self.html, self.req);
+	route_template(r, "statistics", 200, &kt, html_stats, sizeof (html_stats));
+	html_close(&self.html);
+
+	for (size_t i = 0; i < self.languagesz; ++i)
+		free(self.languages[i].name);
+
+	free(self.languages);
+}
@@ -17,9 +17,15 @@
  */
 
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "http.h"
+#include "json-write.h"
 #include "route.h"
 #include "tmp.h"
 #include "util.h"
@@ -27,53 +33,58 @@
 #include "html/header.h"
 #include "html/footer.h"
 
-static const struct status {
-	enum khttp code;
-	const char *message;
-} table[] = {
-	{ KHTTP_201, "Created"                  },
-	{ KHTTP_400, "Bad request"              },
-	{ KHTTP_404, "Not found"                }
-};
+/* Ranges accepted in one request, the whole content is sent otherwise. */
+#define RANGES_MAX 16
 
 enum {
 	KW_TITLE
 };
 
+struct range {
+	size_t first;
+	size_t last;
+};
+
 static const char * const keywords[] = {
 	[KW_TITLE] = "title"
 };
 
 static int
-compare(const void *key, const void *value)
+output(void *data, const void *buf, size_t bufsz)
 {
-	const enum khttp *code = key;
-	const struct status *status = value;
+	struct req *r = data;
 
-	return *code - status->code;
+	req_write(r, buf, bufsz);
+
+	return r->error ? -1 : 0;
 }
 
-static inline const char *
-message(enum khttp code)
+/*
+ * Replies are small and frequent, they are written compact directly into
+ * the response instead of being built with jansson first.
+ */
+static void
+json(struct req *r, const char *fmt, va_list ap)
 {
-	const struct status *rv;
-
-	rv = bsearch(&code, table, LEN(table), sizeof (*rv), compare);
+	struct json_write jw;
 
-	return rv ? rv->message : "unknown error";
+	json_write_init(&jw, output, r);
+	json_write_vpack(&jw, fmt, ap);
+	json_write_finish(&jw);
 }
 
-static inline char *
-json(enum khttp code, const char *msg)
+static void
+pack(struct req *r, const char *fmt, ...)
 {
-	return tmp_json("{si ss}",
-		"status",       code,
-		"message",      msg
-	);
+	va_list ap;
+
+	va_start(ap, fmt);
+	json(r, fmt, ap);
+	va_end(ap);
 }
 
 struct hdrdata {
-	struct kreq *r;
+	struct html html;
 	const char *title;
 };
 
@@ -84,7 +95,7 @@ format(size_t index, void *data)
 
 	switch (index) {
 	case KW_TITLE:
-		khttp_printf(hdr->r, "%s", hdr->title);
+		html_printf(&hdr->html, "%s", hdr->title);
 		break;
 	default:
 		break;
@@ -94,94 +105,295 @@ format(size_t index, void *data)
 }
 
 static void
-header(struct kreq *r, const char *title)
+header(struct req *r, const char *title)
 {
 	struct hdrdata hdr = {
-		.r = r,
 		.title = title
 	};
-	struct ktemplate kt = {
+	struct html_template kt = {
 		.key = keywords,
 		.keysz = LEN(keywords),
 		.cb = format,
 		.arg = &hdr
 	};
 
-	khttp_template_buf(r, &kt, (const char *)html_header, sizeof (html_header));
+	html_open(&hdr.html, r);
+	html_template(r, &kt, (const char *)html_header, sizeof (html_header));
+	html_close(&hdr.html);
 }
 
 static inline void
-footer(struct kreq *r)
+footer(struct req *r)
 {
-	khttp_template_buf(r, NULL, (const char *)html_footer, sizeof (html_footer));
+	html_template(r, NULL, (const char *)html_footer, sizeof (html_footer));
 }
 
 void
-route_template(struct kreq *r,
-              const char *title,
-              enum khttp code,
-              const struct ktemplate *kt,
-              const unsigned char *html,
-              size_t htmlsz)
+route_template(struct req *r,
+               const char *title,
+               int code,
+               const struct html_template *kt,
+               const unsigned char *html,
+               size_t htmlsz)
 {
 	assert(r);
 	assert(title);
 	assert(kt);
 	assert(html);
 
-	khttp_head(r, kresps[KRESP_STATUS], "%s", khttps[code]);
-	khttp_head(r, kresps[KRESP_CONTENT_TYPE], "%s", kmimetypes[KMIME_TEXT_HTML]);
-	khttp_body(r);
+	req_status(r, code);
+	req_head(r, "Content-Type", "%s", req_mimes[REQ_MIME_TEXT_HTML]);
+	req_body(r);
 	header(r, title);
-	khttp_template_buf(r, kt, (const char *)html, htmlsz);
+	html_template(r, kt, (const char *)html, htmlsz);
 	footer(r);
 }
 
 void
-route_status(struct kreq *r, enum khttp code, enum kmime mime)
+route_status(struct req *r, int code, enum req_mime mime)
 {
 	assert(r);
 
 	const char *msg;
-	char *body = NULL;
 
-	khttp_head(r, kresps[KRESP_STATUS], "%s", khttps[code]);
-	khttp_head(r, kresps[KRESP_CONTENT_TYPE], "%s", kmimetypes[mime]);
-	khttp_body(r);
+	req_status(r, code);
+	req_head(r, "Content-Type", "%s", req_mimes[mime]);
+	req_body(r);
 
-	msg = message(code);
+	msg = req_reason(code);
 
 	switch (mime) {
-	case KMIME_TEXT_HTML:
-		body = estrdup(msg);
+	case REQ_MIME_TEXT_HTML:
+	case REQ_MIME_TEXT_PLAIN:
+		req_printf(r, "%s\n", msg);
 		break;
-	case KMIME_APP_JSON:
-		body = json(code, msg);
+	case REQ_MIME_APP_JSON:
+		pack(r, "{si ss}",
+			"status",       code,
+			"message",      msg
+		);
 		break;
 	default:
 		break;
 	}
+}
+
+static int
+number(const char *s, unsigned long long *val, char **end)
+{
+	if (!isdigit((unsigned char)*s))
+		return -1;
+
+	errno = 0;
+	*val = strtoull(s, end, 10);
+
+	return errno ? -1 : 0;
+}
+
+/*
+ * Parse one byte range specification, returns 1 if satisfiable, 0 if not
+ * and -1 if invalid.
+ */
+static int
+spec(const char *s, size_t size, struct range *range)
+{
+	unsigned long long first, last;
+	char *end;
+
+	/* Suffix form, the last N bytes. */
+	if (*s == '-') {
+		if (number(s + 1, &last, &end) < 0 || *end)
+			return -1;
+		if (last == 0 || size == 0)
+			return 0;
+
+		range->first = last >= size ? 0 : size - last;
+		range->last = size - 1;
+
+		return 1;
+	}
+
+	if (number(s, &first, &end) < 0 || *end++ != '-')
+		return -1;
+	if (*end == '\0')
+		last = ULLONG_MAX;
+	else if (number(end, &last, &end) < 0 || *end || last < first)
+		return -1;
+	if (first >= size)
+		return 0;
 
-	khttp_printf(r, "%s\n", body);
-	free(body);
+	range->first = first;
+	range->last = last >= size ? size - 1 : last;
+
+	return 1;
+}
+
+/*
+ * Parse the Range header value, returns the number of satisfiable ranges, 0
+ * if the whole content should be sent or -1 if none is satisfiable.
+ */
+static int
+ranges(const char *value, size_t size, struct range *list)
+{
+	char *copy, *tok, *save, *end;
+	int rv, count = 0, invalid = 0, unsatisfiable = 0;
+
+	if (!value || strncmp(value, "bytes=", 6) != 0)
+		return 0;
+
+	copy = estrdup(value + 6);
+
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		while (isblank((unsigned char)*tok))
+			++tok;
+		for (end = tok + strlen(tok); end > tok && isblank((unsigned char)end[-1]); )
+			*--end = '\0';
+
+		/* Empty elements are allowed by the grammar. */
+		if (*tok == '\0')
+			continue;
+		if (count == RANGES_MAX || (rv = spec(tok, size, &list[count])) < 0) {
+			invalid = 1;
+			break;
+		}
+		if (rv)
+			++count;
+		else
+			++unsatisfiable;
+	}
+
+	free(copy);
+
+	if (invalid)
+		return 0;
+	if (count == 0)
+		return unsatisfiable ? -1 : 0;
+
+	return count;
+}
+
+static int
+part(char *buf, size_t bufsz, const char *boundary, const char *mime,
+     const struct range *range, size_t size)
+{
+	return snprintf(buf, bufsz,
+	    "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %zu-%zu/%zu\r\n\r\n",
+	    boundary, mime, range->first, range->last, size);
+}
+
+static void
+multipart(struct req *r,
+          const char *mime,
+          size_t size,
+          const struct range *list,
+          int count,
+          route_download_fn fn,
+          void *data)
+{
+	char *boundary, head[512];
+	size_t length = 0;
+	int len;
+
+	boundary = tmp_id();
+
+	for (int i = 0; i < count; ++i)
+		length += part(NULL, 0, boundary, mime, &list[i], size) +
+		    list[i].last - list[i].first + 1;
+
+	length += strlen(boundary) + 8;
+
+	req_status(r, 206);
+	req_head(r, "Content-Type", "multipart/byteranges; boundary=%s", boundary);
+	req_head(r, "Content-Length", "%zu", length);
+	req_body(r);
+
+	for (int i = 0; i < count && !r->error; ++i) {
+		len = part(head, sizeof (head), boundary, mime, &list[i], size);
+		req_write(r, head, len);
+
+		/* The reply would be short, the connection must be closed. */
+		if (fn(data, list[i].first, list[i].last - list[i].first + 1) < 0)
+			r->error = 1;
+	}
+
+	if (!r->error)
+		req_printf(r, "\r\n--%s--\r\n", boundary);
+
+	free(boundary);
 }
 
 void
-route_json(struct kreq *r, enum khttp code, const char *fmt, ...)
+route_download(struct req *r,
+               const char *mime,
+               size_t size,
+               route_download_fn fn,
+               void *data)
+{
+	assert(r);
+	assert(mime);
+	assert(fn);
+
+	struct range list[RANGES_MAX];
+	size_t first = 0, length = size;
+	int count = 0;
+
+	req_head(r, "Accept-Ranges", "bytes");
+
+	/* Ranges only apply to GET. */
+	if (r->method == REQ_METHOD_GET)
+		count = ranges(req_header(r, "Range"), size, list);
+
+	if (count < 0) {
+		req_status(r, 416);
+		req_head(r, "Content-Range", "bytes */%zu", size);
+		req_body(r);
+	} else if (count > 1)
+		multipart(r, mime, size, list, count, fn, data);
+	else {
+		if (count == 1) {
+			first = list[0].first;
+			length = list[0].last - first + 1;
+			req_status(r, 206);
+			req_head(r, "Content-Range", "bytes %zu-%zu/%zu",
+			    list[0].first, list[0].last, size);
+		} else
+			req_status(r, 200);
+
+		req_head(r, "Content-Type", "%s", mime);
+		req_head(r, "Content-Length", "%zu", length);
+		req_body(r);
+
+		/* Same as above, the length is already sent. */
+		if (r->method != REQ_METHOD_HEAD && length && fn(data, first, length) < 0)
+			r->error = 1;
+	}
+}
+
+void
+route_json_open(struct req *r, int code, struct json_write *jw)
+{
+	assert(r);
+	assert(jw);
+
+	req_status(r, code);
+	req_head(r, "Content-Type", "%s", req_mimes[REQ_MIME_APP_JSON]);
+	req_body(r);
+	json_write_init(jw, output, r);
+}
+
+void
+route_json(struct req *r, int code, const char *fmt, ...)
 {
 	assert(r);
 	assert(fmt);
 
 	va_list ap;
-	char *dump;
+
+	req_status(r, code);
+	req_head(r, "Content-Type", "%s", req_mimes[REQ_MIME_APP_JSON]);
+	req_body(r);
 
 	va_start(ap, fmt);
-	dump = tmp_jsonv(fmt, ap);
+	json(r, fmt, ap);
 	va_end(ap);
-
-	khttp_head(r, kresps[KRESP_STATUS], "%s", khttps[code]);
-	khttp_head(r, kresps[KRESP_CONTENT_TYPE], "%s", kmimetypes[KMIME_APP_JSON]);
-	khttp_body(r);
-	khttp_printf(r, "%s\n", dump);
-	free(dump);
 }
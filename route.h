@@ -24,13 +24,22 @@
  * \brief Page helpers.
  */
 
-#include <sys/types.h>
 #include <stdarg.h>
 #include <stddef.h>
-#include <stdint.h>
 
-#include <kcgi.h>
-#include <kcgihtml.h>
+#include "html.h"
+#include "json-write.h"
+#include "req.h"
+
+/**
+ * Function writing a portion of a download using ::req_write.
+ *
+ * \param data optional user data
+ * \param offset the first byte to write
+ * \param length the number of bytes to write
+ * \return 0 on success or -1 to stop, the connection is then closed
+ */
+typedef int (*route_download_fn)(void *data, size_t offset, size_t length);
 
 /**
  * Render the route using the HTML template.
@@ -38,41 +47,79 @@
  * \pre r != NULL
  * \pre title != NULL
  * \pre html != NULL
- * \param r the kcgi request
+ * \param r the request
  * \param title route title
  * \param code HTTP result code
+ * \param kt the template keywords
  * \param html the HTML template
  * \param htmlsz HTML data length
  */
 void
-route_template(struct kreq *r,
-              const char *title,
-              enum khttp code,
-              const struct ktemplate *kt,
-              const unsigned char *html,
-              size_t htmlsz);
+route_template(struct req *r,
+               const char *title,
+               int code,
+               const struct html_template *kt,
+               const unsigned char *html,
+               size_t htmlsz);
 
 /**
  * Create a status route either in the form of HTML or JSON depending on the
  * mime type.
  *
  * \pre r != NULL
- * \param r the kcgi request
+ * \param r the request
+ * \param code HTTP result code
+ * \param mime the mime type (REQ_MIME_APP_JSON or REQ_MIME_TEXT_HTML)
+ */
+void
+route_status(struct req *r, int code, enum req_mime mime);
+
+/**
+ * Start a JSON result route of arbitrary length, the document is written
+ * with the json_write_* functions and terminated by ::json_write_finish.
+ *
+ * \pre r != NULL
+ * \pre jw != NULL
+ * \param r the request
  * \param code HTTP result code
- * \param mime the mime type (KMIME_APP_JSON or KMIME_TEXT_HTML)
+ * \param jw the writer to initialize
  */
 void
-route_status(struct kreq *r, enum khttp code, enum kmime mime);
+route_json_open(struct req *r, int code, struct json_write *jw);
 
 /**
- * Create a JSON result route using the jansson packing function.
+ * Create a compact JSON result route.
  *
  * \pre r != NULL
- * \param r the kcgi request
+ * \param r the request
  * \param code HTTP result code
- * \param fmt the format string to pass to json_pack
+ * \param fmt the format string as accepted by ::json_write_vpack
+ */
+void
+route_json(struct req *r, int code, const char *fmt, ...);
+
+/**
+ * Send a download of a given size honoring HEAD and byte Range requests.
+ *
+ * A single range is answered with 206 and multiple ranges with a
+ * multipart/byteranges body, unsatisfiable ranges give 416. The function is
+ * never called for HEAD requests. Resource specific headers must be added
+ * before.
+ *
+ * \pre r != NULL
+ * \pre mime != NULL
+ * \pre fn != NULL
+ * \param r the request
+ * \param mime the content type
+ * \param size the total content size
+ * \param fn the function writing the content
+ * \param data the function user data
  */
 void
-route_json(struct kreq *r, enum khttp code, const char *fmt, ...);
+route_download(struct req *r,
+               const char *mime,
+               size_t size,
+               route_download_fn fn,
+               void *data);
 
 #endif /* !TMPUPD_ROUTE_STATUS */
@@ -0,0 +1,7 @@
+select `paste`.`count`
+     , `paste`.`bytes`
+     , `image`.`count`
+     , `image`.`bytes`
+  from `counter` as `paste`
+  join `counter` as `image` on `image`.`key` = 'image'
+ where `paste`.`key` = 'paste'
@@ -0,0 +1,5 @@
+  select `hour`
+       , `pastes`
+       , `images`
+    from `counter_hour`
+order by `hour` desc
@@ -0,0 +1,5 @@
+  select `language`
+       , `count`
+    from `counter_language`
+order by `count` desc
+       , `language`
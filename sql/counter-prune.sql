@@ -0,0 +1,3 @@
+delete
+  from `counter_hour`
+ where `hour` < ?
@@ -0,0 +1,12 @@
+    select length(`image`.`data`)
+         , `image`.`id`
+         , `image`.`title`
+         , `image`.`author`
+         , `image`.`filename`
+         , case when ?1 then `image`.`data` end
+         , `image`.`start`
+         , `image`.`end`
+         , `image`.`visible`
+      from json_each(?2) as `ids`
+cross join `image` on `image`.`id` = `ids`.`value`
+  order by `ids`.`key`
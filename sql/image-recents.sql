@@ -1,6 +1,15 @@
   select length(`data`)
-       , *
+       , `id`
+       , `title`
+       , `author`
+       , `filename`
+       , NULL
+       , `start`
+       , `end`
+       , `visible`
     from `image`
    where `visible` = 1
+     and (`start`, `id`) < (?1, ?2)
 order by `start` desc
-   limit ?
+       , `id` desc
+   limit ?3
@@ -0,0 +1,10 @@
+insert into `image`(
+	`id`,
+	`title`,
+	`author`,
+	`filename`,
+	`data`,
+	`start`,
+	`end`,
+	`visible`
+) values (?, ?, ?, ?, zeroblob(?), ?, ?, ?)
@@ -0,0 +1,12 @@
+select `rowid`
+     , `id`
+     , `title`
+     , `author`
+     , `filename`
+     , length(`data`)
+     , `start`
+     , `end`
+     , `visible`
+  from `image`
+ where `id` = ?
+ limit 1
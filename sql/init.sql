@@ -1,3 +1,7 @@
+-- Readers never block writers, downloads and raw pastes are streamed to the
+-- client from open blobs and statements which may take a while.
+pragma journal_mode = wal;
+
 create table if not exists `paste`(
 	`id`            TEXT PRIMARY KEY,
 	`title`         TEXT not NULL,
@@ -10,6 +14,12 @@ create table if not exists `paste`(
 	`visible`       INTEGER not NULL default 0
 ) STRICT;
 
+-- Listings walk the visible pastes from the newest, every column shown is
+-- in the index so that the rows are not read.
+create index if not exists `paste_recent`
+	on `paste`(`start`, `id`, `end`, `title`, `author`, `filename`, `language`)
+	where `visible` = 1;
+
 create table if not exists `image`(
 	`id`            TEXT PRIMARY KEY,
 	`title`         TEXT not NULL,
@@ -21,7 +31,339 @@ create table if not exists `image`(
 	`visible`       INTEGER not NULL default 0
 ) STRICT;
 
+-- Same for images, only the data length is read from the rows.
+create index if not exists `image_recent`
+	on `image`(`start`, `id`, `end`, `title`, `author`, `filename`)
+	where `visible` = 1;
+
 create table if not exists `setting`(
 	`key`           TEXT PRIMARY KEY,
 	`value`         TEXT not NULL
 ) STRICT;
+
+create table if not exists `upload`(
+	`id`            TEXT PRIMARY KEY,
+	`type`          TEXT not NULL,
+	`title`         TEXT not NULL,
+	`author`        TEXT not NULL,
+	`filename`      TEXT not NULL,
+	`language`      TEXT not NULL,
+	`size`          INTEGER not NULL,
+	`received`      INTEGER not NULL default 0,
+	`data`          BLOB not NULL,
+	`start`         INTEGER not NULL,
+	`end`           INTEGER not NULL,
+	`expires`       INTEGER not NULL,
+	`visible`       INTEGER not NULL default 0
+) STRICT;
+
+create table if not exists `paste_chunk`(
+	`paste_id`      TEXT not NULL,
+	`seq`           INTEGER not NULL,
+	`data`          TEXT not NULL,
+	PRIMARY KEY (`paste_id`, `seq`)
+) STRICT;
+
+create table if not exists `paste_token`(
+	`paste_id`      TEXT PRIMARY KEY,
+	`token`         TEXT not NULL
+) STRICT;
+
+-- Compressed code of a paste, its code column is then left empty.
+create table if not exists `paste_content`(
+	`paste_id`      TEXT PRIMARY KEY,
+	`codec`         TEXT not NULL,
+	`length`        INTEGER not NULL,
+	`data`          BLOB not NULL
+) STRICT;
+
+-- Paste a paste was forked from, a delta content applies to the first `base`
+-- bytes of the parent code.
+create table if not exists `paste_fork`(
+	`paste_id`      TEXT PRIMARY KEY,
+	`parent_id`     TEXT not NULL,
+	`base`          INTEGER not NULL
+) STRICT;
+
+create index if not exists `paste_fork_parent` on `paste_fork`(`parent_id`);
+
+-- Line index of the code stored at creation, appended chunks excluded: the
+-- offset of every LINES_STEP line and for a gzip content the compressed
+-- offset of every CODEC_BLOCK bytes of code.
+create table if not exists `paste_index`(
+	`paste_id`      TEXT PRIMARY KEY,
+	`offsets`       BLOB not NULL,
+	`blocks`        BLOB
+) STRICT;
+
+-- Figures of the whole code computed when saved and updated on appends so
+-- that listings never read the code, tail tells if the last line has no
+-- newline yet.
+create table if not exists `paste_summary`(
+	`paste_id`      TEXT PRIMARY KEY,
+	`size`          INTEGER not NULL,
+	`lines`         INTEGER not NULL,
+	`tail`          INTEGER not NULL,
+	`preview`       TEXT not NULL
+) STRICT;
+
+create trigger if not exists `paste_delete` after delete on `paste`
+begin
+	delete from `paste_content` where `paste_id` = old.`id`;
+	delete from `paste_fork` where `paste_id` = old.`id`;
+	delete from `paste_index` where `paste_id` = old.`id`;
+	delete from `paste_summary` where `paste_id` = old.`id`;
+	delete from `paste_chunk` where `paste_id` = old.`id`;
+	delete from `paste_token` where `paste_id` = old.`id`;
+end;
+
+-- Pastes with the appended chunks joined to their code, the compressed code
+-- comes first when there is one and a delta applies to the parent code.
+create view if not exists `paste_view` as
+select `paste`.`id`
+     , `paste`.`title`
+     , `paste`.`author`
+     , `paste`.`filename`
+     , `paste`.`language`
+     , `paste`.`code` || coalesce((
+        select group_concat(`data`, '')
+          from (
+                select `data`
+                  from `paste_chunk`
+                 where `paste_id` = `paste`.`id`
+              order by `seq`
+          )
+       ), '') as `code`
+     , `paste`.`start`
+     , `paste`.`end`
+     , `paste`.`visible`
+     , `paste_content`.`codec`
+     , `paste_content`.`length`
+     , `paste_content`.`data` as `content`
+     , `paste_fork`.`parent_id` as `parent`
+     , `paste_fork`.`base`
+     , `paste_summary`.`size`
+     , `paste_summary`.`lines`
+     , `paste_summary`.`preview`
+     from `paste`
+left join `paste_content` on `paste_content`.`paste_id` = `paste`.`id`
+left join `paste_fork` on `paste_fork`.`paste_id` = `paste`.`id`
+left join `paste_summary` on `paste_summary`.`paste_id` = `paste`.`id`;
+
+-- Text searched in visible pastes, paste_code() rebuilds the code as saved
+-- as it may be compressed or a delta. Appended chunks are not searched.
+-- Recreated as first versions also listed hidden pastes.
+drop view if exists `paste_text`;
+
+create view `paste_text` as
+select `rowid` as `row_id`
+     , `title`
+     , `author`
+     , `filename`
+     , paste_code(`id`) as `code`
+  from `paste`
+ where `visible`;
+
+create virtual table if not exists `paste_fts` using fts5(
+	`title`,
+	`author`,
+	`filename`,
+	`code`,
+	content = 'paste_text',
+	content_rowid = 'row_id',
+	tokenize = "unicode61 tokenchars '_'"
+);
+
+-- The code must be stored before the paste row is inserted and is still
+-- there before it is deleted, the index needs the same text both times.
+--
+-- paste_code() only exists in tmpupd connections, inserting or deleting
+-- visible pastes from the sqlite3 shell fails with "no such function". To
+-- edit pastes by hand, drop both triggers and delete the paste_fts setting
+-- below, tmpupd recreates the triggers and rebuilds the index on start.
+create trigger if not exists `paste_fts_insert` after insert on `paste`
+when new.`visible`
+begin
+	insert into `paste_fts`(`rowid`, `title`, `author`, `filename`, `code`)
+	values (new.`rowid`, new.`title`, new.`author`, new.`filename`, paste_code(new.`id`));
+end;
+
+create trigger if not exists `paste_fts_delete` before delete on `paste`
+when old.`visible`
+begin
+	insert into `paste_fts`(`paste_fts`, `rowid`, `title`, `author`, `filename`, `code`)
+	values ('delete', old.`rowid`, old.`title`, old.`author`, old.`filename`, paste_code(old.`id`));
+end;
+
+-- Pastes saved before the index existed, once. They must be indexed before
+-- being deleted as removing a row the index never had breaks it.
+insert into `paste_fts`(`paste_fts`)
+select 'rebuild'
+ where not exists (select 1 from `setting` where `key` = 'paste_fts');
+
+insert or ignore into `setting`(`key`, `value`) values ('paste_fts', 'rebuild');
+
+-- Thumbnails of an image, a NULL data means the original is used instead.
+create table if not exists `thumb`(
+	`image_id`      TEXT not NULL,
+	`size`          INTEGER not NULL,
+	`mime`          TEXT,
+	`data`          BLOB,
+	PRIMARY KEY (`image_id`, `size`)
+) STRICT;
+
+-- Sizes of an image before and after recompression.
+create table if not exists `image_optim`(
+	`image_id`      TEXT PRIMARY KEY,
+	`original`      INTEGER not NULL,
+	`optimized`     INTEGER not NULL
+) STRICT;
+
+create trigger if not exists `image_delete` after delete on `image`
+begin
+	delete from `thumb` where `image_id` = old.`id`;
+	delete from `image_optim` where `image_id` = old.`id`;
+end;
+
+-- Number of items of each kind and the bytes they store, thumbnails
+-- excluded. They are kept by the triggers below within the statement that
+-- changes the items so that they never need to be counted again.
+create table if not exists `counter`(
+	`key`           TEXT PRIMARY KEY,
+	`count`         INTEGER not NULL,
+	`bytes`         INTEGER not NULL
+) STRICT;
+
+create table if not exists `counter_language`(
+	`language`      TEXT PRIMARY KEY,
+	`count`         INTEGER not NULL
+) STRICT;
+
+-- Items created per hour, the hour is the timestamp of its beginning. Only
+-- the last hours are kept.
+create table if not exists `counter_hour`(
+	`hour`          INTEGER PRIMARY KEY,
+	`pastes`        INTEGER not NULL default 0,
+	`images`        INTEGER not NULL default 0
+) STRICT;
+
+-- Items already there when the counters are created, once. The pastes are
+-- joined to the condition so that they are not even scanned afterwards.
+insert into `counter_language`(`language`, `count`)
+     select `paste`.`language`
+          , count(*)
+       from (select 1 where not exists (select 1 from `counter` where `key` = 'paste'))
+ cross join `paste`
+   group by `paste`.`language`;
+
+insert into `counter`(`key`, `count`, `bytes`)
+select 'paste'
+     , (select count(*) from `paste`)
+     , (select coalesce(sum(length(cast(`code` as BLOB))), 0) from `paste`)
+     + (select coalesce(sum(length(`data`)), 0) from `paste_content`)
+     + (select coalesce(sum(length(cast(`data` as BLOB))), 0) from `paste_chunk`)
+ where not exists (select 1 from `counter` where `key` = 'paste');
+
+insert into `counter`(`key`, `count`, `bytes`)
+select 'image'
+     , (select count(*) from `image`)
+     , (select coalesce(sum(length(`data`)), 0) from `image`)
+ where not exists (select 1 from `counter` where `key` = 'image');
+
+create trigger if not exists `counter_paste_insert` after insert on `paste`
+begin
+	update `counter`
+	   set `count` = `count` + 1
+	     , `bytes` = `bytes` + length(cast(new.`code` as BLOB))
+	 where `key` = 'paste';
+
+	insert into `counter_language`(`language`, `count`)
+	values (new.`language`, 1)
+	    on conflict(`language`) do update set `count` = `count` + 1;
+
+	insert into `counter_hour`(`hour`, `pastes`)
+	values (unixepoch() / 3600 * 3600, 1)
+	    on conflict(`hour`) do update set `pastes` = `pastes` + 1;
+end;
+
+create trigger if not exists `counter_paste_update` after update of `code` on `paste`
+begin
+	update `counter`
+	   set `bytes` = `bytes` + length(cast(new.`code` as BLOB)) - length(cast(old.`code` as BLOB))
+	 where `key` = 'paste';
+end;
+
+create trigger if not exists `counter_paste_delete` after delete on `paste`
+begin
+	update `counter`
+	   set `count` = `count` - 1
+	     , `bytes` = `bytes` - length(cast(old.`code` as BLOB))
+	 where `key` = 'paste';
+
+	update `counter_language`
+	   set `count` = `count` - 1
+	 where `language` = old.`language`;
+
+	delete from `counter_language`
+	 where `language` = old.`language` and `count` <= 0;
+end;
+
+-- The content may replace a previous one which fires no delete trigger.
+create trigger if not exists `counter_content_insert` before insert on `paste_content`
+begin
+	update `counter`
+	   set `bytes` = `bytes` + length(new.`data`) - coalesce((
+		select length(`data`)
+		  from `paste_content`
+		 where `paste_id` = new.`paste_id`
+	       ), 0)
+	 where `key` = 'paste';
+end;
+
+create trigger if not exists `counter_content_delete` after delete on `paste_content`
+begin
+	update `counter`
+	   set `bytes` = `bytes` - length(old.`data`)
+	 where `key` = 'paste';
+end;
+
+create trigger if not exists `counter_chunk_insert` after insert on `paste_chunk`
+begin
+	update `counter`
+	   set `bytes` = `bytes` + length(cast(new.`data` as BLOB))
+	 where `key` = 'paste';
+end;
+
+create trigger if not exists `counter_chunk_delete` after delete on `paste_chunk`
+begin
+	update `counter`
+	   set `bytes` = `bytes` - length(cast(old.`data` as BLOB))
+	 where `key` = 'paste';
+end;
+
+create trigger if not exists `counter_image_insert` after insert on `image`
+begin
+	update `counter`
+	   set `count` = `count` + 1
+	     , `bytes` = `bytes` + length(new.`data`)
+	 where `key` = 'image';
+
+	insert into `counter_hour`(`hour`, `images`)
+	values (unixepoch() / 3600 * 3600, 1)
+	    on conflict(`hour`) do update set `images` = `images` + 1;
+end;
+
+create trigger if not exists `counter_image_update` after update of `data` on `image`
+begin
+	update `counter`
+	   set `bytes` = `bytes` + length(new.`data`) - length(old.`data`)
+	 where `key` = 'image';
+end;
+
+create trigger if not exists `counter_image_delete` after delete on `image`
+begin
+	update `counter`
+	   set `count` = `count` - 1
+	     , `bytes` = `bytes` - length(old.`data`)
+	 where `key` = 'image';
+end;
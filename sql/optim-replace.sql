@@ -0,0 +1,3 @@
+update `image`
+   set `data` = ?
+ where `id` = ?
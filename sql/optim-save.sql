@@ -0,0 +1,9 @@
+insert or replace into `image_optim`(
+	`image_id`,
+	`original`,
+	`optimized`
+)
+select ?
+     , ?
+     , ?
+ where exists (select 1 from `image` where `id` = ?)
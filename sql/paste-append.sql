@@ -0,0 +1,14 @@
+insert into `paste_chunk`(`paste_id`, `seq`, `data`)
+select ?1
+     , coalesce((
+        select max(`seq`)
+          from `paste_chunk`
+         where `paste_id` = ?1
+       ), 0) + 1
+     , ?2
+ where exists (
+        select 1
+          from `paste_token`
+         where `paste_id` = ?1
+           and `token` = ?3
+       )
@@ -0,0 +1,4 @@
+  select `data`
+    from `paste_chunk`
+   where `paste_id` = ?
+order by `seq`
@@ -0,0 +1,3 @@
+select `code`
+  from `paste`
+ where `id` = ?
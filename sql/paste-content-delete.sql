@@ -0,0 +1,3 @@
+delete
+  from `paste_content`
+ where `paste_id` = ?
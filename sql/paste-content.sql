@@ -0,0 +1,6 @@
+insert or replace into `paste_content`(
+	`paste_id`,
+	`codec`,
+	`length`,
+	`data`
+) values (?, ?, ?, ?)
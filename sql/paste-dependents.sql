@@ -0,0 +1,10 @@
+-- Pastes stored as a delta of a paste about to be removed, either the one
+-- given or the ones expired while the dependent is not.
+select `fork`.`paste_id`
+     , `content`.`length`
+  from `paste_fork` as `fork`
+  join `paste_content` as `content` on `content`.`paste_id` = `fork`.`paste_id`
+  join `paste` as `parent` on `parent`.`id` = `fork`.`parent_id`
+  join `paste` as `child` on `child`.`id` = `fork`.`paste_id`
+ where `content`.`codec` = 'delta'
+   and (`parent`.`id` = ?1 or (`parent`.`end` <= ?2 and `child`.`end` > ?2))
@@ -0,0 +1,13 @@
+-- Number of deltas to apply to rebuild the code of a paste.
+with recursive `chain`(`id`, `depth`) as (
+	select ?, 0
+	union all
+	select `paste_fork`.`parent_id`
+	     , `chain`.`depth` + 1
+	  from `chain`
+	  join `paste_fork` on `paste_fork`.`paste_id` = `chain`.`id`
+	  join `paste_content` on `paste_content`.`paste_id` = `chain`.`id`
+	 where `paste_content`.`codec` = 'delta'
+)
+select max(`depth`)
+  from `chain`
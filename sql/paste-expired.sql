@@ -0,0 +1,4 @@
+  select `id`
+    from `paste`
+   where `end` <= ?
+order by `rowid` desc
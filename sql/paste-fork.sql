@@ -0,0 +1,5 @@
+insert into `paste_fork`(
+	`paste_id`,
+	`parent_id`,
+	`base`
+) values (?, ?, ?)
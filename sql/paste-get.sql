@@ -1,4 +1,4 @@
 select *
-  from `paste`
+  from `paste_view`
  where `id` = ?
  limit 1
@@ -0,0 +1,5 @@
+insert or replace into `paste_index`(
+	`paste_id`,
+	`offsets`,
+	`blocks`
+) values (?, ?, ?)
@@ -0,0 +1,20 @@
+    select `paste`.`id`
+         , `paste`.`title`
+         , `paste`.`author`
+         , `paste`.`filename`
+         , `paste`.`language`
+         , case when ?1 then `paste`.`code` end
+         , `paste`.`start`
+         , `paste`.`end`
+         , `paste`.`visible`
+         , case when ?1 then `paste`.`codec` end
+         , `paste`.`length`
+         , case when ?1 then `paste`.`content` end
+         , `paste`.`parent`
+         , `paste`.`base`
+         , `paste`.`size`
+         , `paste`.`lines`
+         , `paste`.`preview`
+      from json_each(?2) as `ids`
+cross join `paste_view` as `paste` on `paste`.`id` = `ids`.`value`
+  order by `ids`.`key`
@@ -1,3 +0,0 @@
-delete
-  from `paste`
- where `end` <= ?
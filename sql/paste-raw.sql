@@ -0,0 +1,10 @@
+select `id`
+     , `code`
+     , `codec`
+     , `length`
+     , `content`
+     , `parent`
+     , `base`
+  from `paste_view`
+ where `id` = ?
+ limit 1
@@ -1,5 +1,24 @@
-  select *
-    from `paste`
-   where `visible` = 1
-order by `start` desc
-   limit ?
+   select `paste`.`id`
+        , `paste`.`title`
+        , `paste`.`author`
+        , `paste`.`filename`
+        , `paste`.`language`
+        , NULL
+        , `paste`.`start`
+        , `paste`.`end`
+        , `paste`.`visible`
+        , NULL
+        , NULL
+        , NULL
+        , NULL
+        , NULL
+        , `paste_summary`.`size`
+        , `paste_summary`.`lines`
+        , `paste_summary`.`preview`
+     from `paste`
+left join `paste_summary` on `paste_summary`.`paste_id` = `paste`.`id`
+    where `paste`.`visible` = 1
+      and (`paste`.`start`, `paste`.`id`) < (?1, ?2)
+ order by `paste`.`start` desc
+        , `paste`.`id` desc
+    limit ?3
@@ -0,0 +1,25 @@
+   select `paste`.`id`
+        , `paste`.`title`
+        , `paste`.`author`
+        , `paste`.`filename`
+        , `paste`.`language`
+        , ''
+        , `paste`.`start`
+        , `paste`.`end`
+        , `paste`.`visible`
+        , NULL
+        , NULL
+        , NULL
+        , NULL
+        , NULL
+        , `paste_summary`.`size`
+        , `paste_summary`.`lines`
+        , `paste_summary`.`preview`
+        , snippet(`paste_fts`, -1, char(2), char(3), '...', 24)
+     from `paste_fts`
+     join `paste` on `paste`.`rowid` = `paste_fts`.`rowid`
+left join `paste_summary` on `paste_summary`.`paste_id` = `paste`.`id`
+    where `paste_fts` match ?1
+      and `paste`.`end` > ?2
+ order by bm25(`paste_fts`, 8.0, 2.0, 4.0, 1.0)
+    limit ?3
@@ -0,0 +1,3 @@
+update `paste`
+   set `code` = ?2
+ where `id` = ?1
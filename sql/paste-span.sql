@@ -0,0 +1,16 @@
+select `paste`.`id`
+     , `paste`.`code`
+     , `paste_content`.`codec`
+     , `paste_content`.`length`
+     , `paste_content`.`rowid`
+     , `paste_fork`.`parent_id`
+     , `paste_fork`.`base`
+     , `paste_index`.`offsets`
+     , `paste_index`.`blocks`
+     , length(`paste_content`.`data`)
+     from `paste`
+left join `paste_content` on `paste_content`.`paste_id` = `paste`.`id`
+left join `paste_fork` on `paste_fork`.`paste_id` = `paste`.`id`
+left join `paste_index` on `paste_index`.`paste_id` = `paste`.`id`
+    where `paste`.`id` = ?
+    limit 1
@@ -0,0 +1,21 @@
+   select `paste`.`id`
+        , `paste`.`title`
+        , `paste`.`author`
+        , `paste`.`filename`
+        , `paste`.`language`
+        , ''
+        , `paste`.`start`
+        , `paste`.`end`
+        , `paste`.`visible`
+        , NULL
+        , NULL
+        , NULL
+        , NULL
+        , NULL
+        , `paste_summary`.`size`
+        , `paste_summary`.`lines`
+        , `paste_summary`.`preview`
+     from `paste`
+left join `paste_summary` on `paste_summary`.`paste_id` = `paste`.`id`
+    where `paste`.`id` = ?
+    limit 1
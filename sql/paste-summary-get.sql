@@ -0,0 +1,6 @@
+select `size`
+     , `lines`
+     , `tail`
+     , `preview`
+  from `paste_summary`
+ where `paste_id` = ?
@@ -0,0 +1,7 @@
+insert or replace into `paste_summary`(
+	`paste_id`,
+	`size`,
+	`lines`,
+	`tail`,
+	`preview`
+) values (?, ?, ?, ?, ?)
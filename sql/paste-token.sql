@@ -0,0 +1,4 @@
+insert into `paste_token`(
+	`paste_id`,
+	`token`
+) values (?, ?)
@@ -0,0 +1,6 @@
+select `mime`
+     , `data`
+  from `thumb`
+ where `image_id` = ?
+   and `size` = ?
+ limit 1
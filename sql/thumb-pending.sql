@@ -0,0 +1,8 @@
+select `id`
+  from `image`
+ where not exists (
+        select 1
+          from `thumb`
+         where `image_id` = `image`.`id`
+       )
+ limit ?
@@ -0,0 +1,11 @@
+insert or replace into `thumb`(
+	`image_id`,
+	`size`,
+	`mime`,
+	`data`
+)
+select ?
+     , ?
+     , ?
+     , ?
+ where exists (select 1 from `image` where `id` = ?)
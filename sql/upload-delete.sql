@@ -0,0 +1,3 @@
+delete
+  from `upload`
+ where `id` = ?
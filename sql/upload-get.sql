@@ -0,0 +1,17 @@
+select `rowid`
+     , `id`
+     , `type`
+     , `title`
+     , `author`
+     , `filename`
+     , `language`
+     , `size`
+     , `received`
+     , `start`
+     , `end`
+     , `expires`
+     , `visible`
+  from `upload`
+ where `id` = ?
+   and `expires` > ?
+ limit 1
@@ -0,0 +1,20 @@
+insert into `image`(
+	`id`,
+	`title`,
+	`author`,
+	`filename`,
+	`data`,
+	`start`,
+	`end`,
+	`visible`
+)
+select ?
+     , `title`
+     , `author`
+     , `filename`
+     , `data`
+     , `start`
+     , `end`
+     , `visible`
+  from `upload`
+ where `id` = ?
@@ -0,0 +1,22 @@
+insert into `paste`(
+	`id`,
+	`title`,
+	`author`,
+	`filename`,
+	`language`,
+	`code`,
+	`start`,
+	`end`,
+	`visible`
+)
+select ?
+     , `title`
+     , `author`
+     , `filename`
+     , `language`
+     , cast(`data` as text)
+     , `start`
+     , `end`
+     , `visible`
+  from `upload`
+ where `id` = ?
@@ -0,0 +1,3 @@
+update `upload`
+   set `received` = ?
+ where `id` = ?
@@ -0,0 +1,14 @@
+insert into `upload`(
+	`id`,
+	`type`,
+	`title`,
+	`author`,
+	`filename`,
+	`language`,
+	`size`,
+	`data`,
+	`start`,
+	`end`,
+	`expires`,
+	`visible`
+) values (?, ?, ?, ?, ?, ?, ?, zeroblob(?), ?, ?, ?, ?)
@@ -0,0 +1,148 @@
+/*
+ * stats.c -- shared request statistics
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/mman.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "stats.h"
+#include "util.h"
+
+/*
+ * One cache line per process so that they don't invalidate each other, the
+ * last slot belongs to the supervisor.
+ */
+struct slot {
+	_Alignas(64) atomic_uint_least64_t requests;
+	atomic_uint_least64_t errors;
+	atomic_uint_least64_t received;
+	atomic_uint_least64_t sent;
+	atomic_uint_least64_t optimized;
+	atomic_uint_least64_t original;
+	atomic_uint_least64_t shrunk;
+};
+
+static struct slot *slots;
+static struct slot *self;
+static size_t slotsz;
+
+static inline void
+add(atomic_uint_least64_t *counter, uint64_t value)
+{
+	atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+static inline uint64_t
+get(atomic_uint_least64_t *counter)
+{
+	return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+void
+stats_init(size_t workers)
+{
+	slots = mmap(NULL, (workers + 1) * sizeof (*slots), PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if (slots == MAP_FAILED)
+		die("abort: mmap: %s\n", strerror(errno));
+
+	slotsz = workers + 1;
+	self = &slots[workers];
+}
+
+void
+stats_select(size_t slot)
+{
+	assert(slot + 1 < slotsz);
+
+	self = &slots[slot];
+}
+
+void
+stats_request(int status, size_t received, size_t sent)
+{
+	if (!self)
+		return;
+
+	add(&self->requests, 1);
+	add(&self->received, received);
+	add(&self->sent, sent);
+
+	if (status >= 500)
+		add(&self->errors, 1);
+}
+
+void
+stats_optim(size_t original, size_t shrunk)
+{
+	if (!self)
+		return;
+
+	add(&self->optimized, 1);
+	add(&self->original, original);
+	add(&self->shrunk, shrunk);
+}
+
+void
+stats_slot(size_t slot, struct stats *st)
+{
+	assert(slot < slotsz);
+	assert(st);
+
+	st->requests = get(&slots[slot].requests);
+	st->errors = get(&slots[slot].errors);
+	st->received = get(&slots[slot].received);
+	st->sent = get(&slots[slot].sent);
+	st->optimized = get(&slots[slot].optimized);
+	st->original = get(&slots[slot].original);
+	st->shrunk = get(&slots[slot].shrunk);
+}
+
+void
+stats_sum(struct stats *st)
+{
+	assert(st);
+
+	struct stats one;
+
+	memset(st, 0, sizeof (*st));
+
+	for (size_t i = 0; i < slotsz; ++i) {
+		stats_slot(i, &one);
+		st->requests += one.requests;
+		st->errors += one.errors;
+		st->received += one.received;
+		st->sent += one.sent;
+		st->optimized += one.optimized;
+		st->original += one.original;
+		st->shrunk += one.shrunk;
+	}
+}
+
+void
+stats_finish(void)
+{
+	if (slots)
+		munmap(slots, slotsz * sizeof (*slots));
+
+	slots = self = NULL;
+	slotsz = 0;
+}
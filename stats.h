@@ -0,0 +1,113 @@
+/*
+ * stats.h -- shared request statistics
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_STATS_H
+#define TMPUPD_STATS_H
+
+/**
+ * \file stats.h
+ * \brief Shared request statistics.
+ *
+ * Counters live in a shared memory segment created before the workers are
+ * forked, each worker and the supervisor write into their own slot and any
+ * of them reads all slots without any locking.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \struct stats
+ * \brief Snapshot of the counters.
+ */
+struct stats {
+	uint64_t requests;      /*!< Number of requests processed. */
+	uint64_t errors;        /*!< Number of responses with a 5xx status. */
+	uint64_t received;      /*!< Request body bytes announced. */
+	uint64_t sent;          /*!< Response body bytes written. */
+	uint64_t optimized;     /*!< Number of images recompressed. */
+	uint64_t original;      /*!< Their length before. */
+	uint64_t shrunk;        /*!< Their length after. */
+};
+
+/**
+ * Create the shared memory segment, exits on failure.
+ *
+ * One more slot than workers is created for the supervisor, it is selected
+ * until a worker selects its own.
+ *
+ * \param workers the number of workers, may be 0
+ */
+void
+stats_init(size_t workers);
+
+/**
+ * Select the slot for the current process.
+ *
+ * \pre slot is less than the number of workers
+ * \param slot the worker index
+ */
+void
+stats_select(size_t slot);
+
+/**
+ * Account a finished request in the current slot.
+ *
+ * \param status the HTTP status code
+ * \param received the request body length
+ * \param sent the response body length
+ */
+void
+stats_request(int status, size_t received, size_t sent);
+
+/**
+ * Account an image recompressed in the current slot.
+ *
+ * \param original the image length before
+ * \param shrunk the image length after
+ */
+void
+stats_optim(size_t original, size_t shrunk);
+
+/**
+ * Read the counters of one slot.
+ *
+ * \pre slot is not greater than the number of workers
+ * \pre st != NULL
+ * \param slot the worker index, the number of workers for the supervisor
+ * \param st the snapshot to fill
+ */
+void
+stats_slot(size_t slot, struct stats *st);
+
+/**
+ * Sum the counters of every slot.
+ *
+ * \pre st != NULL
+ * \param st the snapshot to fill
+ */
+void
+stats_sum(struct stats *st);
+
+/**
+ * Unmap the shared memory segment.
+ */
+void
+stats_finish(void);
+
+#endif /* !TMPUPD_STATS_H */
@@ -0,0 +1,391 @@
+/*
+ * thumb.c -- image thumbnails
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jpeglib.h>
+#include <png.h>
+
+#include "check.h"
+#include "thumb.h"
+#include "util.h"
+
+#define JPEG_QUALITY 85
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/*
+ * Decoded image, 3 components for RGB and 4 for RGBA.
+ */
+struct pixmap {
+	unsigned char *data;
+	unsigned int width;
+	unsigned int height;
+	unsigned int comps;
+};
+
+/*
+ * libjpeg reports errors by calling error_exit which must not return.
+ */
+struct error {
+	struct jpeg_error_mgr mgr;
+	jmp_buf env;
+};
+
+static void
+error_exit(j_common_ptr info)
+{
+	longjmp(((struct error *)info->err)->env, 1);
+}
+
+static void
+error_output(j_common_ptr info)
+{
+	(void)info;
+}
+
+static void
+error_init(struct error *err)
+{
+	jpeg_std_error(&err->mgr);
+	err->mgr.error_exit = error_exit;
+	err->mgr.output_message = error_output;
+}
+
+static int
+decode_png(struct pixmap *pm, const void *data, size_t datasz)
+{
+	png_image png = {
+		.version = PNG_IMAGE_VERSION
+	};
+
+	if (!png_image_begin_read_from_memory(&png, data, datasz))
+		return -1;
+	if ((uintmax_t)png.width * png.height > THUMB_PIXELS_MAX) {
+		png_image_free(&png);
+		return -1;
+	}
+
+	/* Palettes, gray levels and 16 bits samples are all expanded. */
+	if (png.format & PNG_FORMAT_FLAG_ALPHA)
+		png.format = PNG_FORMAT_RGBA;
+	else
+		png.format = PNG_FORMAT_RGB;
+
+	pm->width = png.width;
+	pm->height = png.height;
+	pm->comps = PNG_IMAGE_PIXEL_CHANNELS(png.format);
+	pm->data = emalloc(PNG_IMAGE_SIZE(png), 1);
+
+	if (!png_image_finish_read(&png, NULL, pm->data, 0, NULL)) {
+		free(pm->data);
+		pm->data = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * The decoder can scale by 1/2, 1/4 and 1/8 while decoding which saves most
+ * of the work for large photos, the scale is chosen so that the output
+ * stays larger than the biggest thumbnail wanted.
+ */
+static int
+decode_jpeg(struct pixmap *pm, const void *data, size_t datasz, unsigned int size)
+{
+	struct jpeg_decompress_struct info;
+	struct error err;
+	unsigned int max;
+	JSAMPROW row;
+
+	error_init(&err);
+	info.err = &err.mgr;
+
+	if (setjmp(err.env)) {
+		jpeg_destroy_decompress(&info);
+		free(pm->data);
+		pm->data = NULL;
+		return -1;
+	}
+
+	jpeg_create_decompress(&info);
+	jpeg_mem_src(&info, data, datasz);
+	jpeg_read_header(&info, TRUE);
+
+	if ((uintmax_t)info.image_width * info.image_height > THUMB_PIXELS_MAX) {
+		jpeg_destroy_decompress(&info);
+		return -1;
+	}
+
+	max = MAX(info.image_width, info.image_height);
+
+	info.out_color_space = JCS_RGB;
+	info.scale_num = 1;
+
+	for (info.scale_denom = 8; info.scale_denom > 1; info.scale_denom /= 2)
+		if (max / info.scale_denom > size)
+			break;
+
+	jpeg_start_decompress(&info);
+
+	pm->width = info.output_width;
+	pm->height = info.output_height;
+	pm->comps = 3;
+	pm->data = emalloc((size_t)pm->width * pm->height, pm->comps);
+
+	while (info.output_scanline < info.output_height) {
+		row = pm->data + (size_t)info.output_scanline * pm->width * pm->comps;
+		jpeg_read_scanlines(&info, &row, 1);
+	}
+
+	jpeg_finish_decompress(&info);
+	jpeg_destroy_decompress(&info);
+
+	return 0;
+}
+
+static int
+encode_png(struct thumb *th,
+           const unsigned char *px,
+           unsigned int w,
+           unsigned int h,
+           unsigned int comps)
+{
+	png_image png = {
+		.version = PNG_IMAGE_VERSION,
+		.width = w,
+		.height = h,
+		.format = comps == 4 ? PNG_FORMAT_RGBA : PNG_FORMAT_RGB
+	};
+	png_alloc_size_t size;
+
+	if (!png_image_write_get_memory_size(png, size, 0, px, 0, NULL))
+		return -1;
+
+	th->data = emalloc(size, 1);
+
+	if (!png_image_write_to_memory(&png, th->data, &size, 0, px, 0, NULL))
+		return -1;
+
+	th->datasz = size;
+	th->mime = estrdup("image/png");
+
+	return 0;
+}
+
+static int
+encode_jpeg(struct thumb *th, const unsigned char *px, unsigned int w, unsigned int h)
+{
+	struct jpeg_compress_struct info;
+	struct error err;
+	unsigned long size = 0;
+	JSAMPROW row;
+
+	error_init(&err);
+	info.err = &err.mgr;
+
+	/* The output buffer is allocated by libjpeg, thumb_finish frees it. */
+	if (setjmp(err.env)) {
+		jpeg_destroy_compress(&info);
+		return -1;
+	}
+
+	jpeg_create_compress(&info);
+	jpeg_mem_dest(&info, &th->data, &size);
+
+	info.image_width = w;
+	info.image_height = h;
+	info.input_components = 3;
+	info.in_color_space = JCS_RGB;
+
+	jpeg_set_defaults(&info);
+	jpeg_set_quality(&info, JPEG_QUALITY, TRUE);
+	info.optimize_coding = TRUE;
+	jpeg_start_compress(&info, TRUE);
+
+	while (info.next_scanline < info.image_height) {
+		row = (JSAMPROW)px + (size_t)info.next_scanline * w * 3;
+		jpeg_write_scanlines(&info, &row, 1);
+	}
+
+	jpeg_finish_compress(&info);
+	jpeg_destroy_compress(&info);
+
+	th->datasz = size;
+	th->mime = estrdup("image/jpeg");
+
+	return 0;
+}
+
+/*
+ * Box filter: every output pixel is the average of the source pixels it
+ * covers, colors are weighted by their alpha so that transparent pixels
+ * don't bleed into the visible ones.
+ */
+static void
+shrink(const struct pixmap *pm, unsigned char *out, unsigned int w, unsigned int h)
+{
+	const unsigned char *p;
+	const unsigned int c = pm->comps;
+	unsigned int *xs, y0, y1;
+	uint64_t *acc, n, weight;
+
+	xs = ecalloc(w + 1, sizeof (*xs));
+	acc = ecalloc((size_t)w * c, sizeof (*acc));
+
+	for (unsigned int x = 0; x <= w; ++x)
+		xs[x] = (uint64_t)x * pm->width / w;
+
+	for (unsigned int y = 0; y < h; ++y) {
+		y0 = (uint64_t)y * pm->height / h;
+		y1 = (uint64_t)(y + 1) * pm->height / h;
+
+		memset(acc, 0, (size_t)w * c * sizeof (*acc));
+
+		for (unsigned int sy = y0; sy < y1; ++sy) {
+			p = pm->data + (size_t)sy * pm->width * c;
+
+			for (unsigned int x = 0; x < w; ++x) {
+				for (unsigned int sx = xs[x]; sx < xs[x + 1]; ++sx, p += c) {
+					weight = c == 4 ? p[3] : 1;
+
+					acc[x * c + 0] += p[0] * weight;
+					acc[x * c + 1] += p[1] * weight;
+					acc[x * c + 2] += p[2] * weight;
+
+					if (c == 4)
+						acc[x * c + 3] += p[3];
+				}
+			}
+		}
+
+		for (unsigned int x = 0; x < w; ++x, out += c) {
+			n = (uint64_t)(xs[x + 1] - xs[x]) * (y1 - y0);
+			weight = c == 4 ? acc[x * c + 3] : n;
+
+			for (unsigned int i = 0; i < 3; ++i)
+				out[i] = weight ? (acc[x * c + i] + weight / 2) / weight : 0;
+			if (c == 4)
+				out[3] = (acc[x * c + 3] + n / 2) / n;
+		}
+	}
+
+	free(acc);
+	free(xs);
+}
+
+static int
+scale(struct thumb *th, const struct pixmap *pm, enum check_image_format format)
+{
+	unsigned char *px;
+	unsigned int w, h;
+	int rv;
+
+	/* Keep the aspect ratio, the longest side fits the box. */
+	if (pm->width >= pm->height) {
+		w = th->size;
+		h = MAX(1, ((uint64_t)pm->height * th->size + pm->width / 2) / pm->width);
+	} else {
+		h = th->size;
+		w = MAX(1, ((uint64_t)pm->width * th->size + pm->height / 2) / pm->height);
+	}
+
+	px = emalloc((size_t)w * h, pm->comps);
+	shrink(pm, px, w, h);
+
+	if (format == CHECK_IMAGE_PNG)
+		rv = encode_png(th, px, w, h, pm->comps);
+	else
+		rv = encode_jpeg(th, px, w, h);
+
+	free(px);
+
+	return rv;
+}
+
+int
+thumb_generate(struct thumb *thumbs,
+               size_t thumbsz,
+               const void *data,
+               size_t datasz)
+{
+	assert(thumbs);
+	assert(data);
+
+	struct pixmap pm = {0};
+	enum check_image_format format;
+	unsigned int size = 0;
+	int rv;
+
+	for (size_t i = 0; i < thumbsz; ++i) {
+		thumbs[i].mime = NULL;
+		thumbs[i].data = NULL;
+		thumbs[i].datasz = 0;
+		size = MAX(size, thumbs[i].size);
+	}
+
+	switch ((format = check_image_format(data, datasz))) {
+	case CHECK_IMAGE_PNG:
+		rv = decode_png(&pm, data, datasz);
+		break;
+	case CHECK_IMAGE_JPEG:
+		rv = decode_jpeg(&pm, data, datasz, size);
+		break;
+	default:
+		rv = -1;
+		break;
+	}
+
+	for (size_t i = 0; rv == 0 && i < thumbsz; ++i) {
+		if (MAX(pm.width, pm.height) <= thumbs[i].size)
+			continue;
+
+		rv = scale(&thumbs[i], &pm, format);
+
+		/* Noisy images may compress worse once scaled. */
+		if (rv == 0 && thumbs[i].datasz >= datasz)
+			thumb_finish(&thumbs[i]);
+	}
+
+	if (rv < 0)
+		for (size_t i = 0; i < thumbsz; ++i)
+			thumb_finish(&thumbs[i]);
+
+	free(pm.data);
+
+	return rv;
+}
+
+void
+thumb_finish(struct thumb *thumb)
+{
+	assert(thumb);
+
+	free(thumb->mime);
+	free(thumb->data);
+
+	thumb->mime = NULL;
+	thumb->data = NULL;
+	thumb->datasz = 0;
+}
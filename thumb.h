@@ -0,0 +1,115 @@
+/*
+ * thumb.h -- image thumbnails
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_THUMB_H
+#define TMPUPD_THUMB_H
+
+/**
+ * \file thumb.h
+ * \brief Image thumbnails.
+ *
+ * PNG and JPEG images are decoded once and scaled down to every size
+ * requested, a PNG thumbnail is produced for a PNG image so that
+ * transparency is kept and a JPEG thumbnail otherwise.
+ */
+
+#include <stddef.h>
+
+/**
+ * \def THUMB_SMALL
+ * Bounding box of the thumbnails shown in listings.
+ */
+#define THUMB_SMALL 256
+
+/**
+ * \def THUMB_LARGE
+ * Bounding box of the thumbnails shown in the image page.
+ */
+#define THUMB_LARGE 1024
+
+/**
+ * \def THUMB_PIXELS_MAX
+ * Maximum number of pixels decoded, larger images get no thumbnail.
+ */
+#define THUMB_PIXELS_MAX (32UL * 1024 * 1024)
+
+/**
+ * \struct thumb
+ * \brief Generated thumbnail.
+ */
+struct thumb {
+	/**
+	 * (read-write)
+	 *
+	 * Bounding box in pixels.
+	 */
+	unsigned int size;
+
+	/**
+	 * (read-write)
+	 *
+	 * Content type, NULL if the original image is to be used instead.
+	 */
+	char *mime;
+
+	/**
+	 * (read-write)
+	 *
+	 * Encoded thumbnail, NULL if the original image is to be used instead.
+	 */
+	unsigned char *data;
+
+	/**
+	 * (read-write)
+	 *
+	 * Encoded thumbnail length.
+	 */
+	size_t datasz;
+};
+
+/**
+ * Generate thumbnails for an image, the size of each thumbnail must be set
+ * and the remaining fields are filled.
+ *
+ * An image that already fits in a bounding box gets no thumbnail for it,
+ * neither does an image whose thumbnail would not be smaller.
+ *
+ * \pre thumbs != NULL
+ * \pre data != NULL
+ * \param thumbs the thumbnails to generate
+ * \param thumbsz the number of thumbnails
+ * \param data the original image
+ * \param datasz the original image length
+ * \return 0 on success or -1 if the image could not be decoded
+ */
+int
+thumb_generate(struct thumb *thumbs,
+               size_t thumbsz,
+               const void *data,
+               size_t datasz);
+
+/**
+ * Clear thumbnail content, the size is kept.
+ *
+ * \pre thumb != NULL
+ * \param thumb the thumbnail to clear
+ */
+void
+thumb_finish(struct thumb *thumb);
+
+#endif /* !TMPUPD_THUMB_H */
@@ -18,8 +18,10 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "tmp.h"
 #include "util.h"
@@ -44,6 +46,22 @@ tmp_id(void)
 	return estrdup(id);
 }
 
+char *
+tmp_token(void)
+{
+	unsigned char bytes[(TMP_TOKEN_LEN - 1) / 2];
+	char token[TMP_TOKEN_LEN];
+
+	/* Unlike ids, tokens must not be predictable. */
+	if (getentropy(bytes, sizeof (bytes)) < 0)
+		die("abort: getentropy: %s\n", strerror(errno));
+
+	for (size_t i = 0; i < sizeof (bytes); ++i)
+		snprintf(token + i * 2, 3, "%02x", bytes[i]);
+
+	return estrdup(token);
+}
+
 char *
 tmp_json(const char *fmt, ...)
 {
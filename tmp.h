@@ -24,6 +24,7 @@
 #include <jansson.h>
 
 #define TMP_ID_LEN 9
+#define TMP_TOKEN_LEN 33
 
 #define TMP_DEFAULT_TITLE       "void"
 #define TMP_DEFAULT_AUTHOR      "anonymous"
@@ -45,6 +46,12 @@ extern size_t tmp_durationsz;
 char *
 tmp_id(void);
 
+/**
+ * Dynamically allocate a new secret token from the system entropy source.
+ */
+char *
+tmp_token(void);
+
 /**
  * Create a JSON representation using jansson json_pack.
  *
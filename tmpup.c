@@ -17,36 +17,53 @@
  */
 
 #include <assert.h>
+#include <poll.h>
 #include <errno.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <jansson.h>
 
 #include <curl/curl.h>
 
-#include "image.h"
-#include "paste.h"
+#include "base64.h"
 #include "tmp.h"
 #include "util.h"
 
+/* Contents larger than this are sent in pieces through a resumable session. */
+#define UPLOAD_CHUNK    (256 * 1024)
+
+/* Failed pieces in a row before giving up. */
+#define UPLOAD_RETRIES  5
+
+/* Standard input is sent as soon as this much is pending. */
+#define FOLLOW_BATCH    (64 * 1024)
+
+/* Otherwise, milliseconds to wait after the first pending byte. */
+#define FOLLOW_DELAY    1000
+
 struct req {
 	long status;
 	json_t *doc;
+	char error[CURL_ERROR_SIZE];
 };
 
 static const char *title, *author, *filename, *language;
 static const char *host = "http://localhost";
 static long timeout = 3;
 static time_t start, end;
-static int debug, visible;
+static int debug, visible, follow;
 
 static void
 usage(void)
 {
-	fprintf(stderr, "usage: tmpup image [file]\n");
-	fprintf(stderr, "       tmpup paste [file]\n");
+	fprintf(stderr, "usage: tmpup image [file...]\n");
+	fprintf(stderr, "       tmpup paste [file...]\n");
+	fprintf(stderr, "       tmpup -F paste\n");
 	exit(1);
 }
 
@@ -75,65 +92,158 @@ readall(const char *file, char **dst, size_t *dstsz)
 	fclose(out);
 }
 
+/*
+ * Append the query string from the NULL terminated list of key/value pairs,
+ * pairs with a NULL value are skipped.
+ */
 static void
-post(struct req *req, const char *url, const char *body)
+query(FILE *fp, CURL *curl, va_list ap)
+{
+	const char *key, *val;
+	char *enc;
+	int first = 1;
+
+	while ((key = va_arg(ap, const char *))) {
+		if (!(val = va_arg(ap, const char *)))
+			continue;
+		if (!(enc = curl_easy_escape(curl, val, 0)))
+			die("abort: %s\n", strerror(ENOMEM));
+
+		fprintf(fp, "%c%s=%s", first ? '?' : '&', key, enc);
+		curl_free(enc);
+		first = 0;
+	}
+}
+
+/*
+ * Perform a request, the response must be JSON. Returns -1 if the transfer
+ * failed or if the response is not valid and sets the req error field.
+ */
+static int
+perform(struct req *req,
+        const char *method,
+        const char *path,
+        const char *ctype,
+        const void *body,
+        size_t bodysz,
+        va_list ap)
 {
 	struct curl_slist *headers = NULL;
 	CURL *curl;
 	FILE *fp;
-	char *resp = NULL, httperr[CURL_ERROR_SIZE] = {0}, path[256] = {0};
-	const char *message;
-	size_t respsz = 0;
+	char *resp = NULL, *url = NULL, *type = NULL;
+	size_t respsz = 0, urlsz = 0, typesz = 0;
 	json_error_t resperr;
+	int rv = 0;
 
 	memset(req, 0, sizeof (*req));
 
+	curl = curl_easy_init();
+
+	/* Make URL from only path part and query parameters. */
+	fp = eopen_memstream(&url, &urlsz);
+	fprintf(fp, "%s/%s", host, path);
+	query(fp, curl, ap);
+	fclose(fp);
+
+	if (debug)
+		fprintf(stderr, "%s %s\n", method, url);
+
+	fp = eopen_memstream(&type, &typesz);
+	fprintf(fp, "Content-Type: %s", ctype);
+	fclose(fp);
+
 	/* Output response (should be JSON content). */
 	fp = eopen_memstream(&resp, &respsz);
 
-	/* Make URL from only path part. */
-	snprintf(path, sizeof (path), "%s/%s", host, url);
-
-	headers = curl_slist_append(headers, "Content-Type: application/json");
-	curl = curl_easy_init();
-	curl_easy_setopt(curl, CURLOPT_URL, path);
+	headers = curl_slist_append(headers, type);
+	curl_easy_setopt(curl, CURLOPT_URL, url);
 	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
 	curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
 	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, httperr);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, req->error);
 	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 
-	if (body) {
+	if (strcmp(method, "GET") == 0)
+		curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+	else {
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(body));
-	} else
-		curl_easy_setopt(curl, CURLOPT_POST, 1L);
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)bodysz);
+
+		if (strcmp(method, "POST") != 0)
+			curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+	}
 
 #if LIBCURL_VERSION_MAJOR >= 8 || (LIBCURL_VERSION_MAJOR >= 7 && LIBCURL_VERSION_MINOR >= 85)
-	curl_easy_setopt(curl, CURLOPT_PROTOCOLS_STR, "http;https");
+	curl_easy_setopt(curl, CURLOPT_PROTOCOLS_STR, "http,https");
 #else
 	curl_easy_setopt(curl, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
 #endif
 
 	if (curl_easy_perform(curl) != CURLE_OK)
-		die("abort: %s\n", httperr);
+		rv = -1;
 
 	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &req->status);
 	curl_easy_cleanup(curl);
 	curl_slist_free_all(headers);
 
 	fclose(fp);
+	free(url);
+	free(type);
 
 	/* Try to decode JSON. */
-	if (!(req->doc = json_loads(resp, 0, &resperr)))
-		die("abort: %s\n", resperr.text);
+	if (rv == 0 && !(req->doc = json_loads(resp, 0, &resperr))) {
+		snprintf(req->error, sizeof (req->error), "%s", resperr.text);
+		rv = -1;
+	}
+
+	free(resp);
+
+	return rv;
+}
+
+static int
+request(struct req *req,
+        const char *method,
+        const char *path,
+        const char *ctype,
+        const void *body,
+        size_t bodysz,
+        ...)
+{
+	va_list ap;
+	int rv;
+
+	va_start(ap, bodysz);
+	rv = perform(req, method, path, ctype, body, bodysz, ap);
+	va_end(ap);
+
+	return rv;
+}
+
+static void
+post(struct req *req,
+     const char *path,
+     const char *ctype,
+     const void *body,
+     size_t bodysz,
+     ...)
+{
+	const char *message;
+	va_list ap;
+	int rv;
+
+	va_start(ap, bodysz);
+	rv = perform(req, "POST", path, ctype, body, bodysz, ap);
+	va_end(ap);
+
+	if (rv < 0)
+		die("abort: %s\n", req->error);
 
 	/* For convenience, check if there is an error message. */
 	if (json_unpack(req->doc, "{ss}", "error", &message) == 0)
 		die("abort: %s\n", message);
-
-	free(resp);
 }
 
 static void
@@ -145,15 +255,352 @@ req_finish(struct req *req)
 	memset(req, 0, sizeof (*req));
 }
 
+static inline const char *
+basename_of(const char *path)
+{
+	const char *slash;
+
+	return (slash = strrchr(path, '/')) ? slash + 1 : path;
+}
+
+/*
+ * Append one newline delimited JSON item to the batch body.
+ */
+static void
+batch_item(FILE *fp, const char *type, const char *path)
+{
+	json_t *doc;
+	json_error_t err;
+	char *contents = NULL, *enc = NULL, *dump;
+	const char *name = filename ? filename : basename_of(path);
+	size_t contentsz = 0, encsz;
+
+	readall(path, &contents, &contentsz);
+
+	if (strcmp(type, "image") == 0) {
+		encsz = B64_ENCODE_LENGTH(contentsz) + 8;
+		enc = ecalloc(encsz + 1, 1);
+		b64_encode((unsigned char *)contents, contentsz, enc, encsz);
+
+		doc = json_pack_ex(&err, 0, "{ss ss? ss? ss ss sI sI sb}",
+			"type",         type,
+			"title",        title,
+			"author",       author,
+			"filename",     name,
+			"data",         enc,
+			"start",        (json_int_t)start,
+			"end",          (json_int_t)end,
+			"visible",      visible
+		);
+	} else {
+		doc = json_pack_ex(&err, 0, "{ss ss? ss? ss ss? ss% sI sI sb}",
+			"type",         type,
+			"title",        title,
+			"author",       author,
+			"filename",     name,
+			"language",     language,
+			"code",         contents, contentsz,
+			"start",        (json_int_t)start,
+			"end",          (json_int_t)end,
+			"visible",      visible
+		);
+	}
+
+	if (!doc)
+		die("abort: %s: %s\n", path, err.text);
+	if (!(dump = json_dumps(doc, JSON_COMPACT)))
+		die("abort: %s\n", strerror(ENOMEM));
+
+	fputs(dump, fp);
+	fputc('\n', fp);
+
+	free(dump);
+	free(enc);
+	free(contents);
+	json_decref(doc);
+}
+
+/*
+ * Upload several files at once through the batch API, each file gets its
+ * URL or error printed in order.
+ */
+static void
+batch(const char *type, int filesc, char **files)
+{
+	struct req req;
+	json_t *items, *item;
+	FILE *fp;
+	char *body = NULL;
+	const char *id, *error;
+	size_t bodysz = 0, i;
+	int failed = 0;
+
+	fp = eopen_memstream(&body, &bodysz);
+
+	for (i = 0; i < (size_t)filesc; ++i)
+		batch_item(fp, type, files[i]);
+
+	fclose(fp);
+
+	post(&req, "api/v1/batch", "application/x-ndjson", body, bodysz, NULL);
+
+	if (req.status != 200)
+		die("abort: HTTP %ld\n", req.status);
+	if (json_unpack(req.doc, "{so}", "items", &items) < 0 || !json_is_array(items))
+		die("abort: invalid response\n");
+
+	for (i = 0; i < json_array_size(items); ++i) {
+		item = json_array_get(items, i);
+
+		if (json_unpack(item, "{ss}", "id", &id) == 0)
+			printf("%s/%s/%s\n", host, type, id);
+		else if (json_unpack(item, "{ss}", "error", &error) == 0) {
+			fprintf(stderr, "%s: %s\n", files[i], error);
+			failed = 1;
+		}
+	}
+
+	req_finish(&req);
+	free(body);
+
+	if (failed)
+		exit(1);
+}
+
+/*
+ * Get the offset the server expects next from a progress reply.
+ */
+static int
+offset_of(const struct req *req, size_t *offset)
+{
+	json_int_t value;
+
+	if (!req->doc || json_unpack(req->doc, "{sI}", "offset", &value) < 0 || value < 0)
+		return -1;
+
+	*offset = value;
+
+	return 0;
+}
+
+/*
+ * Send a large content through a resumable upload session in pieces. After
+ * a failure the server is asked how much it has stored so that only the
+ * missing part is sent again.
+ */
+static void
+resumable(const char *type, const char *contents, size_t contentsz)
+{
+	struct req req;
+	const char *id;
+	char *session, path[128], sizestr[32], offstr[32], startstr[32], endstr[32];
+	size_t offset = 0, len;
+	int retries = 0, rv;
+
+	snprintf(sizestr, sizeof (sizestr), "%zu", contentsz);
+	snprintf(startstr, sizeof (startstr), "%lld", (long long)start);
+	snprintf(endstr, sizeof (endstr), "%lld", (long long)end);
+
+	post(&req, "api/v1/upload", "application/octet-stream", "", 0,
+	    "type",     type,
+	    "size",     sizestr,
+	    "title",    title,
+	    "author",   author,
+	    "filename", filename,
+	    "language", strcmp(type, "paste") == 0 ? language : NULL,
+	    "start",    startstr,
+	    "end",      endstr,
+	    "visible",  visible ? "1" : NULL,
+	    NULL);
+
+	if (req.status != 201 || json_unpack(req.doc, "{ss}", "id", &id) < 0)
+		die("abort: HTTP %ld\n", req.status);
+
+	session = estrdup(id);
+	snprintf(path, sizeof (path), "api/v1/upload/%s", session);
+	req_finish(&req);
+
+	while (offset < contentsz) {
+		if ((len = contentsz - offset) > UPLOAD_CHUNK)
+			len = UPLOAD_CHUNK;
+
+		snprintf(offstr, sizeof (offstr), "%zu", offset);
+		rv = request(&req, "PUT", path, "application/octet-stream",
+		    contents + offset, len, "offset", offstr, NULL);
+
+		/* A mismatch also tells the expected offset. */
+		if (rv == 0 && (req.status == 200 || req.status == 409) &&
+		    offset_of(&req, &offset) == 0) {
+			if (req.status == 200)
+				retries = 0;
+
+			req_finish(&req);
+			continue;
+		}
+
+		if (++retries > UPLOAD_RETRIES)
+			die("abort: %s\n", rv < 0 ? req.error : "upload failed");
+		if (debug)
+			fprintf(stderr, "retrying after: %s\n", rv < 0 ? req.error : "upload failed");
+
+		req_finish(&req);
+		sleep(retries);
+
+		/* Ask where to resume, keep the current offset otherwise. */
+		if (request(&req, "GET", path, "application/json", NULL, 0, NULL) == 0 &&
+		    req.status == 200)
+			offset_of(&req, &offset);
+
+		req_finish(&req);
+	}
+
+	post(&req, path, "application/octet-stream", "", 0, NULL);
+
+	if (req.status != 201)
+		die("abort: HTTP %ld\n", req.status);
+	if (json_unpack(req.doc, "{ss}", "id", &id) == 0)
+		printf("%s/%s/%s\n", host, type, id);
+
+	req_finish(&req);
+	free(session);
+}
+
+static long long
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Send one batch of standard input, the first one creates the paste and the
+ * following ones are appended using its token.
+ */
+static void
+send_batch(const char *buf, size_t bufsz, char **id, char **token)
+{
+	struct req req;
+	const char *val, *tok;
+	char path[128], startstr[32], endstr[32];
+
+	if (*id) {
+		snprintf(path, sizeof (path), "api/v1/paste/%s/append", *id);
+		post(&req, path, "text/plain; charset=utf-8", buf, bufsz,
+		    "token", *token,
+		    NULL);
+
+		if (req.status != 200)
+			die("abort: HTTP %ld\n", req.status);
+
+		req_finish(&req);
+		return;
+	}
+
+	snprintf(startstr, sizeof (startstr), "%lld", (long long)start);
+	snprintf(endstr, sizeof (endstr), "%lld", (long long)end);
+
+	post(&req, "api/v1/paste", "text/plain; charset=utf-8", buf, bufsz,
+	    "title",    title,
+	    "author",   author,
+	    "filename", filename,
+	    "language", language,
+	    "start",    startstr,
+	    "end",      endstr,
+	    "visible",  visible ? "1" : NULL,
+	    NULL);
+
+	if (req.status != 201 ||
+	    json_unpack(req.doc, "{ss ss}", "id", &val, "token", &tok) < 0)
+		die("abort: HTTP %ld\n", req.status);
+
+	*id = estrdup(val);
+	*token = estrdup(tok);
+
+	/* Print the URL right away so that it can be shared while running. */
+	printf("%s/paste/%s\n", host, *id);
+	fflush(stdout);
+
+	req_finish(&req);
+}
+
+/*
+ * Stream standard input into a paste in batches until its end, each batch
+ * only carries the new data.
+ */
+static void
+cmd_follow(void)
+{
+	struct pollfd pfd = {
+		.fd = STDIN_FILENO,
+		.events = POLLIN
+	};
+	char *buf, *id = NULL, *token = NULL;
+	size_t len = 0;
+	long long first = 0, left;
+	ssize_t nr;
+	int eof = 0;
+
+	buf = emalloc(FOLLOW_BATCH, 1);
+
+	while (!eof) {
+		left = len ? FOLLOW_DELAY - (now() - first) : -1;
+
+		if (len && left <= 0) {
+			send_batch(buf, len, &id, &token);
+			len = 0;
+			continue;
+		}
+		if (poll(&pfd, 1, left) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			die("abort: %s\n", strerror(errno));
+		}
+		if (!pfd.revents)
+			continue;
+
+		if ((nr = read(STDIN_FILENO, buf + len, FOLLOW_BATCH - len)) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			die("abort: %s\n", strerror(errno));
+		}
+		if (nr == 0)
+			eof = 1;
+		else if (len == 0)
+			first = now();
+
+		if ((len += nr) == FOLLOW_BATCH) {
+			send_batch(buf, len, &id, &token);
+			len = 0;
+		}
+	}
+
+	/* Send the rest, or create an empty paste if nothing came. */
+	if (len || !id)
+		send_batch(buf, len, &id, &token);
+
+	free(buf);
+	free(id);
+	free(token);
+}
+
 static void
 cmd_image(int argc, char **argv)
 {
-	struct image image;
 	struct req req;
 	const char *id;
-	char *contents = NULL, *dump, *slash;
+	char *contents = NULL, *slash, startstr[32], endstr[32];
 	size_t contentsz = 0;
 
+	if (argc > 2) {
+		batch("image", argc - 1, argv + 1);
+		return;
+	}
+
 	readall(argc >= 2 ? argv[1] : NULL, &contents, &contentsz);
 
 	if (argc >= 2) {
@@ -163,52 +610,83 @@ cmd_image(int argc, char **argv)
 			filename = argv[1];
 	}
 
-	image_init(&image, NULL, title, author, filename,
-	    (const unsigned char *)contents, contentsz, start, end, visible);
-	dump = image_dump(&image);
+	if (contentsz > UPLOAD_CHUNK) {
+		resumable("image", contents, contentsz);
+		free(contents);
+		return;
+	}
 
-	post(&req, "api/v0/image", dump);
+	snprintf(startstr, sizeof (startstr), "%lld", (long long)start);
+	snprintf(endstr, sizeof (endstr), "%lld", (long long)end);
+
+	post(&req, "api/v1/image", "application/octet-stream", contents, contentsz,
+	    "title",    title,
+	    "author",   author,
+	    "filename", filename,
+	    "start",    startstr,
+	    "end",      endstr,
+	    "visible",  visible ? "1" : NULL,
+	    NULL);
 
 	if (req.status != 201)
 		die("abort: HTTP %ld\n", req.status);
 	if (json_unpack(req.doc, "{ss}", "id", &id) == 0)
 		printf("%s/image/%s\n", host, id);
 
-	image_finish(&image);
-
 	req_finish(&req);
 
 	free(contents);
-	free(dump);
 }
 
 static void
 cmd_paste(int argc, char **argv)
 {
-	struct paste paste;
 	struct req req;
 	const char *id;
-	char *code, *dump;
-	size_t codesz;
+	char *code = NULL, startstr[32], endstr[32];
+	size_t codesz = 0;
+
+	if (follow) {
+		if (argc > 1)
+			usage();
+
+		cmd_follow();
+		return;
+	}
+	if (argc > 2) {
+		batch("paste", argc - 1, argv + 1);
+		return;
+	}
 
 	readall(argc >= 2 ? argv[1] : NULL, &code, &codesz);
 
-	paste_init(&paste, NULL, title, author, filename, language, code, start, end, visible);
-	dump = paste_dump(&paste);
+	if (codesz > UPLOAD_CHUNK) {
+		resumable("paste", code, codesz);
+		free(code);
+		return;
+	}
+
+	snprintf(startstr, sizeof (startstr), "%lld", (long long)start);
+	snprintf(endstr, sizeof (endstr), "%lld", (long long)end);
 
-	post(&req, "api/v0/paste", dump);
+	post(&req, "api/v1/paste", "text/plain; charset=utf-8", code, codesz,
+	    "title",    title,
+	    "author",   author,
+	    "filename", filename,
+	    "language", language,
+	    "start",    startstr,
+	    "end",      endstr,
+	    "visible",  visible ? "1" : NULL,
+	    NULL);
 
 	if (req.status != 201)
 		die("abort: HTTP %ld\n", req.status);
 	if (json_unpack(req.doc, "{ss}", "id", &id) == 0)
 		printf("%s/paste/%s\n", host, id);
 
-	paste_finish(&paste);
-
 	req_finish(&req);
 
 	free(code);
-	free(dump);
 }
 
 static struct cmd {
@@ -253,7 +731,7 @@ main(int argc, char **argv)
 	start = time(NULL);
 	end = start + TMP_DURATION_DAY;
 
-	while ((ch = egetopt(argc, argv, "a:e:f:h:l:pt:v")) != -1) {
+	while ((ch = egetopt(argc, argv, "a:e:Ff:h:l:pt:v")) != -1) {
 		switch (ch) {
 		case 'a':
 			author = optarg;
@@ -261,6 +739,9 @@ main(int argc, char **argv)
 		case 'e':
 			set_duration(optarg);
 			break;
+		case 'F':
+			follow = 1;
+			break;
 		case 'f':
 			filename = optarg;
 			break;
@@ -17,22 +17,36 @@
  */
 
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
+#include "base64.h"
 #include "check.h"
+#include "db-counter.h"
 #include "db-image.h"
+#include "db-optim.h"
 #include "db-paste.h"
+#include "db-thumb.h"
+#include "db-upload.h"
 #include "db.h"
+#include "http-fcgi.h"
 #include "http.h"
+#include "image.h"
+#include "json-write.h"
 #include "log.h"
+#include "optim.h"
 #include "route.h"
+#include "stats.h"
+#include "thumb.h"
 #include "tmp.h"
 #include "tmpupd.h"
 #include "util.h"
@@ -41,9 +55,30 @@
 
 #define TAG "tmpupd: "
 
+/* Images given thumbnails per timer tick. */
+#define THUMB_BATCH 8
+
+/* Images recompressed per timer tick. */
+#define OPTIM_BATCH 4
+
 static const char *dbpath = VARDIR "/db/tmpup/tmpup.db";
+static const char *address;
+static const char *socket_path;
+static mode_t socket_mode = 0666;
+static int optimize;
 static sigset_t sigs;
 
+/*
+ * Worker processes when started with -j, otherwise requests are processed by
+ * the main process.
+ */
+static struct worker {
+	pid_t pid;
+	time_t started;
+	unsigned int restarts;
+} *workers;
+static size_t workersz;
+
 static void
 prune(void)
 {
@@ -64,6 +99,148 @@ prune(void)
 	if (db_image_prune(&db) < 0)
 		log_warn(TAG "unable to prune images: %s", db.error);
 
+	log_debug(TAG "pruning uploads...");
+
+	if (db_upload_prune(&db) < 0)
+		log_warn(TAG "unable to prune uploads: %s", db.error);
+
+	log_debug(TAG "pruning counters...");
+
+	if (db_counter_prune(&db) < 0)
+		log_warn(TAG "unable to prune counters: %s", db.error);
+
+	db_finish(&db);
+}
+
+static int
+append(void *data, const void *buf, size_t bufsz)
+{
+	return fwrite(buf, 1, bufsz, data) == bufsz ? 0 : -1;
+}
+
+static void
+thumbnail(struct db *db, const char *id)
+{
+	struct thumb thumbs[] = {
+		{ .size = THUMB_SMALL },
+		{ .size = THUMB_LARGE }
+	};
+	struct image image;
+	intmax_t row;
+	char *data = NULL;
+	size_t datasz = 0;
+	FILE *fp;
+	int rv;
+
+	if (db_image_stat(&image, &row, id, db) != 1)
+		return;
+
+	fp = eopen_memstream(&data, &datasz);
+	rv = db_image_read(row, 0, image.datasz, append, fp, db);
+	fclose(fp);
+
+	if (rv < 0)
+		log_warn(TAG "unable to read image '%s': %s", id, db->error);
+	else {
+		/* Remember undecodable images too so that they aren't retried. */
+		if (thumb_generate(thumbs, LEN(thumbs), data, datasz) < 0)
+			log_debug(TAG "no thumbnail for image '%s'", id);
+		if (db_thumb_save(id, thumbs, LEN(thumbs), db) < 0)
+			log_warn(TAG "unable to save thumbnails: %s", db->error);
+	}
+
+	for (size_t i = 0; i < LEN(thumbs); ++i)
+		thumb_finish(&thumbs[i]);
+
+	free(data);
+	image_finish(&image);
+}
+
+/*
+ * Thumbnails are generated in the background by the timer, a few images at
+ * a time so that signals are still handled quickly.
+ */
+static void
+thumbnails(void)
+{
+	struct db db;
+	char *ids[THUMB_BATCH];
+	ssize_t idsz;
+
+	if (tmpupd_open(&db, DB_RDWR) < 0)
+		return;
+
+	if ((idsz = db_thumb_pending(ids, LEN(ids), &db)) < 0)
+		log_warn(TAG "unable to list images without thumbnails: %s", db.error);
+
+	for (ssize_t i = 0; i < idsz; ++i) {
+		log_debug(TAG "generating thumbnails for image '%s'", ids[i]);
+		thumbnail(&db, ids[i]);
+		free(ids[i]);
+	}
+
+	db_finish(&db);
+}
+
+static void
+optimization(struct db *db, const char *id)
+{
+	struct image image;
+	intmax_t row;
+	char *data = NULL;
+	unsigned char *out = NULL;
+	size_t datasz = 0, outsz = 0;
+	FILE *fp;
+	int rv;
+
+	if (db_image_stat(&image, &row, id, db) != 1)
+		return;
+
+	fp = eopen_memstream(&data, &datasz);
+	rv = db_image_read(row, 0, image.datasz, append, fp, db);
+	fclose(fp);
+
+	if (rv < 0)
+		log_warn(TAG "unable to read image '%s': %s", id, db->error);
+	else {
+		/* Unsupported images are recorded as is to be skipped later. */
+		if (optim_image(&out, &outsz, data, datasz) > 0)
+			log_debug(TAG "image '%s' recompressed from %zu to %zu bytes",
+			    id, datasz, outsz);
+		if (db_optim_save(id, datasz, out, outsz, db) < 0)
+			log_warn(TAG "unable to save image '%s': %s", id, db->error);
+		else if (out)
+			stats_optim(datasz, outsz);
+	}
+
+	free(out);
+	free(data);
+	image_finish(&image);
+}
+
+/*
+ * Lossless recompression of the images is done in the background as well
+ * when enabled, before thumbnails so that they are made from the new data
+ * which has the same pixels anyway.
+ */
+static void
+optimizations(void)
+{
+	struct db db;
+	char *ids[OPTIM_BATCH];
+	ssize_t idsz;
+
+	if (!optimize || tmpupd_open(&db, DB_RDWR) < 0)
+		return;
+
+	if ((idsz = db_optim_pending(ids, LEN(ids), &db)) < 0)
+		log_warn(TAG "unable to list images to recompress: %s", db.error);
+
+	for (ssize_t i = 0; i < idsz; ++i) {
+		optimization(&db, ids[i]);
+		free(ids[i]);
+	}
+
 	db_finish(&db);
 }
 
@@ -77,10 +254,12 @@ init_signals(void)
 	 *
 	 * SIGINT: stop the application
 	 * SIGALRM: periodic cleanup routine
+	 * SIGCHLD: worker termination
 	 */
 	sigemptyset(&sigs);
 	sigaddset(&sigs, SIGINT);
 	sigaddset(&sigs, SIGALRM);
+	sigaddset(&sigs, SIGCHLD);
 
 	pthread_sigmask(SIG_BLOCK, &sigs, NULL);
 
@@ -102,9 +281,11 @@ init_db(void)
 
 	/*
 	 * Initialize at least once to get table populated since some pages
-	 * would just open for read-only access.
+	 * would just open for read-only access. The search index of older
+	 * databases is built from paste_code().
 	 */
 	if (db_open(&db, dbpath, DB_RDWR) < 0 ||
+	    db_paste_register(&db) < 0 ||
 	    db_exec(&db, (const char *)sql_init) < 0)
 		die("abort: %s: %s\n", dbpath, db.error);
 
@@ -122,17 +303,32 @@ init_misc(void)
 {
 	srandom(time(NULL));
 
-	if (check_init() < 0) {
+	if (check_init() < 0)
 		log_warn(TAG "libmagic initialization error: %s", strerror(errno));
-		log_warn(TAG "image verification will be disabled");
-	} else
-		log_debug(TAG "image verification enabled");
+
+	log_debug(TAG "using %s base64 kernel", b64_kernel());
+}
+
+static inline void
+init_socket(void)
+{
+	/* Otherwise the socket is already provided as stdin. */
+	if (!address && socket_path)
+		http_fcgi_bind(socket_path, socket_mode);
+}
+
+static inline void
+init_stats(void)
+{
+	stats_init(workersz);
 }
 
 static inline void
 init_tmpupd(void)
 {
-	http_init();
+	/* Workers initialize HTTP themselves. */
+	if (!workersz)
+		http_init(address);
 }
 
 static void
@@ -142,6 +338,8 @@ init(enum log_level level)
 	init_db();
 	init_logs(level);
 	init_misc();
+	init_socket();
+	init_stats();
 	init_tmpupd();
 }
 
@@ -162,8 +360,11 @@ loop(void)
 			run = 0;
 			break;
 		case SIGALRM:
-			if (run)
+			if (run) {
 				prune();
+				optimizations();
+				thumbnails();
+			}
 			break;
 		default:
 			break;
@@ -171,11 +372,158 @@ loop(void)
 	}
 }
 
+static void
+report(enum log_level level)
+{
+	struct stats st;
+
+	stats_sum(&st);
+	log_write(level, TAG "%ju requests, %ju errors, %ju bytes received, %ju bytes sent",
+	    (uintmax_t)st.requests, (uintmax_t)st.errors,
+	    (uintmax_t)st.received, (uintmax_t)st.sent);
+
+	if (st.optimized)
+		log_write(level, TAG "%ju images recompressed from %ju to %ju bytes",
+		    (uintmax_t)st.optimized, (uintmax_t)st.original,
+		    (uintmax_t)st.shrunk);
+}
+
+static void
+work(size_t index)
+{
+	/* Don't generate the same identifiers in every worker. */
+	srandom(time(NULL) ^ getpid());
+
+	stats_select(index);
+	http_init(address);
+	loop();
+	http_finish();
+	log_finish();
+	check_finish();
+	exit(0);
+}
+
+static void
+spawn(size_t index)
+{
+	struct worker *w = &workers[index];
+	pid_t pid;
+
+	if ((pid = fork()) < 0) {
+		log_warn(TAG "fork: %s", strerror(errno));
+		return;
+	}
+	if (pid == 0)
+		work(index);
+
+	w->pid = pid;
+	w->started = time(NULL);
+	log_info(TAG "worker %zu started with pid %d", index, (int)pid);
+}
+
+static void
+respawn(size_t index)
+{
+	/*
+	 * A worker that dies right after being started will probably die
+	 * again, let the timer retry later instead of spinning.
+	 */
+	if (time(NULL) - workers[index].started < 1)
+		return;
+
+	workers[index].restarts++;
+	spawn(index);
+}
+
+static void
+reap(int run)
+{
+	pid_t pid;
+	int status;
+	size_t i;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		for (i = 0; i < workersz && workers[i].pid != pid; ++i)
+			continue;
+
+		if (i == workersz)
+			continue;
+
+		workers[i].pid = 0;
+
+		if (WIFSIGNALED(status))
+			log_warn(TAG "worker %zu killed by signal %d", i, WTERMSIG(status));
+		else if (WEXITSTATUS(status))
+			log_warn(TAG "worker %zu exited with code %d", i, WEXITSTATUS(status));
+
+		if (run)
+			respawn(i);
+	}
+}
+
+static void
+supervise(void)
+{
+	int n, run = 1;
+
+	workers = ecalloc(workersz, sizeof (*workers));
+
+	for (size_t i = 0; i < workersz; ++i)
+		spawn(i);
+
+	while (run) {
+		if (sigwait(&sigs, &n) < 0) {
+			log_warn(TAG "sigwait: %s", strerror(errno));
+			break;
+		}
+
+		switch (n) {
+		case SIGINT:
+			log_info(TAG "exiting on signal %d", n);
+			run = 0;
+			break;
+		case SIGALRM:
+			prune();
+			optimizations();
+			thumbnails();
+			report(LOG_LEVEL_DEBUG);
+
+			for (size_t i = 0; i < workersz; ++i)
+				if (!workers[i].pid)
+					respawn(i);
+			break;
+		case SIGCHLD:
+			reap(run);
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < workersz; ++i)
+		if (workers[i].pid)
+			kill(workers[i].pid, SIGINT);
+
+	for (size_t i = 0; i < workersz; ++i) {
+		if (workers[i].pid)
+			waitpid(workers[i].pid, NULL, 0);
+		if (workers[i].restarts)
+			log_info(TAG "worker %zu restarted %u times", i, workers[i].restarts);
+	}
+
+	free(workers);
+}
+
 static void
 finish(void)
 {
 	log_info("tmpupd: exiting...");
-	http_finish();
+	report(LOG_LEVEL_INFO);
+
+	if (!workersz)
+		http_finish();
+
+	stats_finish();
 	log_finish();
 	check_finish();
 }
@@ -185,8 +533,9 @@ tmpupd_open(struct db *db, enum db_mode mode)
 {
 	assert(db);
 
-	if (db_open(db, dbpath, mode) < 0) {
+	if (db_open(db, dbpath, mode) < 0 || db_paste_register(db) < 0) {
 		log_warn("tmpupd: %s: %s", dbpath, db->error);
+		db_finish(db);
 		return -1;
 	}
 
@@ -218,6 +567,21 @@ tmpupd_expiresin(time_t end)
 	return ret;
 }
 
+const char *
+tmpupd_size(size_t size)
+{
+	static _Thread_local char ret[32];
+
+	if (size < 1024)
+		sprintf(ret, "%zu bytes", size);
+	else if (size < 1024 * 1024)
+		sprintf(ret, "%.1f KiB", size / 1024.0);
+	else
+		sprintf(ret, "%.1f MiB", size / (1024.0 * 1024.0));
+
+	return ret;
+}
+
 const char *
 tmpupd_visibility(int val)
 {
@@ -244,11 +608,167 @@ tmpupd_condamn(time_t *start, time_t *end, const char *duration)
 }
 
 int
-tmpupd_isdef(const struct kpair *pair, const char *key)
+tmpupd_isdef(const struct req_field *pair, const char *key)
 {
 	return strcmp(pair->key, key) == 0 && strlen(pair->val) > 0;
 }
 
+int
+tmpupd_period(const struct req *r,
+              time_t *start,
+              time_t *end,
+              char *error,
+              size_t errorsz)
+{
+	assert(r);
+	assert(start);
+	assert(end);
+	assert(error);
+
+	const char *val, *errstr;
+
+	*start = time(NULL);
+
+	if ((val = req_field(r, "start"))) {
+		*start = bstrtonum(val, 0, LLONG_MAX, &errstr);
+
+		if (errstr) {
+			snprintf(error, errorsz, "start is %s", errstr);
+			return -1;
+		}
+	}
+
+	*end = *start + TMP_DURATION_DAY;
+
+	if ((val = req_field(r, "end"))) {
+		*end = bstrtonum(val, 0, LLONG_MAX, &errstr);
+
+		if (errstr) {
+			snprintf(error, errorsz, "end is %s", errstr);
+			return -1;
+		}
+	}
+
+	return check_duration(*start, *end, error, errorsz);
+}
+
+char *
+tmpupd_ids(const struct req *r, char *error, size_t errorsz)
+{
+	assert(r);
+	assert(error);
+
+	struct json_write jw;
+	FILE *fp;
+	char *ids = NULL;
+	size_t idsz = 0, count = 0;
+
+	fp = eopen_memstream(&ids, &idsz);
+	json_write_init(&jw, append, fp);
+	json_write_array(&jw);
+
+	for (size_t i = 0; i < r->fieldsz; ++i) {
+		if (strcmp(r->fields[i].key, "id") != 0)
+			continue;
+		if (++count > TMPUPD_IDS_MAX)
+			break;
+
+		json_write_str(&jw, r->fields[i].val);
+	}
+
+	json_write_close(&jw);
+	json_write_finish(&jw);
+	fclose(fp);
+
+	if (count == 0 || count > TMPUPD_IDS_MAX) {
+		if (count == 0)
+			snprintf(error, errorsz, "missing id");
+		else
+			snprintf(error, errorsz, "too many ids (max %d)", TMPUPD_IDS_MAX);
+
+		free(ids);
+		ids = NULL;
+	}
+
+	return ids;
+}
+
+int
+tmpupd_page(const struct req *r,
+            struct tmpupd_page *page,
+            char *error,
+            size_t errorsz)
+{
+	assert(r);
+	assert(page);
+	assert(error);
+
+	const char *val, *errstr, *id;
+	char start[32];
+
+	memset(page, 0, sizeof (*page));
+	page->limit = TMPUPD_PAGE;
+
+	if ((val = req_field(r, "limit"))) {
+		page->limit = bstrtonum(val, 1, TMPUPD_PAGE_MAX, &errstr);
+
+		if (errstr) {
+			snprintf(error, errorsz, "limit is %s", errstr);
+			return -1;
+		}
+	}
+
+	/* The cursor is <start>-<id>. */
+	if (!(val = req_field(r, "after")))
+		return 0;
+
+	if (!(id = strchr(val, '-')) || (size_t)(id - val) >= sizeof (start) ||
+	    !*++id || strlen(id) >= sizeof (page->id) ||
+	    strspn(id, "abcdefghijklmnopqrstuvwxyz0123456789") != strlen(id)) {
+		snprintf(error, errorsz, "invalid cursor");
+		return -1;
+	}
+
+	bstrlcpy(start, val, id - val);
+	page->start = bstrtonum(start, 0, LLONG_MAX, &errstr);
+
+	if (errstr) {
+		snprintf(error, errorsz, "invalid cursor");
+		return -1;
+	}
+
+	bstrlcpy(page->id, id, sizeof (page->id));
+
+	return 0;
+}
+
+const char *
+tmpupd_cursor(time_t start, const char *id)
+{
+	assert(id);
+
+	static _Thread_local char ret[64];
+
+	snprintf(ret, sizeof (ret), "%lld-%s", (long long)start, id);
+
+	return ret;
+}
+
+static mode_t
+getmode(const char *str)
+{
+	char *end;
+	long mode;
+
+	errno = 0;
+	mode = strtol(str, &end, 8);
+
+	if (errno || end == str || *end || mode < 0 || mode > 0777)
+		die("abort: invalid socket mode %s\n", str);
+
+	return mode;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -257,11 +777,26 @@ main(int argc, char **argv)
 
 	opterr = 0;
 
-	while ((ch = egetopt(argc, argv, "d:v")) != -1) {
+	while ((ch = egetopt(argc, argv, "d:j:l:m:Os:v")) != -1) {
 		switch (ch) {
 		case 'd':
 			dbpath = optarg;
 			break;
+		case 'j':
+			workersz = estrtonum(optarg, 1, 256);
+			break;
+		case 'l':
+			address = optarg;
+			break;
+		case 'm':
+			socket_mode = getmode(optarg);
+			break;
+		case 'O':
+			optimize = 1;
+			break;
+		case 's':
+			socket_path = optarg;
+			break;
 		case 'v':
 			level++;
 			break;
@@ -271,6 +806,11 @@ main(int argc, char **argv)
 	}
 
 	init(level);
-	loop();
+
+	if (workersz)
+		supervise();
+	else
+		loop();
+
 	finish();
 }
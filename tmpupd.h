@@ -19,11 +19,56 @@
 #ifndef TMPUPD_H
 #define TMPUPD_H
 
+#include <stddef.h>
 #include <time.h>
 
+/**
+ * \def TMPUPD_IDS_MAX
+ * Maximum number of identifiers in one read API request.
+ */
+#define TMPUPD_IDS_MAX 1000
+
+/**
+ * \def TMPUPD_PAGE
+ * Default number of items in a listing page.
+ */
+#define TMPUPD_PAGE 20
+
+/**
+ * \def TMPUPD_PAGE_MAX
+ * Maximum number of items in a listing page.
+ */
+#define TMPUPD_PAGE_MAX 100
+
 enum db_mode;
 struct db;
-struct kpair;
+struct req;
+struct req_field;
+
+/**
+ * \struct tmpupd_page
+ * \brief Listing page requested.
+ *
+ * Listings are ordered from the newest item and a page starts right after
+ * the last item of the previous one, named by its creation date and
+ * identifier.
+ */
+struct tmpupd_page {
+	/**
+	 * Number of items to show.
+	 */
+	size_t limit;
+
+	/**
+	 * Creation date of the last item shown.
+	 */
+	time_t start;
+
+	/**
+	 * Identifier of the last item shown, empty for the first page.
+	 */
+	char id[32];
+};
 
 /**
  * Convenient function to open and initialize the database depending on the
@@ -47,6 +92,15 @@ tmpupd_open(struct db *db, enum db_mode mode);
 const char *
 tmpupd_expiresin(time_t end);
 
+/**
+ * Returns a static string with a human format telling a size in bytes.
+ *
+ * \param size the size in bytes
+ * \return a static thread local string with the size
+ */
+const char *
+tmpupd_size(size_t size);
+
 /**
  * Returns either "visible" or "hidden" depending if val is zero or non-zero
  * respectively.
@@ -84,6 +138,75 @@ tmpupd_condamn(time_t *start, time_t *end, const char *duration);
  * \return non-zero if value is usable
  */
 int
-tmpupd_isdef(const struct kpair *pair, const char *key);
+tmpupd_isdef(const struct req_field *pair, const char *key);
+
+/**
+ * Get the start and end dates from the optional `start` and `end` request
+ * fields as UTC timestamps.
+ *
+ * The start date defaults to the current system time and the end date to
+ * one day after start.
+ *
+ * \pre r != NULL
+ * \pre start != NULL
+ * \pre end != NULL
+ * \pre error != NULL
+ * \param r the request
+ * \param start UTC start timestamp to set
+ * \param end UTC end timestamp to set
+ * \param error error string to fill
+ * \param errorsz maximum error string
+ * \return 0 on success or -1 if invalid
+ */
+int
+tmpupd_period(const struct req *r,
+              time_t *start,
+              time_t *end,
+              char *error,
+              size_t errorsz);
+
+/**
+ * Collect the repeated `id` request fields as a JSON array of strings, in
+ * the form expected by the database list functions.
+ *
+ * \pre r != NULL
+ * \pre error != NULL
+ * \param r the request
+ * \param error error string to fill
+ * \param errorsz maximum error string
+ * \return the dynamically allocated array or NULL if invalid
+ */
+char *
+tmpupd_ids(const struct req *r, char *error, size_t errorsz);
+
+/**
+ * Get the listing page from the optional `limit` and `after` request
+ * fields, the latter being a cursor returned by ::tmpupd_cursor.
+ *
+ * \pre r != NULL
+ * \pre page != NULL
+ * \pre error != NULL
+ * \param r the request
+ * \param page the page to fill
+ * \param error error string to fill
+ * \param errorsz maximum error string
+ * \return 0 on success or -1 if invalid
+ */
+int
+tmpupd_page(const struct req *r,
+            struct tmpupd_page *page,
+            char *error,
+            size_t errorsz);
+
+/**
+ * Returns the cursor naming an item to get the listing page after it.
+ *
+ * \pre id != NULL
+ * \param start the item creation date
+ * \param id the item identifier
+ * \return a static thread local string with the cursor
+ */
+const char *
+tmpupd_cursor(time_t start, const char *id);
 
 #endif /* !TMPUPD_H */
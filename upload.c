@@ -0,0 +1,70 @@
+/*
+ * upload.c -- resumable upload session
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmp.h"
+#include "upload.h"
+#include "util.h"
+
+void
+upload_init(struct upload *upload,
+            const char *type,
+            const char *title,
+            const char *author,
+            const char *filename,
+            const char *language,
+            size_t size,
+            time_t start,
+            time_t end,
+            int visible)
+{
+	assert(upload);
+	assert(type);
+	assert(end > start);
+
+	memset(upload, 0, sizeof (*upload));
+
+	upload->id = tmp_id();
+	upload->type = estrdup(type);
+	upload->title = estrdup(title ? title : TMP_DEFAULT_TITLE);
+	upload->author = estrdup(author ? author : TMP_DEFAULT_AUTHOR);
+	upload->filename = estrdup(filename ? filename : TMP_DEFAULT_FILENAME);
+	upload->language = estrdup(language ? language : TMP_DEFAULT_LANG);
+	upload->size = size;
+	upload->start = start;
+	upload->end = end;
+	upload->expires = time(NULL) + TMP_DURATION_DAY;
+	upload->visible = visible;
+}
+
+void
+upload_finish(struct upload *upload)
+{
+	assert(upload);
+
+	free(upload->id);
+	free(upload->type);
+	free(upload->title);
+	free(upload->author);
+	free(upload->filename);
+	free(upload->language);
+	memset(upload, 0, sizeof (*upload));
+}
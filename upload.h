@@ -0,0 +1,172 @@
+/*
+ * upload.h -- resumable upload session
+ *
+ * Copyright (c) 2023-2024 David Demelier <markand@malikania.fr>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TMPUPD_UPLOAD_H
+#define TMPUPD_UPLOAD_H
+
+/**
+ * \file upload.h
+ * \brief Resumable upload session.
+ *
+ * A session stages the content of a future paste or image whose length is
+ * announced at creation. The content is received in pieces at increasing
+ * offsets and the session is converted into the final item once complete.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * \struct upload
+ * \brief Upload session.
+ */
+struct upload {
+	/**
+	 * (read-write)
+	 *
+	 * Unique identifier.
+	 */
+	char *id;
+
+	/**
+	 * (read-write)
+	 *
+	 * Final item type, either `paste` or `image`.
+	 */
+	char *type;
+
+	/**
+	 * (read-write)
+	 *
+	 * Item title.
+	 */
+	char *title;
+
+	/**
+	 * (read-write)
+	 *
+	 * Item author.
+	 */
+	char *author;
+
+	/**
+	 * (read-write)
+	 *
+	 * Item filename.
+	 */
+	char *filename;
+
+	/**
+	 * (read-write)
+	 *
+	 * Code language, only used for pastes.
+	 */
+	char *language;
+
+	/**
+	 * (read-write)
+	 *
+	 * Announced content length.
+	 */
+	size_t size;
+
+	/**
+	 * (read-write)
+	 *
+	 * Number of bytes received so far, the next piece must start there.
+	 */
+	size_t received;
+
+	/**
+	 * (read-write)
+	 *
+	 * Item creation date.
+	 */
+	time_t start;
+
+	/**
+	 * (read-write)
+	 *
+	 * Item expiration date.
+	 */
+	time_t end;
+
+	/**
+	 * (read-write)
+	 *
+	 * Date after which the unfinished session is discarded.
+	 */
+	time_t expires;
+
+	/**
+	 * (read-write)
+	 *
+	 * If non-zero lists the item in the index.
+	 */
+	int visible;
+
+	/**
+	 * (read-only)
+	 *
+	 * Storage row of the staged content.
+	 */
+	intmax_t row;
+};
+
+/**
+ * Initialize a new session copying parameters into local fields.
+ *
+ * Previous fields are ignored.
+ *
+ * \pre upload != NULL
+ * \pre type != NULL
+ * \pre end > start
+ * \param upload session to initialize
+ * \param type the final item type
+ * \param title optional title
+ * \param author optional author
+ * \param filename optional filename
+ * \param language optional language code
+ * \param size the announced content length
+ * \param start item creation date
+ * \param end item expiration date
+ * \param visible non-zero to make the item public
+ */
+void
+upload_init(struct upload *upload,
+            const char *type,
+            const char *title,
+            const char *author,
+            const char *filename,
+            const char *language,
+            size_t size,
+            time_t start,
+            time_t end,
+            int visible);
+
+/**
+ * Cleanup session fields.
+ *
+ * \pre upload != NULL
+ * \param upload the session to clear
+ */
+void
+upload_finish(struct upload *upload);
+
+#endif /* !TMPUPD_UPLOAD_H */